@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+
+# Compare the benchmark reports produced by scripts/run-benchmarks.sh against a baseline
+#
+# Usage: scripts/bench-compare.py [--threshold PCT] [--min-ms MS] baseline current
+#
+# baseline and current can be either two report files, or two directories
+# (e.g. tests/bench/<label>), in which case reports with the same name are compared.
+# A baseline report without a matching current report (e.g. because the run crashed
+# before writing it) counts as a regression.
+# A regression is flagged when, by more than the threshold (default: 5%):
+# * the performance (MIPPS) is lower;
+# * the setup time or the memory per particle is higher;
+# * the average runtime of a command is higher (only for commands whose total
+#   runtime in the baseline is at least MS milliseconds, default: 10).
+# The exit status is 1 if any regression was found.
+
+import sys, os, json, argparse
+
+parser = argparse.ArgumentParser(description="Compare GPUSPH benchmark reports")
+parser.add_argument("--threshold", type=float, default=5.0,
+        help="relative change (in percent) above which a difference is flagged")
+parser.add_argument("--min-ms", type=float, default=10.0,
+        help="ignore commands whose total runtime in the baseline is less than this")
+parser.add_argument("baseline")
+parser.add_argument("current")
+args = parser.parse_args()
+
+def load(fname):
+    with open(fname) as f:
+        return json.load(f)
+
+def pairs(base, cur):
+    if os.path.isdir(base) != os.path.isdir(cur):
+        sys.exit("cannot compare a file with a directory")
+    if not os.path.isdir(base):
+        return [ (os.path.basename(cur), base, cur) ]
+    ret = []
+    for name in sorted(os.listdir(base)):
+        if not name.endswith(".json"):
+            continue
+        cfile = os.path.join(cur, name)
+        ret.append( (name, os.path.join(base, name), cfile if os.path.exists(cfile) else None) )
+    for name in sorted(os.listdir(cur)):
+        if name.endswith(".json") and not os.path.exists(os.path.join(base, name)):
+            print("{}: no baseline, skipping".format(name))
+    return ret
+
+# relative change in percent, positive if cur is larger than base
+def change(base, cur):
+    if base == 0:
+        return 0.0 if cur == 0 else float("inf")
+    return 100.0*(cur - base)/base
+
+regressions = 0
+
+def check(name, what, base, cur, higher_is_better):
+    global regressions
+    delta = change(base, cur)
+    worse = -delta if higher_is_better else delta
+    if worse > args.threshold:
+        tag = "REGRESSION"
+        regressions += 1
+    elif -worse > args.threshold:
+        tag = "improvement"
+    else:
+        return
+    print("{}: {} {} {:.6g} -> {:.6g} ({:+.1f}%)".format(name, tag, what, base, cur, delta))
+
+for name, bfile, cfile in pairs(args.baseline, args.current):
+    if cfile is None:
+        print("{}: REGRESSION no current report".format(name))
+        regressions += 1
+        continue
+
+    b = load(bfile)
+    c = load(cfile)
+
+    if c["status"] != "ok":
+        print("{}: REGRESSION run status {}".format(name, c["status"]))
+        regressions += 1
+        continue
+    if b["particles"] != c["particles"] or b["iterations"] != c["iterations"]:
+        print("{}: warning, comparing {} particles x {} iterations against {} x {}".format(name,
+            c["particles"], c["iterations"], b["particles"], b["iterations"]))
+
+    check(name, "MIPPS", b["mipps"], c["mipps"], True)
+    check(name, "setup time (s)", b["setup_s"], c["setup_s"], False)
+    check(name, "memory per particle (B)",
+            max(b["memory_per_particle"]), max(c["memory_per_particle"]), False)
+
+    for cmd, bt in sorted(b["commands"].items()):
+        ct = c["commands"].get(cmd)
+        if ct is None or bt["tot_ms"] < args.min_ms:
+            continue
+        check(name, cmd + " avg (ms)",
+                bt["tot_ms"]/bt["calls"], ct["tot_ms"]/ct["calls"], False)
+
+if regressions:
+    print("{} regressions found".format(regressions))
+    sys.exit(1)
+print("No regressions found")
@@ -0,0 +1,54 @@
+#!/bin/sh
+
+# Compare the cell linearizations on the benchmark cases
+# Syntax: bench-linearization.sh [maxiter [GPUSPH options]]
+# default maxiter is 1000
+# For each linearization in LINEARIZATIONS (default: "yzx morton"), GPUSPH is rebuilt
+# with that linearization and the benchmark cases (scripts/bench-cases.txt, or the
+# file pointed to by BENCH_CASES) are run with scripts/run-benchmarks.sh,
+# writing the reports to tests/bench/linearization-<linearization>.
+# Every other linearization is then compared against the first one with
+# scripts/bench-compare.py, which reports among other things the change in
+# the average runtime of the neighbor list construction (BUILDNEIBS) and of
+# the force computation (FORCES).
+# The linearization in use before running the script is restored at the end.
+
+abort() {
+	echo "$@" >&2
+	exit 1
+}
+
+linearizations="${LINEARIZATIONS:-yzx morton}"
+maxiter=1000
+
+if [ 0 -lt "$#" ] ; then
+	[ -z "$1" ] || maxiter="$1"
+	shift
+fi
+
+previous="$(make -s show 2>/dev/null | sed -n 's/^Linearization: *//p')"
+
+for lin in $linearizations ; do
+	echo "Building with linearization=${lin} ..."
+	make linearization=$lin || abort "Failed to build with linearization=${lin}"
+	sh scripts/run-benchmarks.sh "linearization-${lin}" $maxiter "$@" \
+		|| abort "Failed to benchmark linearization=${lin}"
+done
+
+if [ -n "$previous" ] ; then
+	make linearization=$previous || echo "Failed to restore linearization=${previous}" >&2
+fi
+
+set -- $linearizations
+base="$1"
+shift
+status=0
+for lin in "$@" ; do
+	echo "Comparing ${lin} against ${base}:"
+	python3 scripts/bench-compare.py --threshold 0 \
+		"tests/bench/linearization-${base}" "tests/bench/linearization-${lin}" \
+		|| status=1
+done
+
+# a non-zero status only means that some command got slower
+exit $status
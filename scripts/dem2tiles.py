@@ -0,0 +1,122 @@
+#!/usr/bin/env python
+
+"""
+This script converts a Digital Elevation Model in ASCII GRID or (ASCII) VTK Structured Points
+format into the tiled binary format that GPUSPH loads with DEM_FMT_TILED.
+
+Only the tiles intersecting the requested window are read when loading a tiled DEM, so
+this is the preferred format to simulate small regions of large (e.g. regional bathymetry)
+DEMs. The input is streamed, so that only one row of tiles is held in memory at a time.
+
+Usage: dem2tiles.py input.{txt,asc,vtk} [output.tiles [tile_size]]
+
+The format is described in TopoCube.cc (TiledDemHeader).
+"""
+
+import sys
+import os
+from struct import pack, calcsize
+from array import array
+
+# magic, ncols, nrows, tile, reserved, west, south, sizex, sizey
+header_enc = '<8siiiidddd'
+
+def usage():
+    print("%s input [output [tile_size]] -- convert an ASCII GRID or VTK DEM into a tiled DEM" %
+        os.path.basename(sys.argv[0]))
+
+def tokens(f):
+    for line in f:
+        for tok in line.split():
+            yield tok
+
+def read_grid_header(f):
+    """Parse an ASCII GRID header, return ncols, nrows, west, south, sizex, sizey
+    and the iterator over the values, which are stored north to south"""
+    toks = tokens(f)
+    md = {}
+    for i in range(6):
+        key = next(toks).rstrip(':')
+        md[key] = float(next(toks))
+    ncols, nrows = int(md['cols']), int(md['rows'])
+    return (ncols, nrows, md['west'], md['south'],
+        md['east'] - md['west'], md['north'] - md['south'], toks, False)
+
+def read_vtk_header(f):
+    """Parse a VTK Structured Points header, return ncols, nrows, west, south, sizex, sizey
+    and the iterator over the values, which are stored south to north"""
+    if not f.readline().startswith('# vtk DataFile Version'):
+        raise ValueError("not a VTK data file")
+    f.readline() # title
+    if f.readline().strip() != 'ASCII':
+        raise ValueError("only ASCII VTK files are supported")
+    toks = tokens(f)
+    while True:
+        tok = next(toks)
+        if tok == 'DIMENSIONS':
+            ncols, nrows = int(next(toks)), int(next(toks))
+            next(toks)
+        elif tok == 'ORIGIN':
+            west, south = float(next(toks)), float(next(toks))
+            next(toks)
+        elif tok == 'SPACING':
+            ewres, nsres = float(next(toks)), float(next(toks))
+            next(toks)
+        elif tok == 'SCALARS':
+            # name, type and optional number of components
+            next(toks) ; next(toks)
+        elif tok == 'LOOKUP_TABLE':
+            next(toks)
+            break
+    # sizes are computed as in the VTK loader of TopoCube
+    return (ncols, nrows, west, south, ewres*ncols, nsres*nrows, toks, True)
+
+if len(sys.argv) < 2:
+    usage()
+    sys.exit(0)
+
+in_fname = sys.argv[1]
+out_fname = sys.argv[2] if len(sys.argv) > 2 else os.path.splitext(in_fname)[0] + '.tiles'
+tile = int(sys.argv[3]) if len(sys.argv) > 3 else 256
+
+with open(in_fname, 'r') as f:
+    if in_fname.endswith('.vtk'):
+        ncols, nrows, west, south, sizex, sizey, values, south_first = read_vtk_header(f)
+    else:
+        ncols, nrows, west, south, sizex, sizey, values, south_first = read_grid_header(f)
+
+    tiles_x = (ncols + tile - 1)//tile
+    tiles_y = (nrows + tile - 1)//tile
+    tile_bytes = tile*tile*calcsize('<f')
+    header = pack(header_enc, b'GPUSPHT', ncols, nrows, tile, 0, west, south, sizex, sizey)
+
+    print("%s: %dx%d samples, %dx%d tiles of %d samples per side" %
+        (in_fname, ncols, nrows, tiles_x, tiles_y, tile))
+
+    with open(out_fname, 'wb') as out:
+        out.write(header)
+        out.truncate(len(header) + tiles_x*tiles_y*tile_bytes)
+
+        # rows of the current tile row, indexed by row within the tile
+        band = [None]*tile
+        rows = range(nrows) if south_first else range(nrows - 1, -1, -1)
+        for row in rows:
+            band[row % tile] = array('f', (float(next(values)) for col in range(ncols)))
+            # the tile row is complete when we reach its last row in file order
+            last = (row % tile == tile - 1 or row == nrows - 1) if south_first else (row % tile == 0)
+            if not last:
+                continue
+            trow = row//tile
+            # pad the rows to whole tiles, and the tile row to whole rows
+            padding = array('f', [0.0])*(tiles_x*tile - ncols)
+            lines = [band[r] + padding if band[r] is not None else array('f', [0.0])*(tiles_x*tile)
+                for r in range(tile)]
+            data = array('f')
+            for tcol in range(tiles_x):
+                for line in lines:
+                    data.extend(line[tcol*tile:(tcol + 1)*tile])
+            if sys.byteorder != 'little':
+                data.byteswap()
+            out.seek(len(header) + trow*tiles_x*tile_bytes)
+            data.tofile(out)
+            band = [None]*tile
@@ -0,0 +1,64 @@
+#!/bin/sh
+
+# Run the benchmark cases for a fixed number of iterations, without intermediate writes,
+# collecting a JSON report for each case
+# Syntax: run-benchmarks.sh [label [maxiter [GPUSPH options]]]
+# default label is the current git revision (or 'bench' outside of a git checkout)
+# default maxiter is 1000
+# if they are present as arguments but empty, they will be kept at the default values
+# The cases are read from scripts/bench-cases.txt, unless the environment variable BENCH_CASES
+# points to a different file. Only the cases with a device list that includes at most
+# BENCH_MAX_DEVICES devices (default: all) are run.
+# Per-command runtimes are only collected if BENCH_COMMAND_TIMES is set to a non-empty value,
+# since timing each command synchronizes the devices and thus lowers the MIPPS; the MIPPS
+# of such runs should not be compared with the ones of runs without them.
+# Reports are written to tests/bench/<label>/<problem>_dp<deltap>_dev<devices>.json,
+# and can be compared with scripts/bench-compare.py
+
+abort() {
+	echo "$@" >&2
+	exit 1
+}
+
+label="$(git describe --always --dirty 2>/dev/null || echo bench)"
+maxiter=1000
+cases="${BENCH_CASES:-scripts/bench-cases.txt}"
+
+if [ 0 -lt "$#" ] ; then
+	[ -z "$1" ] || label="$1"
+	shift
+	if [ 0 -lt "$#" ] ; then
+		[ -z "$1" ] || maxiter="$1"
+		shift
+	fi
+fi
+
+[ -f "$cases" ] || abort "Benchmark cases file $cases not found"
+
+outdir="tests/bench/${label}"
+mkdir -p "$outdir" || abort "Could not create $outdir"
+
+# count the devices in a comma-separated list
+count_devices() {
+	local IFS=,
+	set -- $1
+	echo $#
+}
+
+grep -v '^\s*#' "$cases" | while read problem deltap devices extra ; do
+	[ -z "$problem" ] && continue
+	if [ -n "$BENCH_MAX_DEVICES" ] && [ "$(count_devices "$devices")" -gt "$BENCH_MAX_DEVICES" ] ; then
+		echo "Skipping ${problem} (deltap ${deltap}) on devices ${devices}"
+		continue
+	fi
+	name="${problem}_dp${deltap}_dev$(echo "$devices" | tr , .)"
+	echo "Benchmarking ${name} ..."
+	make $problem || abort "Failed to build $problem"
+	./$problem --dir "${outdir}/${name}" --maxiter $maxiter --nosave \
+		--deltap $deltap --device $devices \
+		${BENCH_COMMAND_TIMES:+--debug benchmark_command_runtimes} \
+		--bench-report "${outdir}/${name}.json" $extra "$@" \
+		|| echo "Failed! (${name})" >&2
+done
+
+echo "Reports written to ${outdir}"
@@ -52,8 +52,24 @@
 // div_up
 #include "utils.h"
 
+// std::function
+#include <functional>
+// std::partial_sum
+#include <numeric>
+// std::atomic
+#include <atomic>
+// ofstream for the bench report
+#include <fstream>
+
 // HotFile
 #include "HotFile.h"
+// HotWriter::RestoreLocal
+#include "HotWriter.h"
+
+// parallel_for_chunks
+#include "parallel_for.h"
+// host_alloc policy, host_pin
+#include "hostalloc.h"
 
 using namespace std;
 
@@ -88,8 +104,15 @@ GPUSPH::GPUSPH() :
 	m_peakParticleSpeed(0.0),
 	m_peakParticleSpeedTime(0.0),
 
+	m_hostThreads(1),
+	m_particleStorageCapped(false),
+
 	initialized(false),
-	repacked(false)
+	repacked(false),
+	m_setupTime(),
+	m_metrics(),
+	m_writeTime(),
+	m_barrierTime()
 {
 	openInfoStream();
 	resetCommandTimes();
@@ -130,6 +153,133 @@ void GPUSPH::showCommandTimes()
 	}
 }
 
+/*! The report is a JSON object meant to be consumed by scripts/bench-compare.py,
+ * so new entries can be added freely, but existing ones should not change meaning.
+ * In multi-node simulations, only rank 0 writes the report, with the global performance.
+ */
+void GPUSPH::writeBenchReport(bool all_ok)
+{
+	if (MULTI_NODE && gdata->mpi_rank != 0)
+		return;
+
+	ofstream out(clOptions->bench_report);
+	if (!out) {
+		cerr << "WARNING: unable to open bench report " << clOptions->bench_report << endl;
+		return;
+	}
+	out.precision(9);
+
+	using s = chrono::duration<double>;
+	using ms = chrono::duration<double, milli>;
+
+	const double mipps = MULTI_NODE ?
+		m_multiNodePerformanceCounter->getMIPPS() :
+		m_totalPerformanceCounter->getMIPPS();
+
+	out << "{\n";
+	out << "\t\"version\": 1,\n";
+	out << "\t\"problem\": \"" << problem->m_name << "\",\n";
+	out << "\t\"status\": \"" << (all_ok ? "ok" : "failed") << "\",\n";
+	out << "\t\"deltap\": " << problem->m_deltap << ",\n";
+	out << "\t\"particles\": " << gdata->totParticles << ",\n";
+	out << "\t\"devices\": " << gdata->totDevices << ",\n";
+	out << "\t\"nodes\": " << (MULTI_NODE ? gdata->mpi_nodes : 1) << ",\n";
+	out << "\t\"options\": {";
+	out << " \"striping\": " << boolalpha << clOptions->striping;
+	out << ", \"gpudirect\": " << clOptions->gpudirect;
+	out << ", \"async_commands\": " << clOptions->async_commands;
+	out << ", \"batch_commands\": " << clOptions->batch_commands;
+	out << ", \"async_bodies\": " << clOptions->async_bodies << noboolalpha;
+	out << " },\n";
+	out << "\t\"iterations\": " << gdata->iterations << ",\n";
+	out << "\t\"setup_s\": " << s(m_setupTime).count() << ",\n";
+	out << "\t\"run_s\": " << m_totalPerformanceCounter->getElapsedSeconds() << ",\n";
+	out << "\t\"mipps\": " << mipps << ",\n";
+
+	out << "\t\"memory_per_particle\": [";
+	for (uint d = 0; d < gdata->devices; ++d)
+		out << (d ? ", " : " ") << gdata->memPerParticle[d];
+	out << " ],\n";
+
+	// only filled in if the command runtimes are being benchmarked
+	out << "\t\"commands\": {";
+	bool first = true;
+	for (CommandName cmd = IDLE; cmd < NUM_COMMANDS; cmd = CommandName(cmd+1))
+	{
+		if (!cmd_calls[cmd])
+			continue;
+		out << (first ? "\n" : ",\n");
+		out << "\t\t\"" << command_name[cmd] << "\": {"
+			<< " \"calls\": " << cmd_calls[cmd]
+			<< ", \"max_ms\": " << ms(max_cmd_time[cmd]).count()
+			<< ", \"tot_ms\": " << ms(tot_cmd_time[cmd]).count()
+			<< " }";
+		first = false;
+	}
+	out << (first ? "}\n" : "\n\t}\n");
+	out << "}\n";
+
+	cout << "Bench report written to " << clOptions->bench_report << endl;
+}
+
+void GPUSPH::startMetrics()
+{
+	if (clOptions->metrics_file.empty() && clOptions->metrics_socket.empty())
+		return;
+
+	const double interval = isfinite(clOptions->metrics_interval) && clOptions->metrics_interval > 0 ?
+		clOptions->metrics_interval : 10.0;
+
+	// in multi-node simulations, each process exports its own metrics,
+	// so the file and socket names are made unique by the rank
+	string fname = clOptions->metrics_file;
+	string socket_path = clOptions->metrics_socket;
+	if (MULTI_NODE) {
+		const string sfx = "." + to_string(gdata->mpi_rank);
+		if (!fname.empty()) fname += sfx;
+		if (!socket_path.empty()) socket_path += sfx;
+	}
+
+	const string labels = "problem=\"" + problem->m_name + "\",rank=\"" +
+		to_string(MULTI_NODE ? gdata->mpi_rank : 0) + "\"";
+
+	m_metrics.reset(new MetricsExporter(fname, socket_path, interval, labels,
+		gdata->devices, problem->simparams()->neiblistsize));
+	publishMetrics();
+	m_metrics->start();
+
+	if (!fname.empty())
+		printf("Writing live metrics to %s every %gs\n", fname.c_str(), interval);
+}
+
+/*! This is called by the main thread between commands, when the workers
+ * are waiting at the barrier, so it can read their state safely.
+ * The exporter thread is never waited for.
+ */
+void GPUSPH::publishMetrics()
+{
+	using s = chrono::duration<double>;
+	MetricsExporter::Values& v = m_metrics->values();
+
+	MetricsExporter::set(v.iteration, gdata->iterations);
+	MetricsExporter::set(v.t, gdata->t);
+	MetricsExporter::set(v.dt, gdata->dt);
+	MetricsExporter::set(v.interval_mipps, m_intervalPerformanceCounter->getMIPPS());
+	MetricsExporter::set(v.mipps, m_totalPerformanceCounter->getMIPPS());
+	MetricsExporter::set(v.max_fluid_boundary_neibs, gdata->lastGlobalPeakFluidBoundaryNeibsNum);
+	MetricsExporter::set(v.max_vertex_neibs, gdata->lastGlobalPeakVertexNeibsNum);
+	MetricsExporter::set(v.write_seconds, s(m_writeTime).count());
+	MetricsExporter::set(v.barrier_seconds, s(m_barrierTime).count());
+	if (MULTI_NODE)
+		MetricsExporter::set(v.mpi_seconds, gdata->networkManager->getReductionSeconds());
+
+	for (uint d = 0; d < gdata->devices; ++d) {
+		MetricsExporter::set(v.particles[d], gdata->s_hPartsPerDevice[d]);
+		MetricsExporter::set(v.host_memory[d], gdata->GPUWORKERS[d]->getHostMemory());
+		MetricsExporter::set(v.device_memory[d], gdata->GPUWORKERS[d]->getDeviceMemory());
+	}
+}
+
 void GPUSPH::openInfoStream() {
 	stringstream ss;
 	ss << "GPUSPH-" << getpid();
@@ -165,6 +315,8 @@ bool GPUSPH::initialize(GlobalData *_gdata) {
 
 	printf("Initializing...\n");
 
+	const cmd_time_clock::time_point setup_start = cmd_time_clock::now();
+
 	gdata = _gdata;
 	clOptions = gdata->clOptions;
 	problem = gdata->problem;
@@ -180,6 +332,17 @@ bool GPUSPH::initialize(GlobalData *_gdata) {
 	// sets the correct viscosity coefficient according to the one set in SimParams
 	setViscosityCoefficient();
 
+	m_hostThreads = configured_host_threads(clOptions->host_threads);
+	printf("Using %u host threads for host-side processing\n", m_hostThreads);
+
+	// host buffers are first-touched by the host threads, so that on NUMA
+	// systems they get spread across the nodes instead of all landing
+	// on the one the main thread runs on
+	HostAllocPolicy host_policy;
+	host_policy.hugepages = !clOptions->no_hugepages;
+	host_policy.first_touch_threads = m_hostThreads;
+	set_host_alloc_policy(host_policy);
+
 	m_totalPerformanceCounter = new IPPSCounter();
 	m_intervalPerformanceCounter = new IPPSCounter();
 	// only init if MULTI_NODE
@@ -224,7 +387,11 @@ bool GPUSPH::initialize(GlobalData *_gdata) {
 	printf(" - World size:   %g x %g x %g\n", gdata->worldSize.x, gdata->worldSize.y, gdata->worldSize.z);
 	printf(" - Cell size:    %g x %g x %g\n", gdata->cellSize.x, gdata->cellSize.y, gdata->cellSize.z);
 	printf(" - Grid size:    %u x %u x %u (%s cells)\n", gdata->gridSize.x, gdata->gridSize.y, gdata->gridSize.z, gdata->addSeparators(gdata->nGridCells).c_str());
+#if MORTON_LINEARIZATION
+	printf(" - Cell linearization: Morton order in %u^3 tiles\n", MORTON_TILE_SIDE);
+#else
 	printf(" - Cell linearization: %s,%s,%s\n", STR(COORD1), STR(COORD2), STR(COORD3));
+#endif
 	printf(" - Dp:   %g\n", gdata->problem->m_deltap);
 	printf(" - R0:   %g\n", gdata->problem->physparams()->r0);
 
@@ -241,15 +408,35 @@ bool GPUSPH::initialize(GlobalData *_gdata) {
 		gdata->dtadapt = false;
 	}
 
+	// capacity planning stops before generating the particles
+	if (clOptions->dry_run)
+		return planCapacity();
+
 	printf("Generating problem particles...\n");
 
-	ifstream *hot_in = NULL;
+	vector< unique_ptr<istream> > hot_in;
 	HotFile **hf = NULL;
 	uint hot_nrank = 1;
 
-	if (clOptions->resume_fname.empty()) {
+	if (clOptions->resume_fname.empty() && !clOptions->resume_local) {
 		// get number of particles from problem file
 		gdata->totParticles = problem->fill_parts();
+	} else if (clOptions->resume_local) {
+		gdata->totParticles = problem->fill_parts(false);
+		// collect the local checkpoints of all processes, setting resume_fname
+		// to the one of this process, so that the rest of the setup knows we are resuming
+		vector<string> checkpoints = HotWriter::RestoreLocal(gdata, clOptions->resume_fname);
+		hot_nrank = checkpoints.size();
+		hf = new HotFile*[hot_nrank];
+		gdata->totParticles = 0;
+		for (uint i = 0; i < hot_nrank; i++) {
+			istringstream *in = new istringstream(checkpoints[i]);
+			string().swap(checkpoints[i]);
+			in->exceptions(istream::failbit | istream::badbit);
+			hot_in.emplace_back(in);
+			hf[i] = new HotFile(*in, gdata);
+			hf[i]->readHeader(gdata->totParticles, gdata->problem->simparams()->numOpenBoundaries);
+		}
 	} else {
 		gdata->totParticles = problem->fill_parts(false);
 		// get number of particles from hot file
@@ -291,7 +478,6 @@ bool GPUSPH::initialize(GlobalData *_gdata) {
 			cout << "Hot start has been written from a multi-node simulation with " << hot_nrank << " processes" << endl;
 		}
 		// allocate hot file arrays and file pointers
-		hot_in = new ifstream[hot_nrank];
 		hf = new HotFile*[hot_nrank];
 		gdata->totParticles = 0;
 		for (uint i = 0; i < hot_nrank; i++) {
@@ -306,10 +492,12 @@ bool GPUSPH::initialize(GlobalData *_gdata) {
 				err_msg << "Hot start file " << fname.str() << " not found";
 				throw runtime_error(err_msg.str());
 			}
+			ifstream *in = new ifstream();
 			/* enable automatic exception handling on failure */
-			hot_in[i].exceptions(ifstream::failbit | ifstream::badbit);
-			hot_in[i].open(fname.str().c_str());
-			hf[i] = new HotFile(hot_in[i], gdata);
+			in->exceptions(ifstream::failbit | ifstream::badbit);
+			in->open(fname.str().c_str());
+			hot_in.emplace_back(in);
+			hf[i] = new HotFile(*in, gdata);
 			hf[i]->readHeader(gdata->totParticles, gdata->problem->simparams()->numOpenBoundaries);
 		}
 	}
@@ -414,7 +602,7 @@ bool GPUSPH::initialize(GlobalData *_gdata) {
 				const float4 *pos = gdata->s_hBuffers.getConstData<BUFFER_POS>();
 				const particleinfo *info = gdata->s_hBuffers.getConstData<BUFFER_INFO>();
 #endif
-				hot_in[i].close();
+				hot_in[i].reset();
 				cerr << "Successfully restored hot start file " << i+1 << " / " << hot_nrank << endl;
 				cerr << *hf[i];
 			}
@@ -437,7 +625,7 @@ bool GPUSPH::initialize(GlobalData *_gdata) {
 				const float4 *pos = gdata->s_hBuffers.getConstData<BUFFER_POS>();
 				const particleinfo *info = gdata->s_hBuffers.getConstData<BUFFER_INFO>();
 #endif
-				hot_in[i].close();
+				hot_in[i].reset();
 				cerr << "Successfully restored repack file " << i+1 << " / " << hot_nrank << endl;
 				cerr << *hf[i];
 			}
@@ -449,7 +637,7 @@ bool GPUSPH::initialize(GlobalData *_gdata) {
 				<< ", dt=" << gdata->dt << endl;
 		}
 		delete[] hf;
-		delete[] hot_in;
+		hot_in.clear();
 		resumed = true;
 	}
 	gdata->s_hBuffers.clear_pending_state();
@@ -521,6 +709,14 @@ bool GPUSPH::initialize(GlobalData *_gdata) {
 				gdata->totParticles;
 	}
 
+	/* The double-precision global position is only needed by the Problem
+	 * while filling and initializing the particles: from now on it is
+	 * recomputed on the fly from POS and HASH wherever it is needed
+	 * (see GlobalPosAccessor), so release it rather than keeping a full
+	 * double4 array around for the whole simulation.
+	 */
+	gdata->s_hBuffers.removeBuffer(BUFFER_POS_GLOBAL);
+
 	for (uint d=0; d < gdata->devices; d++)
 		printf(" - device at index %u has %s particles assigned and offset %s\n",
 			d, gdata->addSeparators(gdata->s_hPartsPerDevice[d]).c_str(), gdata->addSeparators(gdata->s_hStartPerDevice[d]).c_str());
@@ -531,6 +727,9 @@ bool GPUSPH::initialize(GlobalData *_gdata) {
 	// Note that if gdata->run_mode == REPACK, the REPACKING_INTEGRATOR will be instantiated instead
 	integrator = Integrator::instance(PREDITOR_CORRECTOR, gdata);
 
+	// must be done before the workers register their buffers
+	setupBufferAliasing(*integrator);
+
 	// new Synchronizer; it will be waiting on #devices+1 threads (GPUWorkers + main)
 	gdata->threadSynchronizer = new Synchronizer(gdata->devices + 1);
 
@@ -556,15 +755,280 @@ bool GPUSPH::initialize(GlobalData *_gdata) {
 	if (MULTI_GPU)
 		printDeviceAccessibilityTable();
 
+	// this will be completed in runSimulation() by the upload of the subdomains
+	m_setupTime = cmd_time_clock::now() - setup_start;
+
 	return (initialized = true);
 }
 
+/*! Ephemeral device buffers that are never live at the same time, according to
+ * the execution sequence of the integrator, can share their storage, reducing
+ * the memory needed per particle. This excludes the buffers that are also accessed
+ * outside of the integrator commands (when writing or post-processing, or for debugging),
+ * and the ones that are not sized on the number of particles.
+ */
+void GPUSPH::setupBufferAliasing(Integrator const& integrator)
+{
+	gdata->s_bufferInterference.clear();
+
+	if (clOptions->no_buffer_aliasing ||
+		gdata->debug.inspect_preforce ||
+		gdata->debug.check_buffer_consistency ||
+		gdata->debug.clobber_invalid_buffers)
+		return;
+
+	const flag_t candidates = EPHEMERAL_BUFFERS &
+		~(BUFFER_PARTINDEX | POST_PROCESS_BUFFERS | BUFFER_NORMALS |
+		  BUFFERS_CFL | BUFFERS_RB_PARTICLES | getWrittenBuffers());
+
+	gdata->s_bufferInterference = integrator.buffer_interference(candidates);
+}
+
+/*! The particles estimated by ProblemCore::plan_fill() are spread evenly
+ * over the cells covered by each filled region, the domain is partitioned
+ * by the Problem as usual, and the memory needed on each device is computed
+ * from the buffers a GPUWorker would allocate, for the assigned particles
+ * and their halo. No particle is generated, and no device is used.
+ * If the device memory was given (--device-memory), also check that the
+ * simulation fits and estimate the finest deltap that would fit, assuming
+ * that the fluid particles and the cells scale with the volume, and the other
+ * particles (which fill surfaces) and the halos with the surface.
+ * Returns false if the simulation is known not to fit.
+ */
+bool GPUSPH::planCapacity()
+{
+	const SimParams *_sp = problem->simparams();
+	const uint3 gridSize = gdata->gridSize;
+	const uint nCells = gdata->nGridCells;
+	const devcount_t nDevices = gdata->totDevices;
+
+	printf("Capacity planning: estimating the particles without generating them...\n");
+
+	// spread the particles of each region evenly over the cells it covers
+	vector<double> cell_fluid(nCells, 0.0);
+	vector<double> cell_boundary(nCells, 0.0);
+	double tot_fluid = 0, tot_boundary = 0;
+	for (auto const& fill : problem->plan_fill()) {
+		int3 lo = gdata->calcGridPosHost(fill.bbmin.x, fill.bbmin.y, fill.bbmin.z);
+		int3 hi = gdata->calcGridPosHost(fill.bbmax.x, fill.bbmax.y, fill.bbmax.z);
+		lo = make_int3(
+			max(lo.x, 0), max(lo.y, 0), max(lo.z, 0));
+		hi = make_int3(
+			min(hi.x, int(gridSize.x) - 1), min(hi.y, int(gridSize.y) - 1), min(hi.z, int(gridSize.z) - 1));
+		if (hi.x < lo.x || hi.y < lo.y || hi.z < lo.z) {
+			printf("WARNING: %g particles estimated outside of the domain\n", fill.fluid + fill.boundary);
+			continue;
+		}
+		const double covered = double(hi.x - lo.x + 1)*(hi.y - lo.y + 1)*(hi.z - lo.z + 1);
+		for (int cz = lo.z; cz <= hi.z; cz++)
+			for (int cy = lo.y; cy <= hi.y; cy++)
+				for (int cx = lo.x; cx <= hi.x; cx++) {
+					const uint cell = gdata->calcGridHashHost(cx, cy, cz);
+					cell_fluid[cell] += fill.fluid/covered;
+					cell_boundary[cell] += fill.boundary/covered;
+				}
+		tot_fluid += fill.fluid;
+		tot_boundary += fill.boundary;
+	}
+
+	const double tot_parts = tot_fluid + tot_boundary;
+	printf(" - estimated particles: %s (%s fluid, %s other)\n",
+		gdata->addSeparators(long(tot_parts)).c_str(),
+		gdata->addSeparators(long(tot_fluid)).c_str(),
+		gdata->addSeparators(long(tot_boundary)).c_str());
+	if (tot_parts > UINT_MAX)
+		printf("FATAL: cannot handle %g > %u particles\n", tot_parts, UINT_MAX);
+
+	gdata->totParticles = uint(min(tot_parts, double(UINT_MAX)));
+	gdata->allocatedParticles = round_up(problem->max_parts(gdata->totParticles), 4U);
+
+	gdata->s_hPlannedCellFluid.resize(nCells);
+	gdata->s_hPlannedCellBoundary.resize(nCells);
+	for (uint c = 0; c < nCells; c++) {
+		gdata->s_hPlannedCellFluid[c] = uint(lround(cell_fluid[c]));
+		gdata->s_hPlannedCellBoundary[c] = uint(lround(cell_boundary[c]));
+	}
+
+	// particles assigned to each (linearized global) device, and in its halo
+	vector<double> dev_fluid(nDevices, 0.0);
+	vector<double> dev_boundary(nDevices, 0.0);
+	vector<double> dev_halo(nDevices, 0.0);
+
+	if (MULTI_DEVICE) {
+		gdata->s_hDeviceMap = new devcount_t[nCells]();
+		gdata->s_hPartsPerSliceAlongX = new uint[gridSize.x]();
+		gdata->s_hPartsPerSliceAlongY = new uint[gridSize.y]();
+		gdata->s_hPartsPerSliceAlongZ = new uint[gridSize.z]();
+
+		// like in prepareProblem()
+		for (uint c = 0; c < nCells; c++) {
+			uint parts = gdata->s_hPlannedCellFluid[c];
+			if (_sp->boundarytype != LJ_BOUNDARY)
+				parts += gdata->s_hPlannedCellBoundary[c];
+			const uint3 cellCoords = gdata->calcGridPosFromCellHash(c);
+			gdata->s_hPartsPerSliceAlongX[cellCoords.x] += parts;
+			gdata->s_hPartsPerSliceAlongY[cellCoords.y] += parts;
+			gdata->s_hPartsPerSliceAlongZ[cellCoords.z] += parts;
+		}
+
+		printf("Splitting the domain in %u partitions...\n", nDevices);
+		problem->fillDeviceMap();
+
+		const int3 periodic = make_int3(
+			_sp->periodicbound & PERIODIC_X,
+			_sp->periodicbound & PERIODIC_Y,
+			_sp->periodicbound & PERIODIC_Z);
+
+		vector<bool> in_halo(nDevices);
+		for (uint c = 0; c < nCells; c++) {
+			const devcount_t d = gdata->s_hDeviceMap[c];
+			dev_fluid[d] += cell_fluid[c];
+			dev_boundary[d] += cell_boundary[c];
+
+			// the cell is in the halo of the other devices its neighbors are assigned to
+			const uint3 upos = gdata->calcGridPosFromCellHash(c);
+			const int3 pos = make_int3(upos.x, upos.y, upos.z);
+			in_halo.assign(nDevices, false);
+			for (int dz = -1; dz <= 1; dz++)
+				for (int dy = -1; dy <= 1; dy++)
+					for (int dx = -1; dx <= 1; dx++) {
+						int3 n = pos + make_int3(dx, dy, dz);
+						if (periodic.x) n.x = (n.x + gridSize.x) % gridSize.x;
+						if (periodic.y) n.y = (n.y + gridSize.y) % gridSize.y;
+						if (periodic.z) n.z = (n.z + gridSize.z) % gridSize.z;
+						if (n.x < 0 || n.y < 0 || n.z < 0 ||
+							n.x >= int(gridSize.x) || n.y >= int(gridSize.y) || n.z >= int(gridSize.z))
+							continue;
+						in_halo[gdata->s_hDeviceMap[gdata->calcGridHashHost(n)]] = true;
+					}
+			in_halo[d] = false;
+			for (devcount_t nd = 0; nd < nDevices; nd++)
+				if (in_halo[nd])
+					dev_halo[nd] += cell_fluid[c] + cell_boundary[c];
+		}
+
+		delete[] gdata->s_hDeviceMap;
+		delete[] gdata->s_hPartsPerSliceAlongX;
+		delete[] gdata->s_hPartsPerSliceAlongY;
+		delete[] gdata->s_hPartsPerSliceAlongZ;
+		gdata->s_hDeviceMap = NULL;
+		gdata->s_hPartsPerSliceAlongX = gdata->s_hPartsPerSliceAlongY = gdata->s_hPartsPerSliceAlongZ = NULL;
+	} else {
+		dev_fluid[0] = tot_fluid;
+		dev_boundary[0] = tot_boundary;
+	}
+
+	// the buffers that would share their storage don't count
+	setupBufferAliasing(*Integrator::instance(PREDITOR_CORRECTOR, gdata));
+
+	// the buffers are only registered by the worker constructor, the device is
+	// only accessed when the worker thread is started
+	GPUWorker worker(gdata, 0);
+	const size_t memPerParticle = worker.computeMemoryPerParticle();
+	const size_t memPerCells = worker.computeMemoryPerCell()*size_t(nCells);
+
+	printf("Device memory per particle (neighbor list size: %u):\n", _sp->neiblistsize);
+	for (auto const& contrib : worker.computeMemoryPerParticleByBuffer())
+		printf(" - %-24s %6zuB\n", getBufferName(contrib.first), contrib.second);
+	printf("Device memory for the cells: %s (%s cells)\n",
+		gdata->memString(memPerCells).c_str(), gdata->addSeparators(nCells).c_str());
+
+	// same safety margin as GPUWorker::computeAndSetAllocableParticles()
+	const bool check = isfinite(clOptions->device_memory) && clOptions->device_memory > 0;
+	const size_t devMemory = check ? size_t(clOptions->device_memory*(1 << 30)) : 0;
+	const size_t safetyMargin = 16 + devMemory/32;
+
+	// memory needed on device d when deltap is scaled by s
+	auto required = [&](devcount_t d, double s) -> double {
+		const double s2 = s*s, s3 = s2*s;
+		return memPerParticle*(dev_fluid[d]/s3 + (dev_boundary[d] + dev_halo[d])/s2) +
+			memPerCells/s3 + safetyMargin;
+	};
+
+	printf("Predicted device memory:\n");
+	printf(" %6s %14s %14s %12s %12s%s\n", "device", "particles", "halo particles",
+		"particle mem", "total", check ? "  fits" : "");
+	bool all_fit = tot_parts <= UINT_MAX;
+	for (devcount_t d = 0; d < nDevices; d++) {
+		const double parts = dev_fluid[d] + dev_boundary[d];
+		const double total = required(d, 1.0);
+		const bool fits = total <= devMemory;
+		printf(" %6u %14s %14s %12s %12s%s\n", d,
+			gdata->addSeparators(long(parts)).c_str(),
+			gdata->addSeparators(long(dev_halo[d])).c_str(),
+			gdata->memString(size_t(memPerParticle*(parts + dev_halo[d]))).c_str(),
+			gdata->memString(size_t(total)).c_str(),
+			check ? (fits ? "   yes" : "    NO") : "");
+		all_fit = all_fit && fits;
+	}
+	if (_sp->simflags & ENABLE_INLET_OUTLET)
+		printf("NOTE: the particle count may grow during the simulation (open boundaries), "
+			"this is not accounted for\n");
+
+	if (!check) {
+		printf("Use --device-memory to check the estimate against the available device memory\n");
+		return true;
+	}
+
+	// can the simulation fit with deltap scaled by s?
+	auto feasible = [&](double s) -> bool {
+		const double s2 = s*s, s3 = s2*s;
+		if (nCells/s3 > MAX_CELLS || tot_fluid/s3 + tot_boundary/s2 > UINT_MAX)
+			return false;
+		for (devcount_t d = 0; d < nDevices; d++)
+			if (required(d, s) > devMemory)
+				return false;
+		return true;
+	};
+
+	// bracket the smallest feasible scale factor and bisect
+	double lo = 1, hi = 1;
+	if (feasible(1)) {
+		lo = 0.5;
+		while (feasible(lo) && lo > 1e-3) {
+			hi = lo;
+			lo /= 2;
+		}
+	} else {
+		hi = 2;
+		while (!feasible(hi) && hi < 1e3) {
+			lo = hi;
+			hi *= 2;
+		}
+	}
+	if (!feasible(hi)) {
+		printf("No resolution fits in %g GiB per device\n", clOptions->device_memory);
+		return false;
+	}
+	for (int i = 0; i < 50; i++) {
+		const double mid = (lo + hi)/2;
+		if (feasible(mid))
+			hi = mid;
+		else
+			lo = mid;
+	}
+
+	const double dp = problem->get_deltap();
+	printf("Finest feasible resolution with %g GiB on each of %u devices: deltap %g (~%s particles)\n",
+		clOptions->device_memory, nDevices, dp*hi,
+		gdata->addSeparators(long(tot_fluid/(hi*hi*hi) + tot_boundary/(hi*hi))).c_str());
+	printf("The simulation at deltap %g %s\n", dp, all_fit ? "fits" : "does NOT fit");
+
+	return all_fit;
+}
+
 bool GPUSPH::finalize() {
 	// TODO here, when there will be the Integrator
 	// delete Integrator
 
 	printf("Deallocating...\n");
 
+	// stop the metrics exporter, writing the final values
+	if (m_metrics) {
+		publishMetrics();
+		m_metrics.reset();
+	}
+
 	// stuff for rollCallParticles()
 	free(m_rcBitmap);
 	free(m_rcNotified);
@@ -606,6 +1070,8 @@ void GPUSPH::runCommand<END_OF_INIT>(CommandStruct const& cmd)
 
 	// write some info. This could replace "Entering the main simulation cycle"
 	printStatus();
+
+	startMetrics();
 }
 
 template<>
@@ -628,8 +1094,12 @@ void GPUSPH::runCommand<TIME_STEP_PRELUDE>(CommandStruct const& cmd)
 template<>
 void GPUSPH::runCommand<HANDLE_HOTWRITE>(CommandStruct const& cmd)
 {
-	if (Writer::HotWriterPending())
+	if (Writer::HotWriterPending()) {
 		saveParticles(noPostProcess, "step n", HotWriteFlags);
+		// the sampled data is written out at every checkpoint
+		if (gdata->run_mode == SIMULATE)
+			flushPostProcess();
+	}
 }
 
 template<>
@@ -653,7 +1123,19 @@ void GPUSPH::runCommand<TIME_STEP_EPILOGUE>(CommandStruct const& cmd)
 			gdata->dt = min(gdata->dt, gdata->dts[d]);
 		// if runnin multinode, should also find the network minimum
 		if (MULTI_NODE)
-			gdata->networkManager->networkFloatReduction(&(gdata->dt), 1, MIN_REDUCTION);
+			gdata->networkManager->queueReduction(&(gdata->dt), 1, MIN_REDUCTION);
+	}
+
+	// In multi-node, a quit request (e.g. from a signal) must be honored by all processes
+	// at the same iteration, so it is folded into the end-of-step reduction together
+	// with the dt and the other values queued during the step. Requests arriving
+	// after this point are handled at the next iteration.
+	bool quit_request = gdata->quit_request;
+	if (MULTI_NODE) {
+		gdata->networkManager->queueReduction(&quit_request, 1);
+		gdata->networkManager->completeReductions();
+		if (quit_request)
+			gdata->quit_request = true;
 	}
 
 	// check that dt is not too small (absolute)
@@ -661,13 +1143,13 @@ void GPUSPH::runCommand<TIME_STEP_EPILOGUE>(CommandStruct const& cmd)
 		throw DtZeroException(gdata->t, gdata->dt);
 	} else if (gdata->dt < FLT_EPSILON) {
 		fprintf(stderr, "FATAL: timestep %g under machine epsilon at iteration %lu - requesting quit...\n", gdata->dt, gdata->iterations);
-		gdata->quit_request = true;
+		gdata->quit_request = quit_request = true;
 	}
 
 	// check that dt is not too small (relative to t)
 	if (gdata->t == previous_t) {
 		fprintf(stderr, "FATAL: timestep %g too small at iteration %lu, time is still - requesting quit...\n", gdata->dt, gdata->iterations);
-		gdata->quit_request = true;
+		gdata->quit_request = quit_request = true;
 	}
 
 	//printf("Finished iteration %lu, time %g, dt %g\n", gdata->iterations, gdata->t, gdata->dt);
@@ -680,21 +1162,30 @@ void GPUSPH::runCommand<TIME_STEP_EPILOGUE>(CommandStruct const& cmd)
 		// (for repacking, or from the command line during simulation)
 		gdata->iterations >= gdata->maxiter ||
 		// and of course we're finished if a quit was requested
-		gdata->quit_request;
+		quit_request;
+
+	if (m_metrics)
+		publishMetrics();
 
 	if (gdata->run_mode == REPACK && we_are_done) {
 		// signal to the integrator that we are done with the repacking,
 		// so we can proceed with the final
 		integrator->we_are_done();
 		// but don't keep going if a quit was requested
-		if (gdata->quit_request)
+		if (quit_request)
 			gdata->keep_going = false;
 	} else {
+		if (gdata->run_mode == SIMULATE)
+			samplePostProcess();
+
 		check_write(we_are_done);
 
-		if (we_are_done)
+		if (we_are_done) {
+			if (gdata->run_mode == SIMULATE)
+				flushPostProcess();
 			// NO dispatchCommand() after keep_going has been unset!
 			gdata->keep_going = false;
+		}
 	}
 }
 
@@ -730,6 +1221,7 @@ bool GPUSPH::runSimulation() {
 	doWrite(StepInfo(0));
 
 	printf("Letting threads upload the subdomains...\n");
+	const cmd_time_clock::time_point upload_start = cmd_time_clock::now();
 	gdata->threadSynchronizer->barrier(); // begins UPLOAD ***
 
 	// here the Workers are uploading their subdomains
@@ -740,12 +1232,18 @@ bool GPUSPH::runSimulation() {
 	gdata->nextCommand = IDLE;
 	gdata->threadSynchronizer->barrier(); // end of UPLOAD, begins SIMULATION ***
 	gdata->threadSynchronizer->barrier(); // unlock CYCLE BARRIER 1
+	m_setupTime += cmd_time_clock::now() - upload_start;
 
 	integrator->start();
 
 	const CommandStruct* cmd = nullptr;
 	while (gdata->keep_going && (cmd = integrator->next_command()) ) try {
-		dispatchCommand(*cmd);
+		m_commandBatch.assign(1, cmd);
+		integrator->extend_batch(m_commandBatch);
+		if (m_commandBatch.size() > 1)
+			dispatchCommandBatch(m_commandBatch);
+		else
+			dispatchCommand(*cmd);
 	} catch (exception const& e) {
 		cerr << e.what() << endl;
 		all_ok = false;
@@ -771,10 +1269,22 @@ bool GPUSPH::runSimulation() {
 		printf("Global performance of the multinode %s: %.2g MIPPS\n", run_desc,
 			m_multiNodePerformanceCounter->getMIPPS());
 
+	if (m_totBodiesTiming.count > 0) {
+		using ms = chrono::duration<double, milli>;
+		const double solve = ms(m_totBodiesTiming.solve).count();
+		const double overlap = ms(m_totBodiesTiming.overlap()).count();
+		printf("Asynchronous bodies integration: %lu solves, %.3gms/step, %.3gms/step (%.0f%%) overlapped with device work\n",
+			m_totBodiesTiming.count, solve/m_totBodiesTiming.count, overlap/m_totBodiesTiming.count,
+			solve > 0 ? 100*overlap/solve : 0.0);
+	}
+
 	// suggest max speed for next runs
 	printf("Peak particle speed was ~%g m/s at %g s -> can set maximum vel %.2g for this problem\n",
 		m_peakParticleSpeed, m_peakParticleSpeedTime, (m_peakParticleSpeed*1.1));
 
+	if (!clOptions->bench_report.empty())
+		writeBenchReport(all_ok);
+
 	// NO dispatchCommand() nor other barriers than the standard ones after the
 
 	printf("%s end, cleaning up...\n", run_desc_title);
@@ -818,9 +1328,11 @@ void GPUSPH::runCommand<REDUCE_BODIES_FORCES_HOST>(CommandStruct const& cmd)
 
 	// if running multinode, also reduce across nodes
 	if (MULTI_NODE) {
-		// to minimize the overhead, we reduce the whole arrays of forces and torques in one command
-		gdata->networkManager->networkFloatReduction((float*)gdata->s_hRbTotalForce, 3 * numforcesbodies, SUM_REDUCTION);
-		gdata->networkManager->networkFloatReduction((float*)gdata->s_hRbTotalTorque, 3 * numforcesbodies, SUM_REDUCTION);
+		// to minimize the overhead, we reduce the whole arrays of forces and torques in one command,
+		// which is only waited for in BODY_FORCES_CALLBACK
+		gdata->networkManager->queueReduction((float*)gdata->s_hRbTotalForce, 3 * numforcesbodies, SUM_REDUCTION);
+		gdata->networkManager->queueReduction((float*)gdata->s_hRbTotalTorque, 3 * numforcesbodies, SUM_REDUCTION);
+		gdata->networkManager->startReductions();
 	}
 
 }
@@ -834,6 +1346,10 @@ void GPUSPH::runCommand<BODY_FORCES_CALLBACK>(CommandStruct const& cmd)
 
 	const size_t numforcesbodies = problem->simparams()->numforcesbodies;
 
+	// complete the network reduction started in REDUCE_BODIES_FORCES_HOST
+	if (MULTI_NODE)
+		gdata->networkManager->completeReductions();
+
 	memcpy(gdata->s_hRbAppliedForce, gdata->s_hRbTotalForce, numforcesbodies*sizeof(float3));
 	memcpy(gdata->s_hRbAppliedTorque, gdata->s_hRbTotalTorque, numforcesbodies*sizeof(float3));
 
@@ -854,9 +1370,46 @@ void GPUSPH::runCommand<MOVE_BODIES>(CommandStruct const& cmd)
 	// Let the problem compute the new moving bodies data
 	// TODO we pass step and gdata->dt, should be pass step and dt (which is already halved if necessary)?
 	// instead?
-	problem->bodies_timestep(gdata->s_hRbAppliedForce, gdata->s_hRbAppliedTorque, step, gdata->dt, gdata->t,
-		gdata->s_hRbCgGridPos, gdata->s_hRbCgPos,
-		gdata->s_hRbTranslations, gdata->s_hRbRotationMatrices, gdata->s_hRbLinearVelocities, gdata->s_hRbAngularVelocities);
+	auto bodies_timestep = [this, step]() {
+		problem->bodies_timestep(gdata->s_hRbAppliedForce, gdata->s_hRbAppliedTorque, step, gdata->dt, gdata->t,
+			gdata->s_hRbCgGridPos, gdata->s_hRbCgPos,
+			gdata->s_hRbTranslations, gdata->s_hRbRotationMatrices, gdata->s_hRbLinearVelocities, gdata->s_hRbAngularVelocities);
+	};
+
+	// With asynchronous bodies integration, the body solver runs on a separate thread,
+	// while the devices carry on with the commands that don't need the new bodies data,
+	// up to the JOIN_BODIES command. Only the bodies data is touched by the solver;
+	// the post-timestep callback is left to the join point.
+	if (clOptions->async_bodies) {
+		m_bodiesSolve = async(launch::async, [bodies_timestep]() {
+			const auto start = cmd_time_clock::now();
+			bodies_timestep();
+			return cmd_time_duration(cmd_time_clock::now() - start);
+		});
+		return;
+	}
+
+	bodies_timestep();
+
+	if (cmd.step.last)
+		problem->post_timestep_callback(gdata->t);
+}
+
+// wait for the asynchronous bodies integration started by MOVE_BODIES
+template<>
+void GPUSPH::runCommand<JOIN_BODIES>(CommandStruct const& cmd)
+{
+	if (!m_bodiesSolve.valid())
+		return;
+
+	const auto start = cmd_time_clock::now();
+	// this also rethrows any exception raised by the body solver
+	const cmd_time_duration solve = m_bodiesSolve.get();
+	const cmd_time_duration wait = cmd_time_clock::now() - start;
+
+	m_lastBodiesTiming = BodiesTiming();
+	m_lastBodiesTiming.add(solve, wait);
+	m_totBodiesTiming.add(solve, wait);
 
 	if (cmd.step.last)
 		problem->post_timestep_callback(gdata->t);
@@ -960,6 +1513,22 @@ size_t GPUSPH::allocateGlobalHostBuffers()
 		++iter;
 	}
 
+	// The particle buffers are the target of the DUMP transfers from the
+	// devices: page-lock them (if allowed), and report where they ended up
+	const bool pin_buffers = !clOptions->no_pinned_host;
+	printf("Host buffer placement:\n");
+	for (auto& kb : gdata->s_hBuffers) {
+		AbstractBuffer *buf = kb.second.get();
+		const size_t bufmem = buf->get_allocated_elements()*buf->get_element_size();
+		for (uint i = 0; i < buf->get_array_count(); ++i) {
+			void *ptr = buf->get_offset_buffer(i, 0);
+			if (pin_buffers)
+				host_pin(ptr, gdata->device[0]);
+			printf(" - %s: %s (%s)\n", buf->get_buffer_name(),
+				gdata->memString(bufmem).c_str(), host_placement(ptr).c_str());
+		}
+	}
+
 	const size_t numbodies = gdata->problem->simparams()->numbodies;
 	cout << "Numbodies : " << numbodies << "\n";
 	if (numbodies > 0) {
@@ -1061,6 +1630,99 @@ size_t GPUSPH::allocateGlobalHostBuffers()
 }
 
 // Deallocate the shared buffers, i.e. those accessed by all workers
+// Grow the particle buffers on host to the current gdata->allocatedParticles.
+// The content is preserved, but it will be refreshed at the next dump anyway
+size_t GPUSPH::resizeGlobalHostBuffers(uint prevAllocatedParticles)
+{
+	const size_t numparts = gdata->allocatedParticles;
+	const uint neiblistsize = problem->simparams()->neiblistsize;
+	const bool pin_buffers = !clOptions->no_pinned_host;
+
+	size_t totCPUbytes = 0;
+
+	for (auto& kb : gdata->s_hBuffers) {
+		if (kb.first & BUFFERS_CELL)
+			continue;
+		AbstractBuffer *buf = kb.second.get();
+		if (kb.first == BUFFER_NEIBSLIST)
+			totCPUbytes += buf->realloc(numparts*neiblistsize, neiblistsize);
+		else
+			totCPUbytes += buf->realloc(numparts);
+		if (pin_buffers)
+			for (uint i = 0; i < buf->get_array_count(); ++i)
+				host_pin(buf->get_offset_buffer(i, 0), gdata->device[0]);
+	}
+
+	// aux arrays for rollCallParticles()
+	m_rcBitmap = (bool*) realloc(m_rcBitmap, sizeof(bool)*numparts);
+	m_rcNotified = (bool*) realloc(m_rcNotified, sizeof(bool)*numparts);
+	m_rcAddrs = (uint*) realloc(m_rcAddrs, sizeof(uint)*numparts);
+	if (!m_rcBitmap || !m_rcNotified || !m_rcAddrs)
+		throw bad_alloc();
+	const size_t added = numparts - prevAllocatedParticles;
+	memset(m_rcBitmap + prevAllocatedParticles, 0, sizeof(bool)*added);
+	memset(m_rcNotified + prevAllocatedParticles, 0, sizeof(bool)*added);
+	memset(m_rcAddrs + prevAllocatedParticles, 0, sizeof(uint)*added);
+
+	return totCPUbytes;
+}
+
+// With open boundaries, the particle storage starts with some headroom over the initial
+// number of particles, and grows geometrically when the occupancy of any device
+// (or of the host buffers) crosses the high-water mark
+void GPUSPH::checkParticleCapacity()
+{
+	if (m_particleStorageCapped)
+		return;
+
+	const SimParams *sp = problem->simparams();
+	const double highwater = sp->particles_highwater;
+
+	// the largest number of particles that must fit in the storage of a device,
+	// and the number of particles on the host
+	uint deviceDemand = 0;
+	uint processDemand = 0;
+	bool needs_growth = false;
+	for (uint d = 0; d < gdata->devices; d++) {
+		const uint numParts = gdata->GPUWORKERS[d]->getNumParticles();
+		const uint numAllocated = gdata->GPUWORKERS[d]->getNumAllocatedParticles();
+		deviceDemand = max(deviceDemand, numParts);
+		processDemand += numParts;
+		if (numParts > highwater*numAllocated)
+			needs_growth = true;
+	}
+	if (processDemand > highwater*gdata->allocatedParticles)
+		needs_growth = true;
+
+	if (!needs_growth)
+		return;
+
+	const uint prevAllocatedParticles = gdata->allocatedParticles;
+	const double demand = max(deviceDemand, processDemand)/highwater;
+	// round up to multiple of 4 to improve reductions' performances
+	gdata->allocatedParticles = round_up<uint>(
+		ceil(max(prevAllocatedParticles*sp->particles_growth, demand)), 4U);
+
+	printf("Iteration %lu: growing particle storage from %s to %s particles\n",
+		gdata->iterations,
+		gdata->addSeparators(prevAllocatedParticles).c_str(),
+		gdata->addSeparators(gdata->allocatedParticles).c_str());
+
+	resizeGlobalHostBuffers(prevAllocatedParticles);
+
+	dispatchCommand(CommandStruct(RESIZE_PARTICLE_SYSTEM));
+
+	// if a device ran out of memory, stop trying: the simulation will quit
+	// if the particles actually overflow
+	for (uint d = 0; d < gdata->devices; d++) {
+		if (gdata->GPUWORKERS[d]->getNumAllocatedParticles() < gdata->allocatedParticles) {
+			fprintf(stderr, "WARNING: device %u could not grow its particle storage, "
+				"no further growth will be attempted\n", d);
+			m_particleStorageCapped = true;
+		}
+	}
+}
+
 void GPUSPH::deallocateGlobalHostBuffers() {
 	gdata->s_hBuffers.clear();
 
@@ -1570,11 +2232,150 @@ double GPUSPH::Wendland2D(const double r, const double h) {
 	return 7/(4*M_PI*h*h)*temp*(2*q + 1);
 }
 
+//! Spatial index of the wave gages, to speed up the search of the gages affected by each SURFACE particle
+/*! Gages with a positive smoothing length only take contributions from particles
+ * within 2 smoothing lengths of the gage (x,y) position. We bin them on a 2D regular
+ * grid with bin side at least as large as the largest support, so that each particle
+ * only needs to look at the gages registered in its own bin.
+ * Gages with a null smoothing length take the z of the nearest SURFACE particle,
+ * so they can't be binned, and are kept in a separate list that is always checked.
+ */
+class GageBins
+{
+	double2 m_origin;
+	double m_binSize;
+	uint m_nx, m_ny;
+	// the gages registered in bin b are m_gageIdx[m_binStart[b]] to m_gageIdx[m_binStart[b+1]-1]
+	vector<uint> m_binStart;
+	vector<uint> m_gageIdx;
+	// gages that take their value from the nearest particle
+	vector<uint> m_nearestGages;
+
+public:
+	GageBins(GageList const& gages) :
+		m_origin(make_double2(0.0, 0.0)),
+		m_binSize(1.0),
+		m_nx(0), m_ny(0),
+		m_binStart(), m_gageIdx(), m_nearestGages()
+	{
+		const uint numgages = gages.size();
+
+		double2 bmin = make_double2(DBL_MAX, DBL_MAX);
+		double2 bmax = make_double2(-DBL_MAX, -DBL_MAX);
+		double max_support = 0;
+		uint num_binned = 0;
+		for (uint g = 0; g < numgages; ++g) {
+			const double support = 2*gages[g].w;
+			if (!(support > 0)) {
+				m_nearestGages.push_back(g);
+				continue;
+			}
+			bmin.x = fmin(bmin.x, gages[g].x - support);
+			bmin.y = fmin(bmin.y, gages[g].y - support);
+			bmax.x = fmax(bmax.x, gages[g].x + support);
+			bmax.y = fmax(bmax.y, gages[g].y + support);
+			max_support = fmax(max_support, support);
+			++num_binned;
+		}
+
+		if (!num_binned)
+			return;
+
+		m_origin = bmin;
+		m_binSize = max_support;
+		// avoid degenerate grids when the gages are spread over a large area
+		// compared to their support: we don't need more than a few bins per gage
+		const double max_bins = 4.0*num_binned;
+		while (ceil((bmax.x - bmin.x)/m_binSize)*ceil((bmax.y - bmin.y)/m_binSize) > max_bins)
+			m_binSize *= 2;
+		m_nx = max(1U, uint(ceil((bmax.x - bmin.x)/m_binSize)));
+		m_ny = max(1U, uint(ceil((bmax.y - bmin.y)/m_binSize)));
+
+		// count the gages overlapping each bin, then fill
+		vector<uint> count(m_nx*m_ny + 1, 0);
+		auto for_each_bin = [&](uint g, std::function<void(uint)> const& func) {
+			const double support = 2*gages[g].w;
+			const uint x0 = bin_coord(gages[g].x - support, m_origin.x, m_nx);
+			const uint x1 = bin_coord(gages[g].x + support, m_origin.x, m_nx);
+			const uint y0 = bin_coord(gages[g].y - support, m_origin.y, m_ny);
+			const uint y1 = bin_coord(gages[g].y + support, m_origin.y, m_ny);
+			for (uint by = y0; by <= y1; ++by)
+				for (uint bx = x0; bx <= x1; ++bx)
+					func(by*m_nx + bx);
+		};
+
+		for (uint g = 0; g < numgages; ++g)
+			if (gages[g].w > 0)
+				for_each_bin(g, [&](uint b) { ++count[b+1]; });
+
+		m_binStart.resize(m_nx*m_ny + 1);
+		partial_sum(count.begin(), count.end(), m_binStart.begin());
+		m_gageIdx.resize(m_binStart.back());
+
+		vector<uint> fill(m_binStart.begin(), m_binStart.end() - 1);
+		for (uint g = 0; g < numgages; ++g)
+			if (gages[g].w > 0)
+				for_each_bin(g, [&](uint b) { m_gageIdx[fill[b]++] = g; });
+	}
+
+	// bin index along one direction, clamped to the grid
+	uint bin_coord(double x, double origin, uint n) const
+	{
+		const double b = floor((x - origin)/m_binSize);
+		return b < 0 ? 0 : b >= n ? n - 1 : uint(b);
+	}
+
+	//! gages with a null smoothing length
+	vector<uint> const& nearest_gages() const
+	{ return m_nearestGages; }
+
+	//! Range of indices of the smoothed gages that can see a particle at (x, y)
+	/*! Returns an empty range if (x, y) is outside of the area covered by the gages */
+	pair<const uint*, const uint*> smoothed_gages(double x, double y) const
+	{
+		if (!m_nx)
+			return make_pair(nullptr, nullptr);
+		const double bx = floor((x - m_origin.x)/m_binSize);
+		const double by = floor((y - m_origin.y)/m_binSize);
+		if (bx < 0 || by < 0 || bx >= m_nx || by >= m_ny)
+			return make_pair(nullptr, nullptr);
+		const uint b = uint(by)*m_nx + uint(bx);
+		const uint *base = m_gageIdx.data();
+		return make_pair(base + m_binStart[b], base + m_binStart[b+1]);
+	}
+};
+
+//! Partial results of the host-side particle loop in doWrite(), one per thread
+struct WriteReduction
+{
+	// energy in non-fluid particles + one for each fluid type
+	// double4 with .x kinetic, .y potential, .z internal, .w currently ignored
+	double4 energy[MAX_FLUID_TYPES+1];
+	// max particle speed in the chunk
+	float max_part_speed;
+	// gage weights (or distance of the nearest particle) and weighted z
+	vector<double> gages_W;
+	vector<double> gages_z;
+
+	WriteReduction(GageList const& gages) :
+		max_part_speed(0),
+		gages_W(gages.size(), 0.),
+		gages_z(gages.size(), 0.)
+	{
+		for (auto& e : energy)
+			e = make_double4(0.0);
+		for (uint g = 0; g < gages.size(); ++g)
+			if (gages[g].w == 0.)
+				gages_W[g] = DBL_MAX;
+	}
+};
+
 void GPUSPH::doWrite(WriteFlags const& write_flags)
 {
 	// TODO FIXME skip unnecessary work based on write_flags
 	// (e.g. do not run whatever isn't needed by the HotWriter during a hot write)
 	uint node_offset = gdata->s_hStartPerDevice[0];
+	const uint numParts = gdata->processParticles[gdata->mpi_rank];
 
 	// WaveGages work by looking at neighboring SURFACE particles and averaging their z coordinates
 	// NOTE: it's a standard average, not an SPH smoothing, so the neighborhood is arbitrarily fixed
@@ -1582,101 +2383,129 @@ void GPUSPH::doWrite(WriteFlags const& write_flags)
 	// TODO should it be an SPH smoothing instead?
 
 	GageList &gages = problem->simparams()->gage;
-	double slength = problem->simparams()->slength;
 
-	size_t numgages = gages.size();
-	vector<double> gages_W(numgages, 0.);
-	for (uint g = 0; g < numgages; ++g) {
-		if (gages[g].w == 0.)
-			gages_W[g] = DBL_MAX;
-		else
-			gages_W[g] = 0.;
-		gages[g].z = 0.;
-	}
+	const size_t numgages = gages.size();
+	const GageBins gage_bins(gages);
 
 	// energy in non-fluid particles + one for each fluid type
 	// double4 with .x kinetic, .y potential, .z internal, .w currently ignored
 	double4 energy[MAX_FLUID_TYPES+1] = {0.0f};
 
-	// TODO: parallelize? (e.g. each thread tranlsates its own particles)
 	double3 const& wo = problem->get_worldorigin();
 	const float4 *lpos = gdata->s_hBuffers.getConstData<BUFFER_POS>();
 	const hashKey* hash = gdata->s_hBuffers.getConstData<BUFFER_HASH>();
 	const particleinfo *info = gdata->s_hBuffers.getConstData<BUFFER_INFO>();
-	double4 *gpos = gdata->s_hBuffers.getData<BUFFER_POS_GLOBAL>();
 
 	const float *intEnergy = gdata->s_hBuffers.getConstData<BUFFER_INTERNAL_ENERGY>();
 	/* vel is only used to compute kinetic energy */
 	const float4 *vel = gdata->s_hBuffers.getConstData<BUFFER_VEL>();
 	const double3 gravity = make_double3(gdata->problem->physparams()->gravity);
 
-	bool warned_nan_pos = false;
-
-	// max particle speed only for this node only at time t
-	float local_max_part_speed = 0;
-
-	for (uint i = node_offset; i < node_offset + gdata->processParticles[gdata->mpi_rank]; i++) {
-		const float4 pos = lpos[i];
-		uint3 gridPos = gdata->calcGridPosFromCellHash( cellHashFromParticleHash(hash[i]) );
-		// double-precision absolute position, without using world offset (useful for computing the potential energy)
-		double4 dpos = make_double4(
-			gdata->calcGlobalPosOffset(gridPos, as_float3(pos)) + wo,
-			pos.w);
-		const particleinfo pinfo = info[i];
-
-		if (!warned_nan_pos && !(isfinite(dpos.x) && isfinite(dpos.y) && isfinite(dpos.z))) {
-			fprintf(stderr, "WARNING: particle %u (id %u, type %u) has NAN position! (%g, %g, %g) @ (%u, %u, %u) = (%g, %g, %g) at iteration %lu, time %g\n",
-				i, id(pinfo), PART_TYPE(pinfo),
-				pos.x, pos.y, pos.z,
-				gridPos.x, gridPos.y, gridPos.z,
-				dpos.x, dpos.y, dpos.z,
-				gdata->iterations, gdata->t);
-			warned_nan_pos = true;
-		}
+	// we only want to warn once about NaN positions, regardless of the thread that finds them
+	atomic<bool> warned_nan_pos(false);
+
+	// the particles are split in contiguous chunks, each processed by its own thread
+	// and accumulating its own partial results
+	const uint nthreads = effective_host_threads(m_hostThreads, node_offset, node_offset + numParts, 4096);
+	vector<WriteReduction> partial(nthreads, WriteReduction(gages));
+
+	auto process_chunk = [&](uint thread, size_t begin, size_t end) {
+		WriteReduction &red = partial[thread];
+
+		for (uint i = begin; i < end; i++) {
+			const float4 pos = lpos[i];
+			uint3 gridPos = gdata->calcGridPosFromCellHash( cellHashFromParticleHash(hash[i]) );
+			// double-precision absolute position, without using world offset (useful for computing the potential energy)
+			double4 dpos = make_double4(
+				gdata->calcGlobalPosOffset(gridPos, as_float3(pos)) + wo,
+				pos.w);
+			const particleinfo pinfo = info[i];
+
+			if (!(isfinite(dpos.x) && isfinite(dpos.y) && isfinite(dpos.z)) &&
+				!warned_nan_pos.exchange(true)) {
+				fprintf(stderr, "WARNING: particle %u (id %u, type %u) has NAN position! (%g, %g, %g) @ (%u, %u, %u) = (%g, %g, %g) at iteration %lu, time %g\n",
+					i, id(pinfo), PART_TYPE(pinfo),
+					pos.x, pos.y, pos.z,
+					gridPos.x, gridPos.y, gridPos.z,
+					dpos.x, dpos.y, dpos.z,
+					gdata->iterations, gdata->t);
+			}
 
-		// if we're tracking internal energy, we're interested in all the energy
-		// in the system, including kinetic and potential: keep track of that too
-		if (intEnergy) {
-			const double4 energies = dpos.w*make_double4(
-				/* kinetic */ sqlength3(vel[i])/2,
-				/* potential */ -dot3(dpos, gravity),
-				/* internal */ intEnergy[i],
-				/* TODO */ 0);
-			int idx = FLUID(info[i]) ? fluid_num(info[i]) : MAX_FLUID_TYPES;
-			energy[idx] += energies;
-		}
+			// if we're tracking internal energy, we're interested in all the energy
+			// in the system, including kinetic and potential: keep track of that too
+			if (intEnergy) {
+				const double4 energies = dpos.w*make_double4(
+					/* kinetic */ sqlength3(vel[i])/2,
+					/* potential */ -dot3(dpos, gravity),
+					/* internal */ intEnergy[i],
+					/* TODO */ 0);
+				int idx = FLUID(pinfo) ? fluid_num(pinfo) : MAX_FLUID_TYPES;
+				red.energy[idx] += energies;
+			}
 
-		// for surface particles add the z coordinate to the appropriate wavegages
-		if (numgages && SURFACE(info[i])) {
-			for (uint g = 0; g < numgages; ++g) {
-				const double gslength  = gages[g].w;
-				const double r = sqrt((dpos.x - gages[g].x)*(dpos.x - gages[g].x) + (dpos.y - gages[g].y)*(dpos.y - gages[g].y));
-				if (gslength > 0) {
+			// for surface particles add the z coordinate to the appropriate wavegages
+			if (numgages && SURFACE(pinfo)) {
+				// smoothed gages: only the ones binned together with the particle can see it
+				const auto smoothed = gage_bins.smoothed_gages(dpos.x, dpos.y);
+				for (const uint *gp = smoothed.first; gp != smoothed.second; ++gp) {
+					const uint g = *gp;
+					const double gslength  = gages[g].w;
+					const double r = sqrt((dpos.x - gages[g].x)*(dpos.x - gages[g].x) + (dpos.y - gages[g].y)*(dpos.y - gages[g].y));
 					if (r < 2*gslength) {
 						const double W = Wendland2D(r, gslength);
-						gages_W[g] += W;
-						gages[g].z += dpos.z*W;
+						red.gages_W[g] += W;
+						red.gages_z[g] += dpos.z*W;
 					}
 				}
-				else {
-					if (r < gages_W[g]) {
-						gages_W[g] = r;
-						gages[g].z = dpos.z;
+				// nearest-particle gages
+				for (const uint g : gage_bins.nearest_gages()) {
+					const double r = sqrt((dpos.x - gages[g].x)*(dpos.x - gages[g].x) + (dpos.y - gages[g].y)*(dpos.y - gages[g].y));
+					if (r < red.gages_W[g]) {
+						red.gages_W[g] = r;
+						red.gages_z[g] = dpos.z;
 					}
 				}
 			}
+
+
+			// track peak speed
+			red.max_part_speed = fmax(red.max_part_speed, length( as_float3(vel[i]) ));
 		}
+	};
 
-		gpos[i] = dpos;
+	parallel_for_chunks(nthreads, node_offset, node_offset + numParts, process_chunk, 4096);
+
+	// combine the partial results, in thread order so that the result is deterministic
+	// max particle speed only for this node only at time t
+	float local_max_part_speed = 0;
+
+	vector<double> gages_W(numgages, 0.);
+	for (uint g = 0; g < numgages; ++g) {
+		gages_W[g] = (gages[g].w == 0.) ? DBL_MAX : 0.;
+		gages[g].z = 0.;
+	}
 
-		// track peak speed
-		local_max_part_speed = fmax(local_max_part_speed, length( as_float3(vel[i]) ));
+	for (WriteReduction const& red : partial) {
+		for (uint f = 0; f < MAX_FLUID_TYPES+1; ++f)
+			energy[f] += red.energy[f];
+		local_max_part_speed = fmax(local_max_part_speed, red.max_part_speed);
+		for (uint g = 0; g < numgages; ++g) {
+			if (gages[g].w > 0) {
+				gages_W[g] += red.gages_W[g];
+				gages[g].z += red.gages_z[g];
+			} else if (red.gages_W[g] < gages_W[g]) {
+				gages_W[g] = red.gages_W[g];
+				gages[g].z = red.gages_z[g];
+			}
+		}
 	}
 
 	// max speed: read simulation global for multi-node
-	if (MULTI_NODE)
+	if (MULTI_NODE) {
 		// after this, local_max_part_speed actually becomes global_max_part_speed for time t only
-		gdata->networkManager->networkFloatReduction(&(local_max_part_speed), 1, MAX_REDUCTION);
+		gdata->networkManager->queueReduction(&(local_max_part_speed), 1, MAX_REDUCTION);
+		gdata->networkManager->completeReductions();
+	}
 	// update peak
 	if (local_max_part_speed > m_peakParticleSpeed) {
 		m_peakParticleSpeed = local_max_part_speed;
@@ -1723,20 +2552,14 @@ void GPUSPH::doWrite(WriteFlags const& write_flags)
 	Writer::MarkWritten(writers, gdata->t);
 }
 
-/*! Save the particle system to disk.
- *
- * This method downloads all necessary buffers from devices to host,
- * after running the defined post-process functions, and invokes the write-out
- * routine.
+/*! These are the buffers that are saved on every write, depending on the
+ * simulation framework and debug options: post-processing engines may add
+ * their own buffers to these.
  */
-void GPUSPH::saveParticles(
-	PostProcessEngineSet const& enabledPostProcess,
-	string const& state,
-	WriteFlags const& write_flags)
+flag_t GPUSPH::getWrittenBuffers() const
 {
 	const SimParams * const simparams = problem->simparams();
 
-	// set the buffers to be dumped
 	flag_t which_buffers = BUFFER_POS | BUFFER_VEL | BUFFER_INFO | BUFFER_HASH;
 
 	if (gdata->debug.neibs)
@@ -1784,6 +2607,25 @@ void GPUSPH::saveParticles(
 	if (simparams->simflags & ENABLE_INLET_OUTLET)
 		which_buffers |= BUFFER_NEXTID;
 
+	return which_buffers;
+}
+
+/*! Save the particle system to disk.
+ *
+ * This method downloads all necessary buffers from devices to host,
+ * after running the defined post-process functions, and invokes the write-out
+ * routine.
+ */
+void GPUSPH::saveParticles(
+	PostProcessEngineSet const& enabledPostProcess,
+	string const& state,
+	WriteFlags const& write_flags)
+{
+	const cmd_time_clock::time_point write_start = cmd_time_clock::now();
+
+	// set the buffers to be dumped
+	flag_t which_buffers = getWrittenBuffers();
+
 	// run post-process filters and dump their arrays
 	// TODO migrate post-processing commands to command structure
 	for (auto const& flt : enabledPostProcess) {
@@ -1844,6 +2686,41 @@ void GPUSPH::saveParticles(
 
 	// triggers Writer->write()
 	doWrite(write_flags);
+
+	m_writeTime += cmd_time_clock::now() - write_start;
+}
+
+/*! Post-processing engines that accumulate data during the simulation
+ * (e.g. STATISTICS) are asked which buffers they need at the current time:
+ * these are downloaded from the devices, and the engines sample them on host.
+ * Since the sampling time is the same for all processes, this can involve
+ * network operations.
+ */
+void GPUSPH::samplePostProcess()
+{
+	for (auto const& flt : gdata->simframework->getPostProcEngines()) {
+		AbstractPostProcessEngine *engine = flt.second;
+
+		const flag_t sampled_buffers = engine->get_sampled_buffers(gdata->t);
+		if (sampled_buffers == NO_FLAGS)
+			continue;
+
+		const cmd_time_clock::time_point sample_start = cmd_time_clock::now();
+
+		CommandStruct dump(DUMP);
+		dump.reading("step n", sampled_buffers);
+		dispatchCommand(dump);
+
+		engine->hostSample(gdata);
+
+		m_writeTime += cmd_time_clock::now() - sample_start;
+	}
+}
+
+void GPUSPH::flushPostProcess()
+{
+	for (auto const& flt : gdata->simframework->getPostProcEngines())
+		flt.second->hostFlush(gdata);
 }
 
 // scan and check the peak number of neighbors and the estimated number of interactions
@@ -1875,7 +2752,40 @@ void GPUSPH::runCommand<CHECK_NEIBSNUM>(CommandStruct const& cmd)
 		gdata->lastGlobalNumInteractions += gdata->timingInfo[d].numInteractions;
 	}
 
+	// track the interval between constructions, for the average rebuild interval
+	if (gdata->last_buildneibs_iteration != ULONG_MAX &&
+		gdata->iterations > gdata->last_buildneibs_iteration) {
+		gdata->neibsRebuildIterations += gdata->iterations - gdata->last_buildneibs_iteration;
+		gdata->neibsRebuilds++;
+	}
+
 	gdata->last_buildneibs_iteration = gdata->iterations;
+	gdata->neibsDisplacement = 0;
+}
+
+// bound the displacement of the particles since the last neighbors list construction
+template<>
+void GPUSPH::runCommand<UPDATE_NEIBS_DISPLACEMENT>(CommandStruct const& cmd)
+{
+	float& maxSpeed = gdata->h_maxSpeed[0];
+	for (uint d = 1; d < gdata->devices; d++)
+		maxSpeed = fmaxf(maxSpeed, gdata->h_maxSpeed[d]);
+
+	const double dt = cmd.dt(gdata);
+	auto accumulate = [this, &maxSpeed, dt]() {
+		gdata->neibsMaxSpeed = maxSpeed;
+		gdata->neibsDisplacement += double(maxSpeed)*dt;
+		// the next time-step samples its speeds from scratch
+		for (uint d = 0; d < gdata->devices; d++)
+			gdata->h_maxSpeed[d] = 0.0f;
+	};
+
+	// in multi-node, the network maximum is found in the end-of-step reduction,
+	// and the displacement is only updated then
+	if (MULTI_NODE)
+		gdata->networkManager->queueReduction(&maxSpeed, 1, MAX_REDUCTION, accumulate);
+	else
+		accumulate();
 }
 
 // find if new particles were created on any device
@@ -1886,13 +2796,12 @@ void GPUSPH::runCommand<CHECK_NEWNUMPARTS>(CommandStruct const& cmd)
 	gdata->particlesCreated = gdata->particlesCreatedOnNode[0];
 	for (uint d = 1; d < gdata->devices; d++)
 		gdata->particlesCreated |= gdata->particlesCreatedOnNode[d];
-	// if runnign multinode, should also find the network minimum
-	if (MULTI_NODE)
-		gdata->networkManager->networkBoolReduction(
-			&(gdata->particlesCreated), 1);
 
 	// update the it counter if new particles are created
-	if (gdata->particlesCreated) {
+	auto count_created = [this]() {
+		if (!gdata->particlesCreated)
+			return;
+
 		gdata->createdParticlesIterations++;
 
 		/*** IMPORTANT: updateArrayIndices() is only useful to be able to dump
@@ -1914,7 +2823,19 @@ void GPUSPH::runCommand<CHECK_NEWNUMPARTS>(CommandStruct const& cmd)
 		// call
 		updateArrayIndices();
 #endif
-	}
+	};
+
+	// if runnign multinode, should also find the network minimum;
+	// this is folded into the end-of-step reduction, since the result
+	// is only needed at the next neighbors list check
+	if (MULTI_NODE)
+		gdata->networkManager->queueReduction(
+			&(gdata->particlesCreated), 1, count_created);
+	else
+		count_created();
+
+	// make room for the particles to be created in the next steps
+	checkParticleCapacity();
 }
 
 //! Invoke system callbacks
@@ -1938,7 +2859,7 @@ void GPUSPH::runCommand<RUN_CALLBACKS>(CommandStruct const& cmd)
 void GPUSPH::printStatus(FILE *out)
 {
 //#define ti timingInfo
-	fprintf(out, "%s time t=%es, iteration=%s, dt=%es, %s parts (%.2g, cum. %.2g MIPPS), maxneibs %u+%u\n",
+	fprintf(out, "%s time t=%es, iteration=%s, dt=%es, %s parts (%.2g, cum. %.2g MIPPS), maxneibs %u+%u",
 		gdata->run_mode_Desc(),
 			//"mean %e neibs. in %es, %e neibs/s, max %u neibs\n"
 			//"mean neib list in %es\n"
@@ -1953,6 +2874,20 @@ void GPUSPH::printStatus(FILE *out)
 			//ti.meanTimeNeibsList,
 			//ti.meanTimeEuler
 			);
+	// with adaptive neighbors list rebuilding, also show the average rebuild interval
+	if (problem->simparams()->adaptive_neibs && gdata->neibsRebuilds > 0)
+		fprintf(out, ", neibs every %.3g it",
+			double(gdata->neibsRebuildIterations)/gdata->neibsRebuilds);
+	// with asynchronous bodies integration, show the last body solve time
+	// and how much of it was overlapped with device work
+	if (m_lastBodiesTiming.count > 0) {
+		using ms = chrono::duration<double, milli>;
+		const double solve = ms(m_lastBodiesTiming.solve).count();
+		const double overlap = ms(m_lastBodiesTiming.overlap()).count();
+		fprintf(out, ", bodies %.3gms (%.0f%% overlapped)",
+			solve, solve > 0 ? 100*overlap/solve : 0.0);
+	}
+	fputc('\n', out);
 	fflush(out);
 	// output to the info stream is always overwritten
 	if (out == m_info_stream)
@@ -2217,8 +3152,9 @@ void GPUSPH::runCommand<FIND_MAX_IOWATERDEPTH>(CommandStruct const& cmd)
 	}
 	// if we are in multi-node mode we need to run an mpi reduction over all nodes
 	if (MULTI_NODE) {
-		gdata->networkManager->networkIntReduction(
+		gdata->networkManager->queueReduction(
 			(int*)max_waterdepth, numOpenBoundaries, MAX_REDUCTION);
+		gdata->networkManager->completeReductions();
 	}
 	// copy global value back to one array so that we can upload it again
 	for (uint ob = 0; ob < numOpenBoundaries; ob ++)
@@ -2307,8 +3243,9 @@ void GPUSPH::runCommand<JACOBI_STOP_CRITERION>(CommandStruct const& cmd)
 
 	// if we are in multi-node mode we need to run an mpi reduction over all nodes
 	if (MULTI_NODE) {
-		gdata->networkManager->networkFloatReduction(&(gdata->h_jacobiResidual[0]), 1, MAX_REDUCTION);
-		gdata->networkManager->networkFloatReduction(&(gdata->h_jacobiBackwardError[0]), 1, MAX_REDUCTION);
+		gdata->networkManager->queueReduction(&(gdata->h_jacobiResidual[0]), 1, MAX_REDUCTION);
+		gdata->networkManager->queueReduction(&(gdata->h_jacobiBackwardError[0]), 1, MAX_REDUCTION);
+		gdata->networkManager->completeReductions();
 	}
 
 	if ((gdata->h_jacobiBackwardError[0] < gdata->problem->simparams()->jacobi_backerr &&
@@ -2320,6 +3257,90 @@ void GPUSPH::runCommand<JACOBI_STOP_CRITERION>(CommandStruct const& cmd)
 	}
 }
 
+//! Reduce the Krylov effective pressure solver dot products and residual
+//! (and optionally the boundary conditions backward error) across devices and nodes
+static void
+reduce_krylov_dots(GlobalData *gdata, bool with_backerr)
+{
+	for (int d=1; d < gdata->devices; ++d) {
+		gdata->h_krylovGamma[0] += gdata->h_krylovGamma[d];
+		gdata->h_krylovDelta[0] += gdata->h_krylovDelta[d];
+		gdata->h_jacobiResidual[0] = fmaxf(gdata->h_jacobiResidual[0], gdata->h_jacobiResidual[d]);
+		if (with_backerr)
+			gdata->h_jacobiBackwardError[0] = fmaxf(gdata->h_jacobiBackwardError[0], gdata->h_jacobiBackwardError[d]);
+	}
+
+	// a single network collective for all the values
+	if (MULTI_NODE) {
+		gdata->networkManager->queueReduction(&(gdata->h_krylovGamma[0]), 1, SUM_REDUCTION);
+		gdata->networkManager->queueReduction(&(gdata->h_krylovDelta[0]), 1, SUM_REDUCTION);
+		gdata->networkManager->queueReduction(&(gdata->h_jacobiResidual[0]), 1, MAX_REDUCTION);
+		if (with_backerr)
+			gdata->networkManager->queueReduction(&(gdata->h_jacobiBackwardError[0]), 1, MAX_REDUCTION);
+		gdata->networkManager->completeReductions();
+	}
+}
+
+template<>
+void GPUSPH::runCommand<KRYLOV_INIT_COEFFICIENTS>(CommandStruct const& cmd)
+{
+	reduce_krylov_dots(gdata, true);
+
+	// when restarting after an update of the boundary conditions,
+	// the iterations keep counting towards jacobi_maxiter
+	if (!gdata->h_krylovRestart)
+		gdata->h_jacobiCounter = 0;
+	gdata->h_krylovRestart = false;
+	gdata->h_jacobiStop = false;
+
+	const float gamma = gdata->h_krylovGamma[0];
+	const float delta = gdata->h_krylovDelta[0];
+
+	gdata->h_krylovBeta = 0.0f;
+	gdata->h_krylovAlpha = delta != 0 ? gamma/delta : 0.0f;
+	gdata->h_krylovPrevGamma = gamma;
+	gdata->h_krylovPrevAlpha = gdata->h_krylovAlpha;
+}
+
+template<>
+void GPUSPH::runCommand<KRYLOV_STOP_CRITERION>(CommandStruct const& cmd)
+{
+	reduce_krylov_dots(gdata, false);
+
+	const SimParams *sp = gdata->problem->simparams();
+
+	++gdata->h_jacobiCounter;
+
+	// The system is solved for the current boundary conditions: we're done if they
+	// did not change significantly, otherwise we update them and restart the solver
+	if (gdata->h_jacobiResidual[0] < sp->jacobi_residual) {
+		if (gdata->h_jacobiBackwardError[0] < sp->jacobi_backerr)
+			gdata->h_jacobiStop = true;
+		else
+			gdata->h_krylovRestart = true;
+	}
+	if (gdata->h_jacobiCounter > (int)sp->jacobi_maxiter) {
+		gdata->h_jacobiStop = true;
+		gdata->h_krylovRestart = false;
+	}
+	if (gdata->h_jacobiStop || gdata->h_krylovRestart)
+		return;
+
+	// Chronopoulos-Gear coefficients for the next step
+	const float gamma = gdata->h_krylovGamma[0];
+	const float delta = gdata->h_krylovDelta[0];
+	const float prevGamma = gdata->h_krylovPrevGamma;
+	const float prevAlpha = gdata->h_krylovPrevAlpha;
+
+	const float beta = prevGamma != 0 ? gamma/prevGamma : 0.0f;
+	const float denom = delta - (prevAlpha != 0 ? beta*gamma/prevAlpha : 0.0f);
+
+	gdata->h_krylovBeta = beta;
+	gdata->h_krylovAlpha = denom != 0 ? gamma/denom : 0.0f;
+	gdata->h_krylovPrevGamma = gamma;
+	gdata->h_krylovPrevAlpha = gdata->h_krylovAlpha;
+}
+
 //! Auxiliary class to time a command execution
 //! The TimerObject itself checks the time from its own creation to its own destruction,
 //! and updates two associated durations (max and total).
@@ -2352,6 +3373,15 @@ struct TimerObject
 	}
 };
 
+// have the workers run all the commands in the batch, with a single synchronization
+// at the end
+void GPUSPH::dispatchCommandBatch(std::vector<CommandStruct const*> const& batch)
+{
+	gdata->nextCommandBatch = &batch;
+	dispatchCommand(CommandStruct(RUN_COMMAND_BATCH));
+	gdata->nextCommandBatch = NULL;
+}
+
 // set nextCommand, unlock the threads and wait for them to complete
 void GPUSPH::dispatchCommand(CommandStruct const& cmd)
 {
@@ -2372,8 +3402,8 @@ void GPUSPH::dispatchCommand(CommandStruct const& cmd)
 	 memset(gdata->s_hInfo, 0, infoSize);
 	 } */
 
-	if (MULTI_NODE && gdata->networkManager->checkKillRequest())
-		throw runtime_error("GPUSPH killed by MPI kill request");
+	// Kill requests from other processes are checked while waiting for the
+	// fused end-of-step network reduction, see NetworkManager::completeReductions()
 
 	if (cmd.command > NUM_WORKER_COMMANDS) {
 		switch (cmd.command) {
@@ -2391,8 +3421,12 @@ void GPUSPH::dispatchCommand(CommandStruct const& cmd)
 	}
 
 	gdata->nextCommand = cmd;
+	const cmd_time_clock::time_point wait_start = m_metrics ?
+		cmd_time_clock::now() : cmd_time_clock::time_point();
 	gdata->threadSynchronizer->barrier(); // unlock CYCLE BARRIER 2
 	gdata->threadSynchronizer->barrier(); // wait for completion of last command and unlock CYCLE BARRIER 1
+	if (m_metrics)
+		m_barrierTime += cmd_time_clock::now() - wait_start;
 
 	if (!gdata->keep_going)
 		throw runtime_error("GPUSPH aborted by worker thread");
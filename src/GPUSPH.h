@@ -34,6 +34,7 @@
 
 #include <cstdio>
 #include <type_traits>
+#include <future>
 
 #include "Options.h"
 #include "GlobalData.h"
@@ -44,6 +45,9 @@
 // IPPSCounter
 #include "timing.h"
 
+// MetricsExporter
+#include "MetricsExporter.h"
+
 // The GPUSPH class is singleton. Wise tips about a correct singleton implementation are give here:
 // http://stackoverflow.com/questions/1008019/c-singleton-design-pattern
 
@@ -77,6 +81,12 @@ private:
 	float m_peakParticleSpeed;
 	double m_peakParticleSpeedTime; // ...and when
 
+	// number of threads used for host-side loops (e.g. in doWrite())
+	uint m_hostThreads;
+
+	// set when a device could not grow its particle storage anymore
+	bool m_particleStorageCapped;
+
 	// other vars
 	bool initialized;
 	bool repacked;
@@ -95,6 +105,45 @@ protected:
 	cmd_time_duration tot_cmd_time[NUM_COMMANDS];
 	unsigned long cmd_calls[NUM_COMMANDS];
 
+	//! Asynchronous moving bodies integration, started by MOVE_BODIES
+	//! and joined by JOIN_BODIES; returns the time taken by the body solver
+	std::future<cmd_time_duration> m_bodiesSolve;
+
+	//! Timing of the asynchronous bodies integration
+	struct BodiesTiming {
+		cmd_time_duration solve; ///< time spent in the body solver
+		cmd_time_duration wait; ///< time spent waiting for it at the join point
+		unsigned long count; ///< number of solves
+
+		BodiesTiming() : solve(), wait(), count(0) {}
+
+		void add(cmd_time_duration const& s, cmd_time_duration const& w)
+		{ solve += s; wait += w; ++count; }
+
+		//! Time during which the body solver ran concurrently with the other work
+		cmd_time_duration overlap() const
+		{ return solve > wait ? solve - wait : cmd_time_duration(); }
+	};
+	BodiesTiming m_lastBodiesTiming; ///< timing of the last body solve
+	BodiesTiming m_totBodiesTiming; ///< timing of all body solves
+
+	std::vector<CommandStruct const*> m_commandBatch; ///< commands being dispatched together
+
+	//! Time taken by initialize()
+	cmd_time_duration m_setupTime;
+
+	//! Live metrics exporter, if enabled
+	std::unique_ptr<MetricsExporter> m_metrics;
+	//! Time spent dumping and writing, for the metrics
+	cmd_time_duration m_writeTime;
+	//! Time the main thread spent waiting for the workers, for the metrics
+	cmd_time_duration m_barrierTime;
+
+	//! Start the live metrics exporter, if requested
+	void startMetrics();
+	//! Publish the current values of the live metrics
+	void publishMetrics();
+
 private:
 	// constructor and copy/assignment: private for singleton scheme
 	GPUSPH();
@@ -103,6 +152,8 @@ private:
 
 	void resetCommandTimes();
 	void showCommandTimes();
+	//! Write the machine-readable performance report requested with --bench-report
+	void writeBenchReport(bool all_ok);
 
 	// open/close/write the info stream
 	void openInfoStream();
@@ -111,6 +162,10 @@ private:
 	// (de)allocation of shared host buffers
 	size_t allocateGlobalHostBuffers();
 	void deallocateGlobalHostBuffers();
+	// grow the shared host buffers to the current number of allocated particles
+	size_t resizeGlobalHostBuffers(uint prevAllocatedParticles);
+	// grow the particle storage when its occupancy crosses the high-water mark
+	void checkParticleCapacity();
 
 	// check consistency of buffers across multiple GPUs
 	void checkBufferConsistency(CommandStruct const&);
@@ -127,6 +182,12 @@ private:
 	// perform post-filling operations
 	void prepareProblem();
 
+	//! Estimate the particles and device memory of the simulation, for --dry-run
+	bool planCapacity();
+
+	//! Determine which ephemeral device buffers can share their storage
+	void setupBufferAliasing(Integrator const& integrator);
+
 	/// Function template to run a specific command
 	/*! There should be a specialization of the template for each
 	 * (supported) command
@@ -142,6 +203,8 @@ private:
 	// to complete
 	void dispatchCommand(CommandStruct const& cmd);
 	void dispatchCommand(CommandStruct cmd, flag_t flags);
+	// dispatch a sequence of worker commands that can run back to back
+	void dispatchCommandBatch(std::vector<CommandStruct const*> const& batch);
 
 	// sets the correct viscosity coefficient according to the one set in SimParams
 	void setViscosityCoefficient();
@@ -152,10 +215,19 @@ private:
 	// use the writer, with additional options about forced writes
 	void doWrite(WriteFlags const& write_flags);
 
+	// the buffers saved on every write, before post-processing
+	flag_t getWrittenBuffers() const;
+
 	// save the particle system to disk
 	void saveParticles(PostProcessEngineSet const& enabledPostProcess,
 		std::string const& state, WriteFlags const& write_flags);
 
+	// let the sampling post-processing engines sample the particle system
+	void samplePostProcess();
+
+	// let the sampling post-processing engines write out their data
+	void flushPostProcess();
+
 	//! Rebuild the neighbor list
 	void buildNeibList();
 
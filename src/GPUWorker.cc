@@ -104,8 +104,12 @@ GPUWorker::GPUWorker(GlobalData* _gdata, devcount_t _deviceIndex) :
 	m_asyncH2DCopiesStream(0),
 	m_asyncD2HCopiesStream(0),
 	m_asyncPeerCopiesStream(0),
-	m_halfForcesEvent(0)
+	m_halfForcesEvent(0),
+	m_commandDoneEvent(0)
 {
+	// with asynchronous commands, don't synchronize on every error check
+	cuda_sync_checks() = !gdata->clOptions->async_commands;
+
 	printf("number of forces rigid bodies particles = %d\n", m_numForcesBodiesParticles);
 
 	m_dBuffers.setAllocPolicy(gdata->simframework->getAllocPolicy());
@@ -183,6 +187,8 @@ GPUWorker::GPUWorker(GlobalData* _gdata, devcount_t _deviceIndex) :
 	if (m_simparams->rheologytype == GRANULAR) {
 		m_dBuffers.addBuffer<CUDABuffer, BUFFER_EFFPRES>();
 		m_dBuffers.addBuffer<CUDABuffer, BUFFER_JACOBI>();
+		if (m_simparams->effpres_krylov)
+			m_dBuffers.addBuffer<CUDABuffer, BUFFER_KRYLOV>();
 	}
 
 	if (m_simparams->boundarytype == SA_BOUNDARY &&
@@ -210,6 +216,14 @@ GPUWorker::GPUWorker(GlobalData* _gdata, devcount_t _deviceIndex) :
 		m_dBuffers.addBuffer<CUDABuffer, BUFFER_INTERNAL_ENERGY_UPD>(0);
 	}
 
+	// ephemeral buffers that are never live at the same time share their storage
+	if (!gdata->s_bufferInterference.empty()) {
+		const size_t saved = m_dBuffers.alias_buffers(gdata->s_bufferInterference);
+		if (m_deviceIndex == 0 && saved > 0)
+			printf("Buffer aliasing saves %zuB/particle (%s)\n",
+				saved, m_dBuffers.inspect_aliases().c_str());
+	}
+
 	// all workers begin with an "initial upload” state in their particle system,
 	// to hold all the buffers that will be initialized from host
 	m_dBuffers.initialize_state("initial upload");
@@ -244,10 +258,10 @@ uint GPUWorker::getMaxParticles() const
 	return m_numAllocatedParticles;
 }
 
-// Compute the bytes required for each particle.
-size_t GPUWorker::computeMemoryPerParticle()
+// Compute the bytes required for each particle by each buffer.
+vector<pair<flag_t, size_t>> GPUWorker::computeMemoryPerParticleByBuffer()
 {
-	size_t tot = 0;
+	vector<pair<flag_t, size_t>> ret;
 
 	set<flag_t>::const_iterator it = m_dBuffers.get_keys().begin();
 	const set<flag_t>::const_iterator stop = m_dBuffers.get_keys().end();
@@ -265,12 +279,23 @@ size_t GPUWorker::computeMemoryPerParticle()
 		else if (key == BUFFER_PARTINDEX)
 			contrib *= 2;
 
-		tot += contrib;
+		ret.push_back(make_pair(key, contrib));
+		++it;
+	}
+
+	return ret;
+}
+
+// Compute the bytes required for each particle.
+size_t GPUWorker::computeMemoryPerParticle()
+{
+	size_t tot = 0;
+
+	for (auto const& contrib : computeMemoryPerParticleByBuffer()) {
+		tot += contrib.second;
 #if _DEBUG_
-		//printf("with %s: %zu\n", buf->second->get_buffer_name(), tot);
-		// TODO: FIXME buf not declared
+		//printf("with %s: %zu\n", getBufferName(contrib.first), tot);
 #endif
-		++it;
 	}
 
 	// TODO
@@ -327,8 +352,10 @@ void GPUWorker::computeAndSetAllocableParticles()
 
 	freeMemory -= memPerCells;
 
+	gdata->memPerParticle[m_deviceIndex] = computeMemoryPerParticle();
+
 	// keep num allocable particles rounded to the next multiple of 4, to improve reductions' performances
-	uint numAllocableParticles = round_up<uint>(freeMemory / computeMemoryPerParticle(), 4);
+	uint numAllocableParticles = round_up<uint>(freeMemory / gdata->memPerParticle[m_deviceIndex], 4);
 
 	if (numAllocableParticles < gdata->allocatedParticles)
 		printf("NOTE: device %u can allocate %u particles, while the whole simulation might require %u\n",
@@ -933,6 +960,9 @@ void GPUWorker::importExternalCells(CommandStruct const& cmd)
 {
 	if (gdata->debug.check_buffer_update) checkBufferUpdate(cmd);
 
+	if (gdata->clOptions->async_commands)
+		waitEnqueuedWork();
+
 	if (cmd.command == APPEND_EXTERNAL)
 		transferBurstsSizes();
 	if ( (cmd.command == APPEND_EXTERNAL) || (cmd.command == UPDATE_EXTERNAL) )
@@ -981,6 +1011,43 @@ size_t GPUWorker::allocateHostBuffers() {
 	return allocated;
 }
 
+size_t GPUWorker::getBufferElements(flag_t key) const
+{
+	// used to set up the number of elements in CFL arrays,
+	// will only actually be used if adaptive timestepping is enabled
+	const uint fmaxElements = forcesEngine->getFmaxElements(m_numAllocatedParticles);
+	const uint tempCflEls = forcesEngine->getFmaxTempElements(fmaxElements);
+
+	// number of elements to allocate
+	// most have m_numAllocatedParticles. Exceptions follow
+	size_t nels = m_numAllocatedParticles;
+
+	if (key == BUFFER_NEIBSLIST)
+		nels *= m_simparams->neiblistsize; // number of particles times neib list size
+	else if (key & BUFFERS_RB_PARTICLES)
+		nels = m_numForcesBodiesParticles; // number of particles in rigid bodies
+	else if (key & BUFFERS_CELL)
+		nels = m_nGridCells; // cell buffers are sized by number of cells
+	else if (key == BUFFER_CFL_TEMP)
+		nels = tempCflEls;
+	else if (key & BUFFERS_CFL) { // other CFL buffers
+		// TODO FIXME BUFFER_CFL_GAMMA needs to be as large as the whole system,
+		// because it's updated progressively across split forces calls. We could
+		// do with sizing it just like that, but then during the finalizeforces
+		// reductions with striping we would risk overwriting some of the data.
+		// To solve this, we size it as the _sum_ of the two, and will use
+		// the first numAllocatedParticles for the split-force-calls accumulation,
+		// and the remaining fmaxElements for the finalize.
+		// this should be improved
+		if (key == BUFFER_CFL_GAMMA)
+			nels = round_up(nels, size_t(4)) + fmaxElements;
+		else
+			nels = fmaxElements;
+	}
+
+	return nels;
+}
+
 size_t GPUWorker::allocateDeviceBuffers() {
 	// common sizes
 	// compute common sizes (in bytes)
@@ -989,43 +1056,11 @@ size_t GPUWorker::allocateDeviceBuffers() {
 
 	size_t allocated = 0;
 
-	// used to set up the number of elements in CFL arrays,
-	// will only actually be used if adaptive timestepping is enabled
-
-	const uint fmaxElements = forcesEngine->getFmaxElements(m_numAllocatedParticles);
-	const uint tempCflEls = forcesEngine->getFmaxTempElements(fmaxElements);
 	set<flag_t>::const_iterator iter = m_dBuffers.get_keys().begin();
 	set<flag_t>::const_iterator stop = m_dBuffers.get_keys().end();
 	while (iter != stop) {
 		const flag_t key = *iter;
-		// number of elements to allocate
-		// most have m_numAllocatedParticles. Exceptions follow
-		size_t nels = m_numAllocatedParticles;
-
-		if (key == BUFFER_NEIBSLIST)
-			nels *= m_simparams->neiblistsize; // number of particles times neib list size
-		else if (key & BUFFERS_RB_PARTICLES)
-			nels = m_numForcesBodiesParticles; // number of particles in rigid bodies
-		else if (key & BUFFERS_CELL)
-			nels = m_nGridCells; // cell buffers are sized by number of cells
-		else if (key == BUFFER_CFL_TEMP)
-			nels = tempCflEls;
-		else if (key & BUFFERS_CFL) { // other CFL buffers
-			// TODO FIXME BUFFER_CFL_GAMMA needs to be as large as the whole system,
-			// because it's updated progressively across split forces calls. We could
-			// do with sizing it just like that, but then during the finalizeforces
-			// reductions with striping we would risk overwriting some of the data.
-			// To solve this, we size it as the _sum_ of the two, and will use
-			// the first numAllocatedParticles for the split-force-calls accumulation,
-			// and the remaining fmaxElements for the finalize.
-			// this should be improved
-			if (key == BUFFER_CFL_GAMMA)
-				nels = round_up(nels, size_t(4)) + fmaxElements;
-			else
-				nels = fmaxElements;
-		}
-
-		allocated += m_dBuffers.alloc(key, nels);
+		allocated += m_dBuffers.alloc(key, getBufferElements(key));
 		++iter;
 	}
 
@@ -1119,6 +1154,7 @@ void GPUWorker::createEventsAndStreams()
 	cudaStreamCreateWithFlags(&m_asyncPeerCopiesStream, cudaStreamNonBlocking);
 	// init events
 	cudaEventCreate(&m_halfForcesEvent);
+	cudaEventCreateWithFlags(&m_commandDoneEvent, cudaEventDisableTiming);
 }
 
 void GPUWorker::destroyEventsAndStreams()
@@ -1129,6 +1165,28 @@ void GPUWorker::destroyEventsAndStreams()
 	cudaStreamDestroy(m_asyncPeerCopiesStream);
 	// destroy events
 	cudaEventDestroy(m_halfForcesEvent);
+	cudaEventDestroy(m_commandDoneEvent);
+}
+
+/* With asynchronous commands, the kernels enqueued by the previous commands may still
+ * be running when we start importing data, both on this device (which may still be
+ * reading the buffers we are about to overwrite) and on the peers (which may still be
+ * producing the data we are about to read). The copy streams are non-blocking,
+ * so they have to wait explicitly for the corresponding events.
+ */
+void GPUWorker::waitEnqueuedWork()
+{
+	CUDA_SAFE_CALL_NOSYNC(cudaStreamWaitEvent(m_asyncH2DCopiesStream, m_commandDoneEvent, 0));
+	CUDA_SAFE_CALL_NOSYNC(cudaStreamWaitEvent(m_asyncD2HCopiesStream, m_commandDoneEvent, 0));
+	CUDA_SAFE_CALL_NOSYNC(cudaStreamWaitEvent(m_asyncPeerCopiesStream, m_commandDoneEvent, 0));
+	for (uint d = 0; d < gdata->devices; ++d) {
+		if (d == m_deviceIndex) continue;
+		CUDA_SAFE_CALL_NOSYNC(cudaStreamWaitEvent(m_asyncPeerCopiesStream,
+			gdata->GPUWORKERS[d]->getCommandDoneEvent(), 0));
+	}
+	// GPUDirect network transfers read and write device memory outside of any stream
+	if (MULTI_NODE && gdata->clOptions->gpudirect)
+		CUDA_SAFE_CALL_NOSYNC(cudaEventSynchronize(m_commandDoneEvent));
 }
 
 void GPUWorker::printAllocatedMemory()
@@ -1274,6 +1332,71 @@ void GPUWorker::runCommand<SHARE_BUFFERS>(CommandStruct const& cmd)
 	m_dBuffers.share_buffers(cmd.src, cmd.dst, cmd.flags);
 }
 
+template<>
+void GPUWorker::runCommand<RESIZE_PARTICLE_SYSTEM>(CommandStruct const& cmd)
+{
+	const uint prevAllocatedParticles = m_numAllocatedParticles;
+	uint numAllocatedParticles = gdata->allocatedParticles;
+
+	if (numAllocatedParticles <= prevAllocatedParticles)
+		return;
+
+	// Each buffer is reallocated in turn, so on top of the additional memory
+	// for the new particles we need room for the largest buffer.
+	// The safety margin is the same as in computeAndSetAllocableParticles()
+	size_t totMemory, freeMemory;
+	cudaMemGetInfo(&freeMemory, &totMemory);
+	const size_t safetyMargin = totMemory/32;
+	const size_t memPerParticle = computeMemoryPerParticle();
+	const size_t maxBufferMemory = m_dBuffers.get_memory_occupation(BUFFER_NEIBSLIST,
+		size_t(numAllocatedParticles)*m_simparams->neiblistsize);
+
+	const size_t needed = (numAllocatedParticles - prevAllocatedParticles)*memPerParticle
+		+ maxBufferMemory + safetyMargin;
+	if (needed > freeMemory) {
+		const size_t available = freeMemory > maxBufferMemory + safetyMargin ?
+			freeMemory - maxBufferMemory - safetyMargin : 0;
+		// keep num allocable particles a multiple of 4, to improve reductions' performances
+		numAllocatedParticles = prevAllocatedParticles +
+			(available/memPerParticle)/4*4;
+		if (numAllocatedParticles <= prevAllocatedParticles) {
+			fprintf(stderr, "WARNING: device %u cannot grow past %u particles (%s free)\n",
+				m_deviceIndex, prevAllocatedParticles, gdata->memString(freeMemory).c_str());
+			return;
+		}
+	}
+
+	// buffers whose size does not depend on the number of particles
+	static const flag_t fixed_size_buffers = BUFFERS_RB_PARTICLES | BUFFERS_CELL;
+
+	size_t prevMemory = 0;
+	for (flag_t key : m_dBuffers.get_keys())
+		if (!(key & fixed_size_buffers))
+			prevMemory += m_dBuffers.get_memory_occupation(key, getBufferElements(key));
+
+	m_numAllocatedParticles = numAllocatedParticles;
+
+	size_t allocated = 0;
+	for (flag_t key : m_dBuffers.get_keys()) {
+		if (key & fixed_size_buffers)
+			continue;
+		// the neighbors list holds one row per neighbor slot,
+		// with a stride equal to the number of allocated particles
+		allocated += m_dBuffers.realloc(key, getBufferElements(key),
+			key == BUFFER_NEIBSLIST ? m_simparams->neiblistsize : 1);
+	}
+
+	m_deviceMemory += allocated - prevMemory;
+
+	// the neighbors list stride and end depend on the number of allocated particles
+	uploadEngineConstants();
+
+	printf("Device idx %u: particle storage grown from %s to %s (%s on device)\n",
+		m_deviceIndex, gdata->addSeparators(prevAllocatedParticles).c_str(),
+		gdata->addSeparators(m_numAllocatedParticles).c_str(),
+		gdata->memString(m_deviceMemory).c_str());
+}
+
 
 // Download the subset of the specified buffer to the correspondent shared CPU array.
 // Makes multiple transfers. Only downloads the subset relative to the internal particles.
@@ -2141,6 +2264,10 @@ void GPUWorker::runCommand<FORCES_ENQUEUE>(CommandStruct const& cmd)
 
 		// the following event will be used to wait for the first stripe to complete
 		cudaEventRecord(m_halfForcesEvent, 0);
+		// the halo import only needs the first stripe too, so that it can overlap
+		// with the second one (see executeCommand())
+		if (MULTI_DEVICE && gdata->clOptions->async_commands)
+			CUDA_SAFE_CALL_NOSYNC(cudaEventRecord(m_commandDoneEvent, 0));
 
 		// enqueue the second kernel call (on the rest)
 		m_forcesKernelTotalNumBlocks += enqueueForcesOnRange(cmd, buffer_lists,
@@ -2156,6 +2283,8 @@ void GPUWorker::runCommand<FORCES_ENQUEUE>(CommandStruct const& cmd)
 		// but let's mark the write buffers as dirty to be consistent with the workers
 		// that did do the work
 		buffer_lists.second.mark_dirty();
+		if (MULTI_DEVICE && gdata->clOptions->async_commands)
+			CUDA_SAFE_CALL_NOSYNC(cudaEventRecord(m_commandDoneEvent, 0));
 	}
 }
 
@@ -2986,10 +3115,94 @@ void GPUWorker::runCommand<JACOBI_UPDATE_EFFPRES>(CommandStruct const& cmd)
 	bufwrite.clear_pending_state();
 }
 
-void GPUWorker::uploadConstants()
+template<>
+void GPUWorker::runCommand<KRYLOV_INIT_EFFPRES>(CommandStruct const& cmd)
 {
-	// NOTE: visccoeff must be set before uploading the constants. This is done in GPUSPH main cycle
+	uint numPartsToElaborate = (cmd.only_internal ? m_particleRangeEnd : m_numParticles);
+
+	// is the device empty? (unlikely but possible before LB kicks in)
+	if (numPartsToElaborate == 0) return;
+
+	const BufferList bufread = extractExistingBufferList(m_dBuffers, cmd.reads);
+	BufferList bufwrite = extractExistingBufferList(m_dBuffers, cmd.updates) |
+		extractGeneralBufferList(m_dBuffers, cmd.writes);
+	bufwrite.add_manipulator_on_write("init_krylov_effpres");
+
+	viscEngine->init_krylov_effpres(bufread, bufwrite,
+		m_numParticles,
+		numPartsToElaborate);
+
+	bufwrite.clear_pending_state();
+}
+
+template<>
+void GPUWorker::runCommand<KRYLOV_EFFPRES_MATVEC>(CommandStruct const& cmd)
+{
+	uint numPartsToElaborate = (cmd.only_internal ? m_particleRangeEnd : m_numParticles);
+
+	gdata->h_krylovGamma[m_deviceIndex] = 0.0f;
+	gdata->h_krylovDelta[m_deviceIndex] = 0.0f;
+	gdata->h_jacobiResidual[m_deviceIndex] = 0.0f;
+
+	// is the device empty? (unlikely but possible before LB kicks in)
+	if (numPartsToElaborate == 0) return;
+
+	const BufferList bufread = extractExistingBufferList(m_dBuffers, cmd.reads);
+	BufferList bufwrite = extractExistingBufferList(m_dBuffers, cmd.updates);
+	bufwrite.add_manipulator_on_write("krylov_effpres_matvec");
+
+	const float3 dots = viscEngine->krylov_effpres_matvec(bufread, bufwrite,
+		m_numParticles,
+		numPartsToElaborate,
+		gdata->problem->m_deltap,
+		m_simparams->slength,
+		m_simparams->influenceRadius);
+
+	gdata->h_krylovGamma[m_deviceIndex] = dots.x;
+	gdata->h_krylovDelta[m_deviceIndex] = dots.y;
+	gdata->h_jacobiResidual[m_deviceIndex] = dots.z;
+
+	bufwrite.clear_pending_state();
+}
+
+template<>
+void GPUWorker::runCommand<KRYLOV_UPDATE_EFFPRES>(CommandStruct const& cmd)
+{
+	uint numPartsToElaborate = (cmd.only_internal ? m_particleRangeEnd : m_numParticles);
+
+	// is the device empty? (unlikely but possible before LB kicks in)
+	if (numPartsToElaborate == 0) return;
+
+	const BufferList bufread = extractExistingBufferList(m_dBuffers, cmd.reads);
+	BufferList bufwrite = extractExistingBufferList(m_dBuffers, cmd.updates);
+	bufwrite.add_manipulator_on_write("update_krylov_effpres");
+
+	viscEngine->update_krylov_effpres(bufread, bufwrite,
+		m_numParticles,
+		numPartsToElaborate,
+		gdata->h_krylovAlpha,
+		gdata->h_krylovBeta);
+
+	bufwrite.clear_pending_state();
+}
+
+template<>
+void GPUWorker::runCommand<MAX_SPEED>(CommandStruct const& cmd)
+{
+	uint numPartsToElaborate = (cmd.only_internal ? m_particleRangeEnd : m_numParticles);
+
+	const BufferList bufread = extractExistingBufferList(m_dBuffers, cmd.reads);
+
+	// the speed is sampled at several states during the time-step,
+	// and reset by UPDATE_NEIBS_DISPLACEMENT
+	if (numPartsToElaborate > 0)
+		gdata->h_maxSpeed[m_deviceIndex] = fmaxf(gdata->h_maxSpeed[m_deviceIndex],
+			integrationEngine->max_speed(bufread, numPartsToElaborate));
+}
 
+// Upload the engine constants, which also depend on the number of allocated particles
+void GPUWorker::uploadEngineConstants()
+{
 	// Setting kernels and kernels derivative factors
 	forcesEngine->setconstants(m_simparams, m_physparams, gdata->worldOrigin, gdata->gridSize, gdata->cellSize,
 		m_numAllocatedParticles);
@@ -2999,6 +3212,13 @@ void GPUWorker::uploadConstants()
 		m_numAllocatedParticles);
 	if(!postProcEngines.empty())
 		postProcEngines.begin()->second->setconstants(m_simparams, m_physparams, m_numAllocatedParticles);
+}
+
+void GPUWorker::uploadConstants()
+{
+	// NOTE: visccoeff must be set before uploading the constants. This is done in GPUSPH main cycle
+
+	uploadEngineConstants();
 
 	// Compute maximum viscosity in Newtonian case
 	if (m_simparams->rheologytype == NEWTONIAN)
@@ -3232,6 +3452,49 @@ void GPUWorker::describeCommand(CommandStruct const& cmd)
 
 }
 
+// Run a batch of commands set up by the main thread, back to back
+template<>
+void GPUWorker::runCommand<RUN_COMMAND_BATCH>(CommandStruct const& cmd)
+{
+	for (CommandStruct const* batched : *gdata->nextCommandBatch)
+		executeCommand(*batched);
+}
+
+// Run a single command. Like simulationThread() below, this has to be defined
+// after all the specializations of runCommand
+void GPUWorker::executeCommand(CommandStruct const& cmd)
+{
+	const bool dbg_step_printf = gdata->debug.print_step;
+	const bool dbg_buffer_lists = gdata->debug.inspect_buffer_lists;
+
+	// buffers sharing their storage with others get a clean slate when written,
+	// unless the command overwrites them completely
+	for (auto const& spec : cmd.writes)
+		m_dBuffers.claim_storage(spec.buffers, cmd.overwrites);
+
+	switch (cmd.command) {
+#define DEFINE_COMMAND(code, ...) \
+	case code: \
+		if (dbg_step_printf) describeCommand<code>(cmd); \
+		runCommand<code>(cmd); \
+		break;
+#include "define_worker_commands.h"
+#undef DEFINE_COMMAND
+	default:
+		unknownCommand(cmd.command);
+	}
+	// with asynchronous commands, mark the point at which the work
+	// enqueued so far completes, for the peers that need to access our buffers.
+	// FORCES_ENQUEUE marks it after the first stripe itself: the halo import
+	// that follows must not wait for the second stripe, or striping would be pointless
+	if (MULTI_DEVICE && gdata->clOptions->async_commands && cmd.command != FORCES_ENQUEUE)
+		CUDA_SAFE_CALL_NOSYNC(cudaEventRecord(m_commandDoneEvent, 0));
+	if (dbg_buffer_lists) {
+		string desc = " T " + to_string(m_deviceIndex) + " " + m_dBuffers.inspect();
+		cout << desc << endl;
+	}
+}
+
 // Actual thread calling GPU-methods
 // Note that this has to be defined last because it needs to know about all
 // the specializations of runCommand
@@ -3263,30 +3526,14 @@ void GPUWorker::simulationThread() {
 
 		gdata->threadSynchronizer->barrier();  // end of UPLOAD, begins SIMULATION ***
 
-		const bool dbg_step_printf = gdata->debug.print_step;
-		const bool dbg_buffer_lists = gdata->debug.inspect_buffer_lists;
-
 		// TODO automate the dbg_step_printf output
 		// Here is a copy-paste from the CPU thread worker of branch cpusph, as a canvas
 		while (gdata->keep_going) {
 
 			cmd = gdata->nextCommand;
 
-			switch (cmd.command) {
-#define DEFINE_COMMAND(code, ...) \
-			case code: \
-				if (dbg_step_printf) describeCommand<code>(cmd); \
-				runCommand<code>(cmd); \
-				break;
-#include "define_worker_commands.h"
-#undef DEFINE_COMMAND
-			default:
-				unknownCommand(cmd.command);
-			}
-			if (dbg_buffer_lists) {
-				string desc = " T " + to_string(m_deviceIndex) + " " + m_dBuffers.inspect();
-				cout << desc << endl;
-			}
+			executeCommand(cmd);
+
 			if (gdata->keep_going) {
 				/*
 				// example usage of checkPartValBy*()
@@ -98,6 +98,8 @@ private:
 	GlobalData* getGlobalData();
 	unsigned int getCUDADeviceNumber();
 	devcount_t getDeviceIndex();
+	cudaEvent_t getCommandDoneEvent() const
+	{ return m_commandDoneEvent; }
 
 	// number of particles of the assigned subset
 	uint m_numParticles;
@@ -179,6 +181,9 @@ private:
 
 	// event to synchronize striping
 	cudaEvent_t m_halfForcesEvent;
+	// event marking the completion of the device work enqueued by the last command,
+	// used with asynchronous commands
+	cudaEvent_t m_commandDoneEvent;
 
 	/// Function template to run a specific command
 	/*! There should be a specialization of the template for each
@@ -217,12 +222,20 @@ private:
 	void networkTransfer(uchar peer_gdix, TransferDirection direction, void* _ptr, size_t _size, uint bid = 0);
 
 	size_t allocateHostBuffers();
+	// number of elements of the device buffer with the given key,
+	// for the current number of allocated particles
+	size_t getBufferElements(flag_t key) const;
 	size_t allocateDeviceBuffers();
 	void deallocateHostBuffers();
 	void deallocateDeviceBuffers();
 
 	void createEventsAndStreams();
 	void destroyEventsAndStreams();
+	// make the copy streams wait for the work enqueued by the previous commands
+	void waitEnqueuedWork();
+
+	// run a single command
+	void executeCommand(CommandStruct const& cmd);
 
 	void printAllocatedMemory();
 
@@ -251,6 +264,7 @@ private:
 
 	void createCompactDeviceMap();
 	void uploadCompactDeviceMap();
+	void uploadEngineConstants();
 	void uploadConstants();
 
 	// bodies
@@ -332,6 +346,8 @@ public:
 	// compute the bytes required for each particle/cell
 	size_t computeMemoryPerParticle();
 	size_t computeMemoryPerCell();
+	// bytes required for each particle by each buffer, summed up by computeMemoryPerParticle()
+	std::vector<std::pair<flag_t, size_t>> computeMemoryPerParticleByBuffer();
 	// check how many particles we can allocate at most
 	void computeAndSetAllocableParticles();
 
@@ -170,6 +170,16 @@ struct GlobalData {
 	uint* s_hPartsPerSliceAlongY;
 	uint* s_hPartsPerSliceAlongZ;
 
+	// Estimated fluid and non-fluid particles in each cell, used by the capacity
+	// planning (--dry-run) in place of the particles, which are not generated
+	std::vector<uint> s_hPlannedCellFluid;
+	std::vector<uint> s_hPlannedCellBoundary;
+
+	// For each ephemeral device buffer that may share its storage with others,
+	// the buffers whose live range overlaps with its own (see Integrator::buffer_interference).
+	// Empty if buffer aliasing is disabled
+	std::map<flag_t, flag_t> s_bufferInterference;
+
 	// cellStart, cellEnd, segmentStart (limits of cells of the sam type) for each device.
 	// Note the s(shared)_d(device) prefix, since they're device pointers
 	// TODO migrate them to the buffer mechanism as well
@@ -210,6 +220,16 @@ struct GlobalData {
 	bool save_request;
 	unsigned long iterations;
 	unsigned long last_buildneibs_iteration;
+	//! Upper bound of the particle displacement since the last neighbors list
+	//! construction, used by adaptive neighbors list rebuilding
+	double neibsDisplacement;
+	//! Upper bound of the particle speed during the last time-step, used to predict
+	//! the displacement during the next one
+	float neibsMaxSpeed;
+	//! Number of neighbors list constructions and total number of iterations
+	//! between them, for the average rebuild interval
+	unsigned long neibsRebuilds;
+	unsigned long neibsRebuildIterations;
 	//! Maximum number of iterations to run for during this phase.
 	//! This will be set to the problem-specific SimParams' repack_maxiter
 	//! during the repack phase, and to clOptions' maxiter (if specified by the user)
@@ -234,12 +254,16 @@ struct GlobalData {
 
 	// One TimingInfo per worker, currently used for statistics about neibs and interactions
 	TimingInfo timingInfo[MAX_DEVICES_PER_NODE];
+	// device memory needed for each particle, as computed by each worker
+	size_t memPerParticle[MAX_DEVICES_PER_NODE];
 	uint lastGlobalPeakFluidBoundaryNeibsNum;
 	uint lastGlobalPeakVertexNeibsNum;
 	uint lastGlobalNumInteractions;
 
 	// next command to be executed by workers
 	CommandStruct nextCommand;
+	// commands to be run by the workers on RUN_COMMAND_BATCH
+	std::vector<CommandStruct const*> const* nextCommandBatch;
 
 	// ODE objects
 	int* s_hRbFirstIndex; // first indices: so forces kernel knows where to write rigid body force
@@ -272,12 +296,24 @@ struct GlobalData {
 	// across all devices
 	uint*   h_maxIOwaterdepth;
 
+	// maximum particle speed on each device, across the states sampled in the current time-step
+	float h_maxSpeed[MAX_DEVICES_PER_NODE];
+
 	// Jacobi solver residual and backward error
 	float h_jacobiResidual[MAX_DEVICES_PER_NODE];
 	float h_jacobiBackwardError[MAX_DEVICES_PER_NODE];
 	bool h_jacobiStop;
 	int h_jacobiCounter;
 
+	// Krylov solver partial dot products (r.u and w.u) on each device
+	float h_krylovGamma[MAX_DEVICES_PER_NODE];
+	float h_krylovDelta[MAX_DEVICES_PER_NODE];
+	// Krylov solver step coefficients, and their values at the previous iteration
+	float h_krylovAlpha, h_krylovBeta;
+	float h_krylovPrevAlpha, h_krylovPrevGamma;
+	// the Krylov solver converged, but the boundary conditions did not
+	bool h_krylovRestart;
+
 	// peer accessibility table (indexed with device indices, not CUDA dev nums)
 	bool s_hDeviceCanAccessPeer[MAX_DEVICES_PER_NODE][MAX_DEVICES_PER_NODE];
 
@@ -313,6 +349,10 @@ struct GlobalData {
 		save_request(false),
 		iterations(0),
 		last_buildneibs_iteration(ULONG_MAX),
+		neibsDisplacement(0),
+		neibsMaxSpeed(0),
+		neibsRebuilds(0),
+		neibsRebuildIterations(0),
 		maxiter(ULONG_MAX),
 		t(0.0),
 		dt(0.0f),
@@ -320,6 +360,7 @@ struct GlobalData {
 		lastGlobalPeakVertexNeibsNum(0),
 		lastGlobalNumInteractions(0),
 		nextCommand(IDLE),
+		nextCommandBatch(NULL),
 		s_hRbFirstIndex(NULL),
 		s_hRbLastIndex(NULL),
 		s_hRbDeviceTotalForce(NULL),
@@ -341,6 +382,12 @@ struct GlobalData {
 		for (uint d=0; d < MAX_DEVICES_PER_NODE; d++)
 			dts[d] = 0.0F;
 
+		for (uint d=0; d < MAX_DEVICES_PER_NODE; d++)
+			h_maxSpeed[d] = 0.0f;
+
+		for (uint d=0; d < MAX_DEVICES_PER_NODE; d++)
+			memPerParticle[d] = 0;
+
 		// init Jacobi solver auxiliary data
 		for (uint d=0; d < MAX_DEVICES_PER_NODE; d++) {
 			h_jacobiResidual[d] = NAN;
@@ -348,6 +395,13 @@ struct GlobalData {
 		}
 		h_jacobiStop = false;
 		h_jacobiCounter = 0;
+		for (uint d=0; d < MAX_DEVICES_PER_NODE; d++) {
+			h_krylovGamma[d] = 0.0f;
+			h_krylovDelta[d] = 0.0f;
+		}
+		h_krylovAlpha = h_krylovBeta = 0.0f;
+		h_krylovPrevAlpha = h_krylovPrevGamma = 0.0f;
+		h_krylovRestart = false;
 		// init particlesCreatedOnNode
 		for (uint d=0; d < MAX_DEVICES_PER_NODE; d++)
 			particlesCreatedOnNode[d] = false;
@@ -402,7 +456,11 @@ struct GlobalData {
 		trimmed.x = std::min( std::max(0, cellX), int(gridSize.x)-1);
 		trimmed.y = std::min( std::max(0, cellY), int(gridSize.y)-1);
 		trimmed.z = std::min( std::max(0, cellZ), int(gridSize.z)-1);
+#if MORTON_LINEARIZATION
+		return morton_cell_hash(trimmed, gridSize);
+#else
 		return ( (trimmed.COORD3 * gridSize.COORD2) * gridSize.COORD1 ) + (trimmed.COORD2 * gridSize.COORD1) + trimmed.COORD1;
+#endif
 	}
 	// overloaded
 	uint calcGridHashHost(int3 const& gridPos) const {
@@ -415,11 +473,19 @@ struct GlobalData {
 		if (gridPos.y >= gridSize.y) gridPos.y = 0;
 		if (gridPos.z < 0) gridPos.z = gridSize.z - 1;
 		if (gridPos.z >= gridSize.z) gridPos.z = 0;
+#if MORTON_LINEARIZATION
+		return morton_cell_hash(gridPos, gridSize);
+#else
 		return ( (gridPos.COORD3 * gridSize.COORD2) * gridSize.COORD1 ) + (gridPos.COORD2 * gridSize.COORD1) + gridPos.COORD1;
+#endif
 	}
 
 	// TODO MERGE REVIEW. refactor with next one
 	uint3 calcGridPosFromCellHash(uint cellHash) const {
+#if MORTON_LINEARIZATION
+		const int3 pos = morton_cell_pos(cellHash, gridSize);
+		return make_uint3(pos.x, pos.y, pos.z);
+#else
 		uint3 gridPos;
 
 		gridPos.COORD3 = cellHash / (gridSize.COORD1 * gridSize.COORD2);
@@ -427,10 +493,14 @@ struct GlobalData {
 		gridPos.COORD1 = cellHash - gridPos.COORD2 * gridSize.COORD1 - gridPos.COORD3 * gridSize.COORD1 * gridSize.COORD2;
 
 		return gridPos;
+#endif
 	}
 
 	// reverse the linearized hash of the cell and return the location in gridPos
 	int3 reverseGridHashHost(uint cell_lin_idx) const {
+#if MORTON_LINEARIZATION
+		return morton_cell_pos(cell_lin_idx, gridSize);
+#else
 		int3 res;
 
 		res.COORD3 = cell_lin_idx / (gridSize.COORD2 * gridSize.COORD1);
@@ -438,6 +508,7 @@ struct GlobalData {
 		res.COORD1 = cell_lin_idx - (res.COORD3 * gridSize.COORD2 * gridSize.COORD1) - (res.COORD2 * gridSize.COORD1);
 
 		return make_int3(res.x, res.y, res.z);
+#endif
 	}
 
 	// compute the global device Id of the cell holding globalPos
@@ -646,6 +717,10 @@ struct GlobalData {
 		quit_request = false;
 		save_request = false;
 		iterations = 0;
+		neibsDisplacement = 0;
+		neibsMaxSpeed = 0;
+		neibsRebuilds = 0;
+		neibsRebuildIterations = 0;
 		maxiter = ULONG_MAX;
 		t = 0.0;
 		dt = 0.0f;
@@ -80,15 +80,29 @@ Integrator::enter_phase(size_t phase_idx)
 
 //! A function that determines if we should build the neighbors list
 /**! This is only done every buildneibsfreq or if particles got created,
- * but only if we didn't do it already in this iteration
+ * but only if we didn't do it already in this iteration.
+ * With adaptive neighbors list rebuilding (only during the simulation), the fixed frequency is replaced by
+ * a check on the particle displacement since the last construction:
+ * the list is rebuilt as soon as two particles could move towards each other
+ * by more than the skin between the neighbor search radius and the influence radius
+ * by the end of the coming time-step. The displacement during the coming time-step
+ * is predicted from the speed bound of the last one.
  */
 bool needs_new_neibs(Integrator::Phase const*, GlobalData const* gdata)
 {
 	const unsigned long iterations = gdata->iterations;
 	const SimParams* sp = gdata->problem->simparams();
 
-	return (iterations != gdata->last_buildneibs_iteration) &&
-		((iterations % sp->buildneibsfreq == 0) || gdata->particlesCreated);
+	if (iterations == gdata->last_buildneibs_iteration)
+		return false;
+
+	// the repacking integrator doesn't track the displacement
+	if (sp->adaptive_neibs && gdata->run_mode == SIMULATE)
+		return (gdata->last_buildneibs_iteration == ULONG_MAX) ||
+			gdata->particlesCreated ||
+			(2*(gdata->neibsDisplacement + double(gdata->neibsMaxSpeed)*gdata->dt) >= sp->get_neibs_skin());
+
+	return (iterations % sp->buildneibsfreq == 0) || gdata->particlesCreated;
 }
 
 Integrator::Phase *
@@ -248,3 +262,90 @@ Integrator::buildNeibsPhase(flag_t import_buffers)
 
 	return neibs_phase;
 }
+
+/*! The live ranges are computed with a backward scan of the commands in the
+ * execution sequence: a buffer is live from a command that writes it to the last
+ * command that reads or updates it, and it is dead between a command that
+ * last reads it and the next command that writes it (since writing commands
+ * ignore the previous content of the buffer), or once it's removed from the
+ * states. Any buffer used within a repeating block of phases is considered
+ * live throughout the whole block, since its value may be carried over from
+ * one iteration to the next.
+ */
+map<flag_t, flag_t>
+Integrator::buffer_interference(flag_t candidates) const
+{
+	map<flag_t, flag_t> interference;
+
+	// buffer usage of each command of the execution sequence
+	struct Usage {
+		flag_t used; ///< buffers read, updated or written by the command
+		flag_t killed; ///< buffers whose previous content is discarded by the command
+	};
+	vector<Usage> usage;
+	// [begin, end) usage index of the repeating blocks
+	vector<pair<size_t, size_t>> loops;
+
+	for (PhaseBlock const& block : execution_sequence()) {
+		const size_t block_begin = usage.size();
+		for (Phase const* phase : block.phases) {
+			for (CommandStruct const& cmd : phase->commands()) {
+				flag_t read = NO_FLAGS, written = NO_FLAGS;
+				for (auto const& spec : cmd.reads)
+					read |= spec.buffers;
+				for (auto const& spec : cmd.updates)
+					read |= spec.buffers;
+				for (auto const& spec : cmd.writes)
+					written |= spec.buffers;
+
+				Usage u;
+				u.used = (read | written) & candidates;
+				u.killed = (written & ~read) & candidates;
+				if (cmd.command == REMOVE_STATE_BUFFERS)
+					u.killed |= cmd.flags & candidates;
+				usage.push_back(u);
+			}
+		}
+		if (block.repeats)
+			loops.push_back(make_pair(block_begin, usage.size()));
+	}
+
+	const size_t num_cmds = usage.size();
+	if (num_cmds == 0)
+		return interference;
+
+	// buffers holding a meaningful value during each command
+	vector<flag_t> occupied(num_cmds);
+	flag_t live = NO_FLAGS;
+	flag_t touched = NO_FLAGS;
+	for (size_t i = num_cmds; i-- > 0; ) {
+		Usage const& u = usage[i];
+		occupied[i] = live | u.used;
+		live = (live | u.used) & ~u.killed;
+		touched |= u.used;
+	}
+
+	for (auto const& loop : loops) {
+		flag_t loop_used = NO_FLAGS;
+		for (size_t i = loop.first; i < loop.second; ++i)
+			loop_used |= usage[i].used;
+		for (size_t i = loop.first; i < loop.second; ++i)
+			occupied[i] |= loop_used;
+	}
+
+	// buffers still live at the beginning of the sequence are read before being
+	// written, so their content is needed across time-steps
+	const flag_t aliasable = touched & ~live;
+
+	for (flag_t key = 1; key && key <= aliasable; key <<= 1) {
+		if (!(key & aliasable))
+			continue;
+		flag_t overlap = NO_FLAGS;
+		for (flag_t occ : occupied)
+			if (occ & key)
+				overlap |= occ;
+		interference[key] = overlap & aliasable & ~key;
+	}
+
+	return interference;
+}
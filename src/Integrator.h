@@ -32,6 +32,7 @@
 #ifndef INTEGRATOR_H
 #define INTEGRATOR_H
 
+#include <map>
 #include <memory> // shared_ptr
 #include "command_type.h"
 
@@ -127,6 +128,38 @@ public:
 		///< the function called on reset
 		reset_t m_reset_func;
 
+		///< can consecutive worker commands of this phase be dispatched together?
+		bool m_batchable;
+
+		///< for each command, does it belong to the same batch as the previous one?
+		/* This is recorded the first time it's needed, and recorded again if
+		 * commands have been added to the phase since then
+		 */
+		std::vector<bool> m_joins_previous;
+
+		//! Can the given command be dispatched in a batch with other commands?
+		/*! Host commands need to run on the main thread, and the commands that
+		 * import data from other devices need all devices to have finished
+		 * the previous command, and to not start the next one before the import is done
+		 */
+		static bool batchable_command(CommandName cmd)
+		{
+			return cmd < NUM_WORKER_COMMANDS &&
+				cmd != APPEND_EXTERNAL && cmd != UPDATE_EXTERNAL;
+		}
+
+		//! Record which commands can be batched with the previous one
+		void record_batches()
+		{
+			CommandSequence const& seq = m_command;
+			const size_t num_cmds = seq.size();
+			m_joins_previous.assign(num_cmds, false);
+			for (size_t i = 1; i < num_cmds; ++i)
+				m_joins_previous[i] =
+					batchable_command(seq.at(i-1).command) &&
+					batchable_command(seq.at(i).command);
+		}
+
 		/* The next commands should actually be only accessible to Integrator and its
 		 * derived class, but there is no way to achieve that. We probably should look into
 		 * providing a different interface
@@ -160,6 +193,14 @@ public:
 		void set_reset_function(reset_t reset_func)
 		{ m_reset_func = reset_func; }
 
+		//! Allow the consecutive worker commands of this phase to be dispatched as a batch
+		/*! This should only be set for phases whose command sequence does not depend
+		 * on values computed by the commands themselves, save for what can be
+		 * resolved by the workers when running each command
+		 */
+		void set_batchable(bool batchable = true)
+		{ m_batchable = batchable; }
+
 	public:
 
 		// is this phase empty?
@@ -177,6 +218,16 @@ public:
 		bool should_run(GlobalData const* gdata) const
 		{ return m_should_run(this, gdata); }
 
+		//! Can the next command be dispatched together with the previous one?
+		bool in_batch()
+		{
+			if (!m_batchable || finished_commands())
+				return false;
+			if (m_joins_previous.size() != m_command.size())
+				record_batches();
+			return m_joins_previous[m_cmd_idx];
+		}
+
 		// Is this phase done?
 		bool done(GlobalData const* gdata) const
 		{ return m_is_done(this, gdata); }
@@ -202,12 +253,17 @@ public:
 			m_cmd_idx(0),
 			m_should_run(default_should_run),
 			m_is_done(default_is_done),
-			m_reset_func(default_reset)
+			m_reset_func(default_reset),
+			m_batchable(false),
+			m_joins_previous()
 		{}
 
 		std::string const& name() const
 		{ return m_name; }
 
+		CommandSequence const& commands() const
+		{ return m_command; }
+
 		CommandStruct const* current_command() const
 		{ return &m_command.at(m_cmd_idx); }
 
@@ -260,6 +316,24 @@ protected:
 	 */
 	Phase * buildNeibsPhase(flag_t import_buffers);
 
+	//! A sequence of phases, in execution order
+	struct PhaseBlock {
+		std::vector<Phase const*> phases;
+		bool repeats; ///< can the sequence run more than once in a row?
+	};
+
+	//! The phases of the initialization and of a time-step, in execution order
+	/*! This is used to determine the live ranges of the ephemeral buffers
+	 * (see buffer_interference()), so phases that only run under some conditions
+	 * should be included, and iterative phases (or sequences of phases) should be
+	 * marked as repeating. The content of the buffers is assumed not to be needed
+	 * past the end of the sequence, i.e. the next time-step must start by removing
+	 * the ephemeral buffers from the states.
+	 * Integrators that do not override this do not allow buffer aliasing.
+	 */
+	virtual std::vector<PhaseBlock> execution_sequence() const
+	{ return std::vector<PhaseBlock>(); }
+
 	// TODO we should move here phase generators that are common between (most)
 	// integrators
 
@@ -283,6 +357,15 @@ public:
 			delete phase;
 	}
 
+	//! Buffers whose live ranges overlap
+	/*! For each of the given candidate buffers whose content is never needed
+	 * across time-steps, the map holds the set of the other candidates that
+	 * are live at the same time as it. Buffers that are missing from the map
+	 * (not used in the execution sequence, or read before being written)
+	 * cannot share their storage with any other buffer.
+	 */
+	std::map<flag_t, flag_t> buffer_interference(flag_t candidates) const;
+
 	// Start the integrator
 	virtual void start()
 	{ enter_phase(0); }
@@ -301,6 +384,15 @@ public:
 			phase = next_phase();
 		return phase->next_command();
 	}
+
+	//! Extend a batch of commands with the following commands in the same phase
+	//! that can run with it without intervening synchronizations
+	void extend_batch(std::vector<CommandStruct const*>& batch)
+	{
+		Phase* phase = current_phase();
+		while (phase->in_batch() && !phase->done(gdata))
+			batch.push_back(phase->next_command());
+	}
 };
 
 #endif
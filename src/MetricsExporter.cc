@@ -0,0 +1,274 @@
+/*  Copyright (c) 2019 INGV, EDF, UniCT, JHU
+
+    Istituto Nazionale di Geofisica e Vulcanologia, Sezione di Catania, Italy
+    Électricité de France, Paris, France
+    Università di Catania, Catania, Italy
+    Johns Hopkins University, Baltimore (MD), USA
+
+    This file is part of GPUSPH. Project founders:
+        Alexis Hérault, Giuseppe Bilotta, Robert A. Dalrymple,
+        Eugenio Rustico, Ciro Del Negro
+    For a full list of authors and project partners, consult the logs
+    and the project website <https://www.gpusph.org>
+
+    GPUSPH is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GPUSPH is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GPUSPH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*! \file
+ * Live metrics export implementation
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "MetricsExporter.h"
+
+using namespace std;
+
+MetricsExporter::Values::Values() :
+	iteration(0),
+	t(0), dt(0),
+	interval_mipps(0), mipps(0),
+	max_fluid_boundary_neibs(0),
+	max_vertex_neibs(0),
+	write_seconds(0), barrier_seconds(0), mpi_seconds(0)
+{
+	for (uint d = 0; d < MAX_DEVICES_PER_NODE; ++d) {
+		particles[d] = 0;
+		host_memory[d] = 0;
+		device_memory[d] = 0;
+	}
+}
+
+MetricsExporter::MetricsExporter(string const& fname, string const& socket_path, double interval,
+	string const& labels, devcount_t devices, unsigned int max_neibs) :
+	m_fname(fname),
+	m_socket_path(socket_path),
+	m_interval(interval),
+	m_labels(labels),
+	m_devices(devices),
+	m_max_neibs(max_neibs),
+	m_values(),
+	m_stop(false),
+	m_thread(),
+	m_socket(-1)
+{}
+
+MetricsExporter::~MetricsExporter()
+{
+	stop();
+}
+
+void MetricsExporter::start()
+{
+	if (!m_socket_path.empty())
+		openSocket();
+	m_thread = thread(&MetricsExporter::run, this);
+}
+
+void MetricsExporter::stop()
+{
+	if (!m_thread.joinable())
+		return;
+	m_stop = true;
+	m_thread.join();
+	closeSocket();
+}
+
+void MetricsExporter::openSocket()
+{
+	struct sockaddr_un addr;
+	if (m_socket_path.size() >= sizeof(addr.sun_path)) {
+		cerr << "WARNING: metrics socket path " << m_socket_path << " too long, socket disabled" << endl;
+		return;
+	}
+
+	m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (m_socket < 0) {
+		cerr << "WARNING: unable to create metrics socket: " << strerror(errno) << endl;
+		return;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, m_socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+	// remove stale sockets from previous runs
+	unlink(m_socket_path.c_str());
+	if (bind(m_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+		listen(m_socket, 8) < 0)
+	{
+		cerr << "WARNING: unable to listen on metrics socket " << m_socket_path << ": " << strerror(errno) << endl;
+		close(m_socket);
+		m_socket = -1;
+		return;
+	}
+	fcntl(m_socket, F_SETFL, fcntl(m_socket, F_GETFL) | O_NONBLOCK);
+	cout << "Metrics socket: " << m_socket_path << endl;
+}
+
+void MetricsExporter::closeSocket()
+{
+	if (m_socket < 0)
+		return;
+	close(m_socket);
+	unlink(m_socket_path.c_str());
+	m_socket = -1;
+}
+
+// helper to emit a metric with its metadata
+static void
+emit(ostream& out, const char *name, const char *type, const char *help,
+	string const& labels, double value)
+{
+	out << "# HELP " << name << " " << help << "\n";
+	out << "# TYPE " << name << " " << type << "\n";
+	out << name << "{" << labels << "} " << value << "\n";
+}
+
+// helper to emit a per-device metric
+template<typename T>
+static void
+emit_per_device(ostream& out, const char *name, const char *help,
+	string const& labels, devcount_t devices, std::atomic<T> const* values)
+{
+	out << "# HELP " << name << " " << help << "\n";
+	out << "# TYPE " << name << " gauge\n";
+	for (devcount_t d = 0; d < devices; ++d)
+		out << name << "{" << labels << ",device=\"" << int(d) << "\"} "
+			<< values[d].load(memory_order_relaxed) << "\n";
+}
+
+// resident set size of this process, in bytes
+static size_t
+resident_memory()
+{
+	size_t pages = 0, resident = 0;
+	ifstream statm("/proc/self/statm");
+	if (!(statm >> pages >> resident))
+		return 0;
+	return resident*sysconf(_SC_PAGESIZE);
+}
+
+string MetricsExporter::format() const
+{
+	Values const& v = m_values;
+	ostringstream out;
+	out.precision(12);
+
+	emit(out, "gpusph_iteration", "counter", "Iterations completed",
+		m_labels, v.iteration.load(memory_order_relaxed));
+	emit(out, "gpusph_simulated_time_seconds", "gauge", "Simulated time",
+		m_labels, v.t.load(memory_order_relaxed));
+	emit(out, "gpusph_dt_seconds", "gauge", "Current time step",
+		m_labels, v.dt.load(memory_order_relaxed));
+	emit(out, "gpusph_mipps", "gauge", "Millions of iterations times particles per second since the last status update",
+		m_labels, v.interval_mipps.load(memory_order_relaxed));
+	emit(out, "gpusph_cumulative_mipps", "gauge", "Millions of iterations times particles per second since the beginning",
+		m_labels, v.mipps.load(memory_order_relaxed));
+	emit_per_device(out, "gpusph_device_particles", "Particles assigned to each device",
+		m_labels, m_devices, v.particles);
+	emit(out, "gpusph_max_fluid_boundary_neibs", "gauge", "Peak number of fluid and boundary neighbors",
+		m_labels, v.max_fluid_boundary_neibs.load(memory_order_relaxed));
+	emit(out, "gpusph_max_vertex_neibs", "gauge", "Peak number of vertex neighbors",
+		m_labels, v.max_vertex_neibs.load(memory_order_relaxed));
+	emit(out, "gpusph_neiblist_size", "gauge", "Size of the neighbors list of each particle",
+		m_labels, m_max_neibs);
+	emit(out, "gpusph_write_seconds_total", "counter", "Time spent dumping and writing the particle data",
+		m_labels, v.write_seconds.load(memory_order_relaxed));
+	emit(out, "gpusph_barrier_wait_seconds_total", "counter", "Time the main thread spent waiting for the workers to complete commands",
+		m_labels, v.barrier_seconds.load(memory_order_relaxed));
+	emit(out, "gpusph_mpi_seconds_total", "counter", "Time spent in the end-of-step network reductions",
+		m_labels, v.mpi_seconds.load(memory_order_relaxed));
+	emit(out, "gpusph_resident_memory_bytes", "gauge", "Resident host memory of the process",
+		m_labels, resident_memory());
+	emit_per_device(out, "gpusph_worker_host_memory_bytes", "Host memory allocated by each worker",
+		m_labels, m_devices, v.host_memory);
+	emit_per_device(out, "gpusph_worker_device_memory_bytes", "Device memory allocated by each worker",
+		m_labels, m_devices, v.device_memory);
+
+	return out.str();
+}
+
+// write to a temporary file and rename, so that readers never see a partial file
+void MetricsExporter::writeFile(string const& text) const
+{
+	const string tmp = m_fname + ".tmp";
+	{
+		ofstream out(tmp);
+		if (!out)
+			return;
+		out << text;
+	}
+	rename(tmp.c_str(), m_fname.c_str());
+}
+
+// send the metrics to all pending clients, and close the connections
+void MetricsExporter::serveClients(string const& text)
+{
+	int client;
+	while ((client = accept(m_socket, NULL, NULL)) >= 0) {
+		const char *data = text.data();
+		size_t remaining = text.size();
+		while (remaining > 0) {
+			ssize_t sent = send(client, data, remaining, MSG_NOSIGNAL);
+			if (sent <= 0)
+				break;
+			data += sent;
+			remaining -= sent;
+		}
+		close(client);
+	}
+}
+
+void MetricsExporter::run()
+{
+	using clock = chrono::steady_clock;
+	const clock::duration interval = chrono::duration_cast<clock::duration>(
+		chrono::duration<double>(m_interval));
+	// how often to check if we should stop
+	const int poll_ms = 200;
+
+	clock::time_point next_write = clock::now();
+
+	while (!m_stop) {
+		if (!m_fname.empty() && clock::now() >= next_write) {
+			writeFile(format());
+			next_write += interval;
+		}
+		if (m_socket < 0) {
+			this_thread::sleep_for(chrono::milliseconds(poll_ms));
+			continue;
+		}
+		struct pollfd pfd = { m_socket, POLLIN, 0 };
+		if (poll(&pfd, 1, poll_ms) > 0)
+			serveClients(format());
+	}
+
+	// make the final values available
+	if (!m_fname.empty())
+		writeFile(format());
+}
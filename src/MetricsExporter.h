@@ -0,0 +1,119 @@
+/*  Copyright (c) 2019 INGV, EDF, UniCT, JHU
+
+    Istituto Nazionale di Geofisica e Vulcanologia, Sezione di Catania, Italy
+    Électricité de France, Paris, France
+    Università di Catania, Catania, Italy
+    Johns Hopkins University, Baltimore (MD), USA
+
+    This file is part of GPUSPH. Project founders:
+        Alexis Hérault, Giuseppe Bilotta, Robert A. Dalrymple,
+        Eugenio Rustico, Ciro Del Negro
+    For a full list of authors and project partners, consult the logs
+    and the project website <https://www.gpusph.org>
+
+    GPUSPH is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GPUSPH is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GPUSPH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*! \file
+ * Live metrics export for long-running simulations
+ *
+ * The main thread publishes the current values of the metrics with plain
+ * (relaxed) atomic stores, and a background thread periodically formats
+ * them in the Prometheus text exposition format, writing them to a file
+ * and/or serving them to the clients connecting to a Unix-domain socket.
+ * The simulation loop never waits on the exporter.
+ */
+
+#ifndef _METRICSEXPORTER_H
+#define _METRICSEXPORTER_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+// devcount_t, MAX_DEVICES_PER_NODE
+#include "multi_gpu_defines.h"
+
+class MetricsExporter
+{
+public:
+	//! Values published by the simulation
+	/*! All stores should be done with std::memory_order_relaxed: the exporter
+	 * only needs each value to be read atomically, not a consistent snapshot
+	 * across values
+	 */
+	struct Values {
+		std::atomic<unsigned long> iteration;
+		std::atomic<double> t; ///< simulated time
+		std::atomic<double> dt;
+		std::atomic<double> interval_mipps; ///< performance since the last status print
+		std::atomic<double> mipps; ///< performance since the beginning of the simulation
+		std::atomic<unsigned int> particles[MAX_DEVICES_PER_NODE];
+		std::atomic<unsigned int> max_fluid_boundary_neibs;
+		std::atomic<unsigned int> max_vertex_neibs;
+		std::atomic<double> write_seconds; ///< time spent dumping and writing
+		std::atomic<double> barrier_seconds; ///< time the main thread spent waiting for the workers
+		std::atomic<double> mpi_seconds; ///< time spent in the end-of-step network reductions
+		std::atomic<size_t> host_memory[MAX_DEVICES_PER_NODE]; ///< host memory allocated by each worker
+		std::atomic<size_t> device_memory[MAX_DEVICES_PER_NODE]; ///< device memory allocated by each worker
+
+		Values();
+	};
+
+private:
+	const std::string m_fname; ///< file to write the metrics to (empty: none)
+	const std::string m_socket_path; ///< Unix-domain socket to serve the metrics on (empty: none)
+	const double m_interval; ///< seconds between file updates
+	const std::string m_labels; ///< labels common to all metrics
+	const devcount_t m_devices; ///< number of devices on this node
+	const unsigned int m_max_neibs; ///< limit for the number of neighbors
+
+	Values m_values;
+
+	std::atomic<bool> m_stop;
+	std::thread m_thread;
+	int m_socket; ///< listening socket, or -1
+
+	void openSocket();
+	void closeSocket();
+	//! Format the current metrics in the Prometheus text format
+	std::string format() const;
+	void writeFile(std::string const& text) const;
+	void serveClients(std::string const& text);
+	void run();
+
+public:
+	/*! The labels are given in Prometheus syntax, without braces,
+	 * e.g. problem="DamBreak3D",rank="0"
+	 */
+	MetricsExporter(std::string const& fname, std::string const& socket_path, double interval,
+		std::string const& labels, devcount_t devices, unsigned int max_neibs);
+	~MetricsExporter();
+
+	//! Start the background thread
+	void start();
+	//! Stop the background thread, writing the final values
+	void stop();
+
+	Values& values()
+	{ return m_values; }
+
+	//! Convenience function to publish a value
+	template<typename T, typename U>
+	static void set(std::atomic<T>& field, U const& value)
+	{ field.store(T(value), std::memory_order_relaxed); }
+};
+
+#endif
@@ -44,12 +44,54 @@
 #define NO_MPI_ERR throw runtime_error("MPI support not compiled in")
 #endif
 
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
 #include "NetworkManager.h"
 // for GlobalData::RANK()
 #include <GlobalData.h>
 
 #if USE_MPI
 static MPI_Request* m_requestsList;
+
+//! Communicator for the checkpoint exchanges, see exchangeCheckpoint()
+static MPI_Comm s_checkpointComm = MPI_COMM_NULL;
+//! Largest chunk of a checkpoint transferred with a single message
+static const size_t checkpoint_chunk = size_t(1) << 30;
+
+/* Fused reductions are packed as doubles (which represent exactly all
+ * the float, int and bool values we reduce), with a per-element reduction
+ * operator. Since MPI user-defined operators only see the data, the operator
+ * table is stored here: it is the same on all processes, because they queue
+ * the same reductions in the same order, and there is at most one fused
+ * reduction in flight.
+ * The message is sent as a single element of a contiguous datatype,
+ * so that MPI never hands the operator a partial segment of it.
+ */
+static std::vector<unsigned char> s_fusedOps;
+static MPI_Op s_fusedOp = MPI_OP_NULL;
+static MPI_Datatype s_fusedType = MPI_DATATYPE_NULL;
+static int s_fusedTypeCount = 0;
+static MPI_Request s_fusedRequest = MPI_REQUEST_NULL;
+
+static void fused_reduction_op(void *invec, void *inoutvec, int *len, MPI_Datatype *)
+{
+	const double *in = (const double *)invec;
+	double *inout = (double *)inoutvec;
+	for (int e = 0; e < *len; ++e) {
+		for (int i = 0; i < s_fusedTypeCount; ++i) {
+			switch (s_fusedOps[i]) {
+			case MIN_REDUCTION: inout[i] = std::min(inout[i], in[i]); break;
+			case MAX_REDUCTION: inout[i] = std::max(inout[i], in[i]); break;
+			case SUM_REDUCTION: inout[i] += in[i]; break;
+			}
+		}
+		in += s_fusedTypeCount;
+		inout += s_fusedTypeCount;
+	}
+}
 #endif
 
 using namespace std;
@@ -71,9 +113,12 @@ NetworkManager::NetworkManager() {
 	// MPIRequests for asynchronous calls
 	m_numRequests = 0;
 	m_requestsCounter = 0;
+	m_threadMultiple = false;
 #if USE_MPI
 	m_requestsList = NULL;
 #endif
+
+	m_reductionSeconds = 0;
 }
 
 NetworkManager::~NetworkManager() {
@@ -107,6 +152,9 @@ void NetworkManager::initNetwork() {
 		printf("NetworkManager: no complete thread safety, current level: %d\n", result);
 		// MPI_Abort(MPI_COMM_WORLD, 1);
 	}
+	m_threadMultiple = (result >= MPI_THREAD_MULTIPLE);
+
+	MPI_Comm_dup(MPI_COMM_WORLD, &s_checkpointComm);
 
 	// get the global number of processes
 	MPI_Comm_size(MPI_COMM_WORLD, &world_size);
@@ -127,8 +175,15 @@ void NetworkManager::finalizeNetwork(int ret) {
 #if USE_MPI
 	if (ret)
 		MPI_Abort(MPI_COMM_WORLD, ret);
-	else
+	else {
+		if (s_fusedType != MPI_DATATYPE_NULL)
+			MPI_Type_free(&s_fusedType);
+		if (s_fusedOp != MPI_OP_NULL)
+			MPI_Op_free(&s_fusedOp);
+		if (s_checkpointComm != MPI_COMM_NULL)
+			MPI_Comm_free(&s_checkpointComm);
 		MPI_Finalize();
+	}
 #endif
 }
 
@@ -464,6 +519,34 @@ void NetworkManager::networkFloatReduction(float *buffer, const unsigned int buf
 #endif
 }
 
+void NetworkManager::networkDoubleReduction(double *buffer, const unsigned int bufferElements, ReductionType rtype)
+{
+#if USE_MPI
+	MPI_Op _operator;
+	switch (rtype) {
+		case MIN_REDUCTION:
+			_operator = MPI_MIN;
+			break;
+		case MAX_REDUCTION:
+			_operator = MPI_MAX;
+			break;
+		case SUM_REDUCTION:
+			_operator = MPI_SUM;
+			break;
+		default:
+			_operator = MPI_SUM;
+			printf("WARNING: Wrong operator in networkDoubleReduction specified. Defaulting to SUM_REDUCTION.\n");
+	}
+
+	int mpi_err = MPI_Allreduce(MPI_IN_PLACE, buffer, bufferElements, MPI_DOUBLE, _operator, MPI_COMM_WORLD);
+
+	if (mpi_err != MPI_SUCCESS)
+		printf("WARNING: MPI_Allreduce returned error %d\n", mpi_err);
+#else
+	NO_MPI_ERR;
+#endif
+}
+
 void NetworkManager::networkIntReduction(int *buffer, const unsigned int bufferElements, ReductionType rtype)
 {
 #if USE_MPI
@@ -533,6 +616,255 @@ void NetworkManager::networkBarrier()
 #endif
 }
 
+void NetworkManager::allGatherBytes(const void *data, size_t bytes, void *recv_buffer)
+{
+#if USE_MPI
+	int mpi_err = MPI_Allgather(data, bytes, MPI_BYTE, recv_buffer, bytes, MPI_BYTE, MPI_COMM_WORLD);
+	if (mpi_err != MPI_SUCCESS)
+		printf("WARNING: MPI_Allgather returned error %d\n", mpi_err);
+#else
+	NO_MPI_ERR;
+#endif
+}
+
+void NetworkManager::exchangeCheckpoint(int dst_rank, std::string const& send_data,
+	int src_rank, std::string& recv_data)
+{
+#if USE_MPI
+	unsigned long long send_size = send_data.size();
+	unsigned long long recv_size = 0;
+	int mpi_err = MPI_Sendrecv(&send_size, 1, MPI_UNSIGNED_LONG_LONG, dst_rank, 0,
+		&recv_size, 1, MPI_UNSIGNED_LONG_LONG, src_rank, 0, s_checkpointComm, MPI_STATUS_IGNORE);
+	if (mpi_err != MPI_SUCCESS)
+		throw runtime_error("checkpoint size exchange failed");
+
+	recv_data.resize(recv_size);
+
+	// the two checkpoints may have different sizes, and the destination may differ
+	// from the source, so the chunks are sent and received independently:
+	// the number of messages on each side only depends on the size it transfers
+	vector<MPI_Request> requests;
+	for (size_t offset = 0; offset < send_size; offset += checkpoint_chunk) {
+		const int count = min<size_t>(checkpoint_chunk, send_size - offset);
+		requests.push_back(MPI_REQUEST_NULL);
+		mpi_err = MPI_Isend(send_data.data() + offset, count, MPI_BYTE, dst_rank, 1,
+			s_checkpointComm, &requests.back());
+		if (mpi_err != MPI_SUCCESS)
+			throw runtime_error("checkpoint send failed");
+	}
+	for (size_t offset = 0; offset < recv_size; offset += checkpoint_chunk) {
+		const int count = min<size_t>(checkpoint_chunk, recv_size - offset);
+		requests.push_back(MPI_REQUEST_NULL);
+		mpi_err = MPI_Irecv(&recv_data[offset], count, MPI_BYTE, src_rank, 1,
+			s_checkpointComm, &requests.back());
+		if (mpi_err != MPI_SUCCESS)
+			throw runtime_error("checkpoint receive failed");
+	}
+	mpi_err = MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+	if (mpi_err != MPI_SUCCESS)
+		throw runtime_error("checkpoint exchange failed");
+#else
+	NO_MPI_ERR;
+#endif
+}
+
+void NetworkManager::broadcastCheckpoint(int root, std::string& data)
+{
+#if USE_MPI
+	unsigned long long size = data.size();
+	int mpi_err = MPI_Bcast(&size, 1, MPI_UNSIGNED_LONG_LONG, root, s_checkpointComm);
+	if (mpi_err != MPI_SUCCESS)
+		throw runtime_error("checkpoint size broadcast failed");
+
+	data.resize(size);
+	for (size_t offset = 0; offset < size; offset += checkpoint_chunk) {
+		const int count = min<size_t>(checkpoint_chunk, size - offset);
+		mpi_err = MPI_Bcast(&data[offset], count, MPI_BYTE, root, s_checkpointComm);
+		if (mpi_err != MPI_SUCCESS)
+			throw runtime_error("checkpoint broadcast failed");
+	}
+#else
+	NO_MPI_ERR;
+#endif
+}
+
+void NetworkManager::gatherCheckpoint(int root, std::string const& send_data,
+	std::vector<std::string>& recv_data)
+{
+#if USE_MPI
+	unsigned long long send_size = send_data.size();
+	vector<unsigned long long> sizes(world_size);
+	int mpi_err = MPI_Gather(&send_size, 1, MPI_UNSIGNED_LONG_LONG,
+		sizes.data(), 1, MPI_UNSIGNED_LONG_LONG, root, s_checkpointComm);
+	if (mpi_err != MPI_SUCCESS)
+		throw runtime_error("checkpoint size gather failed");
+
+	if (process_rank != root) {
+		for (size_t offset = 0; offset < send_size; offset += checkpoint_chunk) {
+			const int count = min<size_t>(checkpoint_chunk, send_size - offset);
+			mpi_err = MPI_Send(send_data.data() + offset, count, MPI_BYTE, root, 2, s_checkpointComm);
+			if (mpi_err != MPI_SUCCESS)
+				throw runtime_error("checkpoint gather failed");
+		}
+		return;
+	}
+
+	recv_data.assign(world_size, std::string());
+	recv_data[root] = send_data;
+	for (int rank = 0; rank < world_size; ++rank) {
+		if (rank == root)
+			continue;
+		std::string& data = recv_data[rank];
+		data.resize(sizes[rank]);
+		for (size_t offset = 0; offset < data.size(); offset += checkpoint_chunk) {
+			const int count = min<size_t>(checkpoint_chunk, data.size() - offset);
+			mpi_err = MPI_Recv(&data[offset], count, MPI_BYTE, rank, 2, s_checkpointComm, MPI_STATUS_IGNORE);
+			if (mpi_err != MPI_SUCCESS)
+				throw runtime_error("checkpoint gather failed");
+		}
+	}
+#else
+	NO_MPI_ERR;
+#endif
+}
+
+void NetworkManager::queueReduction(void *buffer, uint count,
+	QueuedReduction::ValueType vtype, ReductionType rtype,
+	std::function<void()> const& on_complete)
+{
+	QueuedReduction red;
+	red.buffer = buffer;
+	red.count = count;
+	red.vtype = vtype;
+	red.rtype = rtype;
+	red.on_complete = on_complete;
+	m_queuedReductions.push_back(red);
+}
+
+void NetworkManager::queueReduction(float *buffer, uint count, ReductionType rtype,
+	std::function<void()> const& on_complete)
+{
+	queueReduction(buffer, count, QueuedReduction::FLOAT_VALUE, rtype, on_complete);
+}
+
+void NetworkManager::queueReduction(int *buffer, uint count, ReductionType rtype,
+	std::function<void()> const& on_complete)
+{
+	queueReduction(buffer, count, QueuedReduction::INT_VALUE, rtype, on_complete);
+}
+
+void NetworkManager::queueReduction(bool *buffer, uint count,
+	std::function<void()> const& on_complete)
+{
+	queueReduction(buffer, count, QueuedReduction::BOOL_VALUE, MAX_REDUCTION, on_complete);
+}
+
+void NetworkManager::startReductions()
+{
+#if USE_MPI
+	// only one fused reduction can be in flight
+	waitRunningReductions();
+
+	if (m_queuedReductions.empty())
+		return;
+
+	m_runningReductions.swap(m_queuedReductions);
+
+	m_reductionBuffer.clear();
+	s_fusedOps.clear();
+	for (QueuedReduction const& red : m_runningReductions) {
+		for (uint i = 0; i < red.count; ++i) {
+			double value = 0;
+			switch (red.vtype) {
+			case QueuedReduction::FLOAT_VALUE: value = ((const float *)red.buffer)[i]; break;
+			case QueuedReduction::INT_VALUE: value = ((const int *)red.buffer)[i]; break;
+			case QueuedReduction::BOOL_VALUE: value = ((const bool *)red.buffer)[i] ? 1 : 0; break;
+			}
+			m_reductionBuffer.push_back(value);
+			s_fusedOps.push_back(red.rtype);
+		}
+	}
+
+	const int count = m_reductionBuffer.size();
+	if (s_fusedOp == MPI_OP_NULL)
+		MPI_Op_create(fused_reduction_op, 1, &s_fusedOp);
+	if (count != s_fusedTypeCount) {
+		if (s_fusedType != MPI_DATATYPE_NULL)
+			MPI_Type_free(&s_fusedType);
+		MPI_Type_contiguous(count, MPI_DOUBLE, &s_fusedType);
+		MPI_Type_commit(&s_fusedType);
+		s_fusedTypeCount = count;
+	}
+
+#if MPI_VERSION >= 3
+	int mpi_err = MPI_Iallreduce(MPI_IN_PLACE, m_reductionBuffer.data(), 1, s_fusedType,
+		s_fusedOp, MPI_COMM_WORLD, &s_fusedRequest);
+	if (mpi_err != MPI_SUCCESS)
+		printf("WARNING: MPI_Iallreduce returned error %d\n", mpi_err);
+#else
+	// no non-blocking collectives: reduce now, waitRunningReductions() will only unpack
+	int mpi_err = MPI_Allreduce(MPI_IN_PLACE, m_reductionBuffer.data(), 1, s_fusedType,
+		s_fusedOp, MPI_COMM_WORLD);
+	if (mpi_err != MPI_SUCCESS)
+		printf("WARNING: MPI_Allreduce returned error %d\n", mpi_err);
+#endif
+#else
+	if (!m_queuedReductions.empty())
+		NO_MPI_ERR;
+#endif
+}
+
+void NetworkManager::completeReductions()
+{
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	startReductions();
+	waitRunningReductions();
+	m_reductionSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void NetworkManager::waitRunningReductions()
+{
+#if USE_MPI
+	if (m_runningReductions.empty())
+		return;
+
+	// poll rather than block, so that we don't hang if another process died,
+	// but back off between tests so that we don't steal a core from the workers
+	int done = 0;
+	while (true) {
+		int mpi_err = MPI_Test(&s_fusedRequest, &done, MPI_STATUS_IGNORE);
+		if (mpi_err != MPI_SUCCESS)
+			throw runtime_error("MPI_Test returned error " + to_string(mpi_err) +
+				" while waiting for the network reductions");
+		if (done)
+			break;
+		if (checkKillRequest())
+			throw runtime_error("GPUSPH killed by MPI kill request");
+		this_thread::sleep_for(chrono::microseconds(20));
+	}
+
+	// unpack the results, and collect the callbacks before running them,
+	// since they may queue further reductions
+	QueuedReductionList completed;
+	completed.swap(m_runningReductions);
+
+	const double *value = m_reductionBuffer.data();
+	for (QueuedReduction const& red : completed) {
+		for (uint i = 0; i < red.count; ++i, ++value) {
+			switch (red.vtype) {
+			case QueuedReduction::FLOAT_VALUE: ((float *)red.buffer)[i] = *value; break;
+			case QueuedReduction::INT_VALUE: ((int *)red.buffer)[i] = *value; break;
+			case QueuedReduction::BOOL_VALUE: ((bool *)red.buffer)[i] = *value > 0; break;
+			}
+		}
+	}
+
+	for (QueuedReduction const& red : completed)
+		if (red.on_complete)
+			red.on_complete();
+#endif
+}
+
 #if USE_MPI
 // We send the maximum allowed tag value to denote the kill request
 static const unsigned int kill_tag = MPI_TAG_UB;
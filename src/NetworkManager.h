@@ -38,6 +38,10 @@
 #ifndef NETWORKMANAGER_H_
 #define NETWORKMANAGER_H_
 
+#include <vector>
+#include <string>
+#include <functional>
+
 typedef unsigned int uint;
 
 enum ReductionType
@@ -57,6 +61,36 @@ private:
 
 	uint m_numRequests;
 	uint m_requestsCounter;
+
+	//! Whether MPI can be called concurrently from multiple threads
+	bool m_threadMultiple;
+
+	//! A reduction queued for the next fused network reduction
+	struct QueuedReduction
+	{
+		enum ValueType { FLOAT_VALUE, INT_VALUE, BOOL_VALUE };
+		void *buffer;
+		uint count;
+		ValueType vtype;
+		ReductionType rtype;
+		std::function<void()> on_complete;
+	};
+	typedef std::vector<QueuedReduction> QueuedReductionList;
+
+	//! Reductions queued, but not started yet
+	QueuedReductionList m_queuedReductions;
+	//! Reductions in the fused reduction currently in flight
+	QueuedReductionList m_runningReductions;
+	//! Packed values of the fused reduction currently in flight
+	std::vector<double> m_reductionBuffer;
+	//! Total time spent in completeReductions(), in seconds
+	double m_reductionSeconds;
+
+	void queueReduction(void *buffer, uint count,
+		QueuedReduction::ValueType vtype, ReductionType rtype,
+		std::function<void()> const& on_complete);
+	//! Wait for the fused reduction in flight (if any) and unpack its results
+	void waitRunningReductions();
 public:
 	NetworkManager();
 	~NetworkManager();
@@ -93,10 +127,63 @@ public:
 	void networkIntReduction(int *buffer, const unsigned int bufferElements, ReductionType rtype);
 	// network reduction on float buffer across the network
 	void networkFloatReduction(float *buffer, const unsigned int bufferElements, ReductionType rtype);
+	// network reduction on double buffer across the network
+	void networkDoubleReduction(double *buffer, const unsigned int bufferElements, ReductionType rtype);
 	// send one int, gather the int from all nodes (allgather)
 	void allGatherUints(unsigned int *datum, unsigned int *recv_buffer);
 	// synchronization barrier among all the nodes of the network
 	void networkBarrier();
+	// send bytes bytes, gather the bytes from all nodes (allgather)
+	void allGatherBytes(const void *data, size_t bytes, void *recv_buffer);
+
+	//! Whether MPI can be called by any thread, concurrently
+	bool isThreadMultiple() const
+	{ return m_threadMultiple; }
+
+	/*! \name Checkpoint exchange
+	 * In-memory checkpoints are exchanged over a communicator of their own,
+	 * so that they can be transferred (e.g. by a separate thread) concurrently
+	 * with the simulation messages. Checkpoints can be larger than 2GB,
+	 * and are transferred in chunks.
+	 * @{
+	 */
+	//! Send a checkpoint to dst_rank while receiving one from src_rank
+	void exchangeCheckpoint(int dst_rank, std::string const& send_data,
+		int src_rank, std::string& recv_data);
+	//! Broadcast a checkpoint from the root rank to all the other processes
+	void broadcastCheckpoint(int root, std::string& data);
+	//! Gather the checkpoints of all processes (indexed by rank) on the root rank
+	void gatherCheckpoint(int root, std::string const& send_data,
+		std::vector<std::string>& recv_data);
+	/** @} */
+
+	/*! \name Fused network reductions
+	 * Values to be reduced across the network can be queued, and are then
+	 * packed together and reduced with a single non-blocking collective when
+	 * startReductions() or completeReductions() are called. The results are
+	 * written back into the queued buffers (which must remain valid until then),
+	 * and the optional completion callbacks are invoked, by completeReductions().
+	 * All processes must queue the same reductions in the same order.
+	 * @{
+	 */
+	void queueReduction(float *buffer, uint count, ReductionType rtype,
+		std::function<void()> const& on_complete = std::function<void()>());
+	void queueReduction(int *buffer, uint count, ReductionType rtype,
+		std::function<void()> const& on_complete = std::function<void()>());
+	//! Queue a logical OR reduction
+	void queueReduction(bool *buffer, uint count,
+		std::function<void()> const& on_complete = std::function<void()>());
+	//! Start the reduction of the queued values, without waiting for its completion
+	void startReductions();
+	//! Start the reduction of the queued values (if needed) and wait for its completion
+	/*! While waiting, the kill requests from other processes are checked,
+	 * and an exception is thrown if one is found
+	 */
+	void completeReductions();
+	//! Total time spent completing the fused reductions, in seconds
+	double getReductionSeconds() const
+	{ return m_reductionSeconds; }
+	/** @} */
 
 	//! Send a message to all other processes letting them know that this process is aborting
 	void sendKillRequest();
@@ -75,6 +75,9 @@ public:
 	unsigned int repack_maxiter; ///< maximum number of iterations for repacking
 	float	checkpoint_freq; ///< frequency of hotstart checkpoints (in simulated seconds)
 	int		checkpoints; ///< number of hotstart checkpoints to keep
+	std::string	checkpoint_local; ///< node-local directory for in-memory checkpoints (empty: disabled)
+	int		checkpoint_disk_every; ///< with checkpoint_local, write to disk every this many checkpoints (0: never)
+	bool	resume_local; ///< resume from the local checkpoints in checkpoint_local
 	bool	nosave; ///< disable saving
 	bool	gpudirect; ///< enable GPUDirect
 	bool	striping; ///< enable striping (i.e. compute/transfer overlap)
@@ -88,6 +91,20 @@ public:
 	bool repack; ///< if true, run the repacking before the simulation
 	bool repack_only; ///< if true, run the repacking only and quit
 	std::string repack_fname; ///< repack file to resume simulation from
+	unsigned int host_threads; ///< number of threads for host-side loops (0: autodetect)
+	bool no_pinned_host; ///< if true, do not page-lock the host particle buffers
+	bool no_hugepages; ///< if true, do not advise huge pages for large host buffers
+	bool async_bodies; ///< if true, integrate moving bodies on a separate host thread
+	bool async_commands; ///< if true, workers don't synchronize the device after each command
+	bool batch_commands; ///< if true, dispatch consecutive worker commands as a single batch
+	bool no_buffer_aliasing; ///< if true, ephemeral device buffers never share their storage
+	std::string bench_report; ///< file to write the performance report to
+	std::string metrics_file; ///< file to write the live metrics to
+	std::string metrics_socket; ///< Unix-domain socket to serve the live metrics on
+	double metrics_interval; ///< seconds between updates of the live metrics file
+	bool dry_run; ///< if true, only estimate the particles and memory needed, without running
+	double device_memory; ///< device memory (in GiB) assumed by the dry run
+	std::string setup_cache; ///< directory holding the cached filled particles (empty: no cache)
 	//! @}
 
 	Options(void) :
@@ -104,6 +121,9 @@ public:
 		repack_maxiter(0),
 		checkpoint_freq(NAN),
 		checkpoints(-1),
+		checkpoint_local(),
+		checkpoint_disk_every(10),
+		resume_local(false),
 		nosave(false),
 		gpudirect(false),
 		striping(false),
@@ -116,7 +136,21 @@ public:
 		pipeline_fpath(),
 		repack(false),
 		repack_only(false),
-		repack_fname()
+		repack_fname(),
+		host_threads(0),
+		no_pinned_host(false),
+		no_hugepages(false),
+		async_bodies(false),
+		async_commands(false),
+		batch_commands(false),
+		no_buffer_aliasing(false),
+		bench_report(),
+		metrics_file(),
+		metrics_socket(),
+		metrics_interval(NAN),
+		dry_run(false),
+		device_memory(NAN),
+		setup_cache()
 	{};
 
 	//! set an arbitrary option
@@ -31,6 +31,7 @@
 
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
 
 #include "buffer_traits.h"
 #include "ParticleSystem.h"
@@ -107,6 +108,9 @@ void ParticleSystem::clear()
 
 	// and purge the list of keys too
 	m_buffer_keys.clear();
+
+	m_alias_group.clear();
+	m_alias_owner.clear();
 }
 
 string ParticleSystem::inspect() const
@@ -388,6 +392,11 @@ size_t ParticleSystem::get_memory_occupation(flag_t Key, size_t nels) const
 	if (m_buffer_keys.find(Key) == m_buffer_keys.end())
 		return 0;
 
+	// aliased buffers take no memory of their own
+	auto owner = m_alias_owner.find(Key);
+	if (owner != m_alias_owner.end() && owner->second != Key)
+		return 0;
+
 	// get the corresponding buffer
 	const auto& vec = m_pool.at(Key);
 	const auto buf = vec.front();
@@ -398,3 +407,151 @@ size_t ParticleSystem::get_memory_occupation(flag_t Key, size_t nels) const
 
 	return single*nels;
 }
+
+size_t ParticleSystem::alloc(flag_t Key, size_t nels)
+{
+	// aliased buffers get their storage when the owner is allocated
+	auto owner = m_alias_owner.find(Key);
+	if (owner != m_alias_owner.end() && owner->second != Key)
+		return 0;
+
+	// number of actual instances of the buffer
+	auto& vec = m_pool.at(Key);
+	size_t allocated = 0;
+	for (auto buf : vec)
+		allocated += buf->alloc(nels);
+
+	auto group = m_alias_group.find(Key);
+	if (group != m_alias_group.end())
+		share_alias_storage(group->second, nels);
+
+	return allocated;
+}
+
+size_t ParticleSystem::realloc(flag_t Key, size_t nels, size_t rows)
+{
+	// aliased buffers follow their owner
+	auto owner = m_alias_owner.find(Key);
+	if (owner != m_alias_owner.end() && owner->second != Key)
+		return 0;
+
+	// buffers can be shared between states, so make sure
+	// we only reallocate each of them once
+	set<AbstractBuffer*> done;
+	size_t allocated = 0;
+
+	auto realloc_once = [&](ptr_type buf) {
+		if (done.insert(buf.get()).second)
+			allocated += buf->realloc(nels, rows);
+	};
+
+	for (auto buf : m_pool.at(Key))
+		realloc_once(buf);
+
+	for (auto& st : m_state) {
+		ptr_type buf = st.second.at(Key);
+		if (buf)
+			realloc_once(buf);
+	}
+
+	auto group = m_alias_group.find(Key);
+	if (group != m_alias_group.end())
+		share_alias_storage(group->second, nels);
+
+	return allocated;
+}
+
+/*! The buffers are considered by decreasing element size, and each is added
+ * to the first group none of whose buffers it interferes with, or becomes
+ * the owner of a new group otherwise. This guarantees that the owner storage
+ * is large enough for all the buffers of its group.
+ */
+size_t ParticleSystem::alias_buffers(map<flag_t, flag_t> const& interference)
+{
+	if (!m_alias_group.empty())
+		throw runtime_error("particle system buffers already aliased");
+
+	struct Candidate {
+		flag_t key;
+		size_t size;
+		ptr_type buf;
+	};
+
+	vector<Candidate> candidates;
+	for (auto const& it : interference) {
+		auto pool = m_pool.find(it.first);
+		if (pool == m_pool.end() || pool->second.size() != 1)
+			continue;
+		ptr_type buf = pool->second.front();
+		if (buf->get_array_count() != 1 || buf->get_allocated_elements() > 0)
+			continue;
+		candidates.push_back(Candidate{it.first, buf->get_element_size(), buf});
+	}
+
+	stable_sort(candidates.begin(), candidates.end(),
+		[](Candidate const& a, Candidate const& b) { return a.size > b.size; });
+
+	// the owner and the set of buffers of each group
+	vector<pair<Candidate, flag_t>> groups;
+	size_t saved = 0;
+	for (Candidate const& c : candidates) {
+		const flag_t conflicts = interference.at(c.key);
+		auto group = find_if(groups.begin(), groups.end(),
+			[&](pair<Candidate, flag_t> const& g) { return !(g.second & conflicts); });
+		if (group == groups.end()) {
+			groups.push_back(make_pair(c, c.key));
+			continue;
+		}
+		group->second |= c.key;
+		AliasGroup& alias_group = m_alias_group[group->first.key];
+		alias_group.owner = group->first.key;
+		alias_group.occupant = NO_FLAGS;
+		alias_group.buffers[group->first.key] = group->first.buf;
+		alias_group.buffers[c.key] = c.buf;
+		saved += c.size;
+	}
+
+	for (auto const& group : m_alias_group)
+		for (auto const& buf : group.second.buffers)
+			m_alias_owner[buf.first] = group.first;
+
+	return saved;
+}
+
+string ParticleSystem::inspect_aliases() const
+{
+	stringstream desc;
+	for (auto const& group : m_alias_group) {
+		if (desc.tellp() > 0)
+			desc << "; ";
+		desc << group.second.buffers.at(group.first)->get_buffer_name() << ":";
+		for (auto const& buf : group.second.buffers)
+			if (buf.first != group.first)
+				desc << " " << buf.second->get_buffer_name();
+	}
+	return desc.str();
+}
+
+void ParticleSystem::share_alias_storage(AliasGroup const& group, size_t nels)
+{
+	AbstractBuffer *owner = group.buffers.at(group.owner).get();
+	for (auto const& buf : group.buffers)
+		if (buf.first != group.owner)
+			buf.second->alias(owner, nels);
+}
+
+void ParticleSystem::claim_storage(flag_t keys, flag_t overwritten)
+{
+	for (auto const& it : m_alias_owner) {
+		const flag_t key = it.first;
+		if (!(keys & key))
+			continue;
+		AliasGroup& group = m_alias_group.at(it.second);
+		if (group.occupant == key)
+			continue;
+		// the first time around, the storage holds the initial value of the owner
+		if (!(overwritten & key) && (group.occupant != NO_FLAGS || key != group.owner))
+			group.buffers.at(key)->clobber_async();
+		group.occupant = key;
+	}
+}
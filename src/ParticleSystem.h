@@ -125,6 +125,26 @@ private:
 	// of keys available in m_pool.
 	std::set<flag_t> m_buffer_keys;
 
+	//! A set of buffers sharing the same storage
+	/*! The storage is allocated by the owner buffer, which is the largest
+	 * in the group; the other buffers are never live at the same time as
+	 * the owner or as each other (see alias_buffers())
+	 */
+	struct AliasGroup {
+		flag_t owner; ///< key of the buffer owning the storage
+		std::map<flag_t, ptr_type> buffers; ///< all the buffers in the group, including the owner
+		flag_t occupant; ///< key of the buffer whose content the storage currently holds
+	};
+
+	//! Alias groups, indexed by the key of the owner
+	std::map<flag_t, AliasGroup> m_alias_group;
+
+	//! Key of the owner of the storage used by each aliased buffer (including the owners)
+	std::map<flag_t, flag_t> m_alias_owner;
+
+	//! Let the buffers of the group use the storage of its owner
+	void share_alias_storage(AliasGroup const& group, size_t nels);
+
 	//! Put a buffer back into the pool
 	void pool_buffer(flag_t key, ptr_type buf);
 
@@ -258,20 +278,39 @@ public:
 	{ return m_buffer_keys; }
 
 	/* Get the amount of memory that would be taken by the given buffer
-	 * if it was allocated with the given number of elements */
+	 * if it was allocated with the given number of elements
+	 * (none, for buffers using the storage of another buffer) */
 	size_t get_memory_occupation(flag_t Key, size_t nels) const;
 
+	//! Let buffers that are never live at the same time share their storage
+	/*! For each buffer that may be aliased, the interference map holds the set
+	 * of buffers whose live ranges overlap with its own (see Integrator::buffer_interference()).
+	 * Only buffers with a single copy and a single array are considered.
+	 * This must be called before the buffers are allocated, and returns the number
+	 * of bytes per element that will not be allocated.
+	 */
+	size_t alias_buffers(std::map<flag_t, flag_t> const& interference);
+
+	//! Describe the buffers sharing their storage
+	std::string inspect_aliases() const;
+
+	//! Prepare the storage of the given buffers for writing
+	/*! When the storage of an aliased buffer was last used by another buffer,
+	 * the buffer is reset (asynchronously) to its initial value, so that the elements
+	 * not written by the command keep the value they would have without aliasing.
+	 * This is skipped for the overwritten buffers, whose elements are all written
+	 * by the command.
+	 */
+	void claim_storage(flag_t keys, flag_t overwritten = NO_FLAGS);
+
 	/* Allocate all the necessary copies of the given buffer,
 	 * returning the total amount of memory used */
-	size_t alloc(flag_t Key, size_t nels)
-	{
-		// number of actual instances of the buffer
-		auto& vec = m_pool.at(Key);
-		size_t allocated = 0;
-		for (auto buf : vec)
-			allocated += buf->alloc(nels);
-		return allocated;
-	}
+	size_t alloc(flag_t Key, size_t nels);
+
+	/* Reallocate all the copies of the given buffer, in the pool and
+	 * in all states, preserving their content (see AbstractBuffer::realloc),
+	 * returning the total amount of memory used */
+	size_t realloc(flag_t Key, size_t nels, size_t rows = 1);
 
 	/* Get the buffer list of a specific state */
 	State& getState(std::string const& str)
@@ -31,6 +31,8 @@
 
 #include <sstream>
 #include <stdexcept>
+#include <algorithm>
+#include <numeric>
 #include <string>
 #include <time.h>
 #include <sys/types.h>
@@ -81,7 +83,9 @@ ProblemCore::ProblemCore(GlobalData *_gdata) :
 	m_waterLevel(NAN),
 	gdata(_gdata),
 	m_options(_gdata->clOptions),
-	m_bodies_storage(NULL)
+	m_bodies_storage(NULL),
+	m_bodies_forces_storage(NULL),
+	m_bodies_torques_storage(NULL)
 {
 #if USE_CHRONO == 1
 	m_bodies_physical_system = NULL;
@@ -104,6 +108,13 @@ ProblemCore::initialize()
 		m_simframework->addPostProcessEngine(SURFACE_DETECTION);
 	}
 
+	for (auto const& writer : m_writers) {
+		if (writer.first == SURFACEWRITER && !m_simframework->hasPostProcessEngine(SURFACE_DETECTION)) {
+			printf("Surface mesh output requested: force-enabling surface detection\n");
+			m_simframework->addPostProcessEngine(SURFACE_DETECTION);
+		}
+	}
+
 	const bool multi_fluid_flag = IS_MULTIFLUID(_sp->simflags);
 	const bool has_multiple_fluids = (_pp->numFluids() > 1);
 
@@ -178,6 +189,8 @@ ProblemCore::initialize()
 ProblemCore::~ProblemCore(void)
 {
 	delete [] m_bodies_storage;
+	delete [] m_bodies_forces_storage;
+	delete [] m_bodies_torques_storage;
 	delete m_simframework;
 	delete m_physparams;
 }
@@ -233,6 +246,12 @@ ProblemCore::allocate_bodies_storage()
 		// TODO: this should depend on the integration scheme
 		m_bodies_storage = new KinematicData[nbodies];
 	}
+
+	const uint nforcesbodies = simparams()->numforcesbodies;
+	if (nforcesbodies) {
+		m_bodies_forces_storage = new float3[nforcesbodies];
+		m_bodies_torques_storage = new float3[nforcesbodies];
+	}
 }
 
 void
@@ -494,6 +513,13 @@ ProblemCore::bodies_timestep(const float3 *forces, const float3 *torques, const
 	double t0 = t;
 	double t1 = t + dt1;
 
+	// The body solver can take several sub-steps per fluid step, with the fluid
+	// forces either held constant, or (on the corrector) varying linearly in time
+	// from the predictor forces at t to the corrector forces at t + dt/2,
+	// and held at the corrector forces after that
+	const uint substeps = simparams()->bodies_substeps;
+	const bool interpolate_forces = simparams()->bodies_forces_interpolation && step == 2;
+
 	//#define _DEBUG_OBJ_FORCES_
 	bool there_is_at_least_one_chrono_body = false;
 	// For Chrono bodies apply forces and torques
@@ -501,8 +527,14 @@ ProblemCore::bodies_timestep(const float3 *forces, const float3 *torques, const
 		// Shortcut to body data
 		MovingBodyData* mbdata = m_bodies[i];
 		// Store kinematic data at the beginning of the time step
-		if (step == 1)
+		if (step == 1) {
 			m_bodies_storage[i] = mbdata->kdata;
+			// forces bodies come first
+			if (i < simparams()->numforcesbodies) {
+				m_bodies_forces_storage[i] = forces[i];
+				m_bodies_torques_storage[i] = torques[i];
+			}
+		}
 		// Restore kinematic data from the value stored at the beginning of the time step
 		if (step == 2)
 			mbdata->kdata = m_bodies_storage[i];
@@ -521,10 +553,6 @@ ProblemCore::bodies_timestep(const float3 *forces, const float3 *torques, const
 				body->SetRot(mbdata->kdata.orientation.ToChQuaternion());
 			}
 
-			body->Empty_forces_accumulators();
-			body->Accumulate_force(::chrono::ChVector<>(forces[i].x, forces[i].y, forces[i].z), body->GetPos(), false);
-			body->Accumulate_torque(::chrono::ChVector<>(torques[i].x, torques[i].y, torques[i].z), false);
-
 
 			if (false) {
 				cout << "Before dWorldStep, object " << i << "\tt = " << t << "\tdt = " << dt <<"\n";
@@ -539,7 +567,34 @@ ProblemCore::bodies_timestep(const float3 *forces, const float3 *torques, const
 #if USE_CHRONO == 1
 	// Call Chrono solver. Should it be called only if there are floating ones?
 	if (there_is_at_least_one_chrono_body) {
-		m_bodies_physical_system->DoStepDynamics(dt1);
+		const double sub_dt = dt1/substeps;
+		for (uint s = 0; s < substeps; ++s) {
+			// held forces only need to be applied once, since Chrono
+			// keeps the accumulated forces across steps
+			if (s == 0 || interpolate_forces) {
+				// (fluid) time at the middle of the sub-step, relative to the forces
+				// interval: 0 = predictor forces (t), 1 = corrector forces (t + dt/2);
+				// we do not extrapolate past the corrector forces
+				const float w = fminf(2*(s + 0.5f)/substeps, 1.0f);
+				for (size_t i = 0; i < m_bodies.size(); i++) {
+					MovingBodyData* mbdata = m_bodies[i];
+					if (!mbdata->object->HasBody())
+						continue;
+					float3 force = forces[i];
+					float3 torque = torques[i];
+					// only the forces bodies (which come first) have stored forces
+					if (interpolate_forces && w < 1 && i < simparams()->numforcesbodies) {
+						force = m_bodies_forces_storage[i] + w*(forces[i] - m_bodies_forces_storage[i]);
+						torque = m_bodies_torques_storage[i] + w*(torques[i] - m_bodies_torques_storage[i]);
+					}
+					std::shared_ptr< ::chrono::ChBody > body = mbdata->object->GetBody();
+					body->Empty_forces_accumulators();
+					body->Accumulate_force(::chrono::ChVector<>(force.x, force.y, force.z), body->GetPos(), false);
+					body->Accumulate_torque(::chrono::ChVector<>(torque.x, torque.y, torque.z), false);
+				}
+			}
+			m_bodies_physical_system->DoStepDynamics(sub_dt);
+		}
 	}
 #endif
 
@@ -1005,6 +1060,12 @@ ProblemCore::add_writer(WriterType wt, double freq)
 	m_writers.push_back(make_pair(wt, freq));
 }
 
+void
+ProblemCore::add_writer(WriterType wt, double freq, OutputProfile const& profile)
+{
+	m_writer_profiles.push_back(WriterProfile(wt, freq, profile));
+}
+
 
 // override in problems where you want to save
 // at specific times regardless of standard conditions
@@ -1345,6 +1406,316 @@ void ProblemCore::fillDeviceMapByRegularGrid()
 }
 
 
+// Spread the lowest 21 bits of v so that there are two zero bits between each of them
+static inline uint64_t
+morton_spread(uint64_t v)
+{
+	v &= 0x1fffff;
+	v = (v | (v << 32)) & 0x1f00000000ffffULL;
+	v = (v | (v << 16)) & 0x1f0000ff0000ffULL;
+	v = (v | (v << 8))  & 0x100f00f00f00f00fULL;
+	v = (v | (v << 4))  & 0x10c30c30c30c30c3ULL;
+	v = (v | (v << 2))  & 0x1249249249249249ULL;
+	return v;
+}
+
+// Compute the cost of each cell as the weighted sum of the particles it contains,
+// and the number of particles in each cell
+static void
+compute_cell_weights(GlobalData* gdata,
+	float fluid_weight, float boundary_weight, float vertex_weight,
+	vector<double>& cell_weight, vector<uint>& cell_parts)
+{
+	cell_weight.assign(gdata->nGridCells, 0.0);
+	cell_parts.assign(gdata->nGridCells, 0);
+
+	// in a dry run there are no particles, only the estimated counts
+	if (gdata->clOptions->dry_run) {
+		for (uint c = 0; c < gdata->nGridCells; c++) {
+			const uint fluid = gdata->s_hPlannedCellFluid[c];
+			const uint boundary = gdata->s_hPlannedCellBoundary[c];
+			cell_weight[c] = fluid*fluid_weight + boundary*boundary_weight;
+			cell_parts[c] = fluid + boundary;
+		}
+		return;
+	}
+
+	const particleinfo *infos = gdata->s_hBuffers.getConstData<BUFFER_INFO>();
+	const hashKey *hashes = gdata->s_hBuffers.getConstData<BUFFER_HASH>();
+	for (uint p = 0; p < gdata->totParticles; p++) {
+		const particleinfo info = infos[p];
+		const float w =
+			FLUID(info) ? fluid_weight :
+			BOUNDARY(info) ? boundary_weight :
+			VERTEX(info) ? vertex_weight : 0.0f;
+		const uint cellHash = cellHashFromParticleHash(hashes[p]);
+		cell_weight[cellHash] += w;
+		cell_parts[cellHash]++;
+	}
+}
+
+// Report the load, particles, cells and halo cells (cells with neighbors assigned
+// to other devices) of each device. In multi-node simulations, the halo cells
+// with neighbors on other nodes (whose content is exchanged over the network)
+// are reported separately from those with neighbors only on the same node
+static void
+report_device_map(GlobalData const* gdata, SimParams const* simparams,
+	vector<double> const& cell_weight, vector<uint> const& cell_parts)
+{
+	const uint nCells = gdata->nGridCells;
+	const uint3 gridSize = gdata->gridSize;
+	const devcount_t nDevices = gdata->totDevices;
+	const bool multi_node = gdata->mpi_nodes > 1;
+
+	const int3 periodic = make_int3(
+		simparams->periodicbound & PERIODIC_X,
+		simparams->periodicbound & PERIODIC_Y,
+		simparams->periodicbound & PERIODIC_Z);
+
+	vector<double> dev_weight(nDevices, 0.0);
+	vector<uint> dev_cells(nDevices, 0);
+	vector<uint> dev_parts(nDevices, 0);
+	vector<uint> dev_halo(nDevices, 0);
+	vector<uint> dev_halo_parts(nDevices, 0);
+	vector<uint> dev_net_halo(nDevices, 0);
+	vector<uint> dev_net_halo_parts(nDevices, 0);
+
+	for (uint i = 0; i < nCells; i++) {
+		const devcount_t d = gdata->s_hDeviceMap[i];
+		const devcount_t rank = gdata->RANK_FROM_LINEARIZED_GLOBAL(d);
+		dev_weight[d] += cell_weight[i];
+		dev_cells[d]++;
+		dev_parts[d] += cell_parts[i];
+
+		const uint3 upos = gdata->calcGridPosFromCellHash(i);
+		const int3 pos = make_int3(upos.x, upos.y, upos.z);
+		bool halo = false, net_halo = false;
+		for (int dz = -1; dz <= 1 && !net_halo; dz++)
+			for (int dy = -1; dy <= 1 && !net_halo; dy++)
+				for (int dx = -1; dx <= 1 && !net_halo; dx++) {
+					int3 n = pos + make_int3(dx, dy, dz);
+					if (periodic.x) n.x = (n.x + gridSize.x) % gridSize.x;
+					if (periodic.y) n.y = (n.y + gridSize.y) % gridSize.y;
+					if (periodic.z) n.z = (n.z + gridSize.z) % gridSize.z;
+					if (n.x < 0 || n.y < 0 || n.z < 0 ||
+						n.x >= int(gridSize.x) || n.y >= int(gridSize.y) || n.z >= int(gridSize.z))
+						continue;
+					const devcount_t nd = gdata->s_hDeviceMap[gdata->calcGridHashHost(n)];
+					if (nd == d)
+						continue;
+					halo = true;
+					net_halo = gdata->RANK_FROM_LINEARIZED_GLOBAL(nd) != rank;
+				}
+		if (net_halo) {
+			dev_net_halo[d]++;
+			dev_net_halo_parts[d] += cell_parts[i];
+		} else if (halo) {
+			dev_halo[d]++;
+			dev_halo_parts[d] += cell_parts[i];
+		}
+	}
+
+	const double total_weight = accumulate(dev_weight.begin(), dev_weight.end(), 0.0);
+	for (devcount_t d = 0; d < nDevices; d++) {
+		printf(" - device %u: load %.4g (%.1f%%), %s particles, %s cells, %s halo cells (%s particles)",
+			d, dev_weight[d], total_weight > 0 ? 100*dev_weight[d]/total_weight : 0.0,
+			gdata->addSeparators(dev_parts[d]).c_str(),
+			gdata->addSeparators(dev_cells[d]).c_str(),
+			gdata->addSeparators(dev_halo[d] + dev_net_halo[d]).c_str(),
+			gdata->addSeparators(dev_halo_parts[d] + dev_net_halo_parts[d]).c_str());
+		if (multi_node)
+			printf(", of which %s cells (%s particles) across nodes",
+				gdata->addSeparators(dev_net_halo[d]).c_str(),
+				gdata->addSeparators(dev_net_halo_parts[d]).c_str());
+		printf("\n");
+		if (dev_weight[d] == 0)
+			printf("WARNING: device %u has no load\n", d);
+	}
+	if (multi_node) {
+		const uint intra = accumulate(dev_halo_parts.begin(), dev_halo_parts.end(), 0U);
+		const uint inter = accumulate(dev_net_halo_parts.begin(), dev_net_halo_parts.end(), 0U);
+		printf(" - halo particles: %s within nodes, %s across nodes\n",
+			gdata->addSeparators(intra).c_str(), gdata->addSeparators(inter).c_str());
+	}
+}
+
+// Partition by cutting the Morton curve over the cells in chunks of equal cost
+void ProblemCore::fillDeviceMapBySFC(float fluid_weight, float boundary_weight, float vertex_weight)
+{
+	const uint nCells = gdata->nGridCells;
+	const devcount_t nDevices = gdata->totDevices;
+
+	// cost of each cell, and number of particles, for the report
+	vector<double> cell_weight;
+	vector<uint> cell_parts;
+	compute_cell_weights(gdata, fluid_weight, boundary_weight, vertex_weight,
+		cell_weight, cell_parts);
+
+	// sort the cells along the curve
+	vector<uint64_t> cell_key(nCells);
+	for (uint i = 0; i < nCells; i++) {
+		const uint3 pos = gdata->calcGridPosFromCellHash(i);
+		cell_key[i] = morton_spread(pos.x) | (morton_spread(pos.y) << 1) | (morton_spread(pos.z) << 2);
+	}
+	vector<uint> curve(nCells);
+	iota(curve.begin(), curve.end(), 0);
+	sort(curve.begin(), curve.end(),
+		[&cell_key](uint a, uint b) { return cell_key[a] < cell_key[b]; });
+
+	const double total_weight = accumulate(cell_weight.begin(), cell_weight.end(), 0.0);
+
+	// walk the curve, moving on to the next device when the current one
+	// has reached its share of the total cost. Empty cells simply go to
+	// the device of the cells preceding them along the curve
+	devcount_t dev = 0;
+	double done_weight = 0;
+	for (uint i : curve) {
+		const double w = cell_weight[i];
+		// switch to the next device if adding this cell would take us further
+		// from the target than stopping here
+		const double target = total_weight*(dev + 1)/nDevices;
+		if (dev < nDevices - 1 && w > 0 && done_weight + w/2 > target)
+			++dev;
+		gdata->s_hDeviceMap[i] = dev;
+		done_weight += w;
+	}
+
+	printf("Space-filling curve partitioning (weights: fluid %g, boundary %g, vertex %g):\n",
+		fluid_weight, boundary_weight, vertex_weight);
+	report_device_map(gdata, simparams(), cell_weight, cell_parts);
+}
+
+// Recursive coordinate bisection of the given cells in nparts parts of equal cost.
+// Each region is cut with a plane orthogonal to the longest side of its bounding box,
+// which keeps the interface between the parts small, and the parts are numbered
+// consecutively starting from first_part
+static void
+bisect_cells(GlobalData const* gdata, vector<double> const& cell_weight,
+	vector<uint>& cells, uint nparts, uint first_part, vector<uint>& cell_part)
+{
+	if (nparts == 1 || cells.empty()) {
+		for (uint i : cells)
+			cell_part[i] = first_part;
+		return;
+	}
+
+	// bounding box of the region
+	uint3 lo = make_uint3(UINT_MAX), hi = make_uint3(0);
+	for (uint i : cells) {
+		const uint3 pos = gdata->calcGridPosFromCellHash(i);
+		lo = min(lo, pos);
+		hi = max(hi, pos);
+	}
+	const uint3 extent = hi - lo;
+	const int axis =
+		extent.x >= extent.y && extent.x >= extent.z ? 0 :
+		extent.y >= extent.z ? 1 : 2;
+	const uint axis_lo = axis == 0 ? lo.x : axis == 1 ? lo.y : lo.z;
+	const uint slices = (axis == 0 ? extent.x : axis == 1 ? extent.y : extent.z) + 1;
+
+	auto slice_of = [&](uint i) {
+		const uint3 pos = gdata->calcGridPosFromCellHash(i);
+		return (axis == 0 ? pos.x : axis == 1 ? pos.y : pos.z) - axis_lo;
+	};
+
+	// cost of each slice of the region along the cut axis
+	vector<double> slice_weight(slices, 0.0);
+	for (uint i : cells)
+		slice_weight[slice_of(i)] += cell_weight[i];
+	const double total = accumulate(slice_weight.begin(), slice_weight.end(), 0.0);
+
+	// split the parts as evenly as possible, and the cost proportionally
+	const uint left_parts = nparts/2;
+	const double target = total*left_parts/nparts;
+
+	// find the first slice of the right half: stop before the slice
+	// that would take the left half further from the target than stopping
+	// here, but always leave at least one slice on each side when possible
+	uint cut = 1;
+	double left = slice_weight[0];
+	while (cut < slices - 1 && left + slice_weight[cut]/2 <= target)
+		left += slice_weight[cut++];
+
+	vector<uint> left_cells, right_cells;
+	for (uint i : cells)
+		(slice_of(i) < cut ? left_cells : right_cells).push_back(i);
+	cells.clear();
+	cells.shrink_to_fit();
+
+	bisect_cells(gdata, cell_weight, left_cells, left_parts, first_part, cell_part);
+	bisect_cells(gdata, cell_weight, right_cells, nparts - left_parts, first_part + left_parts, cell_part);
+}
+
+// Two-level partitioning: first among the nodes, then among the devices of each node
+void ProblemCore::fillDeviceMapByTopology(float fluid_weight, float boundary_weight, float vertex_weight)
+{
+	const uint nCells = gdata->nGridCells;
+	const uint nodes = gdata->mpi_nodes > 0 ? gdata->mpi_nodes : 1;
+	const uint devices = gdata->devices;
+
+	vector<double> cell_weight;
+	vector<uint> cell_parts;
+	compute_cell_weights(gdata, fluid_weight, boundary_weight, vertex_weight,
+		cell_weight, cell_parts);
+
+	// When multiple processes run on the same physical host (--num-hosts), their
+	// exchanges don't go through the actual network, so the domain is split
+	// among the hosts first. Which ranks share a host depends on the scheduling
+	// (see the device index offset computation in main)
+	const uint num_hosts = m_options->num_hosts;
+	const bool by_host = num_hosts > 1 && num_hosts < nodes && nodes % num_hosts == 0;
+	const uint ranks_per_host = by_host ? nodes / num_hosts : 1;
+	const uint hosts = by_host ? num_hosts : nodes;
+	// which rank is the r-th rank of host h
+	auto host_rank = [&](uint h, uint r) -> uint {
+		if (!by_host) return h;
+		return m_options->byslot_scheduling ? h*ranks_per_host + r : r*num_hosts + h;
+	};
+
+	vector<uint> all_cells(nCells);
+	iota(all_cells.begin(), all_cells.end(), 0);
+
+	// first level: hosts
+	vector<uint> cell_host(nCells, 0);
+	bisect_cells(gdata, cell_weight, all_cells, hosts, 0, cell_host);
+
+	vector< vector<uint> > host_cells(hosts);
+	for (uint i = 0; i < nCells; i++)
+		host_cells[cell_host[i]].push_back(i);
+
+	// second level: ranks within each host, devices within each rank
+	vector<uint> cell_rank(nCells, 0);
+	vector<uint> cell_dev(nCells, 0);
+	for (uint h = 0; h < hosts; h++) {
+		bisect_cells(gdata, cell_weight, host_cells[h], ranks_per_host, 0, cell_rank);
+		vector< vector<uint> > rank_cells(ranks_per_host);
+		for (uint i = 0; i < nCells; i++)
+			if (cell_host[i] == h)
+				rank_cells[cell_rank[i]].push_back(i);
+		for (uint r = 0; r < ranks_per_host; r++) {
+			const uint rank = host_rank(h, r);
+			bisect_cells(gdata, cell_weight, rank_cells[r], devices, rank*devices, cell_dev);
+		}
+	}
+
+	for (uint i = 0; i < nCells; i++)
+		gdata->s_hDeviceMap[i] = devcount_t(cell_dev[i]);
+
+	printf("Topology-aware partitioning in %u hosts x %u processes x %u devices (weights: fluid %g, boundary %g, vertex %g):\n",
+		hosts, ranks_per_host, devices, fluid_weight, boundary_weight, vertex_weight);
+	report_device_map(gdata, simparams(), cell_weight, cell_parts);
+}
+
+vector<ProblemCore::PlannedFill>
+ProblemCore::plan_fill()
+{
+	PlannedFill whole;
+	whole.bbmin = m_origin;
+	whole.bbmax = m_origin + m_size;
+	whole.fluid = fill_parts();
+	whole.boundary = 0;
+	return vector<PlannedFill>(1, whole);
+}
 
 uint
 ProblemCore::max_parts(uint numParts)
@@ -1352,6 +1723,15 @@ ProblemCore::max_parts(uint numParts)
 	if (!(simparams()->simflags & ENABLE_INLET_OUTLET))
 		return numParts;
 
+	// the particle storage grows during the simulation when its occupancy
+	// reaches particles_highwater, so we only need some headroom for the start
+	const double headroom = simparams()->particles_headroom;
+	if (headroom > 0) {
+		uint hparts = ceil(max(headroom, 1.0)*numParts);
+		printf("  allocating %u particles (%gx the initial count), growing as needed\n", hparts, headroom);
+		return hparts;
+	}
+
 	// we assume that we can't have more particles than by filling the whole domain:
 	// if the user knows how many particles there are going to be he should implement
 	// his own version of this function
@@ -1466,6 +1846,28 @@ ProblemCore::set_grid_params(void)
 		throw runtime_error(ss.str());
 	}
 
+	if ((simparams()->simflags & ENABLE_INLET_OUTLET) && simparams()->particles_headroom > 0 &&
+		!(simparams()->particles_highwater > 0 && simparams()->particles_highwater <= 1 &&
+		  simparams()->particles_growth > 1)) {
+		stringstream ss;
+		ss << "growable particle storage requires 0 < particles_highwater <= 1 (got " <<
+			simparams()->particles_highwater << ") and particles_growth > 1 (got " <<
+			simparams()->particles_growth << ")";
+		throw runtime_error(ss.str());
+	}
+
+	if (simparams()->numbodies > 0 && simparams()->bodies_substeps < 1)
+		throw invalid_argument("bodies_substeps must be at least 1");
+
+	if (simparams()->adaptive_neibs && !(simparams()->get_neibs_skin() > 0)) {
+		stringstream ss;
+		ss << "adaptive neighbor list rebuilding requires a positive skin, " <<
+			"but neighbor search radius " << nlInfluenceRadius <<
+			" == kernel influence radius " << influenceRadius <<
+			"; set a neighbor list expansion factor > 1";
+		throw runtime_error(ss.str());
+	}
+
 	// with semi-analytical boundaries, we want a cell size which is
 	// deltap/2 + the usual influence radius
 	double cellSide = nlInfluenceRadius;
@@ -1546,7 +1948,11 @@ ProblemCore::calc_local_offset(double3 const& vec, int3 const& gridOff) const
 uint
 ProblemCore::calc_grid_hash(int3 gridPos) const
 {
+#if MORTON_LINEARIZATION
+	return morton_cell_hash(gridPos, m_gridsize);
+#else
 	return gridPos.COORD3 * m_gridsize.COORD2 * m_gridsize.COORD1 + gridPos.COORD2 * m_gridsize.COORD1 + gridPos.COORD1;
+#endif
 }
 
 
@@ -58,6 +58,7 @@
 #include "simparams.h"
 #include "vector_math.h"
 #include "Object.h"
+#include "TemporalStatistics.h"
 #include "MovingBody.h"
 
 #include "buffer.h"
@@ -87,6 +88,10 @@ class ProblemCore
 	private:
 		std::string			m_problem_dir;
 		WriterList		m_writers;
+		WriterProfileList	m_writer_profiles;
+		ProbeSetList	m_probe_sets;
+		StatisticsParams	m_statistics;
+		SurfaceMeshParams	m_surface_mesh;
 
 		const float		*m_dem;
 		int				m_ncols, m_nrows;
@@ -182,6 +187,8 @@ class ProblemCore
 
 		MovingBodiesVect	m_bodies;			// array of moving objects
 		KinematicData		*m_bodies_storage;				// kinematic data storage for bodie movement integration
+		float3				*m_bodies_forces_storage;		// forces applied to the bodies on the predictor step
+		float3				*m_bodies_torques_storage;		// torques applied to the bodies on the predictor step
 
 		ProblemCore(GlobalData *_gdata);
 
@@ -496,10 +503,44 @@ class ProblemCore
 		// add a new writer, with the given write frequency in (fractions of) seconds
 		void add_writer(WriterType wt, double freq);
 
+		// add an output profile (reduced output) to a writer, with its own write frequency;
+		// see OutputProfile. Currently only supported by the VTKWRITER
+		void add_writer(WriterType wt, double freq, OutputProfile const& profile);
+
 		// return the list of writers
 		WriterList const& get_writers() const
 		{ return m_writers; }
 
+		// return the list of output profiles
+		WriterProfileList const& get_writer_profiles() const
+		{ return m_writer_profiles; }
+
+		// add a set of probes, sampled by the PROBEWRITER; see ProbeSet
+		void add_probe_set(ProbeSet const& set)
+		{ m_probe_sets.push_back(set); }
+
+		// return the list of probe sets
+		ProbeSetList const& get_probe_sets() const
+		{ return m_probe_sets; }
+
+		// set the sampling parameters of the STATISTICS post-processing engine;
+		// see StatisticsParams
+		void set_statistics(StatisticsParams const& params)
+		{ m_statistics = params; }
+
+		// return the sampling parameters of the STATISTICS post-processing engine
+		StatisticsParams const& get_statistics() const
+		{ return m_statistics; }
+
+		// set the parameters of the free-surface mesh written by the SURFACEWRITER;
+		// see SurfaceMeshParams
+		void set_surface_mesh(SurfaceMeshParams const& params)
+		{ m_surface_mesh = params; }
+
+		// return the parameters of the free-surface mesh
+		SurfaceMeshParams const& get_surface_mesh() const
+		{ return m_surface_mesh; }
+
 		/*!
 		 overridden in subclasses if they want explicit writes
 		 beyond those controlled by the writer(s) periodic time
@@ -525,6 +566,20 @@ class ProblemCore
 		//! User function for setting the maximum number of particles with IO.
 		//! Activate it with IO boundaries.
 		virtual uint max_parts(uint numParts);
+
+		//! A region of the domain and the number of particles estimated to fill it
+		struct PlannedFill {
+			double3 bbmin, bbmax; //!< bounding box of the region
+			double fluid; //!< estimated number of fluid particles
+			double boundary; //!< estimated number of non-fluid particles
+		};
+		//! estimate the particles that fill_parts() would generate, without generating them
+		/*! This is used by the capacity planning (--dry-run). The default implementation
+		 * runs fill_parts() and assumes the particles are spread evenly over the whole
+		 * domain; problems that know their geometries should override it.
+		 */
+		virtual std::vector<PlannedFill> plan_fill();
+
 		//!
 		virtual void copy_to_array(BufferList & ) = 0;
 		//!
@@ -672,6 +727,27 @@ class ProblemCore
 		void fillDeviceMapByRegularGrid();
 		// partition by performing the specified number of cuts along the three cartesian axes
 		void fillDeviceMapByAxesSplits(uint Xslices, uint Yslices, uint Zslices);
+		//! Partition by cutting a Morton space-filling curve over the cells in chunks of equal cost
+		/*! The cost of each cell is the weighted sum of the fluid, boundary and vertex particles
+		 * it contains. The cells are visited in Morton (Z-curve) order, and the curve is cut in
+		 * totDevices contiguous chunks of (approximately) equal cost, so that each device gets
+		 * a compact region following the actual distribution of the particles.
+		 * The resulting load and number of halo cells of each device are reported.
+		 */
+		void fillDeviceMapBySFC(float fluid_weight = 1.0f, float boundary_weight = 1.0f,
+			float vertex_weight = 1.0f);
+		//! Two-level partitioning, first among the nodes and then among the devices of each node
+		/*! The cells are split among the nodes by recursive coordinate bisection,
+		 * cutting across the longest side of each region, to keep the interface between
+		 * the nodes (whose content is exchanged over the network) small; the region
+		 * of each node is then split the same way among its devices.
+		 * When multiple processes share a physical host (--num-hosts, honoring
+		 * --byslot-scheduling), the domain is split among the hosts first.
+		 * Cells are weighted like in fillDeviceMapBySFC(). The resulting load and halo
+		 * sizes (within and across nodes) of each device are reported.
+		 */
+		void fillDeviceMapByTopology(float fluid_weight = 1.0f, float boundary_weight = 1.0f,
+			float vertex_weight = 1.0f);
 
 		void PlaneCut(PointVect&, const double, const double, const double, const double);
 
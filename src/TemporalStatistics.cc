@@ -0,0 +1,692 @@
+/*  Copyright (c) 2019 INGV, EDF, UniCT, JHU
+
+    Istituto Nazionale di Geofisica e Vulcanologia, Sezione di Catania, Italy
+    Électricité de France, Paris, France
+    Università di Catania, Catania, Italy
+    Johns Hopkins University, Baltimore (MD), USA
+
+    This file is part of GPUSPH. Project founders:
+        Alexis Hérault, Giuseppe Bilotta, Robert A. Dalrymple,
+        Eugenio Rustico, Ciro Del Negro
+    For a full list of authors and project partners, consult the logs
+    and the project website <https://www.gpusph.org>
+
+    GPUSPH is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GPUSPH is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GPUSPH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "TemporalStatistics.h"
+
+#include "GlobalData.h"
+#include "NetworkManager.h"
+#include "parallel_for.h"
+
+using namespace std;
+
+//! Version of the saved state
+#define STATS_STATE_VERSION 1
+
+namespace {
+
+//! A field accumulated by the STATISTICS engine
+struct StatsField
+{
+	StatisticsOptions flag;
+	const char *name;
+	uint ncomp;
+};
+
+const StatsField stats_fields[] = {
+	{ STATS_VELOCITY, "Velocity", 3 },
+	{ STATS_PRESSURE, "Pressure", 1 },
+	{ STATS_DENSITY, "Density", 1 },
+};
+
+template<typename T>
+void write_pod(ostream &out, T const& val)
+{ out.write((const char*)&val, sizeof(val)); }
+
+template<typename T>
+T read_pod(istream &in)
+{
+	T val;
+	in.read((char*)&val, sizeof(val));
+	if (!in)
+		throw runtime_error("truncated statistics state");
+	return val;
+}
+
+//! Writer of a VTK XML file with raw appended data
+/*! The arrays are declared first (with add()), and their content is written
+ * at the end (with finish()), calling the given fillers in order
+ */
+class AppendedVTKFile
+{
+	ofstream &m_out;
+	size_t m_offset;
+	vector< function<void(void)> > m_fillers;
+
+public:
+	AppendedVTKFile(ofstream &out) : m_out(out), m_offset(0) {}
+
+	//! Declare an array of count elements with ncomp components of the given VTK type,
+	//! filled by fill(i, dst) for each element
+	template<typename T, typename Fill>
+	void add(const char *type, string const& name, uint ncomp, size_t count, Fill fill)
+	{
+		m_out << "    <DataArray type='" << type << "' Name='" << name << "'";
+		if (ncomp > 1)
+			m_out << " NumberOfComponents='" << ncomp << "'";
+		m_out << " format='appended' offset='" << m_offset << "'/>\n";
+		m_offset += sizeof(uint) + sizeof(T)*ncomp*count;
+
+		ofstream *out = &m_out;
+		m_fillers.push_back([out, ncomp, count, fill]() {
+			const uint bytes = sizeof(T)*ncomp*count;
+			write_pod(*out, bytes);
+			vector<T> buf(ncomp);
+			for (size_t i = 0; i < count; ++i) {
+				fill(i, buf.data());
+				out->write((const char*)buf.data(), sizeof(T)*ncomp);
+			}
+		});
+	}
+
+	void finish()
+	{
+		m_out << " <AppendedData encoding='raw'>\n_";
+		for (auto& fill : m_fillers)
+			fill();
+		m_out << "\n </AppendedData>\n</VTKFile>\n";
+	}
+};
+
+/* Endianness check, as in the VTKWriter */
+const char *byte_order()
+{
+	static const int endian_int = 1;
+	return *(const char*)&endian_int ? "LittleEndian" : "BigEndian";
+}
+
+}
+
+/*
+ * Accumulators
+ */
+
+constexpr size_t TemporalStatistics::Accumulator::NO_ITEM;
+
+size_t
+TemporalStatistics::Accumulator::find(ulong key) const
+{
+	if (!sparse)
+		return key < size() ? key : NO_ITEM;
+	const auto found = items.find(key);
+	return found == items.end() ? NO_ITEM : found->second;
+}
+
+size_t
+TemporalStatistics::Accumulator::insert(ulong key)
+{
+	const auto added = items.insert(make_pair(key, size()));
+	if (added.second) {
+		resize(size() + 1);
+		keys.back() = key;
+	}
+	return added.first->second;
+}
+
+void
+TemporalStatistics::Accumulator::resize(size_t nitems)
+{
+	if (sparse)
+		keys.resize(nitems);
+	count.resize(nitems, 0);
+	mean.resize(nitems*ncomp, 0.0);
+	m2.resize(nitems*ncomp, 0.0);
+	min.resize(nitems*ncomp, FLT_MAX);
+	max.resize(nitems*ncomp, -FLT_MAX);
+}
+
+void
+TemporalStatistics::Accumulator::add(size_t item, const double *values)
+{
+	const uint n = ++count[item];
+	const size_t base = item*ncomp;
+	for (uint c = 0; c < ncomp; ++c) {
+		const double x = values[c];
+		const double delta = x - mean[base + c];
+		mean[base + c] += delta/n;
+		m2[base + c] += delta*(x - mean[base + c]);
+		min[base + c] = std::min(min[base + c], float(x));
+		max[base + c] = std::max(max[base + c], float(x));
+	}
+}
+
+void
+TemporalStatistics::Accumulator::merge(size_t item, uint nb, const double *bmean, const double *bm2,
+	const float *bmin, const float *bmax)
+{
+	if (!nb)
+		return;
+	const uint na = count[item];
+	const double n = double(na) + nb;
+	const size_t base = item*ncomp;
+	for (uint c = 0; c < ncomp; ++c) {
+		const double delta = bmean[c] - mean[base + c];
+		mean[base + c] += delta*nb/n;
+		m2[base + c] += bm2[c] + delta*delta*(double(na)*nb/n);
+		min[base + c] = std::min(min[base + c], bmin[c]);
+		max[base + c] = std::max(max[base + c], bmax[c]);
+	}
+	count[item] = na + nb;
+}
+
+void
+TemporalStatistics::Accumulator::pack(ostream &out) const
+{
+	const size_t items = size();
+	ulong nonempty = 0;
+	for (size_t i = 0; i < items; ++i)
+		nonempty += (count[i] > 0);
+
+	write_pod(out, ncomp);
+	write_pod(out, ulong(items));
+	write_pod(out, nonempty);
+	for (size_t i = 0; i < items; ++i) {
+		if (!count[i])
+			continue;
+		const size_t base = i*ncomp;
+		write_pod(out, key(i));
+		write_pod(out, count[i]);
+		out.write((const char*)&mean[base], ncomp*sizeof(double));
+		out.write((const char*)&m2[base], ncomp*sizeof(double));
+		out.write((const char*)&min[base], ncomp*sizeof(float));
+		out.write((const char*)&max[base], ncomp*sizeof(float));
+	}
+}
+
+void
+TemporalStatistics::Accumulator::unpack(istream &in)
+{
+	const uint nc = read_pod<uint>(in);
+	if (nc != ncomp) {
+		ostringstream err;
+		err << "mismatched statistics components: " << nc << " saved, " << ncomp << " expected";
+		throw runtime_error(err.str());
+	}
+	const ulong nitems = read_pod<ulong>(in);
+	const ulong nonempty = read_pod<ulong>(in);
+	// dense accumulators cover all the keys of the saved one
+	if (!sparse && nitems > size())
+		resize(nitems);
+
+	vector<double> bmean(ncomp), bm2(ncomp);
+	vector<float> bmin(ncomp), bmax(ncomp);
+	for (ulong k = 0; k < nonempty; ++k) {
+		const ulong key = read_pod<ulong>(in);
+		const uint n = read_pod<uint>(in);
+		in.read((char*)bmean.data(), ncomp*sizeof(double));
+		in.read((char*)bm2.data(), ncomp*sizeof(double));
+		in.read((char*)bmin.data(), ncomp*sizeof(float));
+		in.read((char*)bmax.data(), ncomp*sizeof(float));
+		if (!in || (!sparse && key >= nitems))
+			throw runtime_error("corrupted statistics state");
+		merge(sparse ? insert(key) : key, n, bmean.data(), bm2.data(), bmin.data(), bmax.data());
+	}
+}
+
+/*
+ * Engine
+ */
+
+TemporalStatistics::TemporalStatistics(const GlobalData *_gdata, flag_t options) :
+	gdata(_gdata),
+	m_options(options),
+	m_params(_gdata->problem->get_statistics()),
+	m_threads(configured_host_threads(_gdata->clOptions->host_threads)),
+	m_ncomp(0),
+	m_next_sample(m_params.start),
+	m_samples(0),
+	m_flushes(0)
+{
+	for (StatsField const& field : stats_fields)
+		if (m_options & field.flag)
+			m_ncomp += field.ncomp;
+
+	if (!m_ncomp)
+		throw invalid_argument("STATISTICS enabled without any field to accumulate");
+	if (!(m_options & (STATS_PER_PARTICLE | STATS_EULERIAN)))
+		throw invalid_argument("STATISTICS enabled without STATS_PER_PARTICLE or STATS_EULERIAN");
+
+	// per-particle statistics accumulate the position too
+	if (m_options & STATS_PER_PARTICLE)
+		m_particles = Accumulator(m_ncomp + 3, true);
+
+	if (m_options & STATS_EULERIAN) {
+		const double3 size = m_params.grid_upper - m_params.grid_lower;
+		if (!m_params.num_bins() || !(size.x > 0 && size.y > 0 && size.z > 0))
+			throw invalid_argument("STATS_EULERIAN enabled without a valid statistics grid");
+		m_bins = Accumulator(m_ncomp);
+		// the bins are accumulated by the first process only
+		if (gdata->mpi_rank <= 0)
+			m_bins.resize(m_params.num_bins());
+	}
+}
+
+double3
+TemporalStatistics::bin_size() const
+{
+	const uint3 gsize = m_params.grid_size;
+	return (m_params.grid_upper - m_params.grid_lower)/
+		make_double3(double(gsize.x), double(gsize.y), double(gsize.z));
+}
+
+flag_t
+TemporalStatistics::sampled_buffers(double t) const
+{
+	if (t < m_next_sample)
+		return NO_FLAGS;
+	return BUFFER_POS | BUFFER_HASH | BUFFER_VEL | BUFFER_INFO;
+}
+
+void
+TemporalStatistics::field_values(float4 const& vel, particleinfo const& info, double *values) const
+{
+	const int fluid = fluid_num(info);
+	if (m_options & STATS_VELOCITY) {
+		*values++ = vel.x;
+		*values++ = vel.y;
+		*values++ = vel.z;
+	}
+	if (m_options & STATS_PRESSURE)
+		*values++ = gdata->problem->pressure(vel.w, fluid);
+	if (m_options & STATS_DENSITY)
+		*values++ = gdata->problem->physical_density(vel.w, fluid);
+}
+
+void
+TemporalStatistics::sample(BufferList const& buffers, uint node_offset, uint numParts)
+{
+	if (m_options & STATS_PER_PARTICLE)
+		sample_particles(buffers, node_offset, numParts);
+	if (m_options & STATS_EULERIAN)
+		sample_bins(buffers, node_offset, numParts);
+
+	++m_samples;
+	// the next sample is at the first multiple of the interval after the current time,
+	// so that the sampling times do not drift with the time-step
+	const double t = gdata->t;
+	if (m_params.interval > 0)
+		m_next_sample = m_params.start + m_params.interval*(floor((t - m_params.start)/m_params.interval) + 1);
+	else
+		m_next_sample = t;
+}
+
+void
+TemporalStatistics::sample_particles(BufferList const& buffers, uint node_offset, uint numParts)
+{
+	const GlobalPosAccessor pos(gdata, buffers);
+	const float4 *vel = buffers.getData<BUFFER_VEL>();
+	const particleinfo *info = buffers.getData<BUFFER_INFO>();
+
+	// find the items of the particles already sampled by this process in parallel,
+	// and add the ones of the new particles (e.g. created by open boundaries,
+	// or migrated from another process) serially
+	m_item_of.resize(numParts);
+	parallel_for_chunks(m_threads, 0, numParts, [&](uint, size_t b, size_t e) {
+		for (size_t k = b; k < e; ++k) {
+			const particleinfo pinfo = info[node_offset + k];
+			m_item_of[k] = FLUID(pinfo) ? m_particles.find(id(pinfo)) : Accumulator::NO_ITEM;
+		}
+	});
+	for (uint k = 0; k < numParts; ++k) {
+		const particleinfo pinfo = info[node_offset + k];
+		if (FLUID(pinfo) && m_item_of[k] == Accumulator::NO_ITEM)
+			m_item_of[k] = m_particles.insert(id(pinfo));
+	}
+
+	// ids are unique, so that each thread updates different items
+	parallel_for_chunks(m_threads, 0, numParts, [&](uint, size_t b, size_t e) {
+		vector<double> values(m_particles.ncomp);
+		for (size_t k = b; k < e; ++k) {
+			const size_t item = m_item_of[k];
+			if (item == Accumulator::NO_ITEM)
+				continue;
+			const size_t i = node_offset + k;
+			const double4 p = pos[i];
+			values[0] = p.x;
+			values[1] = p.y;
+			values[2] = p.z;
+			field_values(vel[i], info[i], values.data() + 3);
+			m_particles.add(item, values.data());
+		}
+	});
+}
+
+void
+TemporalStatistics::sample_bins(BufferList const& buffers, uint node_offset, uint numParts)
+{
+	const GlobalPosAccessor pos(gdata, buffers);
+	const float4 *vel = buffers.getData<BUFFER_VEL>();
+	const particleinfo *info = buffers.getData<BUFFER_INFO>();
+
+	const uint3 gsize = m_params.grid_size;
+	const double3 lower = m_params.grid_lower;
+	const double3 cell = bin_size();
+	const size_t nbins = m_params.num_bins();
+	const uint stride = m_ncomp + 1;
+
+	// bin of each particle, -1 if outside the grid (or not fluid)
+	m_bin_of.resize(numParts);
+	parallel_for_chunks(m_threads, 0, numParts, [&](uint, size_t b, size_t e) {
+		for (size_t k = b; k < e; ++k) {
+			const size_t i = node_offset + k;
+			m_bin_of[k] = -1;
+			if (!FLUID(info[i]))
+				continue;
+			const double4 p = pos[i];
+			const double fx = floor((p.x - lower.x)/cell.x);
+			const double fy = floor((p.y - lower.y)/cell.y);
+			const double fz = floor((p.z - lower.z)/cell.z);
+			if (!(fx >= 0 && fy >= 0 && fz >= 0 &&
+				fx < gsize.x && fy < gsize.y && fz < gsize.z))
+				continue;
+			m_bin_of[k] = int((uint(fz)*gsize.y + uint(fy))*gsize.x + uint(fx));
+		}
+	});
+
+	// counting sort of the particles by bin, so that the bins can be
+	// summed in parallel
+	m_bin_start.assign(nbins + 1, 0);
+	for (uint k = 0; k < numParts; ++k)
+		if (m_bin_of[k] >= 0)
+			++m_bin_start[m_bin_of[k] + 1];
+	for (size_t b = 0; b < nbins; ++b)
+		m_bin_start[b + 1] += m_bin_start[b];
+	m_bin_parts.resize(m_bin_start[nbins]);
+	{
+		vector<uint> fill(m_bin_start.begin(), m_bin_start.end() - 1);
+		for (uint k = 0; k < numParts; ++k)
+			if (m_bin_of[k] >= 0)
+				m_bin_parts[fill[m_bin_of[k]]++] = node_offset + k;
+	}
+
+	// sum of the fields and number of particles in each bin
+	m_bin_sums.assign(nbins*stride, 0.0);
+	parallel_for_chunks(m_threads, 0, nbins, [&](uint, size_t b, size_t e) {
+		vector<double> values(m_ncomp);
+		for (size_t bin = b; bin < e; ++bin) {
+			double *sums = m_bin_sums.data() + bin*stride;
+			for (uint k = m_bin_start[bin]; k < m_bin_start[bin + 1]; ++k) {
+				const uint i = m_bin_parts[k];
+				field_values(vel[i], info[i], values.data());
+				for (uint c = 0; c < m_ncomp; ++c)
+					sums[c] += values[c];
+			}
+			sums[m_ncomp] = m_bin_start[bin + 1] - m_bin_start[bin];
+		}
+	}, 256);
+
+	// the particles of a bin may be spread across processes
+	if (gdata->mpi_nodes > 1)
+		gdata->networkManager->networkDoubleReduction(m_bin_sums.data(), m_bin_sums.size(), SUM_REDUCTION);
+
+	if (gdata->mpi_rank > 0)
+		return;
+
+	// the sample of each (non-empty) bin is the average of its particles
+	parallel_for_chunks(m_threads, 0, nbins, [&](uint, size_t b, size_t e) {
+		vector<double> values(m_ncomp);
+		for (size_t bin = b; bin < e; ++bin) {
+			const double *sums = m_bin_sums.data() + bin*stride;
+			const double n = sums[m_ncomp];
+			if (!n)
+				continue;
+			for (uint c = 0; c < m_ncomp; ++c)
+				values[c] = sums[c]/n;
+			m_bins.add(bin, values.data());
+		}
+	}, 256);
+}
+
+void
+TemporalStatistics::flush()
+{
+	const bool root = (gdata->mpi_rank <= 0);
+
+	// merge the per-particle statistics of all processes on the first one
+	Accumulator merged(m_particles.ncomp, true);
+	const Accumulator *particles = &m_particles;
+	if ((m_options & STATS_PER_PARTICLE) && gdata->mpi_nodes > 1) {
+		ostringstream packed;
+		m_particles.pack(packed);
+		vector<string> all;
+		gdata->networkManager->gatherCheckpoint(0, packed.str(), all);
+		if (root) {
+			for (string const& part : all) {
+				istringstream in(part);
+				merged.unpack(in);
+			}
+		}
+		particles = &merged;
+	}
+
+	if (!root)
+		return;
+
+	const string dir = gdata->problem->get_dirname() + "/data/";
+	ostringstream num;
+	num << setw(5) << setfill('0') << m_flushes;
+
+	if (m_options & STATS_PER_PARTICLE)
+		write_particles(*particles, dir + "statistics_particles_" + num.str() + ".vtu");
+	if (m_options & STATS_EULERIAN)
+		write_bins(dir + "statistics_grid_" + num.str() + ".vti");
+
+	cout << "Statistics of " << m_samples << " samples written at t=" << gdata->t << endl;
+	++m_flushes;
+}
+
+/* Declare the statistics arrays of the fields, for the items in the given list */
+static void
+add_field_arrays(AppendedVTKFile &vtk, flag_t options, uint offset,
+	const uint *count, const double *mean, const double *m2,
+	const float *min, const float *max, uint ncomp, vector<size_t> const& items)
+{
+	const size_t nitems = items.size();
+	for (StatsField const& field : stats_fields) {
+		if (!(options & field.flag))
+			continue;
+		const uint fc = field.ncomp;
+		const string name(field.name);
+
+		vtk.add<float>("Float32", name + " mean", fc, nitems, [=, &items](size_t i, float *dst) {
+			for (uint c = 0; c < fc; ++c)
+				dst[c] = mean[items[i]*ncomp + offset + c];
+		});
+		vtk.add<float>("Float32", name + " variance", fc, nitems, [=, &items](size_t i, float *dst) {
+			const uint n = count[items[i]];
+			for (uint c = 0; c < fc; ++c)
+				dst[c] = n > 1 ? m2[items[i]*ncomp + offset + c]/(n - 1) : 0;
+		});
+		vtk.add<float>("Float32", name + " min", fc, nitems, [=, &items](size_t i, float *dst) {
+			for (uint c = 0; c < fc; ++c)
+				dst[c] = min[items[i]*ncomp + offset + c];
+		});
+		vtk.add<float>("Float32", name + " max", fc, nitems, [=, &items](size_t i, float *dst) {
+			for (uint c = 0; c < fc; ++c)
+				dst[c] = max[items[i]*ncomp + offset + c];
+		});
+		offset += fc;
+	}
+}
+
+void
+TemporalStatistics::write_particles(Accumulator const& acc, string const& fname) const
+{
+	// write the particles by id, independently of the order in which they were first sampled
+	vector<size_t> items;
+	for (size_t i = 0; i < acc.size(); ++i)
+		if (acc.count[i])
+			items.push_back(i);
+	sort(items.begin(), items.end(), [&acc](size_t a, size_t b) { return acc.key(a) < acc.key(b); });
+	const size_t npts = items.size();
+
+	ofstream out(fname.c_str(), ios::binary);
+	if (!out)
+		throw runtime_error("cannot open " + fname);
+
+	out << "<?xml version='1.0'?>\n";
+	out << "<VTKFile type='UnstructuredGrid' version='0.1' byte_order='" << byte_order() << "'>\n";
+	out << " <UnstructuredGrid>\n";
+	out << "  <Piece NumberOfPoints='" << npts << "' NumberOfCells='" << npts << "'>\n";
+
+	AppendedVTKFile vtk(out);
+	const uint *count = acc.count.data();
+	const double *mean = acc.mean.data();
+	const uint nc = acc.ncomp;
+
+	out << "   <PointData>\n";
+	vtk.add<uint>("UInt32", "Part id", 1, npts, [&](size_t i, uint *dst) { *dst = acc.key(items[i]); });
+	vtk.add<uint>("UInt32", "Samples", 1, npts, [&](size_t i, uint *dst) { *dst = count[items[i]]; });
+	add_field_arrays(vtk, m_options, 3, count, mean, acc.m2.data(),
+		acc.min.data(), acc.max.data(), nc, items);
+	out << "   </PointData>\n";
+
+	out << "   <Points>\n";
+	vtk.add<double>("Float64", "Mean position", 3, npts, [&](size_t i, double *dst) {
+		for (uint c = 0; c < 3; ++c)
+			dst[c] = mean[items[i]*nc + c];
+	});
+	out << "   </Points>\n";
+
+	out << "   <Cells>\n";
+	vtk.add<int>("Int32", "connectivity", 1, npts, [](size_t i, int *dst) { *dst = i; });
+	vtk.add<int>("Int32", "offsets", 1, npts, [](size_t i, int *dst) { *dst = i + 1; });
+	vtk.add<uchar>("UInt8", "types", 1, npts, [](size_t, uchar *dst) { *dst = 1; }); // VTK_VERTEX
+	out << "   </Cells>\n";
+
+	out << "  </Piece>\n";
+	out << " </UnstructuredGrid>\n";
+	vtk.finish();
+}
+
+void
+TemporalStatistics::write_bins(string const& fname) const
+{
+	const uint3 gsize = m_params.grid_size;
+	const double3 lower = m_params.grid_lower;
+	const double3 cell = bin_size();
+	const size_t nbins = m_params.num_bins();
+
+	vector<size_t> items(nbins);
+	for (size_t b = 0; b < nbins; ++b)
+		items[b] = b;
+
+	ofstream out(fname.c_str(), ios::binary);
+	if (!out)
+		throw runtime_error("cannot open " + fname);
+
+	ostringstream extent;
+	extent << "0 " << gsize.x << " 0 " << gsize.y << " 0 " << gsize.z;
+
+	out << setprecision(16);
+	out << "<?xml version='1.0'?>\n";
+	out << "<VTKFile type='ImageData' version='0.1' byte_order='" << byte_order() << "'>\n";
+	out << " <ImageData WholeExtent='" << extent.str() << "'"
+		<< " Origin='" << lower.x << " " << lower.y << " " << lower.z << "'"
+		<< " Spacing='" << cell.x << " " << cell.y << " " << cell.z << "'>\n";
+	out << "  <Piece Extent='" << extent.str() << "'>\n";
+
+	AppendedVTKFile vtk(out);
+	const uint *count = m_bins.count.data();
+
+	out << "   <CellData>\n";
+	vtk.add<uint>("UInt32", "Samples", 1, nbins, [&](size_t i, uint *dst) { *dst = count[i]; });
+	add_field_arrays(vtk, m_options, 0, count, m_bins.mean.data(), m_bins.m2.data(),
+		m_bins.min.data(), m_bins.max.data(), m_bins.ncomp, items);
+	out << "   </CellData>\n";
+
+	out << "  </Piece>\n";
+	out << " </ImageData>\n";
+	vtk.finish();
+}
+
+/*
+ * State
+ */
+
+void
+TemporalStatistics::save(ostream &out) const
+{
+	write_pod(out, uint(STATS_STATE_VERSION));
+	write_pod(out, m_options);
+	write_pod(out, m_next_sample);
+	write_pod(out, m_samples);
+	write_pod(out, m_flushes);
+	if (m_options & STATS_PER_PARTICLE)
+		m_particles.pack(out);
+	if (m_options & STATS_EULERIAN)
+		m_bins.pack(out);
+}
+
+void
+TemporalStatistics::load(istream &in, bool accumulators)
+{
+	const uint version = read_pod<uint>(in);
+	if (version != STATS_STATE_VERSION) {
+		ostringstream err;
+		err << "unsupported statistics state version " << version;
+		throw runtime_error(err.str());
+	}
+	const flag_t options = read_pod<flag_t>(in);
+	if (options != m_options)
+		throw runtime_error("the statistics options differ from the ones of the resumed simulation");
+
+	// all processes sample at the same times, so these are the same in all states
+	m_next_sample = read_pod<double>(in);
+	m_samples = read_pod<ulong>(in);
+	m_flushes = read_pod<uint>(in);
+
+	if (!accumulators)
+		return;
+
+	if (m_options & STATS_PER_PARTICLE)
+		m_particles.unpack(in);
+	if (m_options & STATS_EULERIAN) {
+		// only the first process saves the bins
+		Accumulator bins(m_bins.ncomp);
+		bins.unpack(in);
+		if (bins.size() && bins.size() != m_params.num_bins())
+			throw runtime_error("the statistics grid differs from the one of the resumed simulation");
+		if (bins.size()) {
+			if (!m_bins.size())
+				m_bins.resize(m_params.num_bins());
+			for (size_t b = 0; b < bins.size(); ++b)
+				m_bins.merge(b, bins.count[b], &bins.mean[b*bins.ncomp], &bins.m2[b*bins.ncomp],
+					&bins.min[b*bins.ncomp], &bins.max[b*bins.ncomp]);
+		}
+	}
+}
@@ -0,0 +1,242 @@
+/*  Copyright (c) 2019 INGV, EDF, UniCT, JHU
+
+    Istituto Nazionale di Geofisica e Vulcanologia, Sezione di Catania, Italy
+    Électricité de France, Paris, France
+    Università di Catania, Catania, Italy
+    Johns Hopkins University, Baltimore (MD), USA
+
+    This file is part of GPUSPH. Project founders:
+        Alexis Hérault, Giuseppe Bilotta, Robert A. Dalrymple,
+        Eugenio Rustico, Ciro Del Negro
+    For a full list of authors and project partners, consult the logs
+    and the project website <https://www.gpusph.org>
+
+    GPUSPH is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GPUSPH is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GPUSPH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*! \file
+ * In-situ temporal statistics of the particle fields
+ *
+ * The STATISTICS post-processing engine samples the selected fields
+ * at a fixed interval of simulated time, accumulating their running mean
+ * and variance (with Welford's algorithm) and their extrema, either per particle
+ * (by particle id) or on the bins of an Eulerian grid. Only the accumulated
+ * statistics are written, at checkpoints and at the end of the simulation,
+ * and they are stored in the HotFiles so that they survive a restart.
+ */
+
+#ifndef _TEMPORALSTATISTICS_H
+#define _TEMPORALSTATISTICS_H
+
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common_types.h"
+#include "particleinfo.h"
+#include "vector_math.h"
+
+// BufferList
+#include "buffer.h"
+
+struct GlobalData;
+
+//! Options of the STATISTICS post-processing engine
+/*! The fields and the accumulation modes are passed as options
+ * to the engine, e.g.:
+ * \code
+ * addPostProcess(STATISTICS, STATS_VELOCITY | STATS_PRESSURE | STATS_EULERIAN);
+ * \endcode
+ */
+enum StatisticsOptions
+{
+	STATS_VELOCITY = 1, ///< velocity (3 components)
+	STATS_PRESSURE = (STATS_VELOCITY << 1), ///< pressure
+	STATS_DENSITY = (STATS_PRESSURE << 1), ///< physical density
+	STATS_PER_PARTICLE = (STATS_DENSITY << 1), ///< accumulate per particle id
+	STATS_EULERIAN = (STATS_PER_PARTICLE << 1), ///< accumulate on the grid of the StatisticsParams
+};
+
+//! All the fields supported by the STATISTICS engine
+#define STATS_ALL_FIELDS (STATS_VELOCITY | STATS_PRESSURE | STATS_DENSITY)
+
+/*! Sampling parameters for the STATISTICS post-processing engine,
+ * set by the problem with ProblemCore::set_statistics(), e.g.:
+ * \code
+ * set_statistics(StatisticsParams().every(0.01).from(5.0)
+ *	.grid(make_double3(0, 0, 0), make_double3(2, 1, 0.5), make_uint3(200, 1, 50)));
+ * \endcode
+ */
+struct StatisticsParams
+{
+	double interval; ///< simulated time between samples (0: every iteration)
+	double start; ///< time of the first sample (e.g. to skip the initial transient)
+	double3 grid_lower; ///< lower corner of the Eulerian grid
+	double3 grid_upper; ///< upper corner of the Eulerian grid
+	uint3 grid_size; ///< number of bins of the Eulerian grid in each direction
+
+	StatisticsParams() :
+		interval(0),
+		start(0),
+		grid_lower(make_double3(0.0)),
+		grid_upper(make_double3(0.0)),
+		grid_size(make_uint3(0))
+	{}
+
+	//! Sample every dt of simulated time
+	StatisticsParams& every(double dt)
+	{ interval = dt; return *this; }
+
+	//! Start sampling at time t
+	StatisticsParams& from(double t)
+	{ start = t; return *this; }
+
+	//! Eulerian grid of nx x ny x nz bins on the axis-aligned box from lower to upper
+	StatisticsParams& grid(double3 const& lower, double3 const& upper, uint3 const& size)
+	{ grid_lower = lower; grid_upper = upper; grid_size = size; return *this; }
+
+	//! Total number of bins of the Eulerian grid
+	size_t num_bins() const
+	{ return size_t(grid_size.x)*grid_size.y*grid_size.z; }
+};
+
+/*! Host-side accumulator of the STATISTICS post-processing engine
+ *
+ * Fluid particles only are sampled. Per-particle statistics also accumulate the
+ * position, whose mean is used to place the particle in the output.
+ * The value of an Eulerian bin at each sample is the average over the fluid
+ * particles in the bin, and empty bins are not sampled, so that the number
+ * of samples can differ between bins (e.g. near the free surface).
+ *
+ * In multi-node simulations, each process accumulates the per-particle
+ * statistics of the samples it holds, in a table indexed by the ids of the
+ * particles it has seen (rather than by all the ids), and the partial results are merged
+ * (exactly, with Chan's formula) when writing; the Eulerian bins are reduced
+ * across the network at each sample, and accumulated by the first process.
+ * Each process stores its own accumulators in its HotFile.
+ *
+ * Statistics are written to the data directory, as statistics_particles_*.vtu
+ * (vertex cells at the mean particle position) and statistics_grid_*.vti
+ * (one cell per bin), with the number of samples and the mean, variance
+ * (unbiased), minimum and maximum of each field.
+ */
+class TemporalStatistics
+{
+	//! Welford accumulators for a set of items, with ncomp components each
+	/*! Items are identified by a key: in a dense accumulator, the key is the
+	 * item index itself, while a sparse accumulator adds an item the first
+	 * time a key is seen, and maps the keys to the items with a hash table
+	 */
+	struct Accumulator
+	{
+		//! Item returned by find() for missing keys
+		static constexpr size_t NO_ITEM = ~size_t(0);
+
+		uint ncomp;
+		bool sparse;
+		std::vector<ulong> keys; ///< key of each item (sparse only)
+		std::unordered_map<ulong, size_t> items; ///< item of each key (sparse only)
+		std::vector<uint> count;
+		std::vector<double> mean;
+		std::vector<double> m2;
+		std::vector<float> min;
+		std::vector<float> max;
+
+		Accumulator(uint _ncomp = 0, bool _sparse = false) :
+			ncomp(_ncomp), sparse(_sparse)
+		{}
+
+		size_t size() const
+		{ return count.size(); }
+
+		ulong key(size_t item) const
+		{ return sparse ? keys[item] : item; }
+
+		//! Item of the given key, NO_ITEM if missing
+		size_t find(ulong key) const;
+		//! Item of the given key, added if missing (sparse only)
+		size_t insert(ulong key);
+
+		void resize(size_t nitems);
+		//! Add a sample for the given item
+		void add(size_t item, const double *values);
+		//! Merge the statistics of another set of samples into the given item
+		void merge(size_t item, uint n, const double *bmean, const double *bm2,
+			const float *bmin, const float *bmax);
+
+		//! Write the non-empty items
+		void pack(std::ostream &out) const;
+		//! Read items written by pack(), merging them into the ones with the same key
+		void unpack(std::istream &in);
+	};
+
+	const GlobalData *gdata;
+	const flag_t m_options;
+	const StatisticsParams m_params;
+	const uint m_threads;
+
+	//! Number of field components (excluding the position of per-particle statistics)
+	uint m_ncomp;
+	double m_next_sample;
+	ulong m_samples;
+	uint m_flushes;
+
+	Accumulator m_particles;
+	Accumulator m_bins;
+
+	// per-particle sampling work area (accumulator item of each particle), reused across samples
+	std::vector<size_t> m_item_of;
+
+	// Eulerian sampling work areas, reused across samples
+	std::vector<int> m_bin_of;
+	std::vector<uint> m_bin_start;
+	std::vector<uint> m_bin_parts;
+	std::vector<double> m_bin_sums;
+
+	double3 bin_size() const;
+	void field_values(float4 const& vel, particleinfo const& info, double *values) const;
+	void sample_particles(BufferList const& buffers, uint node_offset, uint numParts);
+	void sample_bins(BufferList const& buffers, uint node_offset, uint numParts);
+
+	void write_particles(Accumulator const& acc, std::string const& fname) const;
+	void write_bins(std::string const& fname) const;
+
+public:
+	TemporalStatistics(const GlobalData *_gdata, flag_t options);
+
+	//! Buffers needed to sample at time t, NO_FLAGS if no sample is due
+	flag_t sampled_buffers(double t) const;
+
+	//! Sample the particles of this process
+	/*! Must be called on all processes at the same time
+	 */
+	void sample(BufferList const& buffers, uint node_offset, uint numParts);
+
+	//! Write the accumulated statistics
+	/*! Must be called on all processes at the same time
+	 */
+	void flush();
+
+	//! Save the state of the accumulators of this process
+	void save(std::ostream &out) const;
+	//! Load a state saved by save()
+	/*! The accumulators are merged into ours only if accumulators is true,
+	 * so that the states of more processes can be combined into one
+	 */
+	void load(std::istream &in, bool accumulators);
+};
+
+#endif
@@ -44,6 +44,8 @@
 #include "VTKWriter.h"
 #include "Writer.h"
 #include "HotWriter.h"
+#include "ProbeWriter.h"
+#include "SurfaceWriter.h"
 
 #include "catalyst_select.opt"
 #if USE_CATALYST == 1
@@ -65,7 +67,9 @@ static const char* WriterName[] = {
 	"CustomTextWriter",
 	"UDPWriter",
 	"HotWriter",
-	"DisplayWriter"
+	"DisplayWriter",
+	"ProbeWriter",
+	"SurfaceWriter"
 };
 
 const char* Writer::Name(WriterType key)
@@ -128,6 +132,12 @@ Writer::Create(GlobalData *_gdata)
 			case CALLBACKWRITER:
 				writer = new CallbackWriter(_gdata);
 				break;
+			case PROBEWRITER:
+				writer = new ProbeWriter(_gdata);
+				break;
+			case SURFACEWRITER:
+				writer = new SurfaceWriter(_gdata);
+				break;
 #if USE_CATALYST == 1
 			case DISPLAYWRITER:
 				writer = new DisplayWriter(_gdata);
@@ -164,6 +174,24 @@ Writer::Create(GlobalData *_gdata)
 
 	avg_freq /= avg_count;
 
+	/* Output profiles: these are handled by the writer itself, which is
+	 * created (with its own output disabled) if the problem didn't ask for it */
+	for (WriterProfile const& wp : problem->get_writer_profiles()) {
+		if (wp.type != VTKWRITER) {
+			cerr << WriterName[wp.type] << " does not support output profiles, ignoring profile "
+				<< wp.profile.name << endl;
+			continue;
+		}
+
+		WriterMap::iterator wm = m_writers.find(wp.type);
+		if (wm == m_writers.end()) {
+			Writer *writer = new VTKWriter(_gdata);
+			writer->set_write_freq(-1);
+			wm = m_writers.insert(make_pair(wp.type, writer)).first;
+		}
+		static_cast<VTKWriter*>(wm->second)->add_profile(wp.profile, wp.freq);
+	}
+
 	/* Checkpoint setup: we setup a HOTWRITER if it's missing,
 	 * change its frequency if present, and set the number of checkpoints
 	 * as appropriate
@@ -334,10 +362,9 @@ Writer::FakeMarkWritten(ConstWriterMap writers, double t)
 			continue;
 
 		Writer *writer = const_cast<Writer*>(it->second);
-		// Only call the default mark_written (which simply resets the last write
-		// time), since we didn't actually do any of the writer-specific start_writing
-		// stuff
-		writer->Writer::mark_written(t);
+		// Don't call the writer-specific mark_written, since we didn't actually
+		// do any of the writer-specific start_writing stuff
+		writer->fake_mark_written(t, m_write_flags);
 	}
 
 	if (common_special && !writers.empty())
@@ -562,6 +589,43 @@ Writer::~Writer()
 	// hi
 }
 
+GlobalPosAccessor::GlobalPosAccessor(const GlobalData *_gdata, BufferList const& buffers) :
+	gdata(_gdata),
+	m_pos(buffers.getData<BUFFER_POS>()),
+	m_hash(buffers.getData<BUFFER_HASH>()),
+	m_gpos(NULL),
+	m_worldOrigin(_gdata->problem->get_worldorigin())
+{
+	// only fall back to the stored global positions if we can't compute them
+	if (!(m_pos && m_hash) && (buffers.get_keys() & BUFFER_POS_GLOBAL))
+		m_gpos = buffers.getData<BUFFER_POS_GLOBAL>();
+}
+
+double4
+GlobalPosAccessor::operator[](size_t i) const
+{
+	if (!(m_pos && m_hash))
+		return m_gpos[i];
+
+	const float4 pos = m_pos[i];
+	const uint3 gridPos = gdata->calcGridPosFromCellHash( cellHashFromParticleHash(m_hash[i]) );
+	return make_double4(
+		gdata->calcGlobalPosOffset(gridPos, as_float3(pos)) + m_worldOrigin,
+		pos.w);
+}
+
+void
+GlobalPosAccessor::fill(double4 *dst, size_t first, size_t count) const
+{
+	if (!(m_pos && m_hash)) {
+		copy(m_gpos + first, m_gpos + first + count, dst);
+		return;
+	}
+
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = (*this)[first + i];
+}
+
 void
 Writer::set_write_freq(double f)
 {
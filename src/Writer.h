@@ -55,6 +55,15 @@
 // StepInfo
 #include "command_type.h"
 
+// OutputProfile
+#include "OutputProfile.h"
+
+// ProbeSet
+#include "ProbeSet.h"
+
+// SurfaceMeshParams
+#include "SurfaceMeshParams.h"
+
 // deprecation macros
 // #include "deprecation.h"
 
@@ -77,12 +86,29 @@ enum WriterType
 	CUSTOMTEXTWRITER,
 	UDPWRITER,
 	HOTWRITER,
-	DISPLAYWRITER
+	DISPLAYWRITER,
+	PROBEWRITER,
+	SURFACEWRITER
 };
 
 // list of writer type, write freq pairs
 typedef std::vector<std::pair<WriterType, double> > WriterList;
 
+// an output profile for a writer, with its own write frequency
+struct WriterProfile
+{
+	WriterType type;
+	double freq;
+	OutputProfile profile;
+
+	WriterProfile(WriterType _type, double _freq, OutputProfile const& _profile) :
+		type(_type), freq(_freq), profile(_profile)
+	{}
+};
+
+// list of output profiles
+typedef std::vector<WriterProfile> WriterProfileList;
+
 class Writer;
 
 // hash of WriterType, pointer to actual writer
@@ -136,6 +162,48 @@ struct WriteFlags
 //! A predefined set of flags to be invoked to satisfy a pending hotwrite
 static const WriteFlags HotWriteFlags = WriteFlags(false, true);
 
+/*! Accessor to the global (double-precision) position of the particles.
+ *
+ * GPUSPH does not keep a host copy of BUFFER_POS_GLOBAL during the simulation:
+ * writers that need global positions should use this accessor, that computes
+ * them on the fly from the local position (BUFFER_POS) and the cell encoded
+ * in the particle hash (BUFFER_HASH). Writers that can work with the local
+ * representation can use local_pos() and hash() directly.
+ *
+ * If the BufferList does not hold BUFFER_POS and BUFFER_HASH, but holds
+ * BUFFER_POS_GLOBAL (e.g. during problem initialization), the accessor
+ * returns the stored values.
+ */
+class GlobalPosAccessor
+{
+	const GlobalData *gdata;
+	const float4 *m_pos;
+	const hashKey *m_hash;
+	const double4 *m_gpos;
+	double3 m_worldOrigin;
+
+public:
+	GlobalPosAccessor(const GlobalData *_gdata, BufferList const& buffers);
+
+	//! Global position (and mass) of particle i
+	double4 operator[](size_t i) const;
+
+	//! Fill dst with the global positions of the count particles starting from first
+	void fill(double4 *dst, size_t first, size_t count) const;
+
+	//! Is the accessor usable? (i.e. does the BufferList provide positions?)
+	bool valid() const
+	{ return (m_pos && m_hash) || m_gpos; }
+
+	//! Raw access to the local positions
+	const float4 *local_pos() const
+	{ return m_pos; }
+
+	//! Raw access to the particle hashes
+	const hashKey *hash() const
+	{ return m_hash; }
+};
+
 /*! The Writer class acts both as base class for the actual writers,
  * and a dispatcher. It holds a (static) list of writers
  * (whose content is decided by the Problem) and passes all requests
@@ -253,6 +321,12 @@ protected:
 		++m_FileCounter;
 	}
 
+	// mark as written without having actually written (e.g. with --nosave).
+	// Writers that manage other writers should override this to mark them too
+	virtual void
+	fake_mark_written(double t, WriteFlags const& write_flags)
+	{ Writer::mark_written(t); }
+
 	virtual bool
 	need_write(double t) const;
 
@@ -127,6 +127,11 @@ public:
 	// reset the buffer content to its initial value
 	virtual void clobber() = 0;
 
+	// reset the buffer content to its initial value, without waiting for
+	// completion if the buffer supports it (e.g. device buffers, where the reset
+	// is queued on the default stream, i.e. in order with the commands)
+	virtual void clobber_async() { clobber(); }
+
 	// access buffer validity
 	inline bool is_valid() const { return m_validity == BUFFER_VALID; }
 	inline bool is_dirty() const { return m_validity == BUFFER_DIRTY; }
@@ -217,6 +222,28 @@ public:
 	// allocate buffer and return total amount of memory allocated
 	virtual size_t alloc(size_t elems) = 0;
 
+	// reallocate the buffer to hold elems elements, preserving its content,
+	// and return the total amount of memory allocated.
+	// The content is seen as a sequence of `rows` equally-sized rows
+	// (e.g. the neighbors list, with one row per neighbor slot),
+	// each of which is preserved at the start of the corresponding new row,
+	// with the rest filled with the initialization value.
+	virtual size_t realloc(size_t elems, size_t rows = 1)
+	{
+		throw std::runtime_error(std::string("cannot reallocate ") +
+			get_buffer_class() + " " + get_buffer_name());
+	}
+
+	// use the storage of the (allocated) owner buffer for elems elements,
+	// instead of allocating our own, and return the total amount of memory
+	// allocated (i.e. none). The storage remains owned by the owner buffer,
+	// and must be shared again whenever the owner is reallocated.
+	virtual size_t alias(AbstractBuffer *owner, size_t elems)
+	{
+		throw std::runtime_error(std::string("cannot alias ") +
+			get_buffer_class() + " " + get_buffer_name());
+	}
+
 	// base method to return a specific buffer of the array
 	// WARNING: this doesn't check for validity of idx.
 	// We have both const and non-const version
@@ -456,13 +483,6 @@ protected:
 		m_keys |= Key;
 	}
 
-	// remove a buffer
-	void removeBuffer(flag_t Key)
-	{
-		m_map.erase(Key);
-		m_keys &= ~Key;
-	}
-
 	// replace the buffer at position Key with buf, returning the
 	// old one
 	ptr_type replaceBuffer(flag_t Key, ptr_type buf)
@@ -491,6 +511,14 @@ public:
 		m_validate_access = true;
 	}
 
+	// remove a buffer; the buffer itself is released when the last
+	// list holding it lets it go
+	void removeBuffer(flag_t Key)
+	{
+		m_map.erase(Key);
+		m_keys &= ~Key;
+	}
+
 	~BufferList() {
 		clear_pending_state();
 		clear();
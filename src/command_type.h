@@ -231,6 +231,9 @@ struct CommandStruct
 	CommandBufferArgument reads;
 	CommandBufferArgument updates;
 	CommandBufferArgument writes;
+	//! written buffers whose elements are all written (or reset) by the command,
+	//! that don't need a reset when taking over the storage of an aliased buffer
+	flag_t overwrites;
 	bool only_internal; ///< does the command run only on internal particles?
 
 	CommandStruct(CommandName cmd) :
@@ -243,6 +246,7 @@ struct CommandStruct
 		reads(),
 		updates(),
 		writes(),
+		overwrites(NO_FLAGS),
 		only_internal(isCommandInternal(cmd))
 	{}
 
@@ -272,6 +276,10 @@ struct CommandStruct
 
 	CommandStruct& writing(std::string const& state, flag_t buffers)
 	{ writes.push_back(StateBuffers(state, buffers)); return *this; }
+
+	//! Mark written buffers as completely overwritten by the command
+	CommandStruct& overwriting(flag_t buffers)
+	{ overwrites |= buffers; return *this; }
 };
 
 inline const char * getCommandName(CommandStruct const& cmd)
@@ -99,8 +99,12 @@ __device__ __forceinline__ uint
 calcGridHash(	int3 const& gridPos	///< [in] grid position
 				)
 {
+#if MORTON_LINEARIZATION
+	return morton_cell_hash(gridPos, d_gridSize);
+#else
 	return INTMUL(INTMUL(gridPos.COORD3, d_gridSize.COORD2), d_gridSize.COORD1)
 			+ INTMUL(gridPos.COORD2, d_gridSize.COORD1) + gridPos.COORD1;
+#endif
 }
 
 
@@ -116,6 +120,9 @@ __device__ __forceinline__ int3
 calcGridPosFromCellHash(	const uint cellHash	///< [in] cell hash value
 							)
 {
+#if MORTON_LINEARIZATION
+	return morton_cell_pos(cellHash, d_gridSize);
+#else
 	int3 gridPos;
 	int temp = INTMUL(d_gridSize.COORD2, d_gridSize.COORD1);
 	gridPos.COORD3 = cellHash / temp;
@@ -124,6 +131,7 @@ calcGridPosFromCellHash(	const uint cellHash	///< [in] cell hash value
 	gridPos.COORD1 = temp - gridPos.COORD2 * d_gridSize.COORD1;
 
 	return gridPos;
+#endif
 }
 
 /// Compute grid position from particle hash value
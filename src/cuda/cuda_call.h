@@ -38,6 +38,18 @@
 #define CUT_CHECK_ERROR(err)		__cutilGetSyncError(err, __FILE__, __LINE__, __func__)
 #define KERNEL_CHECK_ERROR			CUT_CHECK_ERROR("kernel execution failed")
 
+//! Whether error checks after kernel launches and CUDA calls synchronize the device
+/*! With synchronous checks (the default), execution errors are reported by the call
+ * that caused them. Asynchronous command execution disables them, so that the host
+ * can enqueue further work while the device is busy: only launch errors are then
+ * reported immediately, execution errors are reported by the next synchronizing call.
+ */
+inline bool& cuda_sync_checks()
+{
+	static bool sync_checks = true;
+	return sync_checks;
+}
+
 inline void __cudaSafeCallNoSync(cudaError err,
 	const char *file, const int line, const char *func,
 	const char *method="cudaSafeCallNoSync",
@@ -58,7 +70,7 @@ inline void __cudaSafeCallNoSync(cudaError err,
 inline void __cudaSafeCall(cudaError err,
 	const char *file, const int line, const char *func)
 {
-	if (err == cudaSuccess) err = cudaDeviceSynchronize();
+	if (err == cudaSuccess) err = cuda_sync_checks() ? cudaDeviceSynchronize() : cudaGetLastError();
 	__cudaSafeCallNoSync(err, file, line, func, "cudaSafeCall");
 }
 
@@ -79,7 +91,7 @@ inline void __cutilGetLastError(const char *errorMessage,
 inline void __cutilGetSyncError(const char *errorMessage,
 	const char *file, const int line, const char *func)
 {
-	cudaError_t err = cudaDeviceSynchronize();
+	cudaError_t err = cuda_sync_checks() ? cudaDeviceSynchronize() : cudaGetLastError();
 	__cudaSafeCallNoSync(err, file, line, func, "getSyncError", errorMessage);
 }
 
@@ -48,14 +48,20 @@ template<flag_t Key>
 class CUDABuffer : public Buffer<Key>
 {
 	typedef Buffer<Key> baseclass;
+
+	// is the storage owned by another buffer? (see alias())
+	bool m_aliased;
+
 public:
 	typedef typename baseclass::element_type element_type;
 
 	// constructor: nothing to do
-	CUDABuffer(int _init=-1) : Buffer<Key>(_init) {}
+	CUDABuffer(int _init=-1) : Buffer<Key>(_init), m_aliased(false) {}
 
-	// destructor: free allocated memory
+	// destructor: free allocated memory, unless it belongs to another buffer
 	virtual ~CUDABuffer() {
+		if (m_aliased)
+			return;
 		const int N = baseclass::array_count;
 		element_type **bufs = baseclass::get_raw_ptr();
 		for (int i = 0; i < N; ++i) {
@@ -87,6 +93,15 @@ public:
 		}
 	}
 
+	virtual void clobber_async() {
+		const size_t bufmem = AbstractBuffer::get_allocated_elements()*sizeof(element_type);
+		const int N = baseclass::array_count;
+		element_type **bufs = baseclass::get_raw_ptr();
+		for (int i = 0; i < N; ++i) {
+			CUDA_SAFE_CALL_NOSYNC(cudaMemsetAsync(bufs[i], baseclass::get_init_value(), bufmem, 0));
+		}
+	}
+
 
 	// allocate and clear buffer on device
 	virtual size_t alloc(size_t elems) {
@@ -112,6 +127,53 @@ public:
 		return bufmem*N;
 	}
 
+	// reallocate preserving the content, see AbstractBuffer::realloc
+	virtual size_t realloc(size_t elems, size_t rows = 1) {
+		if (m_aliased)
+			throw std::runtime_error(std::string("cannot reallocate aliased buffer ") +
+				BufferTraits<Key>::name);
+		const size_t old_pitch = AbstractBuffer::get_allocated_elements()/rows*sizeof(element_type);
+		const size_t new_pitch = elems/rows*sizeof(element_type);
+		const size_t bufmem = elems*sizeof(element_type);
+		const int N = baseclass::array_count;
+		element_type **bufs = baseclass::get_raw_ptr();
+		for (int i = 0; i < N; ++i) {
+			element_type *newbuf = NULL;
+#ifdef INSPECT_DEVICE_MEMORY
+			CUDA_SAFE_CALL(cudaMallocManaged(&newbuf, bufmem));
+#else
+			CUDA_SAFE_CALL(cudaMalloc(&newbuf, bufmem));
+#endif
+			CUDA_SAFE_CALL(cudaMemset(newbuf, baseclass::get_init_value(), bufmem));
+			if (bufs[i]) {
+				// plain arrays are copied linearly: cudaMemcpy2D would reject
+				// pitches beyond the device limit (about 2GiB)
+				if (rows == 1)
+					CUDA_SAFE_CALL(cudaMemcpy(newbuf, bufs[i],
+							std::min(old_pitch, new_pitch), cudaMemcpyDeviceToDevice));
+				else // one row per neighbor slot
+					CUDA_SAFE_CALL(cudaMemcpy2D(newbuf, new_pitch, bufs[i], old_pitch,
+							std::min(old_pitch, new_pitch), rows, cudaMemcpyDeviceToDevice));
+				CUDA_SAFE_CALL(cudaFree(bufs[i]));
+			}
+			bufs[i] = newbuf;
+		}
+		AbstractBuffer::set_allocated_elements(elems);
+		return bufmem*N;
+	}
+
+	// share the storage of another device buffer, see AbstractBuffer::alias
+	virtual size_t alias(AbstractBuffer *owner, size_t elems) {
+		if (baseclass::array_count != 1 || owner->get_array_count() != 1 ||
+			elems*sizeof(element_type) > owner->get_allocated_elements()*owner->get_element_size())
+			throw std::runtime_error(std::string("cannot alias ") + BufferTraits<Key>::name +
+				" to " + owner->get_buffer_name());
+		AbstractBuffer::set_allocated_elements(elems);
+		baseclass::get_raw_ptr()[0] = static_cast<element_type*>(owner->get_buffer(0));
+		m_aliased = true;
+		return 0;
+	}
+
 	// swap elements at position idx1, idx2 of buffer _buf
 	virtual void swap_elements(uint idx1, uint idx2, uint _buf=0) {
 		element_type tmp;
@@ -261,6 +261,8 @@ protected:
 			return new CUDAPostProcessEngine<FLUX_COMPUTATION, kerneltype, boundarytype, simflags>(options);
 		case CALC_PRIVATE:
 			return new CUDAPostProcessEngine<CALC_PRIVATE, kerneltype, boundarytype, simflags>(options);
+		case STATISTICS:
+			return new CUDAPostProcessEngine<STATISTICS, kerneltype, boundarytype, simflags>(options);
 		case INVALID_POSTPROC:
 			throw runtime_error("Invalid filter type");
 		}
@@ -28,6 +28,10 @@
 #include <stdio.h>
 #include <stdexcept>
 
+#include <thrust/device_ptr.h>
+#include <thrust/transform_reduce.h>
+#include <thrust/functional.h>
+
 #include "define_buffers.h"
 #include "engine_integration.h"
 #include "utils.h"
@@ -388,6 +392,30 @@ disableFreeSurfParts(		float4*			pos,
 	KERNEL_CHECK_ERROR;
 }
 
+/// Functor returning the magnitude of the velocity part of a vel buffer element
+struct speed_op
+{
+	__host__ __device__
+	float operator()(float4 const& vel) const
+	{ return length(make_float3(vel)); }
+};
+
+/// Maximum particle speed over the given particle range
+float
+max_speed(
+	BufferList const& bufread,
+	const	uint	numParticles)
+{
+	if (!numParticles)
+		return 0.0f;
+
+	const thrust::device_ptr<const float4> vel =
+		thrust::device_pointer_cast(bufread.getData<BUFFER_VEL>());
+
+	return thrust::transform_reduce(vel, vel + numParticles,
+		speed_op(), 0.0f, thrust::maximum<float>());
+}
+
 
 };
 
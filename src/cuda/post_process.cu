@@ -36,6 +36,7 @@
 #include "simflags.h"
 #include "multi_gpu_defines.h"
 #include "Writer.h"
+#include "TemporalStatistics.h"
 
 #include "utils.h"
 #include "cuda_call.h"
@@ -74,6 +75,24 @@ struct CUDAPostProcessEngineHelperDefaults
 	write(WriterMap writers, double t)
 	{}
 
+	static flag_t get_sampled_buffers(double t)
+	{ return NO_FLAGS; }
+
+	static void
+	hostSample(const GlobalData * const gdata)
+	{}
+
+	static void
+	hostFlush(const GlobalData * const gdata)
+	{}
+
+	static void
+	saveState(std::ostream &out)
+	{}
+
+	static void
+	loadState(std::istream &in, int saved_by, const GlobalData * const gdata)
+	{}
 };
 
 template<PostProcessType filtertype, KernelType kerneltype, BoundaryType boundarytype, flag_t simflags>
@@ -598,6 +617,61 @@ struct CUDAPostProcessEngineHelper<CALC_PRIVATE, kerneltype, boundarytype, simfl
 	}
 };
 
+// Temporal statistics: everything is done on host, by the TemporalStatistics
+template<KernelType kerneltype, BoundaryType boundarytype, flag_t simflags>
+struct CUDAPostProcessEngineHelper<STATISTICS, kerneltype, boundarytype, simflags>
+: public CUDAPostProcessEngineHelperDefaults
+{
+	static TemporalStatistics *h_stats;
+
+	static void process(
+				flag_t					options,
+		BufferList const& bufread,
+		BufferList&		bufwrite,
+				uint					numParticles,
+				uint					particleRangeEnd,
+				uint					deviceIndex,
+		const	GlobalData	* const		gdata)
+	{}
+
+	static void
+	hostAllocate(const GlobalData * const gdata)
+	{
+		const flag_t options = gdata->simframework->hasPostProcessEngine(STATISTICS)->get_options();
+		h_stats = new TemporalStatistics(gdata, options);
+	}
+
+	static flag_t get_sampled_buffers(double t)
+	{ return h_stats->sampled_buffers(t); }
+
+	static void
+	hostSample(const GlobalData * const gdata)
+	{
+		h_stats->sample(gdata->s_hBuffers, gdata->s_hStartPerDevice[0],
+			gdata->processParticles[gdata->mpi_rank]);
+	}
+
+	static void
+	hostFlush(const GlobalData * const gdata)
+	{ h_stats->flush(); }
+
+	static void
+	saveState(std::ostream &out)
+	{ h_stats->save(out); }
+
+	// the per-particle accumulators saved by the process with the same rank
+	// (modulo the current number of processes) are merged into ours
+	static void
+	loadState(std::istream &in, int saved_by, const GlobalData * const gdata)
+	{
+		const int nodes = gdata->mpi_nodes > 1 ? gdata->mpi_nodes : 1;
+		h_stats->load(in, saved_by % nodes == std::max(gdata->mpi_rank, 0));
+	}
+};
+
+template<KernelType kerneltype, BoundaryType boundarytype, flag_t simflags>
+TemporalStatistics* CUDAPostProcessEngineHelper<STATISTICS, kerneltype, boundarytype, simflags>::h_stats;
+
 /// The actual CUDAPostProcessEngine class delegates to the helpers
 template<PostProcessType pptype, KernelType kerneltype, BoundaryType boundarytype, flag_t simflags>
 class CUDAPostProcessEngine : public AbstractPostProcessEngine
@@ -655,6 +729,29 @@ public:
 	{
 		Helper::write(writers, t);
 	}
+
+	flag_t get_sampled_buffers(double t) const
+	{ return Helper::get_sampled_buffers(t); }
+
+	void hostSample(const GlobalData * const gdata)
+	{
+		Helper::hostSample(gdata);
+	}
+
+	void hostFlush(const GlobalData * const gdata)
+	{
+		Helper::hostFlush(gdata);
+	}
+
+	void saveState(std::ostream &out) const
+	{
+		Helper::saveState(out);
+	}
+
+	void loadState(std::istream &in, int saved_by, const GlobalData * const gdata)
+	{
+		Helper::loadState(in, saved_by, gdata);
+	}
 };
 
 
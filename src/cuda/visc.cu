@@ -29,6 +29,10 @@
  * Template implementation of the ViscEngine in CUDA
  */
 
+#include <thrust/device_ptr.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <thrust/transform_reduce.h>
+
 #include "textures.cuh"
 
 #include "utils.h"
@@ -667,6 +671,191 @@ class CUDAViscEngine : public AbstractViscEngine, public _ViscSpec
 				this);
 	}
 
+	template<typename This>
+	enable_if_t<This::rheologytype != GRANULAR>
+	init_krylov_effpres_implementation(
+		const	BufferList& bufread,
+				BufferList& bufwrite,
+		const	uint	numParticles,
+		const	uint	particleRangeEnd,
+		const	This *)
+	{ /* do nothing */ }
+
+	template<typename This>
+	enable_if_t<This::rheologytype == GRANULAR>
+	init_krylov_effpres_implementation(
+		const	BufferList& bufread,
+				BufferList& bufwrite,
+		const	uint	numParticles,
+		const	uint	particleRangeEnd,
+		const	This *)
+	{
+		const float4 *pos = bufread.getData<BUFFER_POS>();
+		const float4 *vel = bufread.getData<BUFFER_VEL>();
+		const particleinfo *info = bufread.getData<BUFFER_INFO>();
+		const float *effpres = bufread.getData<BUFFER_EFFPRES>();
+
+		float4 *jacobiBuffer = bufwrite.getData<BUFFER_JACOBI>();
+		float4 *krylovBuffer = bufwrite.getData<BUFFER_KRYLOV>();
+
+		uint numThreads = BLOCK_SIZE_SPS;
+		uint numBlocks = div_up(particleRangeEnd, numThreads);
+
+		cuvisc::krylovInitDevice<<<numBlocks, numThreads>>>(
+			pos, vel, info, effpres, jacobiBuffer, krylovBuffer, particleRangeEnd);
+
+		KERNEL_CHECK_ERROR;
+	}
+
+	void
+	init_krylov_effpres(
+		const	BufferList& bufread,
+				BufferList& bufwrite,
+		const	uint	numParticles,
+		const	uint	particleRangeEnd)
+	{
+		init_krylov_effpres_implementation(bufread, bufwrite,
+			numParticles, particleRangeEnd, this);
+	}
+
+	template<typename This>
+	enable_if_t<This::rheologytype != GRANULAR, float3>
+	krylov_effpres_matvec_implementation(
+		const	BufferList& bufread,
+				BufferList& bufwrite,
+		const	uint	numParticles,
+		const	uint	particleRangeEnd,
+		const	float	deltap,
+		const	float	slength,
+		const	float	influenceradius,
+		const	This *)
+	{ return make_float3(0.0f); /* do nothing */ }
+
+	template<typename This>
+	enable_if_t<This::rheologytype == GRANULAR, float3>
+	krylov_effpres_matvec_implementation(
+		const	BufferList& bufread,
+				BufferList& bufwrite,
+		const	uint	numParticles,
+		const	uint	particleRangeEnd,
+		const	float	deltap,
+		const	float	slength,
+		const	float	influenceradius,
+		const	This *)
+	{
+		const float4 *pos = bufread.getData<BUFFER_POS>();
+		const float4 *vel = bufread.getData<BUFFER_VEL>();
+		const particleinfo *info = bufread.getData<BUFFER_INFO>();
+		const hashKey *particleHash = bufread.getData<BUFFER_HASH>();
+		const uint *cellStart = bufread.getData<BUFFER_CELLSTART>();
+		const neibdata *neibsList = bufread.getData<BUFFER_NEIBSLIST>();
+
+		// for SA
+		const	float4 *gGam = bufread.getData<BUFFER_GRADGAMMA>();
+		const	float2 * const *vertPos = bufread.getRawPtr<BUFFER_VERTPOS>();
+
+		const float4 *krylovBuffer = bufread.getData<BUFFER_KRYLOV>();
+		float4 *jacobiBuffer = bufwrite.getData<BUFFER_JACOBI>();
+
+		// bind textures to read all particles, not only internal ones
+#if !PREFER_L1
+		CUDA_SAFE_CALL(cudaBindTexture(0, posTex, pos, numParticles*sizeof(float4)));
+#endif
+		CUDA_SAFE_CALL(cudaBindTexture(0, velTex, vel, numParticles*sizeof(float4)));
+		CUDA_SAFE_CALL(cudaBindTexture(0, infoTex, info, numParticles*sizeof(particleinfo)));
+
+		uint numThreads = BLOCK_SIZE_SPS;
+		uint numBlocks = div_up(particleRangeEnd, numThreads);
+
+		effpres_params<kerneltype, boundarytype> params(
+			pos, particleHash, cellStart, neibsList, numParticles, slength, influenceradius,
+			deltap,
+			gGam, vertPos,
+			NULL, NULL);
+
+		cuvisc::krylovMatVecDevice<<<numBlocks, numThreads>>>(
+			params, jacobiBuffer, krylovBuffer, particleRangeEnd);
+
+		KERNEL_CHECK_ERROR;
+
+		// Unbind textures
+		CUDA_SAFE_CALL(cudaUnbindTexture(infoTex));
+		CUDA_SAFE_CALL(cudaUnbindTexture(velTex));
+#if !PREFER_L1
+		CUDA_SAFE_CALL(cudaUnbindTexture(posTex));
+#endif
+
+		// Fused reduction of the dot products and of the residual
+		// over the particles of this device
+		return thrust::transform_reduce(
+			thrust::counting_iterator<uint>(0),
+			thrust::counting_iterator<uint>(particleRangeEnd),
+			cuvisc::krylov_dots_op(jacobiBuffer, krylovBuffer),
+			make_float3(0.0f), cuvisc::krylov_dots_reduce());
+	}
+
+	float3
+	krylov_effpres_matvec(
+		const	BufferList& bufread,
+				BufferList& bufwrite,
+		const	uint	numParticles,
+		const	uint	particleRangeEnd,
+		const	float	deltap,
+		const	float	slength,
+		const	float	influenceradius)
+	{
+		return krylov_effpres_matvec_implementation(bufread, bufwrite,
+			numParticles, particleRangeEnd, deltap, slength, influenceradius, this);
+	}
+
+	template<typename This>
+	enable_if_t<This::rheologytype != GRANULAR>
+	update_krylov_effpres_implementation(
+		const	BufferList& bufread,
+				BufferList& bufwrite,
+		const	uint	numParticles,
+		const	uint	particleRangeEnd,
+		const	float	alpha,
+		const	float	beta,
+		const	This *)
+	{ /* do nothing */ }
+
+	template<typename This>
+	enable_if_t<This::rheologytype == GRANULAR>
+	update_krylov_effpres_implementation(
+		const	BufferList& bufread,
+				BufferList& bufwrite,
+		const	uint	numParticles,
+		const	uint	particleRangeEnd,
+		const	float	alpha,
+		const	float	beta,
+		const	This *)
+	{
+		const float4 *jacobiBuffer = bufread.getData<BUFFER_JACOBI>();
+		float4 *krylovBuffer = bufwrite.getData<BUFFER_KRYLOV>();
+		float *effpres = bufwrite.getData<BUFFER_EFFPRES>();
+
+		uint numThreads = BLOCK_SIZE_SPS;
+		uint numBlocks = div_up(particleRangeEnd, numThreads);
+
+		cuvisc::krylovUpdateDevice<<<numBlocks, numThreads>>>(
+			jacobiBuffer, krylovBuffer, effpres, alpha, beta, particleRangeEnd);
+
+		KERNEL_CHECK_ERROR;
+	}
+
+	void
+	update_krylov_effpres(
+		const	BufferList& bufread,
+				BufferList& bufwrite,
+		const	uint	numParticles,
+		const	uint	particleRangeEnd,
+		const	float	alpha,
+		const	float	beta)
+	{
+		update_krylov_effpres_implementation(bufread, bufwrite,
+			numParticles, particleRangeEnd, alpha, beta, this);
+	}
 
 };
 
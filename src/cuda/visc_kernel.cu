@@ -1100,6 +1100,180 @@ jacobiUpdateEffPresDevice(
 
 }
 
+//! Particles whose effective pressure is an unknown of the linear system:
+//! free particles of sediment that are not at the interface nor at the free-surface
+__device__ __forceinline__ bool
+effpres_unknown(particleinfo const& info)
+{
+	return PART_TYPE(info) == PT_FLUID && SEDIMENT(info) && !INTERFACE(info) && !SURFACE(info);
+}
+
+// Initialize the Krylov solver from the Jacobi vectors: compute the residual
+// of the volume-weighted system and the preconditioned residual,
+// and reset the search direction
+__global__ void
+__launch_bounds__(BLOCK_SIZE_SPS, MIN_BLOCKS_SPS)
+krylovInitDevice(
+	const float4 * __restrict__ posArray,
+	const float4 * __restrict__ velArray,
+	const particleinfo * __restrict__ infoArray,
+	const float * __restrict__ effpres,
+	float4 * __restrict__ jacobiBuffer,
+	float4 * __restrict__ krylovBuffer,
+	uint particleRangeEnd)
+{
+	const uint index = INTMUL(blockIdx.x,blockDim.x) + threadIdx.x;
+
+	if (index >= particleRangeEnd)
+		return;
+
+	const float4 pos = posArray[index];
+	const particleinfo info = infoArray[index];
+
+	float4 jB = make_float4(0.0f);
+	float4 kB = make_float4(0.0f);
+
+	if (!INACTIVE(pos) && effpres_unknown(info)) {
+		const uint fluid = fluid_num(info);
+		const float volume = pos.w/physical_density(velArray[index].w, fluid);
+		// Reference pressure
+		const float refpres = d_rho0[fluid]*d_sqC0[fluid]/100;
+
+		const float4 jacobi = jacobiBuffer[index];
+		const float D = jacobi.x;
+		const float Rx = jacobi.y;
+		const float B = jacobi.z;
+
+		const float diag = volume*D;
+		const float r = volume*(B - D*effpres[index] - Rx);
+
+		jB = make_float4(diag, volume, 1.0f/(volume*refpres), 0.0f);
+		kB.x = r;
+		kB.y = diag != 0 ? r/diag : 0.0f;
+	}
+
+	jacobiBuffer[index] = jB;
+	krylovBuffer[index] = kB;
+}
+
+// Product of the volume-weighted effective pressure matrix with the
+// preconditioned residual u, stored in jacobiBuffer.w
+template<
+	typename KP,
+	KernelType kerneltype = KP::kerneltype,
+	BoundaryType boundarytype = KP::boundarytype
+>
+__global__ void
+__launch_bounds__(BLOCK_SIZE_SPS, MIN_BLOCKS_SPS)
+krylovMatVecDevice(KP params,
+	float4 * __restrict__ jacobiBuffer,
+	const float4 * __restrict__ krylovBuffer,
+	uint particleRangeEnd)
+{
+	const uint index = INTMUL(blockIdx.x,blockDim.x) + threadIdx.x;
+
+	if (index >= particleRangeEnd)
+		return;
+
+	float4 jB = jacobiBuffer[index];
+
+	// only unknowns with a non-null diagonal have a non-null preconditioned residual
+	if (jB.x != 0) {
+		shear_rate_pdata<boundarytype> pdata(index, params);
+
+		// R.u: contribution of the neighbors that are also unknowns
+		float Ru = 0;
+
+		for_every_neib(boundarytype, pdata.index, pdata.pos, pdata.gridPos, params.cellStart, params.neibsList) {
+
+			const shear_rate_ndata<boundarytype> ndata(neib_iter, pdata, params);
+
+			// skip inactive particles
+			if (INACTIVE(ndata.relPos) || ndata.r >= params.influenceradius)
+				continue;
+
+			if (!effpres_unknown(ndata.info))
+				continue;
+
+			const float f = F<kerneltype>(ndata.r, params.slength);	// 1/r ∂Wij/∂r
+			const float neib_volume = ndata.relPos.w/ndata.rho;
+
+			Ru -= neib_volume*krylovBuffer[ndata.index].y*f;
+		}
+
+		jB.w = jB.x*krylovBuffer[index].y + jB.y*Ru;
+	} else {
+		jB.w = 0;
+	}
+
+	jacobiBuffer[index] = jB;
+}
+
+// Advance the Krylov solver: update the search directions, the effective pressure,
+// the residual and the preconditioned residual
+__global__ void
+__launch_bounds__(BLOCK_SIZE_SPS, MIN_BLOCKS_SPS)
+krylovUpdateDevice(
+	const float4 * __restrict__ jacobiBuffer,
+	float4 * __restrict__ krylovBuffer,
+	float * __restrict__ effpres,
+	const float alpha,
+	const float beta,
+	uint particleRangeEnd)
+{
+	const uint index = INTMUL(blockIdx.x,blockDim.x) + threadIdx.x;
+
+	if (index >= particleRangeEnd)
+		return;
+
+	const float4 jB = jacobiBuffer[index];
+
+	if (jB.x == 0)
+		return;
+
+	float4 kB = krylovBuffer[index];
+
+	kB.z = kB.y + beta*kB.z; // p = u + beta p
+	kB.w = jB.w + beta*kB.w; // s = w + beta s
+
+	const float newEffPres = effpres[index] + alpha*kB.z;
+	// Prevent NaN values.
+	effpres[index] = (newEffPres == newEffPres) ? newEffPres : 0;
+
+	kB.x -= alpha*kB.w; // r = r - alpha s
+	kB.y = kB.x/jB.x; // u = M^-1 r
+
+	krylovBuffer[index] = kB;
+}
+
+//! Terms of the Krylov solver reductions for a single particle:
+//! r.u, w.u and the normalized residual
+struct krylov_dots_op
+{
+	const float4 *jacobiBuffer;
+	const float4 *krylovBuffer;
+
+	krylov_dots_op(const float4 *jacobiBuffer_, const float4 *krylovBuffer_) :
+		jacobiBuffer(jacobiBuffer_), krylovBuffer(krylovBuffer_)
+	{}
+
+	__device__ __forceinline__ float3
+	operator()(uint index) const
+	{
+		const float4 jB = jacobiBuffer[index];
+		const float4 kB = krylovBuffer[index];
+		return make_float3(kB.x*kB.y, jB.w*kB.y, fabsf(kB.x*jB.z));
+	}
+};
+
+//! Combine the Krylov solver reduction terms: sum the dot products, max the residual
+struct krylov_dots_reduce
+{
+	__device__ __forceinline__ float3
+	operator()(float3 const& a, float3 const& b) const
+	{ return make_float3(a.x + b.x, a.y + b.y, fmaxf(a.z, b.z)); }
+};
+
 }
 
 #endif
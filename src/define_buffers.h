@@ -187,7 +187,26 @@ SET_BUFFER_TRAITS(BUFFER_EFFPRES, float, 1, "Effective Pressure");
 */
 #define BUFFER_JACOBI			(BUFFER_EFFPRES << 1)
 SET_BUFFER_TRAITS(BUFFER_JACOBI, float4, 1, "Jacobi vectors");
-#define BUFFER_EULERVEL			(BUFFER_JACOBI << 1)
+
+/* Krylov solver for the effective pressure
+ *------------------------------------------
+ * The system A.x = B, premultiplied by the diagonal matrix of the particle
+ * volumes V, is symmetric, and is solved with a Jacobi-preconditioned
+ * conjugate gradient (Chronopoulos-Gear variant, with a single reduction
+ * per iteration). After the solver initialization, JACOBI_BUFFER holds:
+ * 	jacobiBuffer.x = V.D (the preconditioner)
+ * 	jacobiBuffer.y = V
+ * 	jacobiBuffer.z = 1/(V.refpres), to normalize the residual
+ * 	jacobiBuffer.w = w = V.A.u
+ * and KRYLOV_BUFFER holds the solver vectors:
+ * 	krylovBuffer.x = r (residual of the premultiplied system)
+ * 	krylovBuffer.y = u (preconditioned residual)
+ * 	krylovBuffer.z = p (search direction)
+ * 	krylovBuffer.w = s = V.A.p
+ */
+#define BUFFER_KRYLOV			(BUFFER_JACOBI << 1)
+SET_BUFFER_TRAITS(BUFFER_KRYLOV, float4, 1, "Krylov vectors");
+#define BUFFER_EULERVEL			(BUFFER_KRYLOV << 1)
 SET_BUFFER_TRAITS(BUFFER_EULERVEL, float4, 1, "Eulerian velocity");
 
 /** Next ID of generated particle
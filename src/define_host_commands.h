@@ -82,6 +82,13 @@ DEFINE_COMMAND_NOBUF(BODY_FORCES_CALLBACK)
  */
 DEFINE_COMMAND_NOBUF(MOVE_BODIES)
 
+/// Wait for the moving bodies integration
+/*! With asynchronous bodies integration, MOVE_BODIES only starts the
+ * time-stepping of the bodies on a separate host thread; this is the join point,
+ * which must come before the new bodies data is uploaded to the devices.
+ */
+DEFINE_COMMAND_NOBUF(JOIN_BODIES)
+
 /// Find maximum water depth
 /*! Find the maximum across all devices of the water depth for each open boundary
  */
@@ -95,6 +102,13 @@ DEFINE_COMMAND_NOBUF(COMPUTE_KINETIC_ENERGY)
 /// Check maximum number of neighbors and estimate number of interactions
 DEFINE_COMMAND_NOBUF(CHECK_NEIBSNUM)
 
+/// Accumulate the bound on the particle displacement since the last neighbors list construction
+/*! Reduce the maximum particle speed sampled during the time-step across all
+ * devices and nodes, and add its product with the time-step to the displacement
+ * bound used by adaptive neighbors list rebuilding
+ */
+DEFINE_COMMAND_NOBUF(UPDATE_NEIBS_DISPLACEMENT)
+
 /// Hnadle pending hotwrites
 DEFINE_COMMAND_NOBUF(HANDLE_HOTWRITE)
 
@@ -113,6 +127,19 @@ DEFINE_COMMAND_BUF(JACOBI_STOP_CRITERION, true)
 /// Reset the Jacobi solver stop criterion before entering the solver loop.
 DEFINE_COMMAND_BUF(JACOBI_RESET_STOP_CRITERION, true)
 
+/// Compute the initial step coefficients of the Krylov effective pressure solver
+/*! Reduce the dot products computed on the initial residual, and
+ * reset the iteration counter unless the solver is being restarted
+ * after an update of the boundary conditions
+ */
+DEFINE_COMMAND_BUF(KRYLOV_INIT_COEFFICIENTS, true)
+/// Stop criterion of the Krylov effective pressure solver
+/*! Reduce the dot products and residual, and determine whether the solver
+ * has converged, should be restarted with updated boundary conditions,
+ * or should continue with the next step coefficients
+ */
+DEFINE_COMMAND_BUF(KRYLOV_STOP_CRITERION, true)
+
 /// Not an actual command ;-)
 DEFINE_COMMAND_NOBUF(NUM_COMMANDS)
 
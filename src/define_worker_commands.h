@@ -61,6 +61,12 @@
 
 /// Dummy cycle (do nothing)
 DEFINE_COMMAND_NOBUF(IDLE)
+/// Run the batch of commands in GlobalData::nextCommandBatch
+/*! The main thread uses this to dispatch consecutive commands of a phase
+ * that don't need to synchronize with each other or with the host
+ * (see Integrator::extend_batch)
+ */
+DEFINE_COMMAND_NOBUF(RUN_COMMAND_BATCH)
 /// Quit the simulation cycle
 DEFINE_COMMAND_NOBUF(QUIT)
 
@@ -97,6 +103,12 @@ DEFINE_COMMAND_DYN(MOVE_STATE_BUFFERS)
  */
 DEFINE_COMMAND_DYN(SHARE_BUFFERS)
 
+/// Grow the particle buffers to the current number of allocated particles
+/*! All copies of the buffers, in the pool and in all states, are reallocated
+ * preserving their content (including the neighbors list)
+ */
+DEFINE_COMMAND_NOBUF(RESIZE_PARTICLE_SYSTEM)
+
 /* Host-device data exchange */
 
 /// Dump (device) particle data arrays into shared host arrays
@@ -321,6 +333,24 @@ DEFINE_COMMAND_BUF(JACOBI_WALL_BOUNDARY_CONDITIONS, false)
 DEFINE_COMMAND_BUF(JACOBI_BUILD_VECTORS, false)
 DEFINE_COMMAND_BUF(JACOBI_UPDATE_EFFPRES, false)
 
+	/// Initialize the Krylov solver vectors for the effective pressure
+	/*! Requires the Jacobi vectors built by JACOBI_BUILD_VECTORS */
+DEFINE_COMMAND_BUF(KRYLOV_INIT_EFFPRES, true)
+	/// Matrix-free product of the effective pressure system with the preconditioned residual
+	/*! Also computes the partial dot products and residual needed by the solver,
+	 * in a single pass
+	 */
+DEFINE_COMMAND_BUF(KRYLOV_EFFPRES_MATVEC, true)
+	/// Advance the Krylov solver for the effective pressure
+DEFINE_COMMAND_BUF(KRYLOV_UPDATE_EFFPRES, true)
+
+	/// Find the maximum particle speed on the device
+	/*! The maximum is accumulated across the states sampled during the time-step.
+	 * Used by adaptive neighbors list rebuilding to bound the particle
+	 * displacement since the last neighbors list construction
+	 */
+DEFINE_COMMAND_BUF(MAX_SPEED, true)
+
 	/// Run post-processing filters (e.g. vorticity, testpoints)
 	/*! Special case of dynamic buffer: the buffer specification is directed
 	 * by each specific post-processing engine
@@ -141,5 +141,12 @@ public:
 				const	uint			numParticles,
 				const	uint			particleRangeEnd) = 0;
 
+	/// Maximum particle speed, used to bound the displacement since
+	/// the last neighbors list construction
+	virtual float
+	max_speed(
+		const BufferList& bufread,
+		const	uint	numParticles) = 0;
+
 };
 #endif
@@ -103,5 +103,37 @@ public:
 	//< Main processing routine on host
 	virtual void
 	write(WriterMap writers, double t) = 0;
+
+	/*! \name Sampling engines
+	 * Engines that accumulate data during the simulation (rather than
+	 * at write time) are asked at the end of each time-step which buffers
+	 * they need to sample; these are then dumped to host and hostSample()
+	 * is called. The accumulated data is written out by hostFlush(),
+	 * at checkpoints and at the end of the simulation, and saved in (and
+	 * restored from) the HotFiles with saveState() and loadState().
+	 * These are called on all processes at the same time.
+	 * @{
+	 */
+
+	//< Returns the buffers needed to sample at time t (NO_FLAGS for no sampling)
+	virtual flag_t get_sampled_buffers(double t) const = 0;
+
+	//< Sampling routine on host
+	virtual void
+	hostSample(const GlobalData * const gdata) = 0;
+
+	//< Write out the sampled data
+	virtual void
+	hostFlush(const GlobalData * const gdata) = 0;
+
+	//< Save the engine state; nothing is saved if nothing is written to out
+	virtual void
+	saveState(std::ostream &out) const = 0;
+
+	//< Restore the engine state saved by the given process;
+	//< every process is given the states saved by all processes
+	virtual void
+	loadState(std::istream &in, int saved_by, const GlobalData * const gdata) = 0;
+	/** @} */
 };
 #endif
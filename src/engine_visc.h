@@ -106,5 +106,42 @@ public:
 		const	float	deltap,
 		const	float	slength,
 		const	float	influenceradius) = 0;
+
+	/// Initialize the Krylov solver for the effective pressure
+	/*! Compute the (preconditioned) residual of the current effective pressure
+	 * from the Jacobi vectors, and reset the search directions
+	 */
+	virtual void
+	init_krylov_effpres(
+		const	BufferList& bufread,
+				BufferList& bufwrite,
+		const	uint	numParticles,
+		const	uint	particleRangeEnd) = 0;
+
+	/// Matrix-free product of the effective pressure system matrix with the
+	/// preconditioned residual
+	/*! Returns the partial dot products r.u and w.u in .x and .y,
+	 * and the maximum normalized residual in .z
+	 */
+	virtual float3
+	krylov_effpres_matvec(
+		const	BufferList& bufread,
+				BufferList& bufwrite,
+		const	uint	numParticles,
+		const	uint	particleRangeEnd,
+		const	float	deltap,
+		const	float	slength,
+		const	float	influenceradius) = 0;
+
+	/// Update the effective pressure and the Krylov vectors with the given
+	/// step coefficients
+	virtual void
+	update_krylov_effpres(
+		const	BufferList& bufread,
+				BufferList& bufwrite,
+		const	uint	numParticles,
+		const	uint	particleRangeEnd,
+		const	float	alpha,
+		const	float	beta) = 0;
 };
 #endif
@@ -26,6 +26,7 @@
  */
 
 #include <cstring> // memcpy
+#include <cstdint>
 
 #include <iostream>
 #include <fstream>
@@ -38,8 +39,32 @@
 #include "Vector.h"
 #include "Rect.h"
 
+// parallel_for_chunks
+#include "parallel_for.h"
+
 using namespace std;
 
+template<typename ColumnFiller>
+void TopoCube::fill_columns(PointVect& points, int begin, int end, ColumnFiller&& fill_column) const
+{
+	// minimum number of columns per thread
+	const size_t min_chunk = 16;
+	const unsigned int nthreads = configured_host_threads(m_hostThreads);
+
+	vector<PointVect> chunks(effective_host_threads(nthreads, begin, end, min_chunk));
+	parallel_for_chunks(nthreads, begin, end, [&](unsigned int t, size_t chunk_begin, size_t chunk_end) {
+		for (size_t i = chunk_begin; i < chunk_end; ++i)
+			fill_column(int(i), chunks[t]);
+	}, min_chunk);
+
+	size_t total = points.size();
+	for (PointVect const& chunk : chunks)
+		total += chunk.size();
+	points.reserve(total);
+	for (PointVect const& chunk : chunks)
+		points.insert(points.end(), chunk.begin(), chunk.end());
+}
+
 TopoCube::TopoCube(void)
 {
 	m_origin = Point(0, 0, 0);
@@ -55,6 +80,8 @@ TopoCube::TopoCube(void)
 
 	m_north = m_south = m_east = m_west = NAN;
 	m_voff = 0;
+
+	m_hostThreads = 0;
 }
 
 
@@ -132,11 +159,11 @@ void TopoCube::SetCubeDem(const float *dem,
 
 	m_voff = voff;
 
-	size_t numels = ncols*nrows;
+	size_t numels = size_t(ncols)*nrows;
 	m_dem = new float[numels];
 
 	if (voff) {
-		for (uint i = 0; i < numels; ++i) {
+		for (size_t i = 0; i < numels; ++i) {
 			m_dem[i] = dem[i] + voff;
 		}
 	} else {
@@ -145,9 +172,67 @@ void TopoCube::SetCubeDem(const float *dem,
 	}
 }
 
+TopoCube::SampleRange
+TopoCube::window_samples(GeoWindow const& window, int ncols, int nrows,
+	double west, double south, double sizex, double sizey)
+{
+	// distance between consecutive samples
+	const double ewres = sizex/(ncols - 1);
+	const double nsres = sizey/(nrows - 1);
+
+	// clamp in floating point before converting, since the default window is infinite
+	const double last_col = ncols - 1;
+	const double last_row = nrows - 1;
+	const int col0 = fmax(0.0, floor((window.west - west)/ewres));
+	const int col1 = fmin(last_col, ceil((window.east - west)/ewres));
+	const int row0 = fmax(0.0, floor((window.south - south)/nsres));
+	const int row1 = fmin(last_row, ceil((window.north - south)/nsres));
+
+	if (col1 < col0 || row1 < row0) {
+		stringstream err_msg;
+		err_msg << "DEM window [" << window.west << ", " << window.east << "]x["
+			<< window.south << ", " << window.north << "] does not intersect the DEM";
+		throw invalid_argument(err_msg.str());
+	}
+
+	SampleRange range;
+	range.col0 = col0;
+	range.ncols = col1 - col0 + 1;
+	range.row0 = row0;
+	range.nrows = row1 - row0 + 1;
+	return range;
+}
+
+TopoCube *
+TopoCube::from_samples(const float *dem, SampleRange const& range,
+	int ncols, int nrows, double west, double south, double sizex, double sizey,
+	double zmin, double zmax)
+{
+	const double ewres = sizex/(ncols - 1);
+	const double nsres = sizey/(nrows - 1);
+
+	// when loading the whole DEM, keep the sizes from the file as-is
+	const double wsizex = range.ncols == ncols ? sizex : ewres*(range.ncols - 1);
+	const double wsizey = range.nrows == nrows ? sizey : nsres*(range.nrows - 1);
+	const double wwest = west + ewres*range.col0;
+	const double wsouth = south + nsres*range.row0;
+
+	TopoCube *ret = new TopoCube();
+
+	ret->SetCubeDem(dem, wsizex, wsizey, zmax - zmin,
+		range.ncols, range.nrows, -zmin);
+	ret->SetGeoLocation(wsouth + wsizey, wsouth, wwest + wsizex, wwest);
+
+	if (range.ncols < ncols || range.nrows < nrows)
+		printf("Loaded DEM window of %dx%d samples (out of %dx%d) starting at sample %d, %d\n",
+			range.ncols, range.nrows, ncols, nrows, range.col0, range.row0);
+
+	return ret;
+}
+
 /* Create a TopoCube from a (GRASS) ASCII grid file */
 template<>
-TopoCube *TopoCube::load_file<TopoCube::DEM_FMT_ASCII>(const char* fname)
+TopoCube *TopoCube::load_file<TopoCube::DEM_FMT_ASCII>(const char* fname, GeoWindow const& window)
 {
 	ifstream fdem(fname);
 	if (!fdem.good()) {
@@ -172,29 +257,31 @@ TopoCube *TopoCube::load_file<TopoCube::DEM_FMT_ASCII>(const char* fname)
 		else if (s.find("rows:") != string::npos) fdem >> nrows;
 	}
 
+	const SampleRange range = window_samples(window, ncols, nrows,
+		west, south, east - west, north - south);
+
 	double zmin = NAN, zmax = NAN;
 
-	float *dem = new float[ncols*nrows];
+	float *dem = new float[size_t(range.ncols)*range.nrows];
 
 	double z;
 
 	// DEM data is stored on disk with the north as the first row,
-	// but we want south to be the first array data
-	for (int row = nrows-1; row >= 0; --row) {
+	// but we want south to be the first array data.
+	// Rows south of the window need not be read at all
+	for (int row = nrows-1; row >= range.row0; --row) {
 		for (int col = 0; col < ncols; ++col) {
 			fdem >> z;
+			if (!range.has(col, row)) continue;
 			zmax = max(z, zmax);
 			zmin = min(z, zmin);
-			dem[row*ncols+col] = z;
+			dem[range.index(col, row)] = z;
 		}
 	}
 	fdem.close();
 
-	TopoCube *ret = new TopoCube();
-
-	ret->SetCubeDem(dem, east-west, north-south, zmax-zmin,
-		ncols, nrows, -zmin);
-	ret->SetGeoLocation(north, south, east, west);
+	TopoCube *ret = from_samples(dem, range, ncols, nrows,
+		west, south, east - west, north - south, zmin, zmax);
 
 	delete [] dem;
 
@@ -206,12 +293,12 @@ TopoCube *TopoCube::load_ascii_grid(const char *fname)
 
 /* Create a TopoCube from a VTK Structure Points datafile */
 template<>
-TopoCube *TopoCube::load_file<TopoCube::DEM_FMT_VTK>(const char* fname)
+TopoCube *TopoCube::load_file<TopoCube::DEM_FMT_VTK>(const char* fname, GeoWindow const& window)
 {
 	string s;
 	stringstream err_msg;
 
-	double north(NAN), south(NAN), east(NAN), west(NAN);
+	double south(NAN), west(NAN);
 	double nsres(NAN), ewres(NAN), zbase(NAN);
 	int nrows(0), ncols(0), nz(0), nels(0);
 	double z(NAN), zmin(NAN), zmax(NAN);
@@ -278,21 +365,25 @@ TopoCube *TopoCube::load_file<TopoCube::DEM_FMT_VTK>(const char* fname)
 		}
 	}
 
-	float *dem = new float[nels];
+	const SampleRange range = window_samples(window, ncols, nrows,
+		west, south, ewres*ncols, nsres*nrows);
+
+	float *dem = new float[size_t(range.ncols)*range.nrows];
 
-	for (int el = 0; el < nels; ++el) {
-		fdem >> z;
-		zmax = fmax(z, zmax);
-		zmin = fmin(z, zmin);
-		dem[el] = z;
+	// data is stored south to north, so rows north of the window need not be read
+	for (int row = 0; row < range.row0 + range.nrows; ++row) {
+		for (int col = 0; col < ncols; ++col) {
+			fdem >> z;
+			if (!range.has(col, row)) continue;
+			zmax = fmax(z, zmax);
+			zmin = fmin(z, zmin);
+			dem[range.index(col, row)] = z;
+		}
 	}
 	fdem.close();
 
-	TopoCube *ret = new TopoCube();
-
-	ret->SetCubeDem(dem, ewres*ncols, nsres*nrows, zmax - zmin,
-		ncols, nrows, -zmin);
-	ret->SetGeoLocation(south + nsres*nrows, south, west + ewres*ncols, west);
+	TopoCube *ret = from_samples(dem, range, ncols, nrows,
+		west, south, ewres*ncols, nsres*nrows, zmin, zmax);
 
 	delete [] dem;
 
@@ -315,9 +406,12 @@ TopoCube *TopoCube::load_vtk_file(const char* fname)
  * values.
  * - The underlying grid must be regular : constant and same
  * resolution along x and y.
+ *
+ * Since the resolution is only known after reading the first column,
+ * the whole file is loaded before extracting the requested window.
  */
 template<>
-TopoCube *TopoCube::load_file<TopoCube::DEM_FMT_XYZ>(const char* fname)
+TopoCube *TopoCube::load_file<TopoCube::DEM_FMT_XYZ>(const char* fname, GeoWindow const& window)
 {
 	ifstream fdem(fname);
 	if (!fdem.good()) {
@@ -338,8 +432,7 @@ TopoCube *TopoCube::load_file<TopoCube::DEM_FMT_XYZ>(const char* fname)
 		else if (s.find("rows:") != string::npos) fdem >> nrows;
 	}
 
-	double zmin = NAN, zmax = NAN;
-	float *dem = new float[ncols*nrows];
+	float *dem = new float[size_t(ncols)*nrows];
 	// resolution in x and y directions
 	double xres = 0, yres = 0;
 	double x ,y, z;
@@ -353,9 +446,7 @@ TopoCube *TopoCube::load_file<TopoCube::DEM_FMT_XYZ>(const char* fname)
 				yres = y - yres;
 			else if (row == 0 && col == 1)
 				xres = x - xres;
-			zmax = max(z, zmax);
-			zmin = min(z, zmin);
-			dem[row*ncols+col] = z;
+			dem[size_t(row)*ncols+col] = z;
 		}
 	}
 	fdem.close();
@@ -371,11 +462,23 @@ TopoCube *TopoCube::load_file<TopoCube::DEM_FMT_XYZ>(const char* fname)
 	north = nrows*yres;
 	east = ncols*xres;
 
-	TopoCube *ret = new TopoCube();
+	const SampleRange range = window_samples(window, ncols, nrows,
+		west, south, east - west, north - south);
+
+	// compact the window samples at the beginning of the array;
+	// this is safe since window rows never start after the corresponding DEM row
+	double zmin = NAN, zmax = NAN;
+	for (int row = range.row0; row < range.row0 + range.nrows; ++row) {
+		for (int col = range.col0; col < range.col0 + range.ncols; ++col) {
+			z = dem[size_t(row)*ncols + col];
+			zmax = max(z, zmax);
+			zmin = min(z, zmin);
+			dem[range.index(col, row)] = z;
+		}
+	}
 
-	ret->SetCubeDem(dem, east-west, north-south, zmax-zmin,
-		ncols, nrows, -zmin);
-	ret->SetGeoLocation(north, south, east, west);
+	TopoCube *ret = from_samples(dem, range, ncols, nrows,
+		west, south, east - west, north - south, zmin, zmax);
 
 	delete [] dem;
 
@@ -385,13 +488,107 @@ TopoCube *TopoCube::load_file<TopoCube::DEM_FMT_XYZ>(const char* fname)
 TopoCube *TopoCube::load_xyz_file(const char* fname)
 { return load_file<DEM_FMT_XYZ>(fname); }
 
-TopoCube *TopoCube::load_file(const char *fname, Format fmt)
+namespace {
+
+//! Header of the tiled binary DEM files produced by scripts/dem2tiles.py
+/*! The header is followed by the tiles, each holding tile*tile little-endian floats
+ * in row-major order, with the southernmost row first. Tiles are stored by rows
+ * of tiles, southernmost first, with each row of tiles stored west to east.
+ * Tiles on the northern and eastern borders are padded to full size.
+ */
+struct TiledDemHeader {
+	char magic[8]; // "GPUSPHT"
+	int32_t ncols, nrows;
+	int32_t tile; // samples per tile side
+	int32_t reserved;
+	double west, south;
+	double sizex, sizey; // as if the DEM was loaded from the original file
+};
+
+static_assert(sizeof(TiledDemHeader) == 56, "unexpected tiled DEM header layout");
+
+}
+
+/* Create a TopoCube from a tiled binary DEM: only the tiles intersecting the window
+ * are read, so that small windows of huge DEMs can be loaded quickly
+ */
+template<>
+TopoCube *TopoCube::load_file<TopoCube::DEM_FMT_TILED>(const char* fname, GeoWindow const& window)
+{
+	stringstream err_msg;
+
+	ifstream fdem(fname, ios::binary);
+	if (!fdem.good()) {
+		err_msg	<< "failed to open DEM " << fname;
+		throw runtime_error(err_msg.str());
+	}
+
+	TiledDemHeader hdr;
+	fdem.read((char*)&hdr, sizeof(hdr));
+	if (!fdem || memcmp(hdr.magic, "GPUSPHT", 8) || hdr.tile < 1) {
+		err_msg << fname << " is not a tiled DEM file";
+		throw runtime_error(err_msg.str());
+	}
+
+	const int ncols = hdr.ncols;
+	const int nrows = hdr.nrows;
+	const int tile = hdr.tile;
+	const size_t tile_els = size_t(tile)*tile;
+	const size_t tiles_x = (ncols + tile - 1)/tile;
+
+	const SampleRange range = window_samples(window, ncols, nrows,
+		hdr.west, hdr.south, hdr.sizex, hdr.sizey);
+
+	const int tcol0 = range.col0/tile;
+	const int tcol1 = (range.col0 + range.ncols - 1)/tile;
+	const int trow0 = range.row0/tile;
+	const int trow1 = (range.row0 + range.nrows - 1)/tile;
+
+	// the tiles of a tile row intersecting the window are contiguous in the file
+	vector<float> band((tcol1 - tcol0 + 1)*tile_els);
+
+	float *dem = new float[size_t(range.ncols)*range.nrows];
+	double zmin = NAN, zmax = NAN;
+
+	for (int trow = trow0; trow <= trow1; ++trow) {
+		fdem.seekg(sizeof(hdr) + (trow*tiles_x + tcol0)*tile_els*sizeof(float));
+		fdem.read((char*)band.data(), band.size()*sizeof(float));
+		if (!fdem) {
+			delete [] dem;
+			err_msg << fname << " is truncated";
+			throw runtime_error(err_msg.str());
+		}
+
+		const int row_begin = max(range.row0, trow*tile);
+		const int row_end = min(range.row0 + range.nrows, (trow + 1)*tile);
+		for (int row = row_begin; row < row_end; ++row) {
+			for (int col = range.col0; col < range.col0 + range.ncols; ++col) {
+				const size_t tile_offset = (col/tile - tcol0)*tile_els;
+				const double z = band[tile_offset + (row % tile)*tile + (col % tile)];
+				zmax = fmax(z, zmax);
+				zmin = fmin(z, zmin);
+				dem[range.index(col, row)] = z;
+			}
+		}
+	}
+	fdem.close();
+
+	TopoCube *ret = from_samples(dem, range, ncols, nrows,
+		hdr.west, hdr.south, hdr.sizex, hdr.sizey, zmin, zmax);
+
+	delete [] dem;
+
+	return ret;
+}
+
+TopoCube *TopoCube::load_file(const char *fname, Format fmt, GeoWindow const& window)
 {
 	switch (fmt)
 	{
-	case DEM_FMT_ASCII: return load_file<DEM_FMT_ASCII>(fname);
-	case DEM_FMT_VTK: return load_file<DEM_FMT_VTK>(fname);
-	case DEM_FMT_XYZ: return load_file<DEM_FMT_XYZ>(fname);
+	case DEM_FMT_ASCII: return load_file<DEM_FMT_ASCII>(fname, window);
+	case DEM_FMT_VTK: return load_file<DEM_FMT_VTK>(fname, window);
+	case DEM_FMT_XYZ: return load_file<DEM_FMT_XYZ>(fname, window);
+	case DEM_FMT_TILED: return load_file<DEM_FMT_TILED>(fname, window);
 	}
 	throw std::invalid_argument("Unsupported format for " + string(fname));
 }
@@ -458,16 +655,19 @@ TopoCube::FillBorder(PointVect& points, const double dx, const int face_num, con
 		nstart++;
 		nend--;
 	}
-	for (int i = nstart; i <= nend; i++) {
+	if (nend < nstart)
+		return;
+
+	fill_columns(points, nstart, nend + 1, [&](int i, PointVect& column) {
 		const double x = rorigin(0) + (double) i/((double) n)*v(0);
 		const double y = rorigin(1) + (double) i/((double) n)*v(1);
 		float z = m_H;
 		while (DemDist(x, y, z, dx) > 0) {
 			Point p(x, y, z, m_center(3));
-			points.push_back(p);
+			column.push_back(p);
 			z -= dx;
 		}
-	}
+	});
 }
 
 
@@ -481,15 +681,15 @@ TopoCube::FillDem(PointVect& points, double dx)
 	double deltay = m_vy.norm()/((double) ny);
 	*/
 
-	for (int i = 0; i <= nx; i++) {
+	fill_columns(points, 0, nx + 1, [&](int i, PointVect& column) {
 		for (int j = 0; j <= ny; j++) {
 			const double x = m_origin(0) + (double) i/((double) nx)*m_vx(0) + (double) j/((double) ny)*m_vy(0);
 			const double y = m_origin(1) + (double) i/((double) nx)*m_vx(1) + (double) j/((double) ny)*m_vy(1);
 			const double z = DemInterpol(x, y);
 			Point p(x, y, z, m_center(3));
-			points.push_back(p);
-			}
+			column.push_back(p);
 		}
+	});
 }
 
 
@@ -561,20 +761,28 @@ TopoCube::Fill(PointVect& points, const double H, const double dx, const bool fa
 		endy--;
 	}
 
-	for (int i = startx; i <= endx; i++) {
+	if (endx < startx)
+		return 0;
+
+	vector<int> column_parts(endx - startx + 1, 0);
+
+	fill_columns(points, startx, endx + 1, [&](int i, PointVect& column) {
 		for (int j = starty; j <= endy; j++) {
 			float x = m_origin(0) + (float) i/((float) nx)*m_vx(0) + (float) j/((float) ny)*m_vy(0);
 			float y = m_origin(1) + (float) i/((float) nx)*m_vx(1) + (float) j/((float) ny)*m_vy(1);
 			float z = H;
 			while (DemDist(x, y, z, dx) > dx) {
 				Point p(x, y, z, m_center(3));
-				nparts ++;
+				column_parts[i - startx]++;
 				if (fill)
-					points.push_back(p);
+					column.push_back(p);
 				z -= dx;
 			}
 		}
-	}
+	});
+
+	for (int count : column_parts)
+		nparts += count;
 
 	return nparts;
 }
@@ -39,7 +39,42 @@
 #include "Vector.h"
 
 class TopoCube: public Object {
+	public:
+		struct GeoWindow;
+
 	private:
+		//! Range of the samples of a DEM file that are loaded, row 0 being the southernmost
+		struct SampleRange {
+			int col0, ncols;
+			int row0, nrows;
+
+			bool has(int col, int row) const
+			{ return col >= col0 && col < col0 + ncols && row >= row0 && row < row0 + nrows; }
+
+			//! Index of a sample in the loaded DEM array
+			size_t index(int col, int row) const
+			{ return size_t(row - row0)*ncols + (col - col0); }
+		};
+
+		//! Find the samples enclosing the given window in a DEM file with the given grid
+		/*! sizex and sizey are the DEM sizes in the file coordinates, as loaded in full
+		 */
+		static SampleRange window_samples(GeoWindow const& window, int ncols, int nrows,
+			double west, double south, double sizex, double sizey);
+
+		//! Create a TopoCube from the samples of a DEM file in the given range
+		static TopoCube* from_samples(const float *dem, SampleRange const& range,
+			int ncols, int nrows, double west, double south, double sizex, double sizey,
+			double zmin, double zmax);
+
+		//! Fill the columns [begin, end) of the DEM area over multiple threads
+		/*! fill_column(i, out) must append the points of column i to out.
+		 * The columns are appended to points in order, so that the result does not depend
+		 * on the number of threads.
+		 */
+		template<typename ColumnFiller>
+		void fill_columns(PointVect& points, int begin, int end, ColumnFiller&& fill_column) const;
+
 		Point	m_origin;
 		Vector	m_vx, m_vy, m_vz;
 		float*	m_dem;
@@ -51,6 +86,8 @@ class TopoCube: public Object {
 		double	m_north, m_south, m_east, m_west;
 		double	m_voff; // vertical offset
 
+		unsigned int	m_hostThreads; // threads to use for filling (0: autodetect)
+
 	public:
 		TopoCube(void);
 		virtual ~TopoCube(void);
@@ -78,6 +115,10 @@ class TopoCube: public Object {
 		void SetCubeHeight(double H);
 
 		/* Geolocation data (optional) */
+		//! Set the number of threads used to fill the DEM (0: autodetect)
+		void SetHostThreads(unsigned int nthreads)
+		{ m_hostThreads = nthreads; }
+
 		void SetGeoLocation(double north, double south,
 				double east, double west);
 
@@ -91,16 +132,31 @@ class TopoCube: public Object {
 		enum Format {
 			DEM_FMT_ASCII, /* GRASS ASCII grid format */
 			DEM_FMT_VTK, /* VTK Structured Grid */
-			DEM_FMT_XYZ /* XYZ file with header */
+			DEM_FMT_XYZ, /* XYZ file with header */
+			DEM_FMT_TILED /* tiled binary cache, see scripts/dem2tiles.py */
+		};
+
+		//! Geographical window of a DEM file to load, in the coordinates of the file
+		/*! The loaded topography covers the smallest set of samples enclosing the window,
+		 * and is located (get_north() etc) accordingly. The default window covers
+		 * the whole file.
+		 */
+		struct GeoWindow {
+			double west, south, east, north;
+			GeoWindow(double w = -INFINITY, double s = -INFINITY,
+				double e = INFINITY, double n = INFINITY) :
+				west(w), south(s), east(e), north(n)
+			{}
 		};
 
 		//! Load a topography from the file, given the file name and format
 		//! \seealso TopoCube::Format
-		static TopoCube* load_file(const char *fname, Format fmt);
+		static TopoCube* load_file(const char *fname, Format fmt,
+			GeoWindow const& window = GeoWindow());
 
 		//! Format-specific implementation of topography loader
 		template<Format>
-		static TopoCube* load_file(const char *fname);
+		static TopoCube* load_file(const char *fname, GeoWindow const& window = GeoWindow());
 
 		/* Legacy loader names */
 		static TopoCube* load_ascii_grid(const char *fname);
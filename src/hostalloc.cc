@@ -0,0 +1,196 @@
+/*  Copyright (c) 2019 INGV, EDF, UniCT, JHU
+
+    Istituto Nazionale di Geofisica e Vulcanologia, Sezione di Catania, Italy
+    Électricité de France, Paris, France
+    Università di Catania, Catania, Italy
+    Johns Hopkins University, Baltimore (MD), USA
+
+    This file is part of GPUSPH. Project founders:
+        Alexis Hérault, Giuseppe Bilotta, Robert A. Dalrymple,
+        Eugenio Rustico, Ciro Del Negro
+    For a full list of authors and project partners, consult the logs
+    and the project website <https://www.gpusph.org>
+
+    GPUSPH is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GPUSPH is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GPUSPH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*! \file
+ * Allocation policy for the host-side particle buffers
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <iostream>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cuda_runtime.h>
+
+#include "hostalloc.h"
+#include "parallel_for.h"
+
+using namespace std;
+
+namespace {
+
+//! Information about a live host allocation
+struct HostAllocation
+{
+	size_t bytes;
+	bool hugepages;
+	bool pinned;
+};
+
+HostAllocPolicy s_policy;
+
+mutex s_allocations_lock;
+map<const void*, HostAllocation> s_allocations;
+
+//! Alignment for host allocations: the huge page size for large allocations,
+//! the page size otherwise
+size_t alignment_for(bool hugepages)
+{
+	static const size_t page_size = sysconf(_SC_PAGESIZE);
+	return hugepages ? max(page_size, size_t(2) << 20) : page_size;
+}
+
+//! Set bytes of memory to init_value using the first-touch thread layout
+/*! Chunks are multiples of the alignment, so that no page is shared
+ * between threads.
+ */
+void touch(void *ptr, size_t bytes, int init_value, size_t align)
+{
+	char *base = static_cast<char*>(ptr);
+	const size_t pages = (bytes + align - 1)/align;
+	parallel_for_chunks(s_policy.first_touch_threads, 0, pages,
+		[base, bytes, init_value, align](unsigned int, size_t first, size_t last) {
+			const size_t from = first*align;
+			const size_t to = min(last*align, bytes);
+			memset(base + from, init_value, to - from);
+		}, 1);
+}
+
+}
+
+void set_host_alloc_policy(HostAllocPolicy const& policy)
+{
+	s_policy = policy;
+}
+
+HostAllocPolicy const& get_host_alloc_policy()
+{
+	return s_policy;
+}
+
+void *host_alloc(size_t bytes, int init_value)
+{
+	bool hugepages = s_policy.hugepages && bytes >= s_policy.hugepage_threshold;
+	const size_t align = alignment_for(hugepages);
+
+	void *ptr = NULL;
+	if (posix_memalign(&ptr, align, max(bytes, size_t(1))))
+		return NULL;
+
+#ifdef MADV_HUGEPAGE
+	// the advice must be given before the pages are touched
+	if (hugepages && madvise(ptr, bytes, MADV_HUGEPAGE))
+		hugepages = false;
+#else
+	hugepages = false;
+#endif
+
+	touch(ptr, bytes, init_value, align);
+
+	lock_guard<mutex> lock(s_allocations_lock);
+	s_allocations[ptr] = HostAllocation{bytes, hugepages, false};
+
+	return ptr;
+}
+
+void host_clear(void *ptr, size_t bytes, int init_value)
+{
+	bool hugepages = false;
+	{
+		lock_guard<mutex> lock(s_allocations_lock);
+		auto found = s_allocations.find(ptr);
+		if (found != s_allocations.end())
+			hugepages = found->second.hugepages;
+	}
+	touch(ptr, bytes, init_value, alignment_for(hugepages));
+}
+
+void host_free(void *ptr)
+{
+	if (!ptr)
+		return;
+
+	bool pinned = false;
+	{
+		lock_guard<mutex> lock(s_allocations_lock);
+		auto found = s_allocations.find(ptr);
+		if (found != s_allocations.end()) {
+			pinned = found->second.pinned;
+			s_allocations.erase(found);
+		}
+	}
+
+	// failures here are harmless (e.g. the devices have already been reset),
+	// but we don't want them to be picked up by later error checks
+	if (pinned && cudaHostUnregister(ptr) != cudaSuccess)
+		cudaGetLastError();
+
+	free(ptr);
+}
+
+bool host_pin(void *ptr, int device)
+{
+	lock_guard<mutex> lock(s_allocations_lock);
+	auto found = s_allocations.find(ptr);
+	if (found == s_allocations.end() || found->second.bytes == 0)
+		return false;
+	if (found->second.pinned)
+		return true;
+
+	cudaError_t err = cudaSetDevice(device);
+	if (err == cudaSuccess)
+		err = cudaHostRegister(ptr, found->second.bytes, cudaHostRegisterPortable);
+	if (err != cudaSuccess) {
+		cerr << "WARNING: failed to page-lock " << found->second.bytes
+			<< " bytes of host memory: " << cudaGetErrorString(err) << endl;
+		cudaGetLastError();
+		return false;
+	}
+
+	found->second.pinned = true;
+	return true;
+}
+
+string host_placement(const void *ptr)
+{
+	lock_guard<mutex> lock(s_allocations_lock);
+	auto found = s_allocations.find(ptr);
+	if (found == s_allocations.end())
+		return "unmanaged";
+
+	string desc = found->second.pinned ? "pinned" : "pageable";
+	if (found->second.hugepages)
+		desc += ", huge pages";
+	if (s_policy.first_touch_threads > 1)
+		desc += ", first touch by " + to_string(s_policy.first_touch_threads) + " threads";
+	return desc;
+}
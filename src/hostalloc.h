@@ -0,0 +1,90 @@
+/*  Copyright (c) 2019 INGV, EDF, UniCT, JHU
+
+    Istituto Nazionale di Geofisica e Vulcanologia, Sezione di Catania, Italy
+    Électricité de France, Paris, France
+    Università di Catania, Catania, Italy
+    Johns Hopkins University, Baltimore (MD), USA
+
+    This file is part of GPUSPH. Project founders:
+        Alexis Hérault, Giuseppe Bilotta, Robert A. Dalrymple,
+        Eugenio Rustico, Ciro Del Negro
+    For a full list of authors and project partners, consult the logs
+    and the project website <https://www.gpusph.org>
+
+    GPUSPH is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GPUSPH is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GPUSPH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*! \file
+ * Allocation policy for the host-side particle buffers
+ *
+ * Host buffers are allocated page-aligned, with transparent huge pages
+ * advised for large arrays, initialized (first-touched) from multiple
+ * threads so that the pages are spread across the NUMA nodes the threads
+ * run on, and can be page-locked after allocation so that the DUMP
+ * transfers from the devices do not need to bounce through a driver
+ * staging area.
+ */
+
+#ifndef _HOSTALLOC_H
+#define _HOSTALLOC_H
+
+#include <cstddef>
+#include <string>
+
+//! Host allocation policy
+struct HostAllocPolicy
+{
+	bool hugepages; ///< advise transparent huge pages for large allocations
+	size_t hugepage_threshold; ///< minimum allocation size (in bytes) for the huge page advice
+	unsigned int first_touch_threads; ///< number of threads used to initialize new allocations
+
+	HostAllocPolicy() :
+		hugepages(true),
+		hugepage_threshold(size_t(32) << 20),
+		first_touch_threads(1)
+	{}
+};
+
+//! Set the policy for subsequent host allocations
+void set_host_alloc_policy(HostAllocPolicy const& policy);
+
+//! Get the current host allocation policy
+HostAllocPolicy const& get_host_alloc_policy();
+
+//! Allocate bytes of host memory, setting every byte to init_value
+/*! The memory is first touched using the policy first_touch_threads.
+ * Returns NULL if the allocation fails.
+ */
+void *host_alloc(size_t bytes, int init_value);
+
+//! Set every byte of a host_alloc()ated area to init_value
+/*! The same thread layout as the first touch is used, to avoid
+ * migrating pages around.
+ */
+void host_clear(void *ptr, size_t bytes, int init_value);
+
+//! Release memory allocated with host_alloc(), unpinning it if necessary
+void host_free(void *ptr);
+
+//! Page-lock a host_alloc()ated area, making it accessible to all devices
+/*! The registration is done from the given device. Returns false (and leaves
+ * the memory pageable) if page-locking fails.
+ */
+bool host_pin(void *ptr, int device);
+
+//! Human-readable description of the placement of a host_alloc()ated area
+std::string host_placement(const void *ptr);
+
+#endif
@@ -32,18 +32,18 @@
  * Specializations of the Buffer class for host buffers
  */
 
-// malloc
-#include <cstdlib>
-// memset
-#include <cstring>
+// host_alloc, host_clear, host_free
+#include "hostalloc.h"
 
-// swap
+// swap, min
 #include <algorithm>
+// memcpy
+#include <cstring>
 
 #include "buffer.h"
 
 /*! Specialize the Buffer class in the case of host allocations
- * (i.e. using malloc/free/memset/etc)
+ * (i.e. using host_alloc/host_free/host_clear, see hostalloc.h)
  */
 template<flag_t Key>
 class HostBuffer : public Buffer<Key>
@@ -64,7 +64,7 @@ public:
 			//printf("\tfreeing buffer %d\n", i);
 #endif
 			if (bufs[i]) {
-				free(bufs[i]);
+				host_free(bufs[i]);
 				bufs[i] = NULL;
 			}
 		}
@@ -75,7 +75,7 @@ public:
 		const int N = baseclass::array_count;
 		element_type **bufs = baseclass::get_raw_ptr();
 		for (int i = 0; i < N; ++i) {
-			memset(bufs[i], baseclass::get_init_value(), bufmem);
+			host_clear(bufs[i], bufmem, baseclass::get_init_value());
 		}
 	}
 
@@ -86,14 +86,34 @@ public:
 		const int N = baseclass::array_count; // see NOTE for this class
 		element_type **bufs = baseclass::get_raw_ptr();
 		for (int i = 0; i < N; ++i) {
-			// malloc instead of calloc since the init
-			// value might be nonzero
-			bufs[i] = (element_type*)malloc(bufmem);
-			memset(bufs[i], baseclass::get_init_value(), bufmem);
+			// the init value might be nonzero, so host_alloc
+			// takes care of it (using the first-touch policy)
+			bufs[i] = (element_type*)host_alloc(bufmem, baseclass::get_init_value());
 		}
 		return bufmem*N;
 	}
 
+	// reallocate preserving the content, see AbstractBuffer::realloc
+	virtual size_t realloc(size_t elems, size_t rows = 1) {
+		const size_t old_row = AbstractBuffer::get_allocated_elements()/rows;
+		const size_t new_row = elems/rows;
+		const size_t copy_row = std::min(old_row, new_row)*sizeof(element_type);
+		const size_t bufmem = elems*sizeof(element_type);
+		const int N = baseclass::array_count; // see NOTE for this class
+		element_type **bufs = baseclass::get_raw_ptr();
+		for (int i = 0; i < N; ++i) {
+			element_type *newbuf = (element_type*)host_alloc(bufmem, baseclass::get_init_value());
+			if (bufs[i]) {
+				for (size_t r = 0; r < rows; ++r)
+					memcpy(newbuf + r*new_row, bufs[i] + r*old_row, copy_row);
+				host_free(bufs[i]);
+			}
+			bufs[i] = newbuf;
+		}
+		AbstractBuffer::set_allocated_elements(elems);
+		return bufmem*N;
+	}
+
 	virtual void swap_elements(uint idx1, uint idx2, uint _buf=0) {
 		element_type *buf = baseclass::get_raw_ptr()[_buf];
 		std::swap(buf[idx1], buf[idx2]);
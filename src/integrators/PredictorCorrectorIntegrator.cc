@@ -368,7 +368,25 @@ PredictorCorrector::initializeNextStepSequence(StepInfo const& step)
 
 	// at the end of the corrector we rename step n+1 to step n, in preparation
 	// for the next loop
+	// adaptive neighbors list: bound the displacement during this time-step
+	// from the maximum speed at its start, at the predictor and at its end.
+	// The predicted state is updated in place by the corrector, so it must
+	// be sampled here
+	if (sp->adaptive_neibs && step.number == 1) {
+		this_phase->add_command(MAX_SPEED)
+			.reading("step n", BUFFER_VEL);
+		this_phase->add_command(MAX_SPEED)
+			.reading("step n*", BUFFER_VEL);
+	}
+
 	if (step.last) {
+		if (sp->adaptive_neibs) {
+			this_phase->add_command(MAX_SPEED)
+				.reading("step n+1", BUFFER_VEL);
+			this_phase->add_command(UPDATE_NEIBS_DISPLACEMENT)
+				.set_dt(dt_op);
+		}
+
 		this_phase->add_command(RELEASE_STATE)
 			.set_src("step n");
 		this_phase->add_command(RENAME_STATE)
@@ -394,6 +412,15 @@ PredictorCorrector::initializePredCorrSequence(StepInfo const& step)
 		step.number == 1 ? "predictor" :
 		step.number == 2 ? "corrector" : "this can't happen");
 
+	// the predictor and corrector sequences don't depend on anything computed
+	// during the phase, so their worker commands can be dispatched in batches.
+	// This is disabled when we need to inspect the effects of each command
+	// from the main thread
+	if (gdata->clOptions->batch_commands &&
+		!gdata->debug.benchmark_command_runtimes &&
+		!gdata->debug.check_buffer_consistency)
+		this_phase->set_batchable();
+
 	/* In the predictor/corrector scheme we use, there are four buffers that
 	 * need special treatment:
 	 * * the INFO buffer is always representative of both states —in fact, because of this
@@ -504,6 +531,8 @@ PredictorCorrector::initializePredCorrSequence(StepInfo const& step)
 			 */
 			BUFFER_DKDE | BUFFER_TAU |
 			BUFFER_INTERNAL_ENERGY_UPD);
+	// pre_forces() resets the forces and XSPH buffers itself
+	forces_cmd.overwriting(BUFFER_FORCES | BUFFER_XSPH);
 
 	/* When calling FORCES_SYNC, the CFL buffers must also be read in the final
 	 * post_forces() call (with FORCES_ENQUEUE, this is done by FORCES_COMPLETE below
@@ -512,11 +541,40 @@ PredictorCorrector::initializePredCorrSequence(StepInfo const& step)
 		forces_cmd.reading(current_state, BUFFERS_CFL & ~BUFFER_CFL_TEMP)
 			.set_dt(dt_op);
 
-	if (MULTI_DEVICE)
-		this_phase->add_command(UPDATE_EXTERNAL)
-			.updating(current_state,
-				BUFFER_FORCES | BUFFER_XSPH | BUFFER_DKDE |
-				BUFFER_INTERNAL_ENERGY_UPD);
+	/* With asynchronous bodies integration, the commands that don't depend on the
+	 * new bodies data are deferred until after MOVE_BODIES, so that they run
+	 * while the body solver is working on the host. When striping, the external
+	 * update is already overlapped with the forces computation, so it stays here.
+	 */
+	const bool async_bodies = sp->numbodies > 0 && gdata->clOptions->async_bodies;
+	const bool defer_forces_update = async_bodies && !striping;
+
+	auto update_forces_external = [&]() {
+		if (MULTI_DEVICE)
+			this_phase->add_command(UPDATE_EXTERNAL)
+				.updating(current_state,
+					BUFFER_FORCES | BUFFER_XSPH | BUFFER_DKDE |
+					BUFFER_INTERNAL_ENERGY_UPD);
+	};
+
+	// On the predictor, we need to (re)init the predicted status (n*),
+	// on the corrector this will be updated (in place) to the corrected status (n+1)
+	auto init_predicted_state = [&]() {
+		if (step.number != 1)
+			return;
+		this_phase->add_command(INIT_STATE)
+			.set_src("step n*");
+		/* The buffers (re)initialized during the neighbors list construction
+		 * and the INFO and HASH buffers are shared between states
+		 */
+		this_phase->add_command(SHARE_BUFFERS)
+			.set_src("step n")
+			.set_dst("step n*")
+			.set_flags(shared_buffers | SUPPORT_BUFFERS);
+	};
+
+	if (!defer_forces_update)
+		update_forces_external();
 
 	if (striping) {
 		CommandStruct& complete_cmd = this_phase->add_command(FORCES_COMPLETE)
@@ -558,6 +616,15 @@ PredictorCorrector::initializePredCorrSequence(StepInfo const& step)
 			.set_dt(dt_op)
 			.set_src(current_state);
 
+		if (async_bodies) {
+			if (defer_forces_update)
+				update_forces_external();
+			init_predicted_state();
+			// wait for the body solver before using its results
+			this_phase->add_command(JOIN_BODIES)
+				.set_step(step);
+		}
+
 		// Upload translation vectors and rotation matrices; will upload CGs after euler
 		this_phase->add_command(UPLOAD_OBJECTS_MATRICES);
 		// Upload objects linear and angular velocities
@@ -570,19 +637,8 @@ PredictorCorrector::initializePredCorrSequence(StepInfo const& step)
 		}
 	}
 
-	// On the predictor, we need to (re)init the predicted status (n*),
-	// on the corrector this will be updated (in place) to the corrected status (n+1)
-	if (step.number == 1) {
-		this_phase->add_command(INIT_STATE)
-			.set_src("step n*");
-		/* The buffers (re)initialized during the neighbors list construction
-		 * and the INFO and HASH buffers are shared between states
-		 */
-		this_phase->add_command(SHARE_BUFFERS)
-			.set_src("step n")
-			.set_dst("step n*")
-			.set_flags(shared_buffers | SUPPORT_BUFFERS);
-	}
+	if (!async_bodies)
+		init_predicted_state();
 
 	CommandStruct& euler_cmd = this_phase->add_command(EULER)
 		.set_step(step)
@@ -988,6 +1044,8 @@ PredictorCorrector::phase_after(PredictorCorrector::PhaseCode cur)
 	if (cur == INIT_EFFPRES) {
 		if (gdata->h_jacobiStop) {
 			return NEIBS_LIST;
+		} else if (gdata->h_krylovRestart) {
+			return INIT_EFFPRES_PREP;
 		} else {
 			return INIT_EFFPRES;
 		}
@@ -995,6 +1053,8 @@ PredictorCorrector::phase_after(PredictorCorrector::PhaseCode cur)
 	if (cur == POSTPRED_EFFPRES) {
 		if (gdata->h_jacobiStop) {
 			return CORRECTOR;
+		} else if (gdata->h_krylovRestart) {
+			return POSTPRED_EFFPRES_PREP;
 		} else {
 			return POSTPRED_EFFPRES;
 		}
@@ -1002,6 +1062,8 @@ PredictorCorrector::phase_after(PredictorCorrector::PhaseCode cur)
 	if (cur == POSTCORR_EFFPRES) {
 		if (gdata->h_jacobiStop) {
 			return BEGIN_TIME_STEP;
+		} else if (gdata->h_krylovRestart) {
+			return POSTCORR_EFFPRES_PREP;
 		} else {
 			return POSTCORR_EFFPRES;
 		}
@@ -1043,6 +1105,41 @@ PredictorCorrector::phase_after(PredictorCorrector::PhaseCode cur)
 	throw logic_error("unknown condition after phase " + to_string(cur));
 }
 
+vector<Integrator::PhaseBlock>
+PredictorCorrector::execution_sequence() const
+{
+	const SimParams *sp = gdata->problem->simparams();
+	const bool has_granular_rheology = sp->rheologytype == GRANULAR;
+
+	vector<PhaseBlock> seq;
+	auto add = [&](std::initializer_list<PhaseCode> codes, bool repeats) {
+		PhaseBlock block;
+		for (PhaseCode code : codes)
+			block.phases.push_back(m_phase.at(code));
+		block.repeats = repeats;
+		seq.push_back(block);
+	};
+
+	// initialization
+	add({ POST_UPLOAD, NEIBS_LIST, INITIALIZATION }, false);
+
+	// time-step: the effective pressure solvers are iterative, and their preparation
+	// phase is re-entered on restarts
+	add({ BEGIN_TIME_STEP }, false);
+	if (has_granular_rheology)
+		add({ INIT_EFFPRES_PREP, INIT_EFFPRES }, true);
+	add({ NEIBS_LIST, FILTER_INTRO }, false);
+	add({ FILTER_CALL }, true);
+	add({ FILTER_OUTRO, PREDICTOR, PREDICTOR_END }, false);
+	if (has_granular_rheology)
+		add({ POSTPRED_EFFPRES_PREP, POSTPRED_EFFPRES }, true);
+	add({ CORRECTOR, CORRECTOR_END }, false);
+	if (has_granular_rheology)
+		add({ POSTCORR_EFFPRES_PREP, POSTCORR_EFFPRES }, true);
+
+	return seq;
+}
+
 Integrator::Phase *
 PredictorCorrector::initializeEffPresSolverPrepSequence(StepInfo const& step)
 {
@@ -1099,7 +1196,99 @@ PredictorCorrector::initializeEffPresSolverPrepSequence(StepInfo const& step)
 		this_phase->add_command(UPDATE_EXTERNAL)
 			.updating(current_state, BUFFER_EFFPRES);
 
-	this_phase->add_command(JACOBI_RESET_STOP_CRITERION);
+	if (!sp->effpres_krylov) {
+		this_phase->add_command(JACOBI_RESET_STOP_CRITERION);
+		return this_phase;
+	}
+
+	/* Krylov solver
+	 *---------------
+	 * The Jacobi vectors are built once for the current boundary conditions,
+	 * and used to initialize the conjugate gradient residual (warm-started from
+	 * the current effective pressure). This phase is re-entered to restart
+	 * the solver when the boundary conditions need to be updated.
+	 */
+	this_phase->add_command(JACOBI_BUILD_VECTORS)
+		.reading(current_state,
+				BUFFER_POS | BUFFER_HASH | BUFFER_INFO | BUFFER_CELLSTART | BUFFER_NEIBSLIST |
+				BUFFER_VEL | BUFFER_EFFPRES |
+				(has_sa ? BUFFER_VERTPOS | BUFFER_GRADGAMMA | BUFFER_BOUNDELEMENTS : BUFFER_NONE))
+		.writing(current_state, BUFFER_JACOBI);
+
+	this_phase->add_command(KRYLOV_INIT_EFFPRES)
+		.reading(current_state, BUFFER_POS | BUFFER_VEL | BUFFER_INFO | BUFFER_EFFPRES)
+		.updating(current_state, BUFFER_JACOBI)
+		.writing(current_state, BUFFER_KRYLOV)
+		// written for all particles, see krylovInitDevice
+		.overwriting(BUFFER_KRYLOV);
+	if (MULTI_DEVICE)
+		this_phase->add_command(UPDATE_EXTERNAL)
+			.updating(current_state, BUFFER_KRYLOV);
+
+	addKrylovMatVec(this_phase, current_state);
+
+	this_phase->add_command(KRYLOV_INIT_COEFFICIENTS);
+
+	return this_phase;
+}
+
+void
+PredictorCorrector::addKrylovMatVec(Phase *this_phase, std::string const& current_state)
+{
+	SimParams const* sp = gdata->problem->simparams();
+	static const bool has_sa = sp->boundarytype == SA_BOUNDARY;
+
+	this_phase->add_command(KRYLOV_EFFPRES_MATVEC)
+		.reading(current_state,
+				BUFFER_POS | BUFFER_HASH | BUFFER_INFO | BUFFER_CELLSTART | BUFFER_NEIBSLIST |
+				BUFFER_VEL | BUFFER_KRYLOV |
+				(has_sa ? BUFFER_VERTPOS | BUFFER_GRADGAMMA : BUFFER_NONE))
+		.updating(current_state, BUFFER_JACOBI);
+}
+
+//! The Krylov effective pressure phase bails out before its final command
+//! (the state buffers swap that follows the post-predictor solution)
+//! unless the solver has converged
+static bool
+krylov_effpres_is_done(Integrator::Phase const* p, GlobalData const* gdata)
+{
+	return p->finished_commands() ||
+		(!gdata->h_jacobiStop && p->current_command()->command == SWAP_STATE_BUFFERS);
+}
+
+Integrator::Phase *
+PredictorCorrector::initializeKrylovEffPresSolverSequence(StepInfo const& step)
+{
+	Phase *this_phase = new Phase(this,
+			step.number == 0 ? "initialization effpres calculation" :
+			step.number == 1 ? "post-predictor effpres calculation" :
+			step.number == 2 ? "post-corrector effpres calculation" : "this can't happen");
+
+	string current_state = getCurrentStateForStep(step.number);
+	if (step.number == 2)
+		current_state = "step n";
+
+	// Advance the solver: search directions, effective pressure and residuals
+	this_phase->add_command(KRYLOV_UPDATE_EFFPRES)
+		.reading(current_state, BUFFER_JACOBI)
+		.updating(current_state, BUFFER_KRYLOV | BUFFER_EFFPRES);
+	if (MULTI_DEVICE)
+		this_phase->add_command(UPDATE_EXTERNAL)
+			.updating(current_state, BUFFER_KRYLOV | BUFFER_EFFPRES);
+
+	// Matrix-vector product and dot products for the next step
+	addKrylovMatVec(this_phase, current_state);
+
+	this_phase->add_command(KRYLOV_STOP_CRITERION);
+
+	if (step.number == 1) {
+		this_phase->add_command(SWAP_STATE_BUFFERS)
+			.set_src("step n*")
+			.set_dst("step n")
+			.set_flags(BUFFER_EFFPRES);
+		this_phase->is_done_if(krylov_effpres_is_done);
+	}
+
 	return this_phase;
 }
 
@@ -1107,6 +1296,9 @@ Integrator::Phase *
 PredictorCorrector::initializeEffPresSolverSequence(StepInfo const& step)
 {
 	SimParams const* sp = gdata->problem->simparams();
+	if (sp->effpres_krylov)
+		return initializeKrylovEffPresSolverSequence(step);
+
 	Phase *this_phase = new Phase(this,
 			step.number == 0 ? "initialization effpres calculation" :
 			step.number == 1 ? "post-predictor effpres calculation" :
@@ -83,6 +83,9 @@ class PredictorCorrector : public Integrator
 	Phase* initializePredCorrSequence(StepInfo const& step_num);
 	Phase* initializeEffPresSolverPrepSequence(StepInfo const& step_num);
 	Phase* initializeEffPresSolverSequence(StepInfo const& step_num);
+	Phase* initializeKrylovEffPresSolverSequence(StepInfo const& step_num);
+	// add the Krylov solver matrix-vector product for the effective pressure
+	void addKrylovMatVec(Phase *this_phase, std::string const& current_state);
 
 	template<PhaseCode phase>
 	void initializePhase();
@@ -90,6 +93,10 @@ class PredictorCorrector : public Integrator
 	// Determine the phase following phase cur
 	PhaseCode phase_after(PhaseCode cur);
 
+	// The phases of the initialization and of a time-step, in the order
+	// in which phase_after() walks them
+	std::vector<PhaseBlock> execution_sequence() const override;
+
 public:
 	// From the generic Integrator we only reimplement
 	// the constructor, that will initialize the integrator phases
@@ -334,6 +334,8 @@ RepackingIntegrator::initializeRepackingSequence(StepInfo const& step)
 			 */
 			BUFFER_DKDE | BUFFER_TAU |
 			BUFFER_INTERNAL_ENERGY_UPD);
+	// pre_forces() resets the forces and XSPH buffers itself
+	forces_cmd.overwriting(BUFFER_FORCES | BUFFER_XSPH);
 
 	/* When calling FORCES_SYNC, the CFL buffers must also be read in the final
 	 * post_forces() call (with FORCES_ENQUEUE, this is done by FORCES_COMPLETE below
@@ -32,6 +32,106 @@
  * simulations will benefit of it when the major split axis is COORD3: this means that all the
  * particles in an edging slice (orthogonal to COORD3 axis) will be consecutive in memory and
  * thus eligible for a single burst transfer.
- * Cells with consecutive COORD1 are consecutive in their linearized index. */
+ * Cells with consecutive COORD1 are consecutive in their linearized index.
+ *
+ * Alternatively (linearization=morton at build time), the cells are grouped in
+ * tiles of MORTON_TILE_SIDE^3 cells, laid out in x, y, z order, and the cells
+ * of each tile are laid out along a Z-order (Morton) curve, so that cells
+ * which are close in space are also close in memory along all directions.
+ * Tiles at the upper edges of the domain can be partial: their cells are
+ * laid out in x, y, z order, so that the linearization stays compact
+ * (the cell indices are still exactly 0 to nGridCells - 1). */
+
+#ifndef _LINEARIZATION_H
+#define _LINEARIZATION_H
 
 #include "linearization_select.opt"
+
+#ifndef MORTON_LINEARIZATION
+#define MORTON_LINEARIZATION 0
+#endif
+
+#if MORTON_LINEARIZATION
+
+#include "cuda_runtime.h"
+
+#define MORTON_TILE_BITS 3
+#define MORTON_TILE_SIDE (1U << MORTON_TILE_BITS)
+#define MORTON_TILE_MASK (MORTON_TILE_SIDE - 1)
+
+//! Spread the MORTON_TILE_BITS bits of v two bits apart
+__host__ __device__ __forceinline__ unsigned int
+morton_tile_spread(unsigned int v)
+{ return (v & 1) | ((v & 2) << 2) | ((v & 4) << 4); }
+
+//! Inverse of morton_tile_spread()
+__host__ __device__ __forceinline__ unsigned int
+morton_tile_compact(unsigned int v)
+{ return (v & 1) | ((v >> 2) & 2) | ((v >> 4) & 4); }
+
+//! Number of cells of the tile starting at the given coordinate, along an axis of the given size
+__host__ __device__ __forceinline__ unsigned int
+morton_tile_extent(unsigned int tile_start, unsigned int size)
+{ return size - tile_start < MORTON_TILE_SIDE ? size - tile_start : MORTON_TILE_SIDE; }
+
+//! Linearized index of the cell at gridPos, in a grid of the given size
+__host__ __device__ __forceinline__ unsigned int
+morton_cell_hash(int3 const& gridPos, uint3 const& gridSize)
+{
+	const unsigned int x0 = gridPos.x & ~MORTON_TILE_MASK;
+	const unsigned int y0 = gridPos.y & ~MORTON_TILE_MASK;
+	const unsigned int z0 = gridPos.z & ~MORTON_TILE_MASK;
+	const unsigned int sx = morton_tile_extent(x0, gridSize.x);
+	const unsigned int sy = morton_tile_extent(y0, gridSize.y);
+	const unsigned int sz = morton_tile_extent(z0, gridSize.z);
+
+	// cells in the tiles preceding this one: whole slabs of tiles below,
+	// whole rows of tiles in the same slab, and tiles in the same row
+	const unsigned int tile_start = z0*gridSize.y*gridSize.x + y0*sz*gridSize.x + x0*sy*sz;
+
+	const unsigned int lx = gridPos.x & MORTON_TILE_MASK;
+	const unsigned int ly = gridPos.y & MORTON_TILE_MASK;
+	const unsigned int lz = gridPos.z & MORTON_TILE_MASK;
+	const bool full_tile = (sx & sy & sz) == MORTON_TILE_SIDE;
+
+	return tile_start + (full_tile ?
+		morton_tile_spread(lx) | (morton_tile_spread(ly) << 1) | (morton_tile_spread(lz) << 2) :
+		(lz*sy + ly)*sx + lx);
+}
+
+//! Grid position of the cell with the given linearized index, in a grid of the given size
+__host__ __device__ __forceinline__ int3
+morton_cell_pos(unsigned int cellHash, uint3 const& gridSize)
+{
+	const unsigned int slab = (gridSize.x*gridSize.y) << MORTON_TILE_BITS;
+	const unsigned int z0 = (cellHash / slab) << MORTON_TILE_BITS;
+	cellHash -= z0*gridSize.x*gridSize.y;
+	const unsigned int sz = morton_tile_extent(z0, gridSize.z);
+
+	const unsigned int row = (gridSize.x*sz) << MORTON_TILE_BITS;
+	const unsigned int y0 = (cellHash / row) << MORTON_TILE_BITS;
+	cellHash -= y0*gridSize.x*sz;
+	const unsigned int sy = morton_tile_extent(y0, gridSize.y);
+
+	const unsigned int tile = (sy*sz) << MORTON_TILE_BITS;
+	const unsigned int x0 = (cellHash / tile) << MORTON_TILE_BITS;
+	cellHash -= x0*sy*sz;
+	const unsigned int sx = morton_tile_extent(x0, gridSize.x);
+
+	int3 gridPos;
+	if ((sx & sy & sz) == MORTON_TILE_SIDE) {
+		gridPos.x = x0 + morton_tile_compact(cellHash);
+		gridPos.y = y0 + morton_tile_compact(cellHash >> 1);
+		gridPos.z = z0 + morton_tile_compact(cellHash >> 2);
+	} else {
+		gridPos.x = x0 + cellHash % sx;
+		cellHash /= sx;
+		gridPos.y = y0 + cellHash % sy;
+		gridPos.z = z0 + cellHash / sy;
+	}
+	return gridPos;
+}
+
+#endif
+
+#endif
@@ -85,12 +85,19 @@ void print_usage() {
 	cout << "\t       [--dir directory] [--nosave] [--striping] [--gpudirect [--asyncmpi]]\n";
 	cout << "\t       [--num-hosts VAL [--byslot-scheduling]]\n";
 	cout << "\t       [--display [--display-every VAL] --display-script VAL]\n";
+	cout << "\t       [--host-threads VAL]\n";
 	cout << "\t       [--debug FLAGS]\n";
 	cout << "\tGPUSPH --help\n\n";
 	cout << " --resume : resume from the given file (HotStart file saved by HotWriter)\n";
 	cout << " --checkpoint-every : HotStart checkpoints will be created every VAL seconds\n";
 	cout << "                      of simulated time (float VAL, 0 disables)\n";
 	cout << " --checkpoints : number of HotStart checkpoints to keep (integer VAL)\n";
+	cout << " --checkpoint-local DIR : keep the HotStart checkpoints in the node-local DIR\n";
+	cout << "                      (ideally RAM-backed, e.g. /dev/shm), mirrored to a buddy process\n";
+	cout << " --checkpoint-disk-every : with --checkpoint-local, also write every VAL-th\n";
+	cout << "                      checkpoint to the data directory (integer VAL, 0: never, default 10)\n";
+	cout << " --resume-local : resume from the newest checkpoint in the --checkpoint-local DIR\n";
+	cout << "                      available for all processes\n";
 	cout << " --device n[,n...] : Use device number n; runs multi-gpu if multiple n are given\n";
 	cout << " --dem : Use given DEM (if problem supports it)\n";
 	cout << " --deltap : Use given deltap (VAL is cast to float)\n";
@@ -111,6 +118,27 @@ void print_usage() {
 	cout << " --display-every : Simulation data will be passed to visualization every VAL seconds\n";
 	cout << "                   of simulated time (VAL is cast to double, 0 or not defined - visualization for each iteration)\n";
 	cout << " --display-script : Path to co-processing Python script\n";
+	cout << " --host-threads : use VAL threads for host-side processing (e.g. before writing; 0 autodetects)\n";
+	cout << " --no-pinned-host : do not page-lock the host particle buffers\n";
+	cout << " --no-hugepages : do not use huge pages for large host buffers\n";
+	cout << " --async-bodies : integrate moving bodies on a separate host thread, overlapping device work\n";
+	cout << " --async-commands : enqueue device work without waiting for its completion, synchronizing only\n";
+	cout << "                    when results are needed (device errors may be reported by a later command)\n";
+	cout << " --batch-commands : dispatch the predictor and corrector worker commands in batches,\n";
+	cout << "                    synchronizing the threads only around host commands and data exchanges\n";
+	cout << " --no-buffer-aliasing : do not let ephemeral device buffers that are never in use\n";
+	cout << "                        at the same time share their storage\n";
+	cout << " --bench-report FILE : write a JSON report with setup time, performance, memory usage\n";
+	cout << "                       and (with --debug benchmark_command_runtimes) per-command timings to FILE\n";
+	cout << " --metrics-file FILE : periodically write live metrics to FILE, in the Prometheus text format\n";
+	cout << " --metrics-socket PATH : serve live metrics to clients connecting to the Unix-domain socket PATH\n";
+	cout << " --metrics-every VAL : seconds between updates of the metrics file (VAL is cast to double, default: 10)\n";
+	cout << " --dry-run : estimate the number of particles and the memory needed on each device,\n";
+	cout << "             without generating the particles nor using any device, and quit\n";
+	cout << " --device-memory VAL : device memory in GiB assumed by --dry-run to check if the case fits\n";
+	cout << "                       and find the finest feasible resolution (VAL is cast to double)\n";
+	cout << " --setup-cache DIR : reuse the particles filled by a previous run with the same geometry,\n";
+	cout << "                     caching them in DIR\n";
 	cout << " --debug : enable debug flags FLAGS\n";
 #include "describe-debugflags.h"
 	cout << " --repack : run the repacking before the simulation, beware to enable repacking in the simulation framework\n";
@@ -153,6 +181,16 @@ int parse_options(int argc, char **argv, GlobalData *gdata)
 			sscanf(*argv, "%d", &(_clOptions->checkpoints));
 			argv++;
 			argc--;
+		} else if (!strcmp(arg, "--checkpoint-local")) {
+			_clOptions->checkpoint_local = string(*argv);
+			argv++;
+			argc--;
+		} else if (!strcmp(arg, "--checkpoint-disk-every")) {
+			sscanf(*argv, "%d", &(_clOptions->checkpoint_disk_every));
+			argv++;
+			argc--;
+		} else if (!strcmp(arg, "--resume-local")) {
+			_clOptions->resume_local = true;
 		} else if (!strcmp(arg, "--device")) {
 			/* parse the argument as a device list, and append it to any previously
 			 * added devices */
@@ -231,6 +269,51 @@ int parse_options(int argc, char **argv, GlobalData *gdata)
 			_clOptions->pipeline_fpath = string(*argv);
 			argv++;
 			argc--;
+		} else if (!strcmp(arg, "--host-threads")) {
+			/* read the next arg as a uint */
+			sscanf(*argv, "%u", &(_clOptions->host_threads));
+			argv++;
+			argc--;
+		} else if (!strcmp(arg, "--no-pinned-host")) {
+			_clOptions->no_pinned_host = true;
+		} else if (!strcmp(arg, "--no-hugepages")) {
+			_clOptions->no_hugepages = true;
+		} else if (!strcmp(arg, "--async-bodies")) {
+			_clOptions->async_bodies = true;
+		} else if (!strcmp(arg, "--async-commands")) {
+			_clOptions->async_commands = true;
+		} else if (!strcmp(arg, "--batch-commands")) {
+			_clOptions->batch_commands = true;
+		} else if (!strcmp(arg, "--no-buffer-aliasing")) {
+			_clOptions->no_buffer_aliasing = true;
+		} else if (!strcmp(arg, "--bench-report")) {
+			_clOptions->bench_report = string(*argv);
+			argv++;
+			argc--;
+		} else if (!strcmp(arg, "--metrics-file")) {
+			_clOptions->metrics_file = string(*argv);
+			argv++;
+			argc--;
+		} else if (!strcmp(arg, "--metrics-socket")) {
+			_clOptions->metrics_socket = string(*argv);
+			argv++;
+			argc--;
+		} else if (!strcmp(arg, "--metrics-every")) {
+			/* read the next arg as a double */
+			sscanf(*argv, "%lf", &(_clOptions->metrics_interval));
+			argv++;
+			argc--;
+		} else if (!strcmp(arg, "--dry-run")) {
+			_clOptions->dry_run = true;
+		} else if (!strcmp(arg, "--device-memory")) {
+			/* read the next arg as a double */
+			sscanf(*argv, "%lf", &(_clOptions->device_memory));
+			argv++;
+			argc--;
+		} else if (!strcmp(arg, "--setup-cache")) {
+			_clOptions->setup_cache = string(*argv);
+			argv++;
+			argc--;
 		} else if (!strcmp(arg, "--debug")) {
 			gdata->debug = parse_debug_flags(*argv);
 			argv++;
@@ -364,6 +447,13 @@ void simulate(GlobalData *gdata, RunMode repack_or_run)
 	// initialize CUDA, start workers, allocate CPU and GPU buffers
 	bool initialized  = Simulator->initialize(gdata);
 
+	// in a dry run, initialize() only does the capacity planning
+	if (gdata->clOptions->dry_run) {
+		if (!initialized)
+			gdata->ret = 1;
+		return;
+	}
+
 	if (!initialized)
 		throw runtime_error("GPUSPH: problem during initialization");
 
@@ -463,9 +553,18 @@ int main(int argc, char** argv) {
 				throw invalid_argument("asynchronous network transfers only supported with 1 process per device");
 		}
 
-		if (gdata.clOptions->repack || gdata.clOptions->repack_only)
+		if (gdata.clOptions->resume_local) {
+			if (gdata.clOptions->checkpoint_local.empty())
+				throw invalid_argument("--resume-local requires --checkpoint-local");
+			if (!gdata.clOptions->resume_fname.empty())
+				throw invalid_argument("--resume and --resume-local are mutually exclusive");
+		}
+
+		if (gdata.clOptions->dry_run)
+			simulate(&gdata, SIMULATE);
+		else if (gdata.clOptions->repack || gdata.clOptions->repack_only)
 			simulate(&gdata, REPACK);
-		if (!gdata.ret && !gdata.clOptions->repack_only) {
+		if (!gdata.ret && !gdata.clOptions->repack_only && !gdata.clOptions->dry_run) {
 			simulate(&gdata, SIMULATE);
 		}
 	} catch (exception const& e) {
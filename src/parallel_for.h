@@ -0,0 +1,114 @@
+/*  Copyright (c) 2019 INGV, EDF, UniCT, JHU
+
+    Istituto Nazionale di Geofisica e Vulcanologia, Sezione di Catania, Italy
+    Électricité de France, Paris, France
+    Università di Catania, Catania, Italy
+    Johns Hopkins University, Baltimore (MD), USA
+
+    This file is part of GPUSPH. Project founders:
+        Alexis Hérault, Giuseppe Bilotta, Robert A. Dalrymple,
+        Eugenio Rustico, Ciro Del Negro
+    For a full list of authors and project partners, consult the logs
+    and the project website <https://www.gpusph.org>
+
+    GPUSPH is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GPUSPH is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GPUSPH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*! \file
+ * Minimal helpers to run host-side loops over multiple threads
+ */
+
+#ifndef _PARALLEL_FOR_H
+#define _PARALLEL_FOR_H
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+//! Default number of host threads to use for host-side loops
+/*! This is the number of hardware threads available, as reported by the
+ * standard library, with a fallback to 1 when this is not known.
+ */
+inline unsigned int default_host_threads()
+{
+	const unsigned int hw = std::thread::hardware_concurrency();
+	return hw ? hw : 1;
+}
+
+//! Number of host threads to use, given the requested one
+/*! A request of 0 (the default for --host-threads) means autodetection,
+ * see default_host_threads().
+ */
+inline unsigned int configured_host_threads(unsigned int requested)
+{
+	return requested ? requested : default_host_threads();
+}
+
+//! Number of threads that parallel_for_chunks() would use
+/*! Each thread should get at least min_chunk elements, to avoid paying the
+ * thread creation overhead for trivial work.
+ */
+inline unsigned int effective_host_threads(unsigned int nthreads,
+	size_t begin, size_t end, size_t min_chunk)
+{
+	if (end <= begin || nthreads < 2)
+		return 1;
+	const size_t by_work = (end - begin + min_chunk - 1)/std::max(min_chunk, size_t(1));
+	return unsigned(std::max(size_t(1), std::min(size_t(nthreads), by_work)));
+}
+
+//! Split the range [begin, end) in contiguous chunks, and process each on a different thread
+/*! The functor is called as func(thread_index, chunk_begin, chunk_end),
+ * with thread_index going from 0 to the number of actually used threads
+ * (see effective_host_threads()) minus one. Chunk 0 is processed by
+ * the calling thread. Chunks are assigned in order, so that partial results
+ * collected per thread index can be combined in a deterministic order.
+ * \return the number of threads actually used
+ */
+template<typename Func>
+unsigned int parallel_for_chunks(unsigned int nthreads, size_t begin, size_t end,
+	Func&& func, size_t min_chunk = 4096)
+{
+	const unsigned int used = effective_host_threads(nthreads, begin, end, min_chunk);
+	if (used == 1) {
+		func(0U, begin, end);
+		return 1;
+	}
+
+	const size_t count = end - begin;
+	const size_t chunk = count/used;
+	const size_t extra = count % used;
+
+	// chunk boundaries: the first `extra` chunks get one more element
+	auto chunk_begin = [&](unsigned int t) -> size_t {
+		return begin + t*chunk + std::min(size_t(t), extra);
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve(used - 1);
+	for (unsigned int t = 1; t < used; ++t)
+		workers.emplace_back([&func, t, &chunk_begin]() {
+			func(t, chunk_begin(t), chunk_begin(t+1));
+		});
+
+	func(0U, chunk_begin(0), chunk_begin(1));
+
+	for (auto& w : workers)
+		w.join();
+
+	return used;
+}
+
+#endif
@@ -295,6 +295,7 @@ enum PostProcessType {
 	INTERFACE_DETECTION,
 	FLUX_COMPUTATION,
 	CALC_PRIVATE,
+	STATISTICS, ///< temporal statistics, see TemporalStatistics
 	INVALID_POSTPROC
 };
 
@@ -308,8 +309,10 @@ const char *PostProcessName[INVALID_POSTPROC+1]
 	"Vorticity",
 	"Testpoints",
 	"Surface detection",
+	"Interface detection",
 	"Flux computation",
 	"Private",
+	"Statistics",
 	"(invalid)"
 }
 #endif
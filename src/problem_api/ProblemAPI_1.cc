@@ -31,6 +31,16 @@
 
 #include <string>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <typeinfo>
+#include <cstdint>
+#include <cstring>
+
+// mkdir, getpid, gethostname
+#include <sys/stat.h>
+#include <unistd.h>
 
 // limits
 #include <cfloat>
@@ -926,9 +936,19 @@ GeometryID ProblemAPI<1>::addXYZFile(const GeometryType otype, const Point &orig
 
 GeometryID
 ProblemAPI<1>::addDEM(const char * fname_dem, const TopographyFormat dem_fmt, const FillType fill_type)
+{
+	return addDEM(fname_dem, dem_fmt, -INFINITY, -INFINITY, INFINITY, INFINITY, fill_type);
+}
+
+GeometryID
+ProblemAPI<1>::addDEM(const char * fname_dem, const TopographyFormat dem_fmt,
+	double west, double south, double east, double north,
+	const FillType fill_type)
 {
 	TopoCube::Format tc_fmt = (TopoCube::Format)dem_fmt;
-	TopoCube * dem = TopoCube::load_file(fname_dem, tc_fmt);
+	TopoCube * dem = TopoCube::load_file(fname_dem, tc_fmt,
+		TopoCube::GeoWindow(west, south, east, north));
+	dem->SetHostThreads(gdata->clOptions->host_threads);
 	GeometryID ret = addGeometry(
 		GT_DEM,
 		fill_type,
@@ -1462,6 +1482,87 @@ void ProblemAPI<1>::setDynamicBoundariesLayers(const uint numLayers)
 	m_numDynBoundLayers = numLayers;
 }
 
+/*! Geometry each point of the filled vectors comes from, as needed by the setup cache.
+ * Points are only appended by the fills, and only removed by the erase operations
+ * and (usually) by filterPoints(), in both cases preserving the order of the others,
+ * so that the origins of the remaining points can be found by walking both lists
+ */
+class FillOrigins
+{
+	vector<PointVect*> m_vecs;
+	vector< vector<int> > m_origins;
+	// points before the current removal, for each vector
+	vector<PointVect> m_before;
+	bool m_tracked;
+
+	static bool same_point(Point const& a, Point const& b)
+	{ return a(0) == b(0) && a(1) == b(1) && a(2) == b(2) && a(3) == b(3); }
+
+	size_t index(PointVect const& points) const
+	{ return find(m_vecs.begin(), m_vecs.end(), &points) - m_vecs.begin(); }
+
+public:
+	FillOrigins(vector<PointVect*> const& vecs, bool track) :
+		m_vecs(vecs),
+		m_origins(vecs.size()),
+		m_before(vecs.size()),
+		m_tracked(track)
+	{
+		// the points present before the fill are added by the problem itself
+		for (size_t v = 0; v < m_vecs.size(); ++v)
+			m_origins[v].assign(m_vecs[v]->size(), -1);
+	}
+
+	//! Were the origins of all the points tracked?
+	bool tracked() const
+	{ return m_tracked; }
+
+	vector< vector<int> > const& origins() const
+	{ return m_origins; }
+
+	//! Points were appended to the vector by the given geometry
+	void appended(PointVect const& points, int geom)
+	{
+		const size_t v = index(points);
+		if (m_tracked && v < m_vecs.size())
+			m_origins[v].resize(points.size(), geom);
+	}
+
+	//! Some points are about to be removed from the vector
+	void removing(PointVect const& points)
+	{
+		const size_t v = index(points);
+		if (m_tracked && v < m_vecs.size())
+			m_before[v] = points;
+	}
+
+	//! Some points were removed from the vector, see removing()
+	void removed(PointVect const& points)
+	{
+		const size_t v = index(points);
+		if (!m_tracked || v >= m_vecs.size())
+			return;
+
+		PointVect const& before = m_before[v];
+		vector<int>& origins = m_origins[v];
+		vector<int> kept;
+		kept.reserve(points.size());
+		size_t i = 0;
+		for (Point const& pt : points) {
+			while (i < before.size() && !same_point(before[i], pt))
+				++i;
+			// the points were moved or added, rather than removed
+			if (i == before.size()) {
+				m_tracked = false;
+				break;
+			}
+			kept.push_back(origins[i++]);
+		}
+		origins.swap(kept);
+		PointVect().swap(m_before[v]);
+	}
+};
+
 int ProblemAPI<1>::fill_parts(bool fill)
 {
 	// if for debug reason we need to test the position and verse of a plane, we can ask ODE to
@@ -1478,6 +1579,14 @@ int ProblemAPI<1>::fill_parts(bool fill)
 	uint hdf5file_parts_counter = 0;
 	uint xyzfile_parts_counter = 0;
 
+	// with --setup-cache, reuse the particles filled by a previous run with the same geometry;
+	// otherwise, track the geometry each particle comes from, to save them
+	const string cache_fname = (fill && !m_options->setup_cache.empty()) ?
+		setupCacheFilename() : string();
+	SetupCacheOrigins cache_origins;
+	const bool cached = !cache_fname.empty() && loadSetupCache(cache_fname, cache_origins);
+	FillOrigins origins(setupCacheVectors(), !cache_fname.empty() && !cached);
+
 	for (size_t g = 0, num_geoms = m_geometries.size(); g < num_geoms; g++) {
 		PointVect* parts_vector = NULL;
 		double dx = 0.0;
@@ -1524,33 +1633,37 @@ int ProblemAPI<1>::fill_parts(bool fill)
 		if (m_geometries[g]->type == GT_FLOATING_BODY && !m_geometries[g]->mass_was_set)
 			setMassByDensity(g, DEFAULT_PHYSICAL_DENSITY);
 
-		// prepare for erase operations
-		bool del_fluid = (m_geometries[g]->erase_operation == ET_ERASE_FLUID);
-		bool del_bound = (m_geometries[g]->erase_operation == ET_ERASE_BOUNDARY);
-		if (m_geometries[g]->erase_operation == ET_ERASE_ALL) del_fluid = del_bound = true;
+		// prepare for erase operations (the cached particles have undergone them already)
+		bool del_fluid = !cached && (m_geometries[g]->erase_operation == ET_ERASE_FLUID);
+		bool del_bound = !cached && (m_geometries[g]->erase_operation == ET_ERASE_BOUNDARY);
+		if (!cached && m_geometries[g]->erase_operation == ET_ERASE_ALL) del_fluid = del_bound = true;
 
 		double unfill_dx = dx; // or, dp also if (r0!=dp)?
 		if (!std::isnan(m_geometries[g]->unfill_radius))
 			unfill_dx = m_geometries[g]->unfill_radius;
 		// erase operations with existent geometries
 		if (del_fluid) {
+			origins.removing(m_fluidParts);
 			if (m_geometries[g]->intersection_type == IT_SUBTRACT)
 				m_geometries[g]->ptr->Unfill(m_fluidParts, unfill_dx);
 			else
 				m_geometries[g]->ptr->Intersect(m_fluidParts, unfill_dx);
+			origins.removed(m_fluidParts);
 		}
 		if (del_bound) {
+			origins.removing(m_boundaryParts);
 			if (m_geometries[g]->intersection_type == IT_SUBTRACT)
 				m_geometries[g]->ptr->Unfill(m_boundaryParts, unfill_dx);
 			else
 				m_geometries[g]->ptr->Intersect(m_boundaryParts, unfill_dx);
+			origins.removed(m_boundaryParts);
 		}
 
 		if (m_geometries[g]->fill_type == FT_UNFILL)
 			continue;
 
 		// after making some space, fill
-		if (fill) {
+		if (fill && !cached) {
 			switch (m_geometries[g]->fill_type) {
 				case FT_BORDER:
 					if (simparams()->boundarytype == DYN_BOUNDARY)
@@ -1567,6 +1680,7 @@ int ProblemAPI<1>::fill_parts(bool fill)
 				// case FT_NOFILL: ;
 				// yes, it is legal to have no "default:": ISO/IEC 9899:1999, section 6.8.4.2
 			}
+			origins.appended(*parts_vector, g);
 		}
 
 		// floating and moving bodies fill in their local point vector; let's increase
@@ -1678,13 +1792,347 @@ int ProblemAPI<1>::fill_parts(bool fill)
 
 	} // iterate on geometries
 
-	// call user-set filtering routine, if any
-	filterPoints(m_fluidParts, m_boundaryParts);
+	// call user-set filtering routine, if any (the cached particles are filtered already)
+	if (!cached) {
+		origins.removing(m_fluidParts);
+		origins.removing(m_boundaryParts);
+		filterPoints(m_fluidParts, m_boundaryParts);
+		origins.removed(m_fluidParts);
+		origins.removed(m_boundaryParts);
+	}
+
+	// the cached particles get the masses of the current setup
+	if (cached)
+		setCachedMasses(cache_origins);
+	else if (origins.tracked())
+		saveSetupCache(cache_fname, origins.origins());
+	else if (!cache_fname.empty())
+		printf("WARNING: filterPoints() moved or added points, not saving the setup cache\n");
 
 	return m_fluidParts.size() + m_boundaryParts.size() + m_testpointParts.size() +
 		bodies_parts_counter + hdf5file_parts_counter + xyzfile_parts_counter;
 }
 
+namespace {
+
+//! Incremental FNV-1a hash of the problem setup, used as setup cache key
+class SetupHash
+{
+	uint64_t m_hash;
+public:
+	SetupHash() : m_hash(UINT64_C(14695981039346656037)) {}
+
+	void add(const void *data, size_t bytes)
+	{
+		const unsigned char *p = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < bytes; ++i) {
+			m_hash ^= p[i];
+			m_hash *= UINT64_C(1099511628211);
+		}
+	}
+
+	template<typename T>
+	void add(T const& val)
+	{ add(&val, sizeof(T)); }
+
+	void add(string const& str)
+	{
+		add(str.size());
+		add(str.data(), str.size());
+	}
+
+	void add(PointVect const& points)
+	{
+		add(points.size());
+		for (Point const& pt : points)
+			for (int c = 0; c < 4; ++c)
+				add(pt(c));
+	}
+
+	//! Hash the name and contents of a file (unreadable files only contribute the name)
+	void add_file(string const& fname)
+	{
+		add(fname);
+		if (fname.empty()) return;
+		ifstream file(fname.c_str(), ios::binary);
+		char buf[1 << 16];
+		while (file.read(buf, sizeof(buf)) || file.gcount() > 0)
+			add(buf, file.gcount());
+	}
+
+	uint64_t value() const
+	{ return m_hash; }
+};
+
+const char setup_cache_magic[8] = "GPUSPHF";
+// bump whenever the fill or the cache layout change in a way that invalidates existing caches
+const uint32_t setup_cache_version = 2;
+
+}
+
+//! The point vectors filled by fill_parts(), in a fixed order
+vector<PointVect*> ProblemAPI<1>::setupCacheVectors()
+{
+	vector<PointVect*> vecs;
+	vecs.push_back(&m_testpointParts);
+	vecs.push_back(&m_fluidParts);
+	vecs.push_back(&m_boundaryParts);
+	for (size_t g = 0, num_geoms = m_geometries.size(); g < num_geoms; g++) {
+		if (!m_geometries[g]->enabled) continue;
+		if (m_geometries[g]->type == GT_FLOATING_BODY ||
+			m_geometries[g]->type == GT_MOVING_BODY)
+			vecs.push_back(&(m_geometries[g]->ptr->GetParts()));
+	}
+	return vecs;
+}
+
+/* The cache key covers everything the fill depends on: the inter-particle distance,
+ * the boundary model, and for each geometry its type, fill and erase operations,
+ * placement and size, as well as the contents of the files it was loaded from.
+ * The particle masses are not part of the key, since the cache stores the geometry
+ * of each particle, and the particles get the masses of the current setup when loaded.
+ * Changes in user code that are not reflected in the geometry (e.g. in
+ * filterPoints()) are not detected: the cache directory must be cleared in that case.
+ */
+string ProblemAPI<1>::setupCacheFilename()
+{
+	SetupHash hash;
+	hash.add(setup_cache_version);
+	hash.add(m_name);
+	hash.add(m_deltap);
+	hash.add(simparams()->boundarytype);
+	hash.add(m_numDynBoundLayers);
+
+	// points added directly by the problem (e.g. test points)
+	vector<PointVect*> vecs = setupCacheVectors();
+	for (PointVect const* vec : vecs)
+		hash.add(*vec);
+
+	for (size_t g = 0, num_geoms = m_geometries.size(); g < num_geoms; g++) {
+		GeometryInfo *geom = m_geometries[g];
+		hash.add(geom->enabled);
+		if (!geom->enabled) continue;
+
+		const double dx = preferredDeltaP(geom->type);
+		hash.add(geom->type);
+		hash.add(geom->fill_type);
+		hash.add(geom->erase_operation);
+		hash.add(geom->intersection_type);
+		hash.add(geom->unfill_radius);
+		hash.add(dx);
+		hash.add(string(typeid(*geom->ptr).name()));
+
+		Point bbmin, bbmax;
+		geom->ptr->getBoundingBox(bbmin, bbmax);
+		const EulerParameters *ep = geom->ptr->getEulerParameters();
+		for (int c = 0; c < 4; ++c) {
+			hash.add(bbmin(c));
+			hash.add(bbmax(c));
+			hash.add((*ep)(c));
+		}
+		hash.add(geom->ptr->Volume(dx));
+
+		hash.add_file(geom->hdf5_filename);
+		hash.add_file(geom->xyz_filename);
+		if (geom->type == GT_DEM) {
+			// only the loaded window of the DEM file matters, and DEM files may be huge
+			auto dem = static_pointer_cast<TopoCube>(geom->ptr);
+			hash.add(dem->get_dem(), sizeof(float)*dem->get_ncols()*dem->get_nrows());
+		} else
+			hash.add_file(geom->stl_filename);
+	}
+
+	ostringstream fname;
+	fname << m_options->setup_cache << "/" << m_name << "-"
+		<< hex << setw(16) << setfill('0') << hash.value() << ".fill";
+	return fname.str();
+}
+
+// Load the cached particles into the filled vectors, and their geometries into origins;
+// returns false (leaving the vectors untouched) if there is no usable cache
+bool ProblemAPI<1>::loadSetupCache(string const& fname, SetupCacheOrigins& origins)
+{
+	ifstream cache(fname.c_str(), ios::binary);
+	if (!cache)
+		return false;
+
+	vector<PointVect*> vecs = setupCacheVectors();
+
+	char magic[sizeof(setup_cache_magic)];
+	uint32_t version = 0;
+	uint64_t num_vecs = 0;
+	cache.read(magic, sizeof(magic));
+	cache.read((char*)&version, sizeof(version));
+	cache.read((char*)&num_vecs, sizeof(num_vecs));
+	if (!cache || memcmp(magic, setup_cache_magic, sizeof(magic)) ||
+		version != setup_cache_version || num_vecs != vecs.size()) {
+		printf("WARNING: ignoring incompatible setup cache %s\n", fname.c_str());
+		return false;
+	}
+
+	vector<PointVect> loaded(num_vecs);
+	SetupCacheOrigins loaded_origins(num_vecs);
+	size_t total = 0;
+	bool valid = true;
+	for (size_t v = 0; v < num_vecs && valid; ++v) {
+		uint64_t count = 0;
+		cache.read((char*)&count, sizeof(count));
+		if (!cache) break;
+		vector<double> coords(4*count);
+		cache.read((char*)coords.data(), coords.size()*sizeof(double));
+		vector<int32_t> geoms(count);
+		cache.read((char*)geoms.data(), geoms.size()*sizeof(int32_t));
+		if (!cache) break;
+		PointVect& points = loaded[v];
+		points.reserve(count);
+		for (uint64_t p = 0; p < count; ++p)
+			points.push_back(Point(coords[4*p], coords[4*p+1], coords[4*p+2], coords[4*p+3]));
+		loaded_origins[v].assign(geoms.begin(), geoms.end());
+		for (int32_t g : geoms)
+			valid &= (g < 0 || (size_t(g) < m_geometries.size() && m_geometries[g]->enabled));
+		total += count;
+	}
+	if (!cache || !valid) {
+		printf("WARNING: ignoring %s setup cache %s\n", valid ? "truncated" : "invalid", fname.c_str());
+		return false;
+	}
+
+	for (size_t v = 0; v < num_vecs; ++v)
+		vecs[v]->swap(loaded[v]);
+	origins.swap(loaded_origins);
+
+	printf("Setup cache: reusing %zu filled particles from %s\n", total, fname.c_str());
+	return true;
+}
+
+// Save the filled vectors to the cache; failures are not fatal, since the cache
+// is only an optimization. The file is written under a temporary name and then
+// renamed, so that concurrent runs never see a partial cache. The temporary
+// name includes the host name, since processes on different hosts sharing
+// the cache directory (e.g. the ranks of a multi-node run) may have the same PID
+void ProblemAPI<1>::saveSetupCache(string const& fname, SetupCacheOrigins const& origins)
+{
+	mkdir(m_options->setup_cache.c_str(), S_IRWXU | S_IRWXG | S_IRWXO);
+
+	char hostname[256] = "";
+	gethostname(hostname, sizeof(hostname) - 1);
+
+	ostringstream tmpname;
+	tmpname << fname << ".tmp." << hostname << "." << getpid();
+
+	vector<PointVect*> vecs = setupCacheVectors();
+	const uint64_t num_vecs = vecs.size();
+	size_t total = 0;
+
+	ofstream cache(tmpname.str().c_str(), ios::binary);
+	cache.write(setup_cache_magic, sizeof(setup_cache_magic));
+	cache.write((const char*)&setup_cache_version, sizeof(setup_cache_version));
+	cache.write((const char*)&num_vecs, sizeof(num_vecs));
+	for (size_t v = 0; v < num_vecs; ++v) {
+		PointVect const& points = *vecs[v];
+		const uint64_t count = points.size();
+		cache.write((const char*)&count, sizeof(count));
+		for (Point const& pt : points)
+			for (int c = 0; c < 4; ++c) {
+				const double coord = pt(c);
+				cache.write((const char*)&coord, sizeof(coord));
+			}
+		for (int g : origins[v]) {
+			const int32_t geom = g;
+			cache.write((const char*)&geom, sizeof(geom));
+		}
+		total += count;
+	}
+	cache.close();
+
+	if (!cache || rename(tmpname.str().c_str(), fname.c_str())) {
+		printf("WARNING: could not save the setup cache %s\n", fname.c_str());
+		unlink(tmpname.str().c_str());
+		return;
+	}
+
+	printf("Setup cache: saved %zu filled particles to %s\n", total, fname.c_str());
+}
+
+// Assign to the cached particles the particle mass of their geometry in the current setup,
+// which may differ from the one of the run that saved the cache (e.g. with a different density)
+void ProblemAPI<1>::setCachedMasses(SetupCacheOrigins const& origins)
+{
+	vector<PointVect*> vecs = setupCacheVectors();
+	for (size_t v = 0; v < vecs.size(); ++v) {
+		PointVect& points = *vecs[v];
+		for (size_t p = 0; p < points.size(); ++p) {
+			const int g = origins[v][p];
+			if (g >= 0)
+				points[p](3) = m_geometries[g]->ptr->GetPartMass();
+		}
+	}
+}
+
+/* Solid fills are counted with the fill = false path of Object::Fill(),
+ * which does not generate the particles. Borders have no such path, but
+ * they only grow with the surface of the geometry, so they are generated
+ * and discarded. Erase operations and filterPoints() are not applied,
+ * so the counts are upper bounds of what fill_parts() would generate.
+ */
+vector<ProblemCore::PlannedFill> ProblemAPI<1>::plan_fill()
+{
+	vector<PlannedFill> fills;
+
+	for (size_t g = 0, num_geoms = m_geometries.size(); g < num_geoms; g++) {
+		const GeometryInfo *geom = m_geometries[g];
+
+		// ignore deleted geometries, and the ones that are not filled
+		if (!geom->enabled || geom->type == GT_PLANE || geom->fill_type == FT_UNFILL)
+			continue;
+
+		const double dx = preferredDeltaP(geom->type);
+
+		double count = 0;
+		PointVect parts;
+		switch (geom->fill_type) {
+			case FT_BORDER:
+				if (simparams()->boundarytype == DYN_BOUNDARY)
+					geom->ptr->FillIn(parts, dx, - m_numDynBoundLayers);
+				else
+					geom->ptr->FillBorder(parts, dx);
+				count = parts.size();
+				break;
+			case FT_SOLID:
+				count = geom->ptr->Fill(parts, dx, false);
+				break;
+			default:
+				break;
+		}
+
+		// like in fill_parts(), particles loaded from files are counted as well
+		if (geom->has_hdf5_file)
+			count += geom->hdf5_reader->getNParts();
+		if (geom->has_xyz_file)
+			count += geom->xyz_reader->getNParts();
+
+		if (count == 0)
+			continue;
+
+		PlannedFill fill;
+		if (geom->ptr) {
+			Point bbmin, bbmax;
+			geom->ptr->getBoundingBox(bbmin, bbmax);
+			fill.bbmin = make_double3(bbmin);
+			fill.bbmax = make_double3(bbmax);
+		} else {
+			fill.bbmin = m_origin;
+			fill.bbmax = m_origin + m_size;
+		}
+		const bool fluid = (geom->type == GT_FLUID);
+		fill.fluid = fluid ? count : 0;
+		fill.boundary = fluid ? 0 : count;
+		fills.push_back(fill);
+	}
+
+	return fills;
+}
+
 void ProblemAPI<1>::copy_planes(PlaneList &planes)
 {
 	if (m_numPlanes == 0) return;
@@ -84,7 +84,8 @@ enum IntersectionType {	IT_NONE,
 // So for the time being this enum replicates TopoCube::Format explicitly
 enum TopographyFormat {	DEM_FMT_ASCII,
 						DEM_FMT_VTK,
-						DEM_FMT_XYZ
+						DEM_FMT_XYZ,
+						DEM_FMT_TILED
 };
 
 // NOTE: erasing is always done with fluid or boundary point vectors.
@@ -255,6 +256,17 @@ class ProblemAPI<1> : public ProblemCore
 		// number of layers for filling dynamic boundaries
 		uint m_numDynBoundLayers;
 
+		// setup cache (--setup-cache): the particles filled by a previous run
+		// with the same geometry are stored in a file named after a hash of it,
+		// together with the geometry each particle comes from (-1 for the points
+		// added by the problem itself), so that its mass can be reassigned
+		typedef std::vector< std::vector<int> > SetupCacheOrigins;
+		std::vector<PointVect*> setupCacheVectors();
+		std::string setupCacheFilename();
+		bool loadSetupCache(std::string const& fname, SetupCacheOrigins& origins);
+		void saveSetupCache(std::string const& fname, SetupCacheOrigins const& origins);
+		void setCachedMasses(SetupCacheOrigins const& origins);
+
 
 	protected:
 		// methods for creation of new objects
@@ -301,6 +313,16 @@ class ProblemAPI<1> : public ProblemCore
 			const FillType fill_type = FT_NOFILL)
 		{ return addDEM(fname_dem.c_str(), dem_fmt, fill_type); }
 
+		//! Add a Digital Elevation Model, loading only the given window of the file
+		/*! The window is given in the (geographical) coordinates of the file, and should include
+		 * any margin needed around the simulated area. Only the samples enclosing the window are
+		 * kept in memory; with DEM_FMT_TILED (see scripts/dem2tiles.py) only the tiles intersecting
+		 * the window are read, which is the preferred way to simulate small areas of large DEMs.
+		 */
+		GeometryID addDEM(const char *fname_dem, const TopographyFormat dem_fmt,
+			double west, double south, double east, double north,
+			const FillType fill_type = FT_NOFILL);
+
 		//! Add a box of fluid on top of the DEM, with the given fluid height
 		/*! The fluid height is considered from the bottom of the DEM
 		 */
@@ -433,6 +455,7 @@ class ProblemAPI<1> : public ProblemCore
 		bool initialize();
 
 		int fill_parts(bool fill = true);
+		std::vector<PlannedFill> plan_fill();
 		void copy_planes(PlaneList &planes);
 
 		void copy_to_array(BufferList &buffers);
@@ -107,6 +107,8 @@ typedef struct SimParams {
 	 * TLT_NEIB_FREQ
 	 */
 	uint			buildneibsfreq;			///< Frequency (in iterations) of neighbor list rebuilding
+	bool			adaptive_neibs;			///< Rebuild the neighbor list when the particle displacement exceeds half the skin, instead of at fixed frequency
+	double			neibs_skin;				///< Skin used by adaptive rebuilding (0 = nlInfluenceRadius - influenceRadius)
 	/*!
 	 * \inpsection{neighbours}
 	 * \default{256}
@@ -198,11 +200,16 @@ typedef struct SimParams {
 	uint			numODEbodies;			///< Number of bodies which movement is computed by ODE
 	uint			numforcesbodies;		///< Number of moving bodies on which we need to compute the forces on (includes ODE bodies)
 	uint			numbodies;				///< Total number of bodies (ODE + forces + moving)
+	uint			bodies_substeps;		///< Number of body solver sub-steps per (fluid) integrator step
+	bool			bodies_forces_interpolation;	///< Interpolate the fluid forces across sub-steps instead of holding them
 	/** @} */
 
 	/** \name I/O boundaries related parameters
 	 * @{ */
 	uint			numOpenBoundaries;		///< Number of open boundaries
+	double			particles_headroom;		///< Initial particle storage, relative to the initial number of particles (0 = enough to fill the world)
+	double			particles_highwater;	///< Storage occupancy that triggers the growth of the particle storage
+	double			particles_growth;		///< Growth factor of the particle storage
 	/** @} */
 
 	/** \name Other parameters
@@ -256,6 +263,7 @@ typedef struct SimParams {
 	 * TLT_JACOBI_RESIDUAL
 	 */
 	float			jacobi_residual;	//< residual threshold for fluid particles effective pressure convergence
+	bool			effpres_krylov;	//< solve for the effective pressure with a preconditioned conjugate gradient instead of Jacobi iterations
 	/** @} */
 
 	template<typename Framework>
@@ -288,6 +296,8 @@ typedef struct SimParams {
 		nlInfluenceRadius(0),
 		nlSqInfluenceRadius(0),
 		buildneibsfreq(10),
+		adaptive_neibs(false),
+		neibs_skin(0),
 		neiblistsize(0),
 		neibboundpos(0),
 
@@ -303,14 +313,20 @@ typedef struct SimParams {
 		numODEbodies(0),
 		numforcesbodies(0),
 		numbodies(0),
+		bodies_substeps(1),
+		bodies_forces_interpolation(false),
 		numOpenBoundaries(0),
+		particles_headroom(1.5),
+		particles_highwater(0.9),
+		particles_growth(1.5),
 		epsilon(5e-5f),
 		repack_maxiter(2000),
 		repack_a(0.1f),
 		repack_alpha(0.01f),
 		jacobi_maxiter(1000),
 		jacobi_backerr(0.00001),
-		jacobi_residual(0.000001)
+		jacobi_residual(0.000001),
+		effpres_krylov(false)
 	{}
 
 	/** \name Kernel parameters related methods
@@ -360,6 +376,18 @@ typedef struct SimParams {
 		return nlInfluenceRadius;
 	}
 
+	/// Skin used for displacement-driven neighbor list rebuilds
+	/*! The neighbor list remains valid as long as no pair of particles
+	 *  has closed the gap between the neighbor search radius and the
+	 *  influence radius, i.e. as long as the maximum displacement since
+	 *  the last rebuild is less than half the skin.
+	 */
+	inline double
+	get_neibs_skin() const
+	{
+		return neibs_skin > 0 ? neibs_skin : nlInfluenceRadius - influenceRadius;
+	}
+
 
 	/// Update Kernel radius related parameters
 	/*! This the Kernel radius related parameters (influenceRadius, nlInfluenceRadius, ...).
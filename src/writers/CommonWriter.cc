@@ -181,7 +181,7 @@ CommonWriter::write(uint numParts, BufferList const& buffers, uint node_offset,
 	if (!testpoints)
 		return;
 
-	const double4 *pos = buffers.getData<BUFFER_POS_GLOBAL>();
+	const GlobalPosAccessor pos(gdata, buffers);
 	const hashKey *particleHash = buffers.getData<BUFFER_HASH>();
 	const float4 *vel = buffers.getData<BUFFER_VEL>();
 	const particleinfo *info = buffers.getData<BUFFER_INFO>();
@@ -341,7 +341,8 @@ CommonWriter::write_simparams(ostream &out)
 	}
 
 	if (SP->rheologytype == GRANULAR) {
-		out << " Granular rheology: effective pressure Jacobi solver parameters: " << endl;
+		out << " Granular rheology: effective pressure " <<
+			(SP->effpres_krylov ? "conjugate gradient" : "Jacobi") << " solver parameters: " << endl;
 		out << "\tMaximum number of iterations: " << SP->jacobi_maxiter << endl;
 		out << "\tBackward error threshold (boundary convergence): " << SP->jacobi_backerr << endl;
 		out << "\tResidual threshold (fluid convergence): " << SP->jacobi_residual << endl;
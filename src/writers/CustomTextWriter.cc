@@ -52,7 +52,7 @@ CustomTextWriter::~CustomTextWriter()
 void
 CustomTextWriter::write(uint numParts, BufferList const& buffers, uint node_offset, double t, const bool testpoints)
 {
-	const double4 *pos = buffers.getData<BUFFER_POS_GLOBAL>();
+	const GlobalPosAccessor pos(gdata, buffers);
 	const float4 *vel = buffers.getData<BUFFER_VEL>();
 	const particleinfo *info = buffers.getData<BUFFER_INFO>();
 	const float3 *vort = buffers.getData<BUFFER_VORTICITY>();
@@ -64,10 +64,11 @@ CustomTextWriter::write(uint numParts, BufferList const& buffers, uint node_offs
 	// Writing datas
 	for (uint i=node_offset; i < node_offset + numParts; i++) {
 		int fluid = fluid_num(info[i]);
+		const double4 gpos = pos[i];
 
 		// id, type, object, position
 		fid << id(info[i]) << "\t" << type(info[i]) << "\t" << object(info[i]) << "\t";
-		fid << pos[i].x << "\t" << pos[i].y << "\t" << pos[i].z << "\t";
+		fid << gpos.x << "\t" << gpos.y << "\t" << gpos.z << "\t";
 
 		// velocity
 		if (FLUID(info[i]))
@@ -76,7 +77,7 @@ CustomTextWriter::write(uint numParts, BufferList const& buffers, uint node_offs
 			fid << "0.0\t0.0\t0.0\t";
 
 		// mass
-		fid << pos[i].w << "\t";
+		fid << gpos.w << "\t";
 
 		// density
 		if (FLUID(info[i]))
@@ -72,7 +72,7 @@ DisplayWriter::write(uint numParts, BufferList const& buffers, uint node_offset,
 vtkSmartPointer<vtkUnstructuredGrid>
 DisplayWriter::buildGrid(uint numParts, BufferList const& buffers, uint node_offset)
 {
-	const double4 *pos = buffers.getData<BUFFER_POS_GLOBAL>();
+	const GlobalPosAccessor pos(gdata, buffers);
 	const hashKey *particleHash = buffers.getData<BUFFER_HASH>();
 	const float4 *vel = buffers.getData<BUFFER_VEL>();
 	const float4 *vol = buffers.getData<BUFFER_VOLUME>();
@@ -101,7 +101,8 @@ DisplayWriter::buildGrid(uint numParts, BufferList const& buffers, uint node_off
 	points->SetNumberOfPoints(numParts);
 
 	for (uint i = node_offset; i < node_offset + numParts; i++) {
-		points->SetPoint(i - node_offset, pos[i].x, pos[i].y, pos[i].z);
+		const double4 gpos = pos[i];
+		points->SetPoint(i - node_offset, gpos.x, gpos.y, gpos.z);
 	}
 
 	vtkGrid->SetPoints(points.GetPointer());
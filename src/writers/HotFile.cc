@@ -30,7 +30,13 @@ The file represents particle and other state.
 */
 
 #include <stdexcept>
+#include <sstream>
+#include <vector>
 #include "HotFile.h"
+// GlobalPosAccessor
+#include "Writer.h"
+// post-processing engines
+#include "simframework.h"
 
 using namespace std;
 
@@ -72,7 +78,20 @@ typedef struct {
 	float	reserved[10];
 } encoded_body_t;
 
-HotFile::HotFile(ofstream &fp, const GlobalData *gdata, uint numParts,
+/**
+HotFile post-processing engine state encoding, followed by the state_size bytes
+of the state. Sections are only present for the engines that have a state to save
+(e.g. STATISTICS); the process that saved it is recorded, since every process loads
+the HotFiles of all processes.
+*/
+typedef struct {
+	uint	type;
+	int		saved_by;
+	uint	reserved[2];
+	unsigned long long	state_size;
+} encoded_postproc_t;
+
+HotFile::HotFile(ostream &fp, const GlobalData *gdata, uint numParts,
 	uint node_offset, double t, const bool testpoints) {
 	_fp.out = &fp;
 	_gdata = gdata;
@@ -82,12 +101,22 @@ HotFile::HotFile(ofstream &fp, const GlobalData *gdata, uint numParts,
 	_testpoints = testpoints;
 }
 
-HotFile::HotFile(ifstream &fp, const GlobalData *gdata) {
+HotFile::HotFile(istream &fp, const GlobalData *gdata) {
 	_fp.in = &fp;
 	_gdata = gdata;
 }
 
 void HotFile::save() {
+	// collect the states of the post-processing engines, which are
+	// counted in the header
+	_postproc_states.clear();
+	for (auto const& pp : _gdata->simframework->getPostProcEngines()) {
+		ostringstream state;
+		pp.second->saveState(state);
+		if (state.tellp() > 0)
+			_postproc_states.push_back(make_pair(uint(pp.first), state.str()));
+	}
+
 	// write a header
 	writeHeader(_fp.out, VERSION_1);
 
@@ -103,6 +132,12 @@ void HotFile::save() {
 	// to include both the total buffer count and the stored buffer count.
 	const flag_t skip_bufs = EPHEMERAL_BUFFERS;
 
+	// The global position is not kept on host during the simulation,
+	// but the HotFile layout expects it as the first buffer: compute it
+	// on the fly from POS and HASH, so that the file format is unchanged
+	if (!(_gdata->s_hBuffers.get_keys() & BUFFER_POS_GLOBAL))
+		writeGlobalPos(_fp.out, VERSION_1);
+
 	for (auto& iter : _gdata->s_hBuffers) {
 		if (iter.first & skip_bufs)
 			continue;
@@ -115,6 +150,10 @@ void HotFile::save() {
 		const uint numparts = _gdata->problem->m_bodies[id]->object->GetNumParts();
 		writeBody(_fp.out, mbdata, numparts, VERSION_1);
 	}
+
+	for (auto const& pp : _postproc_states)
+		writePostProcess(_fp.out, pp.first, pp.second, VERSION_1);
+	_postproc_states.clear();
 }
 
 // auxiliary method that checks that two values are the same, and throws an
@@ -166,6 +205,9 @@ void HotFile::load() {
 		cout << "Restoring body #" << b << " ..." << endl;
 		readBody(_fp.in, VERSION_1);
 	}
+
+	for (uint p = 0; p < _header.postproc_count; ++p)
+		readPostProcess(_fp.in, VERSION_1);
 }
 
 HotFile::~HotFile() {
@@ -181,15 +223,19 @@ unsupported_version(uint version)
 	throw out_of_range(os.str());
 }
 
-void HotFile::writeHeader(ofstream *fp, version_t version) {
+void HotFile::writeHeader(ostream *fp, version_t version) {
 	switch (version) {
 	case VERSION_1:
 		memset(&_header, 0, sizeof(_header));
 		_header.version = 1;
 		_header.buffer_count = _gdata->s_hBuffers.size();
+		// account for the global position, synthesized on save if missing
+		if (!(_gdata->s_hBuffers.get_keys() & BUFFER_POS_GLOBAL))
+			_header.buffer_count += 1;
 		_header.particle_count = _particle_count;
 		_header.body_count = _gdata->problem->simparams()->numbodies;
 		_header.numOpenBoundaries = _gdata->problem->simparams()->numOpenBoundaries;
+		_header.postproc_count = _postproc_states.size();
 		_header.iterations = _gdata->iterations;
 		_header.dt = _gdata->dt;
 		_header.t = _gdata->t;
@@ -217,7 +263,7 @@ void HotFile::readHeader(uint &part_count, uint &numOpenBoundaries) {
 	part_count += _particle_count;
 }
 
-void HotFile::writeBuffer(ofstream *fp, const AbstractBuffer *buffer, version_t version) {
+void HotFile::writeBuffer(ostream *fp, const AbstractBuffer *buffer, version_t version) {
 	switch (version) {
 	case VERSION_1:
 		encoded_buffer_t eb;
@@ -253,6 +299,36 @@ void HotFile::writeBuffer(ofstream *fp, const AbstractBuffer *buffer, version_t
 	}
 }
 
+void HotFile::writeGlobalPos(ostream *fp, version_t version) {
+	switch (version) {
+	case VERSION_1:
+		{
+		const char *name = BufferTraits<BUFFER_POS_GLOBAL>::name;
+		encoded_buffer_t eb;
+		memset(&eb, 0, sizeof(eb));
+		eb.name_length = strlen(name);
+		strcpy(eb.name, name);
+		eb.element_size = sizeof(BufferTraits<BUFFER_POS_GLOBAL>::element_type);
+		eb.array_count = BufferTraits<BUFFER_POS_GLOBAL>::num_buffers;
+		fp->write((char*)&eb, sizeof(eb));
+
+		// compute and write the data in blocks, to avoid materializing
+		// the whole array
+		const GlobalPosAccessor gpos(_gdata, _gdata->s_hBuffers);
+		const size_t block = 65536;
+		vector<double4> data(std::min<size_t>(block, _particle_count));
+		for (size_t first = 0; first < _particle_count; first += block) {
+			const size_t count = std::min<size_t>(block, _particle_count - first);
+			gpos.fill(data.data(), _node_offset + first, count);
+			fp->write((const char*)data.data(), count*sizeof(double4));
+		}
+		}
+		break;
+	default:
+		unsupported_version(version);
+	}
+}
+
 // auxiliary method that throw an exception about a
 // buffer name mismatch
 static void
@@ -265,7 +341,7 @@ bufname_mismatch(const char *expected, const char *got)
 	throw runtime_error(os.str());
 }
 
-void HotFile::readBuffer(ifstream *fp, AbstractBuffer *buffer, version_t version) {
+void HotFile::readBuffer(istream *fp, AbstractBuffer *buffer, version_t version) {
 	size_t sz = buffer->get_element_size()*_particle_count;
 	switch (version) {
 	case VERSION_1:
@@ -282,7 +358,7 @@ void HotFile::readBuffer(ifstream *fp, AbstractBuffer *buffer, version_t version
 	}
 }
 
-void HotFile::writeBody(ofstream *fp, const MovingBodyData *mbdata, uint numparts, version_t version)
+void HotFile::writeBody(ostream *fp, const MovingBodyData *mbdata, uint numparts, version_t version)
 {
 	switch (version) {
 	case VERSION_1:
@@ -345,7 +421,7 @@ void HotFile::writeBody(ofstream *fp, const MovingBodyData *mbdata, uint numpart
 	}
 }
 
-void HotFile::readBody(ifstream *fp, version_t version)
+void HotFile::readBody(istream *fp, version_t version)
 {
 	switch (version) {
 	case VERSION_1:
@@ -403,6 +479,53 @@ void HotFile::readBody(ifstream *fp, version_t version)
 	}
 }
 
+void HotFile::writePostProcess(ostream *fp, uint type, string const& state, version_t version)
+{
+	switch (version) {
+	case VERSION_1:
+		{
+		encoded_postproc_t ep;
+		memset(&ep, 0, sizeof(ep));
+		ep.type = type;
+		ep.saved_by = _gdata->mpi_rank > 0 ? _gdata->mpi_rank : 0;
+		ep.state_size = state.size();
+		fp->write((const char *)&ep, sizeof(ep));
+		fp->write(state.data(), state.size());
+		}
+		break;
+	default:
+		unsupported_version(version);
+	}
+}
+
+void HotFile::readPostProcess(istream *fp, version_t version)
+{
+	switch (version) {
+	case VERSION_1:
+		{
+		encoded_postproc_t ep;
+		memset(&ep, 0, sizeof(ep));
+		fp->read((char *)&ep, sizeof(ep));
+
+		string state(ep.state_size, '\0');
+		fp->read(&state[0], state.size());
+
+		AbstractPostProcessEngine *engine = ep.type < INVALID_POSTPROC ?
+			_gdata->simframework->hasPostProcessEngine(PostProcessType(ep.type)) : NULL;
+		if (!engine) {
+			cerr << "WARNING: ignoring the saved state of post-processing engine " <<
+				(ep.type < INVALID_POSTPROC ? PostProcessName[ep.type] : "(unknown)") <<
+				", which is not enabled" << endl;
+			break;
+		}
+		istringstream in(state);
+		engine->loadState(in, ep.saved_by, _gdata);
+		}
+		break;
+	default:
+		unsupported_version(version);
+	}
+}
 
 ostream& operator<<(ostream &strm, const HotFile &h) {
 	return strm << "HotFile( version=" << h._header.version << ", pc=" <<
@@ -30,9 +30,12 @@ The file represents particle and other state.
 */
 
 #ifndef H_HOTFILE_H
+#define H_HOTFILE_H
 
 #include <string>
 #include <fstream>
+#include <vector>
+#include <utility>
 
 #include "GlobalData.h"
 #include "MovingBody.h"
@@ -49,7 +52,8 @@ typedef struct {
 	uint	particle_count;
 	uint	body_count;
 	uint	numOpenBoundaries;
-	uint	reserved[12];
+	uint	postproc_count; ///< number of post-processing engine states (0 in older files)
+	uint	reserved[11];
 	ulong	iterations;
 	double	t;
 	float	dt;
@@ -63,8 +67,8 @@ typedef enum {
 
 class HotFile {
 public:
-	HotFile(std::ifstream &fp, const GlobalData *gdata);
-	HotFile(std::ofstream &fp, const GlobalData *gdata, uint numParts,
+	HotFile(std::istream &fp, const GlobalData *gdata);
+	HotFile(std::ostream &fp, const GlobalData *gdata, uint numParts,
 		uint node_offset, double t, const bool testpoints);
 	~HotFile();
 	ulong get_iterations() { return _header.iterations; }
@@ -75,8 +79,8 @@ public:
 	void readHeader(uint &part_count, uint &numOpenBoundaries);
 private:
 	union {
-		std::ifstream		*in;
-		std::ofstream		*out;
+		std::istream		*in;
+		std::ostream		*out;
 	}					_fp;
 	uint				_particle_count;
 	uint				_node_offset;
@@ -84,12 +88,17 @@ private:
 	bool				_testpoints;
 	const GlobalData	*_gdata;
 	header_t			_header;
+	//! States of the post-processing engines to be saved, collected by save()
+	std::vector< std::pair<uint, std::string> > _postproc_states;
 
-	void writeBuffer(std::ofstream *fp, const AbstractBuffer *buffer, version_t version);
-	void writeBody(std::ofstream *fp, const MovingBodyData *mbdata, const uint numparts, version_t version);
-	void writeHeader(std::ofstream *fp, version_t version);
-	void readBuffer(std::ifstream *fp, AbstractBuffer *buffer, version_t version);
-	void readBody(std::ifstream *fp, version_t version);
+	void writeBuffer(std::ostream *fp, const AbstractBuffer *buffer, version_t version);
+	void writeGlobalPos(std::ostream *fp, version_t version);
+	void writeBody(std::ostream *fp, const MovingBodyData *mbdata, const uint numparts, version_t version);
+	void writeHeader(std::ostream *fp, version_t version);
+	void readBuffer(std::istream *fp, AbstractBuffer *buffer, version_t version);
+	void readBody(std::istream *fp, version_t version);
+	void writePostProcess(std::ostream *fp, uint type, std::string const& state, version_t version);
+	void readPostProcess(std::istream *fp, version_t version);
 
 	friend std::ostream& operator<<(std::ostream&, const HotFile&);
 };
@@ -29,28 +29,206 @@
 #include <unistd.h>
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
+#include <set>
 #include <fcntl.h>
 #include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
 #include "HotWriter.h"
 #include "GlobalData.h"
+#include "NetworkManager.h"
 
 using namespace std;
 
+namespace {
+
+// number of processes and rank of this process, also without MPI
+int num_ranks(const GlobalData *gdata)
+{ return max<int>(1, gdata->mpi_nodes); }
+
+int this_rank(const GlobalData *gdata)
+{ return max(0, gdata->mpi_rank); }
+
+// Each process mirrors its local checkpoints to the process buddy_offset() ranks after it.
+// Buddies are half the processes apart, so that they are on different nodes
+// when the processes are assigned to the nodes in blocks. With an odd number of processes,
+// the buddy of a process is not the one it receives from, which exchangeCheckpoint() supports
+int buddy_offset(int nranks)
+{ return max(1, nranks/2); }
+
+int buddy_source(const GlobalData *gdata)
+{
+	const int nranks = num_ranks(gdata);
+	return (this_rank(gdata) + nranks - buddy_offset(nranks)) % nranks;
+}
+
+// directory of the local checkpoints of the problem, and of the buddy copies
+string local_dir(const GlobalData *gdata)
+{ return gdata->clOptions->checkpoint_local + "/" + gdata->problem->m_name; }
+
+string buddy_dir(const GlobalData *gdata)
+{ return local_dir(gdata) + "/buddy"; }
+
+// name of the local checkpoint of the given rank, as for the HotFiles written to disk
+string local_name(const GlobalData *gdata, int rank, ulong generation)
+{
+	ostringstream name;
+	name << "hot";
+	if (num_ranks(gdata) > 1)
+		name << "_n" << rank << "." << num_ranks(gdata);
+	name << "_" << generation << ".bin";
+	return name.str();
+}
+
+struct LocalCheckpoint {
+	ulong generation;
+	int rank;
+	string path;
+
+	bool operator<(LocalCheckpoint const& other) const
+	{ return generation < other.generation; }
+};
+
+// parse the name of a local checkpoint, skipping those for a different number of processes
+bool parse_local_name(const GlobalData *gdata, const char *name, LocalCheckpoint &chk)
+{
+	const int nranks = num_ranks(gdata);
+	int file_nranks = 1;
+	int consumed = 0;
+	chk.rank = 0;
+	if (nranks > 1) {
+		if (sscanf(name, "hot_n%d.%d_%lu.bin%n", &chk.rank, &file_nranks, &chk.generation, &consumed) != 3)
+			return false;
+	} else if (sscanf(name, "hot_%lu.bin%n", &chk.generation, &consumed) != 1)
+		return false;
+	return consumed > 0 && name[consumed] == '\0' &&
+		file_nranks == nranks && chk.rank >= 0 && chk.rank < nranks;
+}
+
+// list the local checkpoints of the given rank in the given directory, oldest first
+vector<LocalCheckpoint> list_local(const GlobalData *gdata, string const& dir, int rank)
+{
+	vector<LocalCheckpoint> found;
+	DIR *d = opendir(dir.c_str());
+	if (!d)
+		return found;
+	while (struct dirent *entry = readdir(d)) {
+		LocalCheckpoint chk;
+		if (parse_local_name(gdata, entry->d_name, chk) && chk.rank == rank) {
+			chk.path = dir + "/" + entry->d_name;
+			found.push_back(chk);
+		}
+	}
+	closedir(d);
+	sort(found.begin(), found.end());
+	return found;
+}
+
+// write the file under a temporary name first, so that an interrupted write
+// never leaves a partial checkpoint
+void save_file(string const& path, string const& data)
+{
+	const string tmp = path + ".tmp";
+	ofstream out(tmp.c_str(), ios::binary);
+	out.write(data.data(), data.size());
+	out.close();
+	if (!out || rename(tmp.c_str(), path.c_str()))
+		throw runtime_error("cannot write local checkpoint " + path);
+}
+
+string read_file(string const& path)
+{
+	ifstream in(path.c_str(), ios::binary);
+	ostringstream data;
+	data << in.rdbuf();
+	if (!in || !data)
+		throw runtime_error("cannot read local checkpoint " + path);
+	return data.str();
+}
+
+// add a file to the list, and remove the oldest ones, keeping the last `keep`
+void add_and_rotate(vector<string> &files, string const& fname, size_t keep)
+{
+	if (files.empty() || files.back() != fname)
+		files.push_back(fname);
+	while (files.size() > keep) {
+		if (unlink(files.front().c_str()))
+			perror(files.front().c_str());
+		files.erase(files.begin());
+	}
+}
+
+}
+
 HotWriter::HotWriter(const GlobalData *_gdata): Writer(_gdata) {
 
 	m_fname_sfx = ".bin";
 
 	_num_files_to_save = DEFAULT_NUM_FILES_TO_SAVE;
 	_particle_count = 0;
+
+	const Options *options = gdata->clOptions;
+	_local = !options->checkpoint_local.empty();
+	_disk_every = options->checkpoint_disk_every;
+	_local_count = 0;
+
+	if (!_local)
+		return;
+
+	mkdir(options->checkpoint_local.c_str(), S_IRWXU | S_IRWXG | S_IRWXO);
+	mkdir(local_dir(gdata).c_str(), S_IRWXU | S_IRWXG | S_IRWXO);
+	mkdir(buddy_dir(gdata).c_str(), S_IRWXU | S_IRWXG | S_IRWXO);
+
+	// Local checkpoints left over by previous runs are stale, except for the ones
+	// we are resuming from, which are kept until newer ones are written.
+	// Those newer than the one we resumed from are removed too, since they
+	// were not available for all processes
+	ulong resumed = 0;
+	bool resuming = false;
+	if (options->resume_local) {
+		LocalCheckpoint chk;
+		const string resume = options->resume_fname.substr(options->resume_fname.find_last_of('/') + 1);
+		resuming = parse_local_name(gdata, resume.c_str(), chk);
+		resumed = chk.generation;
+	}
+
+	vector<LocalCheckpoint> own = list_local(gdata, local_dir(gdata), this_rank(gdata));
+	vector<LocalCheckpoint> copies = list_local(gdata, buddy_dir(gdata), buddy_source(gdata));
+	auto keep_or_remove = [&](vector<string> &files, vector<LocalCheckpoint> const& found) {
+		for (auto const& chk : found) {
+			if (resuming && chk.generation <= resumed)
+				add_and_rotate(files, chk.path, LOCAL_CHECKPOINT_GENERATIONS);
+			else if (unlink(chk.path.c_str()))
+				perror(chk.path.c_str());
+		}
+	};
+	keep_or_remove(_local_filenames, own);
+	keep_or_remove(_buddy_filenames, copies);
+
+	cout << "Local checkpoints in " << local_dir(gdata);
+	if (_disk_every > 0)
+		cout << ", written to disk every " << _disk_every << " checkpoints";
+	cout << endl;
 }
 
 HotWriter::~HotWriter() {
+	wait_mirror();
 }
 
 void HotWriter::write(uint numParts, const BufferList &buffers,
 	uint node_offset, double t, const bool testpoints) {
 
+	// with local checkpoints, only every _disk_every-th checkpoint is written to disk
+	// (repack files are always written to disk, since they are used to start the simulation)
+	if (_local && gdata->run_mode != REPACK) {
+		write_local(numParts, node_offset, t, testpoints);
+		++_local_count;
+		if (_disk_every <= 0 || _local_count % _disk_every)
+			return;
+	}
+
 	// generate filename with iterative integer
 	ofstream out;
 	string filename;
@@ -86,3 +264,133 @@ void HotWriter::write(uint numParts, const BufferList &buffers,
 
 }
 
+void HotWriter::write_local(uint numParts, uint node_offset, double t, const bool testpoints)
+{
+	const ulong generation = gdata->iterations;
+
+	// the previous checkpoint must have been mirrored before we start the next one
+	wait_mirror();
+
+	ostringstream snapshot(ios::out | ios::binary);
+	HotFile hf(snapshot, gdata, numParts, node_offset, t, testpoints);
+	hf.save();
+	_mirror_data = snapshot.str();
+
+	const string fname = local_dir(gdata) + "/" + local_name(gdata, this_rank(gdata), generation);
+	save_file(fname, _mirror_data);
+	add_and_rotate(_local_filenames, fname, LOCAL_CHECKPOINT_GENERATIONS);
+
+	if (num_ranks(gdata) == 1) {
+		string().swap(_mirror_data);
+		return;
+	}
+
+	// mirror in the background, if MPI allows calls from other threads
+	if (gdata->networkManager->isThreadMultiple())
+		_mirror_thread = thread([this, generation]() {
+			try {
+				mirror(generation);
+			} catch (exception const& e) {
+				cerr << "WARNING: mirroring checkpoint " << generation << " failed: " << e.what() << endl;
+			}
+		});
+	else
+		mirror(generation);
+}
+
+void HotWriter::mirror(ulong generation)
+{
+	const int nranks = num_ranks(gdata);
+	const int buddy = (this_rank(gdata) + buddy_offset(nranks)) % nranks;
+	const int source = buddy_source(gdata);
+
+	string copy;
+	gdata->networkManager->exchangeCheckpoint(buddy, _mirror_data, source, copy);
+	string().swap(_mirror_data);
+
+	const string fname = buddy_dir(gdata) + "/" + local_name(gdata, source, generation);
+	save_file(fname, copy);
+	add_and_rotate(_buddy_filenames, fname, LOCAL_CHECKPOINT_GENERATIONS);
+}
+
+void HotWriter::wait_mirror()
+{
+	if (_mirror_thread.joinable())
+		_mirror_thread.join();
+}
+
+vector<string> HotWriter::RestoreLocal(const GlobalData *gdata, string &fname)
+{
+	const int nranks = num_ranks(gdata);
+	const int rank = this_rank(gdata);
+
+	// The local checkpoints available on each process: its own, and the buddy copies.
+	// Older ones beyond the generations we keep may be left over by interrupted runs
+	struct Available {
+		unsigned long long generation;
+		int rank; // -1 for unused slots
+		int own;
+	};
+	const size_t max_available = 2*(LOCAL_CHECKPOINT_GENERATIONS + 1);
+	vector<Available> available(max_available, Available{0, -1, 0});
+
+	vector<LocalCheckpoint> own = list_local(gdata, local_dir(gdata), rank);
+	vector<LocalCheckpoint> copies = nranks > 1 ?
+		list_local(gdata, buddy_dir(gdata), buddy_source(gdata)) : vector<LocalCheckpoint>();
+	size_t count = 0;
+	for (auto it = own.rbegin(); it != own.rend() && count < max_available/2; ++it)
+		available[count++] = Available{it->generation, it->rank, 1};
+	for (auto it = copies.rbegin(); it != copies.rend() && count < max_available; ++it)
+		available[count++] = Available{it->generation, it->rank, 0};
+
+	vector<Available> all_available(max_available*nranks);
+	if (nranks > 1)
+		gdata->networkManager->allGatherBytes(available.data(), max_available*sizeof(Available),
+			all_available.data());
+	else
+		all_available = available;
+
+	// find the newest generation available for all processes, and which process provides
+	// each checkpoint (preferring the own copies, to spread the load)
+	set<unsigned long long> generations;
+	for (auto const& avail : all_available)
+		if (avail.rank >= 0)
+			generations.insert(avail.generation);
+
+	vector<int> holder(nranks, -1);
+	bool found = false;
+	unsigned long long generation = 0;
+	for (auto gen = generations.rbegin(); gen != generations.rend() && !found; ++gen) {
+		generation = *gen;
+		fill(holder.begin(), holder.end(), -1);
+		for (size_t i = 0; i < all_available.size(); ++i) {
+			Available const& avail = all_available[i];
+			if (avail.rank < 0 || avail.generation != generation)
+				continue;
+			if (avail.own || holder[avail.rank] < 0)
+				holder[avail.rank] = i/max_available;
+		}
+		found = (find(holder.begin(), holder.end(), -1) == holder.end());
+	}
+
+	if (!found)
+		throw runtime_error("no local checkpoint in " + local_dir(gdata) + " is available for all processes");
+
+	cout << "Resuming from the local checkpoints at iteration " << generation << endl;
+
+	vector<string> checkpoints(nranks);
+	for (int r = 0; r < nranks; ++r) {
+		if (holder[r] == rank) {
+			const string path = (r == rank ? local_dir(gdata) : buddy_dir(gdata)) +
+				"/" + local_name(gdata, r, generation);
+			if (r != rank)
+				cout << "Restoring the checkpoint of process " << r << " from the buddy copy " << path << endl;
+			checkpoints[r] = read_file(path);
+		}
+		if (nranks > 1)
+			gdata->networkManager->broadcastCheckpoint(holder[r], checkpoints[r]);
+	}
+
+	fname = local_dir(gdata) + "/" + local_name(gdata, rank, generation);
+	return checkpoints;
+}
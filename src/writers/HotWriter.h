@@ -27,6 +27,8 @@
 #ifndef H_HOTWRITER_H
 #define H_HOTWRITER_H
 
+#include <thread>
+
 #include "Writer.h"
 #include "HotFile.h"
 
@@ -57,6 +59,18 @@ e.g. 'hot_00063.bin' and invoke GPUSPH with the --resume command line option:
 
 If the hotstart file is found and valid, the simulation will start from that
 point. GPUSPH will abort otherwise.
+
+With --checkpoint-local DIR, checkpoints are kept in node-local storage (ideally
+RAM-backed, e.g. /dev/shm) rather than on the (shared) data directory, and each
+process mirrors its checkpoint to a buddy process in the background. Only the
+last LOCAL_CHECKPOINT_GENERATIONS local checkpoints are kept, and a checkpoint
+is also written to the data directory every --checkpoint-disk-every checkpoints.
+Local checkpoints are HotFiles, named as the ones in the data directory.
+
+To resume from the local checkpoints, use --resume-local with the same
+--checkpoint-local DIR and number of processes: the newest checkpoint available
+for all processes is loaded, with the missing ones (e.g. those of a node that
+was lost and replaced) provided by the processes holding the buddy copy.
 */
 class HotWriter : public Writer {
 public:
@@ -74,13 +88,35 @@ public:
 		return _num_files_to_save;
 	}
 
+	//! Collect the newest generation of local checkpoints available for all processes
+	/*! Must be called by all processes. Returns the checkpoint of each process,
+	 * in rank order, and its name in the local checkpoint directory.
+	 */
+	static std::vector<std::string> RestoreLocal(const GlobalData *gdata, std::string &fname);
+
 private:
 	int					_num_files_to_save;
 	std::vector<std::string>	_current_filenames;
 	uint				_particle_count;
+
+	// local checkpoints (--checkpoint-local)
+	bool				_local;
+	int					_disk_every; ///< write to disk every this many checkpoints (0: never)
+	ulong				_local_count; ///< number of local checkpoints written
+	std::vector<std::string>	_local_filenames; ///< own local checkpoints, oldest first
+	std::vector<std::string>	_buddy_filenames; ///< buddy copies, oldest first
+	std::string			_mirror_data; ///< checkpoint being mirrored to the buddy
+	std::thread			_mirror_thread;
+
+	void write_local(uint numParts, uint node_offset, double t, const bool testpoints);
+	void mirror(ulong generation);
+	void wait_mirror();
 };
 
 /** Determines how far back in simulation time we can restart a simulation */
 #define DEFAULT_NUM_FILES_TO_SAVE 8
 
+/** Number of local checkpoints (and buddy copies) kept with --checkpoint-local */
+#define LOCAL_CHECKPOINT_GENERATIONS 2
+
 #endif
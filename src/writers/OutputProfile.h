@@ -0,0 +1,155 @@
+/*  Copyright (c) 2019 INGV, EDF, UniCT, JHU
+
+    Istituto Nazionale di Geofisica e Vulcanologia, Sezione di Catania, Italy
+    Électricité de France, Paris, France
+    Università di Catania, Catania, Italy
+    Johns Hopkins University, Baltimore (MD), USA
+
+    This file is part of GPUSPH. Project founders:
+        Alexis Hérault, Giuseppe Bilotta, Robert A. Dalrymple,
+        Eugenio Rustico, Ciro Del Negro
+    For a full list of authors and project partners, consult the logs
+    and the project website <https://www.gpusph.org>
+
+    GPUSPH is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GPUSPH is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GPUSPH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*! \file
+ * Output profiles: reduced views of the particle system for the writers
+ */
+
+#ifndef _OUTPUTPROFILE_H
+#define _OUTPUTPROFILE_H
+
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <set>
+#include <vector>
+
+#include "vector_math.h"
+#include "particleinfo.h"
+
+/*! An output profile describes a reduced view of the particle system:
+ * only the particles of the selected types, within the selected region
+ * and surviving the subsampling are written, and only the selected fields.
+ * Each profile is written with its own frequency, to its own time series.
+ *
+ * Profiles are added by the problem with ProblemCore::add_writer(),
+ * e.g. to write the fluid in a region of interest every 0.01s:
+ * \code
+ * add_writer(VTKWRITER, 0.01, OutputProfile("basin")
+ *	.only(PT_FLUID)
+ *	.box(make_double3(0, 0, 0), make_double3(2, 1, 1))
+ *	.field("Velocity").field("Pressure"));
+ * \endcode
+ *
+ * Subsampling is based on the particle id, so the same particles
+ * are selected across frames.
+ */
+struct OutputProfile
+{
+	std::string name; ///< profile name, used in the output file names
+	uint types; ///< bitmask of the particle types to write (bit PT_* set if included)
+	bool clip_box; ///< is the axis-aligned box enabled?
+	double3 box_min; ///< lower corner of the axis-aligned box
+	double3 box_max; ///< upper corner of the axis-aligned box
+	std::vector<double4> planes; ///< half-spaces (a, b, c, d): keep a x + b y + c z + d >= 0
+	uint stride; ///< only keep particles whose id is a multiple of stride
+	double fraction; ///< only keep this (pseudo-random, per id) fraction of the particles
+	std::set<std::string> fields; ///< fields to write (empty: all)
+
+	OutputProfile(std::string const& _name) :
+		name(_name),
+		types(0),
+		clip_box(false),
+		box_min(make_double3(-INFINITY)),
+		box_max(make_double3(INFINITY)),
+		planes(),
+		stride(1),
+		fraction(1.0),
+		fields()
+	{}
+
+	//! Include particles of type pt (by default, all types are included)
+	OutputProfile& only(ParticleType pt)
+	{ types |= (1U << pt); return *this; }
+
+	//! Only include particles in the given axis-aligned box
+	OutputProfile& box(double3 const& lower, double3 const& upper)
+	{ clip_box = true; box_min = lower; box_max = upper; return *this; }
+
+	//! Only include particles with a x + b y + c z + d >= 0
+	OutputProfile& clip(double a, double b, double c, double d)
+	{ planes.push_back(make_double4(a, b, c, d)); return *this; }
+
+	//! Only include one particle every n (by id)
+	OutputProfile& every(uint n)
+	{ stride = n > 0 ? n : 1; return *this; }
+
+	//! Only include (approximately) the given fraction of the particles
+	OutputProfile& sample(double f)
+	{ fraction = f; return *this; }
+
+	//! Add a field to the list of fields to write
+	/*! The name is the one of the array in the output (e.g. "Velocity").
+	 * Positions are always written.
+	 */
+	OutputProfile& field(std::string const& fname)
+	{ fields.insert(fname); return *this; }
+
+	//! Does the profile only select some of the particles?
+	bool is_filtered() const
+	{ return types || clip_box || !planes.empty() || stride > 1 || fraction < 1.0; }
+
+	//! Should the field with the given name be written?
+	bool writes_field(const char *fname) const
+	{ return fields.empty() || fields.count(fname) || !strcmp(fname, "Position"); }
+
+	//! Should the given particle be written?
+	bool selects(particleinfo const& info, double3 const& gpos) const
+	{
+		if (types && !(types & (1U << PART_TYPE(info))))
+			return false;
+
+		if (clip_box && (
+			gpos.x < box_min.x || gpos.x > box_max.x ||
+			gpos.y < box_min.y || gpos.y > box_max.y ||
+			gpos.z < box_min.z || gpos.z > box_max.z))
+			return false;
+
+		for (double4 const& p : planes)
+			if (p.x*gpos.x + p.y*gpos.y + p.z*gpos.z + p.w < 0)
+				return false;
+
+		const uint pid = id(info);
+		if (stride > 1 && (pid % stride))
+			return false;
+
+		if (fraction < 1.0) {
+			// integer hash of the id, mapped to [0, 1)
+			uint h = pid;
+			h ^= h >> 16; h *= 0x7feb352dU;
+			h ^= h >> 15; h *= 0x846ca68bU;
+			h ^= h >> 16;
+			if (h*(1.0/4294967296.0) >= fraction)
+				return false;
+		}
+
+		return true;
+	}
+};
+
+#endif
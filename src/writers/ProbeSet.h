@@ -0,0 +1,125 @@
+/*  Copyright (c) 2019 INGV, EDF, UniCT, JHU
+
+    Istituto Nazionale di Geofisica e Vulcanologia, Sezione di Catania, Italy
+    Électricité de France, Paris, France
+    Università di Catania, Catania, Italy
+    Johns Hopkins University, Baltimore (MD), USA
+
+    This file is part of GPUSPH. Project founders:
+        Alexis Hérault, Giuseppe Bilotta, Robert A. Dalrymple,
+        Eugenio Rustico, Ciro Del Negro
+    For a full list of authors and project partners, consult the logs
+    and the project website <https://www.gpusph.org>
+
+    GPUSPH is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GPUSPH is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GPUSPH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*! \file
+ * Probe sets: points where the fields are sampled by the ProbeWriter
+ */
+
+#ifndef _PROBESET_H
+#define _PROBESET_H
+
+#include <string>
+#include <vector>
+
+#include "vector_math.h"
+
+/*! A named set of probes, i.e. points where the velocity, pressure and
+ * density are sampled at output time by the ProbeWriter, using an SPH
+ * interpolant over the neighboring fluid particles.
+ * Contrary to testpoints, probes are not particles, and they do not
+ * take part in the simulation.
+ *
+ * Probe sets are added by the problem with ProblemCore::add_probe_set(),
+ * and sampled when the PROBEWRITER writes, e.g.:
+ * \code
+ * add_writer(PROBEWRITER, 0.01);
+ * add_probe_set(ProbeSet::line("profile", make_double3(0.5, 0.5, 0), make_double3(0.5, 0.5, 1), 100));
+ * add_probe_set(ProbeSet::plane("piv", make_double3(0, 0.5, 0),
+ *	make_double3(1, 0, 0), make_double3(0, 0, 0.5), 200, 100).in_binary());
+ * \endcode
+ */
+struct ProbeSet
+{
+	std::string name; ///< set name, used in the output file name
+	std::vector<double3> points; ///< global position of the probes
+	bool binary; ///< write the time series in binary rather than CSV format
+
+	ProbeSet(std::string const& _name) :
+		name(_name),
+		points(),
+		binary(false)
+	{}
+
+	//! Write the time series in binary format
+	ProbeSet& in_binary()
+	{ binary = true; return *this; }
+
+	//! A set of arbitrary points
+	static ProbeSet scattered(std::string const& name, std::vector<double3> const& pts)
+	{
+		ProbeSet set(name);
+		set.points = pts;
+		return set;
+	}
+
+	//! n equispaced points on the segment from start to end (both included)
+	static ProbeSet line(std::string const& name,
+		double3 const& start, double3 const& end, uint n)
+	{
+		ProbeSet set(name);
+		const double3 step = n > 1 ? (end - start)/(n - 1) : make_double3(0.0);
+		for (uint i = 0; i < n; ++i)
+			set.points.push_back(start + i*step);
+		return set;
+	}
+
+	//! nu x nv points on the parallelogram with corner origin and sides u, v
+	static ProbeSet plane(std::string const& name,
+		double3 const& origin, double3 const& u, double3 const& v, uint nu, uint nv)
+	{
+		ProbeSet set(name);
+		const double3 du = nu > 1 ? u/(nu - 1) : make_double3(0.0);
+		const double3 dv = nv > 1 ? v/(nv - 1) : make_double3(0.0);
+		for (uint j = 0; j < nv; ++j)
+			for (uint i = 0; i < nu; ++i)
+				set.points.push_back(origin + i*du + j*dv);
+		return set;
+	}
+
+	//! nx x ny x nz points on the axis-aligned box from lower to upper
+	static ProbeSet volume(std::string const& name,
+		double3 const& lower, double3 const& upper, uint nx, uint ny, uint nz)
+	{
+		ProbeSet set(name);
+		const double3 size = upper - lower;
+		const double3 step = make_double3(
+			nx > 1 ? size.x/(nx - 1) : 0,
+			ny > 1 ? size.y/(ny - 1) : 0,
+			nz > 1 ? size.z/(nz - 1) : 0);
+		for (uint k = 0; k < nz; ++k)
+			for (uint j = 0; j < ny; ++j)
+				for (uint i = 0; i < nx; ++i)
+					set.points.push_back(lower + make_double3(i*step.x, j*step.y, k*step.z));
+		return set;
+	}
+};
+
+//! List of probe sets
+typedef std::vector<ProbeSet> ProbeSetList;
+
+#endif
@@ -0,0 +1,227 @@
+/*  Copyright (c) 2019 INGV, EDF, UniCT, JHU
+
+    Istituto Nazionale di Geofisica e Vulcanologia, Sezione di Catania, Italy
+    Électricité de France, Paris, France
+    Università di Catania, Catania, Italy
+    Johns Hopkins University, Baltimore (MD), USA
+
+    This file is part of GPUSPH. Project founders:
+        Alexis Hérault, Giuseppe Bilotta, Robert A. Dalrymple,
+        Eugenio Rustico, Ciro Del Negro
+    For a full list of authors and project partners, consult the logs
+    and the project website <https://www.gpusph.org>
+
+    GPUSPH is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GPUSPH is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GPUSPH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iomanip>
+#include <stdexcept>
+
+#include "ProbeWriter.h"
+#include "kernel_shape.h"
+
+#include "GlobalData.h"
+#include "NetworkManager.h"
+#include "parallel_for.h"
+
+using namespace std;
+
+ProbeWriter::ProbeWriter(const GlobalData *_gdata)
+	: Writer(_gdata)
+{
+	// the samples are collected across processes, and written by the first one
+	if (gdata->mpi_rank <= 0)
+		for (ProbeSet const& set : m_problem->get_probe_sets())
+			open_set_file(set);
+
+	if (m_problem->get_probe_sets().empty())
+		cerr << "WARNING: ProbeWriter enabled, but no probe sets defined" << endl;
+}
+
+ProbeWriter::~ProbeWriter()
+{
+	for (auto& fp : m_files)
+		fp->close();
+}
+
+void
+ProbeWriter::open_set_file(ProbeSet const& set)
+{
+	m_files.push_back(unique_ptr<ofstream>(new ofstream()));
+	ofstream &out = *m_files.back();
+
+	const string base = "probes_" + set.name;
+	open_data_file(out, base.c_str(), string(), set.binary ? ".bin" : ".csv");
+	if (!out)
+		return;
+
+	const uint nprobes = set.points.size();
+
+	if (set.binary) {
+		const uint version = 1;
+		const uint nfields = NUM_FIELDS;
+		out.write("GPUSPHPR", 8);
+		out.write((const char*)&version, sizeof(version));
+		out.write((const char*)&nprobes, sizeof(nprobes));
+		out.write((const char*)&nfields, sizeof(nfields));
+		for (double3 const& pt : set.points)
+			out.write((const char*)&pt, sizeof(pt));
+	} else {
+		out << setprecision(16);
+		for (uint p = 0; p < nprobes; ++p)
+			out << "# probe " << p << " " << set.points[p].x << " "
+				<< set.points[p].y << " " << set.points[p].z << "\n";
+		out << "time,probe,vx,vy,vz,pressure,density" << endl;
+	}
+}
+
+void
+ProbeWriter::build_cell_index(uint numParts, BufferList const& buffers, uint node_offset)
+{
+	const hashKey *hash = buffers.getData<BUFFER_HASH>() + node_offset;
+	const particleinfo *info = buffers.getData<BUFFER_INFO>() + node_offset;
+	const uint ncells = gdata->nGridCells;
+
+	// counting sort of the fluid particles by cell
+	m_cellStart.assign(ncells + 1, 0);
+	for (uint i = 0; i < numParts; ++i) {
+		if (!FLUID(info[i]))
+			continue;
+		++m_cellStart[cellHashFromParticleHash(hash[i]) + 1];
+	}
+	for (uint c = 0; c < ncells; ++c)
+		m_cellStart[c + 1] += m_cellStart[c];
+
+	m_cellParts.resize(m_cellStart[ncells]);
+	vector<uint> fill(m_cellStart.begin(), m_cellStart.end() - 1);
+	for (uint i = 0; i < numParts; ++i) {
+		if (!FLUID(info[i]))
+			continue;
+		m_cellParts[fill[cellHashFromParticleHash(hash[i])]++] = i;
+	}
+}
+
+void
+ProbeWriter::sample(ProbeSet const& set, uint numParts, BufferList const& buffers, uint node_offset)
+{
+	const GlobalPosAccessor pos(gdata, buffers);
+	const float4 *vel = buffers.getData<BUFFER_VEL>();
+	const particleinfo *info = buffers.getData<BUFFER_INFO>();
+
+	const SimParams *sp = m_problem->simparams();
+	const double slength = sp->slength;
+	const double influenceRadius = sp->influenceRadius;
+	const KernelType kernel = sp->kerneltype;
+	const double kernelradius = sp->kernelradius;
+
+	const uint nprobes = set.points.size();
+	m_sums.assign(size_t(nprobes)*NUM_SUMS, 0.0);
+
+	const uint nthreads = configured_host_threads(gdata->clOptions->host_threads);
+
+	parallel_for_chunks(nthreads, 0, nprobes, [&](unsigned int, size_t begin, size_t end) {
+		for (size_t p = begin; p < end; ++p) {
+			const double3 pt = set.points[p];
+			const int3 gridPos = gdata->calcGridPosHost(pt);
+
+			double *sums = m_sums.data() + p*NUM_SUMS;
+
+			// the cell size is at least the influence radius, so the neighboring cells suffice
+			for (int dz = -1; dz <= 1; ++dz)
+			for (int dy = -1; dy <= 1; ++dy)
+			for (int dx = -1; dx <= 1; ++dx) {
+				const int3 cell = gridPos + make_int3(dx, dy, dz);
+				if (cell.x < 0 || cell.y < 0 || cell.z < 0 ||
+					cell.x >= int(gdata->gridSize.x) ||
+					cell.y >= int(gdata->gridSize.y) ||
+					cell.z >= int(gdata->gridSize.z))
+					continue;
+				const uint cellHash = gdata->calcGridHashHost(cell);
+				for (uint k = m_cellStart[cellHash]; k < m_cellStart[cellHash + 1]; ++k) {
+					const uint i = m_cellParts[k] + node_offset;
+					const double4 ppos = pos[i];
+					const double r = length(as_double3(ppos) - pt);
+					if (r >= influenceRadius)
+						continue;
+
+					const int fluid = fluid_num(info[i]);
+					const float rho = m_problem->physical_density(vel[i].w, fluid);
+					// the particle volume m/rho weights the kernel
+					const double w = kernel_shape(kernel, r/slength, kernelradius)*ppos.w/rho;
+
+					sums[0] += w;
+					sums[1] += w*vel[i].x;
+					sums[2] += w*vel[i].y;
+					sums[3] += w*vel[i].z;
+					sums[4] += w*m_problem->pressure(vel[i].w, fluid);
+					sums[5] += w*rho;
+				}
+			}
+		}
+	}, 64);
+
+	// the neighbors of probes close to a subdomain edge are spread across processes
+	if (gdata->mpi_nodes > 1)
+		gdata->networkManager->networkDoubleReduction(m_sums.data(), m_sums.size(), SUM_REDUCTION);
+
+	m_samples.assign(size_t(nprobes)*NUM_FIELDS, NAN);
+	for (uint p = 0; p < nprobes; ++p) {
+		const double *sums = m_sums.data() + size_t(p)*NUM_SUMS;
+		const double wsum = sums[0];
+		if (wsum > 0) {
+			float *out = m_samples.data() + size_t(p)*NUM_FIELDS;
+			for (uint f = 0; f < NUM_FIELDS; ++f)
+				out[f] = sums[f + 1]/wsum;
+		}
+	}
+}
+
+void
+ProbeWriter::write(uint numParts, BufferList const& buffers, uint node_offset, double t, const bool testpoints)
+{
+	const ProbeSetList& sets = m_problem->get_probe_sets();
+	if (sets.empty())
+		return;
+
+	build_cell_index(numParts, buffers, node_offset);
+
+	for (size_t s = 0; s < sets.size(); ++s) {
+		ProbeSet const& set = sets[s];
+
+		// all processes take part in the sampling
+		sample(set, numParts, buffers, node_offset);
+
+		if (m_files.empty())
+			continue;
+		ofstream &out = *m_files[s];
+		if (!out)
+			continue;
+
+		const uint nprobes = set.points.size();
+		if (set.binary) {
+			out.write((const char*)&t, sizeof(t));
+			out.write((const char*)m_samples.data(), m_samples.size()*sizeof(float));
+		} else {
+			for (uint p = 0; p < nprobes; ++p) {
+				const float *val = m_samples.data() + size_t(p)*NUM_FIELDS;
+				out << t << "," << p;
+				for (uint f = 0; f < NUM_FIELDS; ++f)
+					out << "," << val[f];
+				out << "\n";
+			}
+		}
+		out.flush();
+	}
+}
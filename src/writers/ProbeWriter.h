@@ -0,0 +1,90 @@
+/*  Copyright (c) 2019 INGV, EDF, UniCT, JHU
+
+    Istituto Nazionale di Geofisica e Vulcanologia, Sezione di Catania, Italy
+    Électricité de France, Paris, France
+    Università di Catania, Catania, Italy
+    Johns Hopkins University, Baltimore (MD), USA
+
+    This file is part of GPUSPH. Project founders:
+        Alexis Hérault, Giuseppe Bilotta, Robert A. Dalrymple,
+        Eugenio Rustico, Ciro Del Negro
+    For a full list of authors and project partners, consult the logs
+    and the project website <https://www.gpusph.org>
+
+    GPUSPH is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GPUSPH is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GPUSPH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef H_PROBEWRITER_H
+#define H_PROBEWRITER_H
+
+/* The ProbeWriter samples velocity, pressure and density at the probe sets
+ * defined by the problem (see ProbeSet), using a (Shepard-normalized) SPH
+ * interpolant over the fluid particles in the neighboring cells.
+ * Sampling is only done when the writer writes, so probes have no cost
+ * during the simulation.
+ *
+ * Each probe set is written to its own time series, either as CSV
+ * (probes_<name>.csv, one row per probe per time, with the probe positions
+ * listed in the header comments) or binary (probes_<name>.bin):
+ *
+ * - a header with the magic string "GPUSPHPR", the format version (uint),
+ *   the number of probes (uint), the number of fields per probe (uint),
+ *   followed by the probe positions (3 doubles per probe);
+ * - for each time: the time (double), followed by the fields
+ *   (vx, vy, vz, pressure, density as floats) for each probe.
+ *
+ * Probes without fluid neighbors are reported as NaN.
+ * In multi-node simulations, the partial sums of the interpolant over the
+ * particles of each rank are reduced across ranks, and the first rank
+ * writes the samples.
+ */
+
+#include <memory>
+#include <vector>
+
+#include "Writer.h"
+
+class ProbeWriter : public Writer
+{
+	// one output file per probe set
+	std::vector<std::unique_ptr<std::ofstream> > m_files;
+
+	// cell index of the particles (CSR over the grid cells), reused across writes
+	std::vector<uint> m_cellStart;
+	std::vector<uint> m_cellParts;
+
+	// partial sums of the interpolant (kernel weight sum, followed by the
+	// weighted fields) for the probes of one set, reused across sets and writes
+	std::vector<double> m_sums;
+	// sampled fields for the probes of one set, reused across sets and writes
+	std::vector<float> m_samples;
+
+	void open_set_file(ProbeSet const& set);
+	void build_cell_index(uint numParts, BufferList const& buffers, uint node_offset);
+	void sample(ProbeSet const& set, uint numParts, BufferList const& buffers, uint node_offset);
+
+public:
+	//! number of fields sampled for each probe
+	static const uint NUM_FIELDS = 5;
+	//! number of partial sums accumulated for each probe
+	static const uint NUM_SUMS = NUM_FIELDS + 1;
+
+	ProbeWriter(const GlobalData *_gdata);
+	~ProbeWriter();
+
+	void write(uint numParts, BufferList const& buffers, uint node_offset, double t, const bool testpoints);
+};
+
+#endif
@@ -0,0 +1,69 @@
+/*  Copyright (c) 2019 INGV, EDF, UniCT, JHU
+
+    Istituto Nazionale di Geofisica e Vulcanologia, Sezione di Catania, Italy
+    Électricité de France, Paris, France
+    Università di Catania, Catania, Italy
+    Johns Hopkins University, Baltimore (MD), USA
+
+    This file is part of GPUSPH. Project founders:
+        Alexis Hérault, Giuseppe Bilotta, Robert A. Dalrymple,
+        Eugenio Rustico, Ciro Del Negro
+    For a full list of authors and project partners, consult the logs
+    and the project website <https://www.gpusph.org>
+
+    GPUSPH is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GPUSPH is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GPUSPH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file
+ * Parameters of the free-surface mesh extracted by the SurfaceWriter
+ */
+
+#ifndef _SURFACEMESHPARAMS_H
+#define _SURFACEMESHPARAMS_H
+
+/*! Parameters of the SURFACEWRITER, set by the problem with
+ * ProblemCore::set_surface_mesh(), e.g.:
+ * \code
+ * add_writer(SURFACEWRITER, 0.02);
+ * set_surface_mesh(SurfaceMeshParams().spacing(m_deltap/2).in_ply());
+ * \endcode
+ * The defaults (spacing equal to the particle spacing, iso-value 0.5,
+ * VTK PolyData output) are used if set_surface_mesh() is not called.
+ */
+struct SurfaceMeshParams
+{
+	double cell; ///< spacing of the sampling grid (0: use the particle spacing)
+	double isovalue; ///< iso-value of the color field (1 in the bulk of the fluid)
+	bool ply; ///< write the meshes in binary PLY rather than VTK PolyData format
+
+	SurfaceMeshParams() :
+		cell(0),
+		isovalue(0.5),
+		ply(false)
+	{}
+
+	//! Sample the color field on a grid with spacing ds
+	SurfaceMeshParams& spacing(double ds)
+	{ cell = ds; return *this; }
+
+	//! Extract the iso-surface at color value v
+	SurfaceMeshParams& iso(double v)
+	{ isovalue = v; return *this; }
+
+	//! Write the meshes in binary PLY format
+	SurfaceMeshParams& in_ply()
+	{ ply = true; return *this; }
+};
+
+#endif
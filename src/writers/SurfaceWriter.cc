@@ -0,0 +1,632 @@
+/*  Copyright (c) 2019 INGV, EDF, UniCT, JHU
+
+    Istituto Nazionale di Geofisica e Vulcanologia, Sezione di Catania, Italy
+    Électricité de France, Paris, France
+    Università di Catania, Catania, Italy
+    Johns Hopkins University, Baltimore (MD), USA
+
+    This file is part of GPUSPH. Project founders:
+        Alexis Hérault, Giuseppe Bilotta, Robert A. Dalrymple,
+        Eugenio Rustico, Ciro Del Negro
+    For a full list of authors and project partners, consult the logs
+    and the project website <https://www.gpusph.org>
+
+    GPUSPH is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GPUSPH is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GPUSPH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <iomanip>
+
+#include "SurfaceWriter.h"
+#include "kernel_shape.h"
+
+#include "GlobalData.h"
+#include "NetworkManager.h"
+#include "parallel_for.h"
+
+using namespace std;
+
+namespace {
+
+/* Marching cubes
+ *
+ * Corner c of the cube is at (c & 1, (c >> 1) & 1, (c >> 2) & 1) in units of the grid spacing.
+ * Edge e is along axis e/4, and starts from the corner that has 0 along the axis,
+ * and (e & 1, (e >> 1) & 1) along the two following axes (cyclically).
+ */
+
+//! Component of v along axis
+template<typename T>
+inline auto axis_comp(T const& v, int axis) -> decltype(v.x)
+{ return axis == 0 ? v.x : axis == 1 ? v.y : v.z; }
+
+//! Corner where edge e starts
+inline int edge_start(int e)
+{
+	const int axis = e/4;
+	return ((e & 1) << ((axis + 1) % 3)) | (((e >> 1) & 1) << ((axis + 2) % 3));
+}
+
+//! Edge between corners c0 and c1 (which must differ along one axis only)
+inline int corner_edge(int c0, int c1)
+{
+	const int axis = (c0 ^ c1) == 1 ? 0 : (c0 ^ c1) == 2 ? 1 : 2;
+	const int start = c0 & c1;
+	return 4*axis + ((start >> ((axis + 1) % 3)) & 1) + (((start >> ((axis + 2) % 3)) & 1) << 1);
+}
+
+//! Do edges e0 and e1 lie on the same face of the cube?
+inline bool share_face(int e0, int e1)
+{
+	// the faces of an edge are those orthogonal to the other axes, on the side of its start
+	const int a0 = e0/4, a1 = e1/4;
+	const int s0 = edge_start(e0), s1 = edge_start(e1);
+	for (int axis = 0; axis < 3; ++axis)
+		if (axis != a0 && axis != a1 && ((s0 ^ s1) & (1 << axis)) == 0)
+			return true;
+	return false;
+}
+
+/*! Triangles for each of the 256 configurations of the corners inside the fluid
+ *
+ * Rather than hard-coding the classic tables, the triangles are built from the
+ * iso-lines on the faces of the cube: on each face, the iso-lines go from the
+ * edges where we exit the fluid to the edges where we enter it, walking around
+ * the face counter-clockwise (seen from outside the cube), and ambiguous faces
+ * always separate the corners in the fluid. Since a face is resolved the same
+ * way by the two cubes sharing it, the surface is closed. The face segments are
+ * then chained into loops, which are triangulated as fans.
+ */
+struct MarchingCubesTable
+{
+	// a loop on n edges gives n - 2 triangles, and each of the 12 edges is in one loop at most
+	static const int MAX_TRIS = 10;
+
+	uint8_t ntris[256];
+	uint8_t edges[256][3*MAX_TRIS];
+
+	MarchingCubesTable()
+	{
+		for (int mask = 0; mask < 256; ++mask) {
+			// next edge of the iso-line loop through each edge
+			int next[12];
+			fill(next, next + 12, -1);
+
+			for (int axis = 0; axis < 3; ++axis)
+			for (int side = 0; side < 2; ++side) {
+				const int u = 1 << ((axis + 1) % 3);
+				const int v = 1 << ((axis + 2) % 3);
+				// face corners, counter-clockwise as seen from outside the cube
+				int p[4] = { 0, u, u | v, v };
+				if (!side)
+					swap(p[1], p[3]);
+				for (int k = 0; k < 4; ++k)
+					p[k] |= side << axis;
+
+				int exits[2], entries[2];
+				int nexits = 0, nentries = 0;
+				for (int k = 0; k < 4; ++k) {
+					const bool in0 = (mask >> p[k]) & 1;
+					const bool in1 = (mask >> p[(k + 1) % 4]) & 1;
+					if (in0 && !in1)
+						exits[nexits++] = k;
+					else if (!in0 && in1)
+						entries[nentries++] = k;
+				}
+
+				auto face_edge = [&p](int k) { return corner_edge(p[k], p[(k + 1) % 4]); };
+				if (nexits == 1) {
+					next[face_edge(exits[0])] = face_edge(entries[0]);
+				} else if (nexits == 2) {
+					// ambiguous face: go back to the entry edge next to the same corner
+					for (int x = 0; x < 2; ++x)
+						next[face_edge(exits[x])] = face_edge((exits[x] + 3) % 4);
+				}
+			}
+
+			bool seen[12] = { false };
+			int n = 0;
+			for (int e0 = 0; e0 < 12; ++e0) {
+				if (next[e0] < 0 || seen[e0])
+					continue;
+				int loop[12];
+				int len = 0;
+				for (int e = e0; !seen[e]; e = next[e]) {
+					seen[e] = true;
+					loop[len++] = e;
+				}
+				// pick a fan apex whose diagonals do not lie on a face of the cube,
+				// where they could overlap with the triangles of the neighboring cube
+				int apex = 0;
+				for (int a = 0; a < len; ++a) {
+					bool on_face = false;
+					for (int k = 2; k + 1 < len; ++k)
+						on_face |= share_face(loop[a], loop[(a + k) % len]);
+					if (!on_face) {
+						apex = a;
+						break;
+					}
+				}
+				// the loops run clockwise around the outward normal, so reverse the fans
+				for (int k = 1; k + 1 < len; ++k, ++n) {
+					edges[mask][3*n] = loop[apex];
+					edges[mask][3*n + 1] = loop[(apex + k + 1) % len];
+					edges[mask][3*n + 2] = loop[(apex + k) % len];
+				}
+			}
+			ntris[mask] = n;
+		}
+	}
+};
+
+const MarchingCubesTable& marching_cubes_table()
+{
+	static const MarchingCubesTable table;
+	return table;
+}
+
+/* Endianness check: (char*)&endian_int reads the first byte of the int,
+ * which is 0 on big-endian machines, and 1 in little-endian machines */
+const int endian_int = 1;
+inline bool little_endian()
+{ return *(const char*)&endian_int & 1; }
+
+/* The cubes starting in a cell have their nodes in the cell and the following one,
+ * and the color at each node is sampled from the neighbors of its cell:
+ * meshing a cell needs the particles up to this many cells away
+ */
+const int HALO_CELLS = 2;
+
+}
+
+SurfaceWriter::SurfaceWriter(const GlobalData *_gdata)
+	: Writer(_gdata),
+	m_params(m_problem->get_surface_mesh()),
+	m_spacing(m_params.cell > 0 ? m_params.cell : m_problem->get_deltap()),
+	m_norm(1)
+{
+	m_fname_sfx = m_params.ply ? ".ply" : ".vtp";
+
+	// the nodes in each cell of the simulation grid must be sampled with
+	// the neighbors of the cell only
+	const double min_cell = min(gdata->cellSize.x, min(gdata->cellSize.y, gdata->cellSize.z));
+	if (m_spacing > min_cell) {
+		cerr << "WARNING: surface mesh spacing " << m_spacing << " is larger than the cell size, using "
+			<< min_cell << endl;
+		m_spacing = min_cell;
+	}
+
+	m_nodes = make_int3(
+		first_node(0, gdata->gridSize.x) + 1,
+		first_node(1, gdata->gridSize.y) + 1,
+		first_node(2, gdata->gridSize.z) + 1);
+
+	// normalize the color field to 1 on a lattice at the initial particle spacing
+	const SimParams *sp = m_problem->simparams();
+	const double deltap = m_problem->get_deltap();
+	const int extent = ceil(sp->influenceRadius/deltap);
+	double lattice_sum = 0;
+	for (int k = -extent; k <= extent; ++k)
+	for (int j = -extent; j <= extent; ++j)
+	for (int i = -extent; i <= extent; ++i) {
+		const double r = deltap*sqrt(double(i*i + j*j + k*k));
+		if (r < sp->influenceRadius)
+			lattice_sum += kernel_shape(sp->kerneltype, r/sp->slength, sp->kernelradius);
+	}
+	m_norm = 1/(lattice_sum*deltap*deltap*deltap);
+
+	if (!m_params.ply) {
+		open_data_file(m_timefile, "SURFACE", "", ".pvd");
+		if (m_timefile) {
+			m_timefile << setprecision(16);
+			m_timefile << "<?xml version='1.0'?>\n";
+			m_timefile << "<VTKFile type='Collection' version='0.1'>\n";
+			m_timefile << " <Collection>\n";
+		}
+	}
+}
+
+SurfaceWriter::~SurfaceWriter()
+{
+	m_timefile.close();
+}
+
+int
+SurfaceWriter::first_node(int axis, int cell) const
+{
+	return int(ceil(cell*double(axis_comp(gdata->cellSize, axis))/m_spacing));
+}
+
+bool
+SurfaceWriter::own_cell(uint cellHash) const
+{
+	return gdata->mpi_nodes < 2 ||
+		gdata->RANK(gdata->s_hDeviceMap[cellHash]) == gdata->mpi_rank;
+}
+
+bool
+SurfaceWriter::near_own_cell(uint cellHash, bool own) const
+{
+	const int3 gridPos = gdata->reverseGridHashHost(cellHash);
+	for (int dz = -HALO_CELLS; dz <= HALO_CELLS; ++dz)
+	for (int dy = -HALO_CELLS; dy <= HALO_CELLS; ++dy)
+	for (int dx = -HALO_CELLS; dx <= HALO_CELLS; ++dx) {
+		const int3 neib = gridPos + make_int3(dx, dy, dz);
+		if (neib.x < 0 || neib.y < 0 || neib.z < 0 ||
+			neib.x >= int(gdata->gridSize.x) ||
+			neib.y >= int(gdata->gridSize.y) ||
+			neib.z >= int(gdata->gridSize.z))
+			continue;
+		if (own_cell(gdata->calcGridHashHost(neib)) == own)
+			return true;
+	}
+	return false;
+}
+
+void
+SurfaceWriter::collect_particles(uint numParts, BufferList const& buffers, uint node_offset)
+{
+	const GlobalPosAccessor pos(gdata, buffers);
+	const hashKey *hash = buffers.getData<BUFFER_HASH>() + node_offset;
+	const float4 *vel = buffers.getData<BUFFER_VEL>() + node_offset;
+	const particleinfo *info = buffers.getData<BUFFER_INFO>() + node_offset;
+
+	m_particles.clear();
+	for (uint i = 0; i < numParts; ++i) {
+		if (!FLUID(info[i]))
+			continue;
+		const double4 ppos = pos[i + node_offset];
+		const float rho = m_problem->physical_density(vel[i].w, fluid_num(info[i]));
+		CellParticle part;
+		part.data = make_double4(ppos.x, ppos.y, ppos.z, ppos.w/rho);
+		part.cell = cellHashFromParticleHash(hash[i]);
+		part.surface = SURFACE(info[i]) ? 1 : 0;
+		m_particles.push_back(part);
+	}
+}
+
+/*! Each rank sends the particles of its cells close to the cells of other ranks
+ * (with a broadcast per rank), and keeps the received particles of the cells close
+ * to its own. The particles of each cell come from its rank in the same order,
+ * so that the nodes on the subdomain edges get the same color on all ranks
+ */
+void
+SurfaceWriter::import_halo()
+{
+	if (gdata->mpi_nodes < 2)
+		return;
+
+	// halo flags of the cells: 0 not checked yet, 1 not in the halo, 2 in the halo
+	vector<uint8_t> halo(gdata->nGridCells, 0);
+	auto in_halo = [&](uint cell, bool own) -> bool {
+		if (!halo[cell])
+			halo[cell] = near_own_cell(cell, own) ? 2 : 1;
+		return halo[cell] == 2;
+	};
+
+	string sent;
+	for (CellParticle const& part : m_particles)
+		if (in_halo(part.cell, false))
+			sent.append((const char*)&part, sizeof(part));
+
+	halo.assign(gdata->nGridCells, 0);
+	for (int rank = 0; rank < int(gdata->mpi_nodes); ++rank) {
+		string data;
+		if (rank == gdata->mpi_rank)
+			data = sent;
+		gdata->networkManager->broadcastCheckpoint(rank, data);
+		if (rank == gdata->mpi_rank)
+			continue;
+
+		const CellParticle *recv = (const CellParticle *)data.data();
+		const size_t count = data.size()/sizeof(CellParticle);
+		for (size_t k = 0; k < count; ++k)
+			if (in_halo(recv[k].cell, true))
+				m_particles.push_back(recv[k]);
+	}
+}
+
+void
+SurfaceWriter::build_cell_index()
+{
+	const uint ncells = gdata->nGridCells;
+
+	// counting sort of the fluid particles by cell
+	m_cellStart.assign(ncells + 1, 0);
+	for (CellParticle const& part : m_particles)
+		++m_cellStart[part.cell + 1];
+	for (uint c = 0; c < ncells; ++c)
+		m_cellStart[c + 1] += m_cellStart[c];
+
+	m_partData.resize(m_cellStart[ncells]);
+	vector<uint> fill(m_cellStart.begin(), m_cellStart.end() - 1);
+	for (CellParticle const& part : m_particles)
+		m_partData[fill[part.cell]++] = part.data;
+}
+
+void
+SurfaceWriter::find_active_cells()
+{
+	// 1: contains surface particles, 2: active
+	vector<uint8_t> flag(gdata->nGridCells, 0);
+	vector<uint> surface_cells;
+	for (CellParticle const& part : m_particles) {
+		if (!part.surface)
+			continue;
+		const uint cell = part.cell;
+		if (!flag[cell])
+			surface_cells.push_back(cell);
+		flag[cell] = 1;
+	}
+
+	// the surface may cross the neighboring cells too; each rank meshes its own cells only
+	m_activeCells.clear();
+	for (uint cell : surface_cells) {
+		const int3 gridPos = gdata->reverseGridHashHost(cell);
+		for (int dz = -1; dz <= 1; ++dz)
+		for (int dy = -1; dy <= 1; ++dy)
+		for (int dx = -1; dx <= 1; ++dx) {
+			const int3 neib = gridPos + make_int3(dx, dy, dz);
+			if (neib.x < 0 || neib.y < 0 || neib.z < 0 ||
+				neib.x >= int(gdata->gridSize.x) ||
+				neib.y >= int(gdata->gridSize.y) ||
+				neib.z >= int(gdata->gridSize.z))
+				continue;
+			const uint neibHash = gdata->calcGridHashHost(neib);
+			if (flag[neibHash] & 2)
+				continue;
+			flag[neibHash] |= 2;
+			if (own_cell(neibHash))
+				m_activeCells.push_back(neibHash);
+		}
+	}
+}
+
+/*! The color field at a node is always computed from the neighbors of the cell
+ * the node belongs to, summing in the same order, so that nodes shared by
+ * adjacent cells get exactly the same value, and the mesh has no cracks
+ */
+double
+SurfaceWriter::color(int3 const& node) const
+{
+	const SimParams *sp = m_problem->simparams();
+	const double3 pt = make_double3(gdata->worldOrigin) + m_spacing*make_double3(node);
+
+	int3 cell;
+	for (int axis = 0; axis < 3; ++axis) {
+		const int n = axis_comp(node, axis);
+		int c = int(floor(n*m_spacing/axis_comp(gdata->cellSize, axis)));
+		// fix rounding, so that first_node(c) <= n < first_node(c + 1)
+		while (first_node(axis, c + 1) <= n)
+			++c;
+		while (first_node(axis, c) > n)
+			--c;
+		(axis == 0 ? cell.x : axis == 1 ? cell.y : cell.z) = c;
+	}
+
+	double sum = 0;
+	for (int dz = -1; dz <= 1; ++dz)
+	for (int dy = -1; dy <= 1; ++dy)
+	for (int dx = -1; dx <= 1; ++dx) {
+		const int3 neib = cell + make_int3(dx, dy, dz);
+		if (neib.x < 0 || neib.y < 0 || neib.z < 0 ||
+			neib.x >= int(gdata->gridSize.x) ||
+			neib.y >= int(gdata->gridSize.y) ||
+			neib.z >= int(gdata->gridSize.z))
+			continue;
+		const uint neibHash = gdata->calcGridHashHost(neib);
+		for (uint k = m_cellStart[neibHash]; k < m_cellStart[neibHash + 1]; ++k) {
+			const double4 pdata = m_partData[k];
+			const double r = length(as_double3(pdata) - pt);
+			if (r < sp->influenceRadius)
+				sum += pdata.w*kernel_shape(sp->kerneltype, r/sp->slength, sp->kernelradius);
+		}
+	}
+	return m_norm*sum;
+}
+
+void
+SurfaceWriter::extract_cell(uint cellHash, ThreadMesh &mesh) const
+{
+	const MarchingCubesTable& table = marching_cubes_table();
+	const double iso = m_params.isovalue;
+
+	// cubes whose first corner is in the cell, and their nodes
+	const int3 gridPos = gdata->reverseGridHashHost(cellHash);
+	const int3 first = make_int3(
+		first_node(0, gridPos.x), first_node(1, gridPos.y), first_node(2, gridPos.z));
+	const int3 dim = make_int3(
+		first_node(0, gridPos.x + 1), first_node(1, gridPos.y + 1), first_node(2, gridPos.z + 1))
+		- first + make_int3(1, 1, 1);
+	if (dim.x < 2 || dim.y < 2 || dim.z < 2)
+		return;
+
+	mesh.values.resize(size_t(dim.x)*dim.y*dim.z);
+	for (int k = 0; k < dim.z; ++k)
+	for (int j = 0; j < dim.y; ++j)
+	for (int i = 0; i < dim.x; ++i)
+		mesh.values[i + dim.x*(j + dim.y*k)] = color(first + make_int3(i, j, k));
+
+	for (int k = 0; k < dim.z - 1; ++k)
+	for (int j = 0; j < dim.y - 1; ++j)
+	for (int i = 0; i < dim.x - 1; ++i) {
+		double val[8];
+		int mask = 0;
+		for (int c = 0; c < 8; ++c) {
+			val[c] = mesh.values[(i + (c & 1)) + dim.x*((j + ((c >> 1) & 1)) + dim.y*(k + (c >> 2)))];
+			if (val[c] > iso)
+				mask |= 1 << c;
+		}
+
+		for (int v = 0; v < 3*table.ntris[mask]; ++v) {
+			const int e = table.edges[mask][v];
+			const int axis = e/4;
+			const int c0 = edge_start(e);
+			const int c1 = c0 | (1 << axis);
+			const int3 node = first + make_int3(i + (c0 & 1), j + ((c0 >> 1) & 1), k + (c0 >> 2));
+
+			// vertices are identified by the edge of the sampling grid they lie on
+			const uint64_t key = 3*(node.x + uint64_t(m_nodes.x)*(node.y + uint64_t(m_nodes.y)*node.z)) + axis;
+			mesh.tris.push_back(key);
+			if (mesh.verts.count(key))
+				continue;
+
+			double3 vert = make_double3(gdata->worldOrigin) + m_spacing*make_double3(node);
+			const double frac = (iso - val[c0])/(val[c1] - val[c0]);
+			(axis == 0 ? vert.x : axis == 1 ? vert.y : vert.z) += frac*m_spacing;
+			mesh.verts[key] = make_float3(vert);
+		}
+	}
+}
+
+void
+SurfaceWriter::merge_meshes()
+{
+	m_points.clear();
+	m_tris.clear();
+
+	unordered_map<uint64_t, int> index;
+	for (ThreadMesh const& mesh : m_threadMesh) {
+		for (uint64_t key : mesh.tris) {
+			auto found = index.find(key);
+			if (found == index.end()) {
+				found = index.insert(make_pair(key, int(m_points.size()))).first;
+				m_points.push_back(mesh.verts.at(key));
+			}
+			m_tris.push_back(found->second);
+		}
+	}
+}
+
+void
+SurfaceWriter::write_vtp(double t)
+{
+	ofstream out;
+	const string fname = open_data_file(out, "SURFACE", current_filenum());
+	if (!out)
+		return;
+
+	const uint32_t npoints = m_points.size();
+	const uint32_t ntris = m_tris.size()/3;
+
+	const uint32_t points_bytes = npoints*3*sizeof(float);
+	const uint32_t conn_bytes = ntris*3*sizeof(int);
+	const uint32_t offsets_bytes = ntris*sizeof(int);
+
+	out << "<?xml version='1.0'?>\n";
+	out << "<VTKFile type='PolyData' version='0.1' byte_order='"
+		<< (little_endian() ? "LittleEndian" : "BigEndian") << "'>\n";
+	out << " <PolyData>\n";
+	out << "  <Piece NumberOfPoints='" << npoints << "' NumberOfPolys='" << ntris << "'>\n";
+	out << "   <Points>\n";
+	out << "	<DataArray type='Float32' Name='Position' NumberOfComponents='3' format='appended' offset='0'/>\n";
+	out << "   </Points>\n";
+	out << "   <Polys>\n";
+	out << "	<DataArray type='Int32' Name='connectivity' format='appended' offset='"
+		<< sizeof(uint32_t) + points_bytes << "'/>\n";
+	out << "	<DataArray type='Int32' Name='offsets' format='appended' offset='"
+		<< 2*sizeof(uint32_t) + points_bytes + conn_bytes << "'/>\n";
+	out << "   </Polys>\n";
+	out << "  </Piece>\n";
+	out << " </PolyData>\n";
+	out << " <AppendedData encoding='raw'>\n_";
+
+	out.write((const char*)&points_bytes, sizeof(points_bytes));
+	for (float3 const& p : m_points)
+		out.write((const char*)&p, 3*sizeof(float));
+
+	out.write((const char*)&conn_bytes, sizeof(conn_bytes));
+	out.write((const char*)m_tris.data(), conn_bytes);
+
+	vector<int> offsets(ntris);
+	for (uint32_t f = 0; f < ntris; ++f)
+		offsets[f] = 3*(f + 1);
+	out.write((const char*)&offsets_bytes, sizeof(offsets_bytes));
+	out.write((const char*)offsets.data(), offsets_bytes);
+
+	out << "\n </AppendedData>\n</VTKFile>" << endl;
+	out.close();
+
+	if (!m_timefile)
+		return;
+	m_timefile << "  <DataSet timestep='" << t << "' file='" << fname << "'/>" << endl;
+	// close the XML, and go back so that the next dataset overwrites the closing tags
+	ofstream::pos_type mark = m_timefile.tellp();
+	m_timefile << " </Collection>\n";
+	m_timefile << "</VTKFile>" << endl;
+	m_timefile.seekp(mark);
+}
+
+void
+SurfaceWriter::write_ply(double t)
+{
+	ofstream out;
+	open_data_file(out, "SURFACE", current_filenum());
+	if (!out)
+		return;
+
+	const uint32_t ntris = m_tris.size()/3;
+
+	out << "ply\n";
+	out << "format " << (little_endian() ? "binary_little_endian" : "binary_big_endian") << " 1.0\n";
+	out << "comment GPUSPH free surface at t=" << setprecision(16) << t << "\n";
+	out << "element vertex " << m_points.size() << "\n";
+	out << "property float x\n";
+	out << "property float y\n";
+	out << "property float z\n";
+	out << "element face " << ntris << "\n";
+	out << "property list uchar int vertex_indices\n";
+	out << "end_header\n";
+
+	for (float3 const& p : m_points)
+		out.write((const char*)&p, 3*sizeof(float));
+
+	const unsigned char nverts = 3;
+	for (uint32_t f = 0; f < ntris; ++f) {
+		out.write((const char*)&nverts, sizeof(nverts));
+		out.write((const char*)(m_tris.data() + 3*f), 3*sizeof(int));
+	}
+
+	out.close();
+}
+
+void
+SurfaceWriter::write(uint numParts, BufferList const& buffers, uint node_offset, double t, const bool testpoints)
+{
+	collect_particles(numParts, buffers, node_offset);
+	import_halo();
+	build_cell_index();
+	find_active_cells();
+
+	const uint nthreads = configured_host_threads(gdata->clOptions->host_threads);
+
+	m_threadMesh.resize(max(size_t(nthreads), m_threadMesh.size()));
+	for (ThreadMesh& mesh : m_threadMesh) {
+		mesh.tris.clear();
+		mesh.verts.clear();
+	}
+
+	parallel_for_chunks(nthreads, 0, m_activeCells.size(), [&](unsigned int thread, size_t begin, size_t end) {
+		for (size_t c = begin; c < end; ++c)
+			extract_cell(m_activeCells[c], m_threadMesh[thread]);
+	}, 16);
+
+	merge_meshes();
+
+	if (m_params.ply)
+		write_ply(t);
+	else
+		write_vtp(t);
+}
@@ -0,0 +1,137 @@
+/*  Copyright (c) 2019 INGV, EDF, UniCT, JHU
+
+    Istituto Nazionale di Geofisica e Vulcanologia, Sezione di Catania, Italy
+    Électricité de France, Paris, France
+    Università di Catania, Catania, Italy
+    Johns Hopkins University, Baltimore (MD), USA
+
+    This file is part of GPUSPH. Project founders:
+        Alexis Hérault, Giuseppe Bilotta, Robert A. Dalrymple,
+        Eugenio Rustico, Ciro Del Negro
+    For a full list of authors and project partners, consult the logs
+    and the project website <https://www.gpusph.org>
+
+    GPUSPH is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GPUSPH is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GPUSPH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef H_SURFACEWRITER_H
+#define H_SURFACEWRITER_H
+
+/* The SurfaceWriter extracts the free surface of the fluid as a triangle mesh,
+ * so that it can be visualized or analyzed without writing all the particles.
+ *
+ * A color field c = sum_j V_j W(x - x_j) over the fluid particles, normalized
+ * so that it is 1 in the bulk of the fluid, is sampled on a regular grid
+ * (see SurfaceMeshParams) only in the cells of the simulation grid that
+ * contain particles flagged by the SURFACE_DETECTION post-processing engine
+ * (which is enabled automatically), and their neighbors. The iso-surface
+ * of the color field is then extracted with marching cubes, in parallel
+ * over the active cells, and the vertices shared by adjacent cubes are merged,
+ * so that the mesh is closed wherever the active region is.
+ *
+ * Each write produces SURFACE_<num>.vtp (VTK PolyData, with a SURFACE.pvd
+ * time series) or SURFACE_<num>.ply (binary PLY), with single-precision
+ * vertex positions. Triangles are oriented with the normal pointing out
+ * of the fluid.
+ *
+ * In multi-node simulations, each rank imports the fluid particles of the
+ * cells of other ranks close to its own, and meshes only the cubes starting
+ * in its own cells, so that the meshes written by the ranks join without gaps
+ * or overlaps at the subdomain edges.
+ * Periodic boundaries are not considered.
+ */
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "Writer.h"
+
+class SurfaceWriter : public Writer
+{
+	const SurfaceMeshParams m_params;
+
+	// spacing of the sampling grid
+	double m_spacing;
+	// normalization of the color field
+	double m_norm;
+
+	// time series of the VTK PolyData output
+	std::ofstream m_timefile;
+
+	// number of nodes of the sampling grid in each direction
+	int3 m_nodes;
+
+	// position (xyz) and volume (w) of a fluid particle, with its cell
+	struct CellParticle
+	{
+		double4 data;
+		uint cell;
+		uint surface;
+	};
+	// fluid particles of this rank, followed by the ones imported from the other ranks,
+	// reused across writes
+	std::vector<CellParticle> m_particles;
+
+	// position (xyz) and volume (w) of the fluid particles, sorted by cell
+	// (CSR over the grid cells), reused across writes
+	std::vector<uint> m_cellStart;
+	std::vector<double4> m_partData;
+
+	// cells of the simulation grid where the color field is sampled
+	std::vector<uint> m_activeCells;
+
+	// mesh extracted by each thread: vertices are identified by the sampling grid edge
+	// they lie on, so that vertices shared across threads can be merged
+	struct ThreadMesh
+	{
+		std::vector<uint64_t> tris;
+		std::unordered_map<uint64_t, float3> verts;
+		// color field at the nodes of the current cell
+		std::vector<double> values;
+	};
+	std::vector<ThreadMesh> m_threadMesh;
+
+	// merged mesh
+	std::vector<float3> m_points;
+	std::vector<int> m_tris;
+
+	// first node of the sampling grid in the given cell of the simulation grid, along the given axis
+	int first_node(int axis, int cell) const;
+
+	// is the cell of the simulation grid assigned to this rank?
+	bool own_cell(uint cellHash) const;
+	// is there a cell assigned (or not assigned) to this rank within the halo of the given cell?
+	bool near_own_cell(uint cellHash, bool own) const;
+
+	void collect_particles(uint numParts, BufferList const& buffers, uint node_offset);
+	void import_halo();
+	void build_cell_index();
+	void find_active_cells();
+	double color(int3 const& node) const;
+	void extract_cell(uint cellHash, ThreadMesh &mesh) const;
+	void merge_meshes();
+
+	void write_vtp(double t);
+	void write_ply(double t);
+
+public:
+	SurfaceWriter(const GlobalData *_gdata);
+	~SurfaceWriter();
+
+	void write(uint numParts, BufferList const& buffers, uint node_offset, double t, const bool testpoints);
+};
+
+#endif
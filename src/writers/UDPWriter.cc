@@ -203,7 +203,7 @@ UDPWriter::~UDPWriter() {
 void
 UDPWriter::write(uint numParts, BufferList const& buffers, uint node_offset, double t, const bool testpoints)
 {
-	const double4 *pos = buffers.getData<BUFFER_POS_GLOBAL>();
+	const GlobalPosAccessor pos(gdata, buffers);
 	const float4 *vel = buffers.getData<BUFFER_VEL>();
 	const particleinfo *info = buffers.getData<BUFFER_INFO>();
 
@@ -272,7 +272,8 @@ UDPWriter::write(uint numParts, BufferList const& buffers, uint node_offset, dou
             int offset = (pi * PTP_PARTICLES_PER_PACKET) + i;
             packet.data[i].id = offset;
             packet.data[i].particle_type = info[offset].x;
-            memcpy(&packet.data[i].position, &pos[offset], sizeof(double4));
+            const double4 gpos = pos[offset];
+            memcpy(&packet.data[i].position, &gpos, sizeof(double4));
             total_particles_sent++;
         }
 
@@ -62,7 +62,7 @@ VTKLegacyWriter::~VTKLegacyWriter()
 void
 VTKLegacyWriter::write(uint numParts, BufferList const& buffers, uint node_offset, double t, const bool testpoints)
 {
-	const double4 *pos = buffers.getData<BUFFER_POS_GLOBAL>();
+	const GlobalPosAccessor pos(gdata, buffers);
 	const float4 *vel = buffers.getData<BUFFER_VEL>();
 	const particleinfo *info = buffers.getData<BUFFER_INFO>();
 	const float3 *vort = buffers.getData<BUFFER_VORTICITY>();
@@ -77,8 +77,10 @@ VTKLegacyWriter::write(uint numParts, BufferList const& buffers, uint node_offse
 	fid << "POINTS " << numParts << "double" << endl;
 
 	// Start with particle positions
-	for (uint i=0; i < numParts; ++i)
-		fid << pos[i].x << " " << pos[i].y << " " << pos[i].z << endl;
+	for (uint i=0; i < numParts; ++i) {
+		const double4 gpos = pos[i];
+		fid << gpos.x << " " << gpos.y << " " << gpos.z << endl;
+	}
 	fid << endl;
 
 	// All “cells” are vertices
@@ -66,10 +66,13 @@ const char *vtk_type_name<double>(double const*)
 
 typedef unsigned char dev_idx_t;
 
-VTKWriter::VTKWriter(const GlobalData *_gdata)
+VTKWriter::VTKWriter(const GlobalData *_gdata, const OutputProfile *profile)
   : Writer(_gdata),
 	m_planes_fname(),
 	m_blockidx(-1),
+	m_profile(profile ? new OutputProfile(*profile) : NULL),
+	m_profile_writers(),
+	m_writing(false),
 	m_neiblist_stride(gdata->allocatedParticles),
 	m_neiblist_size(gdata->problem->simparams()->neiblistsize),
 	m_neiblist_end(m_neiblist_stride*m_neiblist_size),
@@ -77,7 +80,9 @@ VTKWriter::VTKWriter(const GlobalData *_gdata)
 {
 	m_fname_sfx = ".vtp";
 
-	string time_fname = open_data_file(m_timefile, "VTUinp", "", ".pvd");
+	// each profile has its own time series
+	const string time_base = m_profile ? "VTUinp_" + m_profile->name : "VTUinp";
+	string time_fname = open_data_file(m_timefile, time_base.c_str(), "", ".pvd");
 
 	// Writing header of VTUinp.pvd file
 	if (m_timefile) {
@@ -90,10 +95,45 @@ VTKWriter::VTKWriter(const GlobalData *_gdata)
 
 VTKWriter::~VTKWriter()
 {
+	for (VTKWriter *pw : m_profile_writers)
+		delete pw;
+
 	mark_timefile();
 	m_timefile.close();
 }
 
+void VTKWriter::add_profile(OutputProfile const& profile, double freq)
+{
+	VTKWriter *pw = new VTKWriter(gdata, &profile);
+	pw->set_write_freq(freq);
+	m_profile_writers.push_back(pw);
+
+	if (freq > 0)
+		cout << "VTKWriter profile " << profile.name << " will write every " << freq << " (simulated) seconds" << endl;
+	else if (freq == 0)
+		cout << "VTKWriter profile " << profile.name << " will write every iteration" << endl;
+	else
+		cout << "VTKWriter profile " << profile.name << " has been disabled" << endl;
+}
+
+string VTKWriter::particle_file_base() const
+{
+	string base = gdata->run_mode == REPACK ? "REPACK" : "PART";
+	if (m_profile)
+		base += "_" + m_profile->name;
+	return base;
+}
+
+bool VTKWriter::need_write(double t) const
+{
+	if (Writer::need_write(t))
+		return true;
+	for (const VTKWriter *pw : m_profile_writers)
+		if (pw->need_write(t))
+			return true;
+	return false;
+}
+
 void VTKWriter::add_block(string const& blockname, string const& fname)
 {
 	++m_blockidx;
@@ -103,6 +143,14 @@ void VTKWriter::add_block(string const& blockname, string const& fname)
 
 void VTKWriter::start_writing(double t, WriteFlags const& write_flags)
 {
+	// the profiles decide on their own if they need to write
+	for (VTKWriter *pw : m_profile_writers)
+		pw->start_writing(t, write_flags);
+
+	m_writing = write_flags.forced_write || Writer::need_write(t);
+	if (!m_writing)
+		return;
+
 	Writer::start_writing(t, write_flags);
 
 	ostringstream time_repr;
@@ -142,11 +190,42 @@ void VTKWriter::start_writing(double t, WriteFlags const& write_flags)
 
 void VTKWriter::mark_written(double t)
 {
+	for (VTKWriter *pw : m_profile_writers)
+		pw->mark_written(t);
+
+	if (!m_writing)
+		return;
+	m_writing = false;
+
 	mark_timefile();
 
 	Writer::mark_written(t);
 }
 
+void VTKWriter::fake_mark_written(double t, WriteFlags const& write_flags)
+{
+	// as in start_writing(), the profiles decide on their own if they would have written
+	for (VTKWriter *pw : m_profile_writers)
+		if (write_flags.forced_write || pw->Writer::need_write(t))
+			pw->fake_mark_written(t, write_flags);
+
+	if (write_flags.forced_write || Writer::need_write(t))
+		Writer::fake_mark_written(t, write_flags);
+}
+
+void VTKWriter::select_particles(vector<uint> &selection, uint numParts,
+	BufferList const& buffers, uint node_offset) const
+{
+	const GlobalPosAccessor pos(gdata, buffers);
+	const particleinfo *info = buffers.getData<BUFFER_INFO>();
+
+	selection.clear();
+	for (uint i = 0; i < numParts; ++i) {
+		if (m_profile->selects(info[i + node_offset], as_double3(pos[i + node_offset])))
+			selection.push_back(i);
+	}
+}
+
 /* Endianness check: (char*)&endian_int reads the first byte of the int,
  * which is 0 on big-endian machines, and 1 in little-endian machines */
 static int endian_int=1;
@@ -180,6 +259,11 @@ struct VTKAppender
 	size_t numParts;
 	size_t data_offset;
 
+	// if not NULL, the (local) indices of the numParts particles to write
+	uint const* selection;
+	// if not NULL, the profile deciding which fields to write
+	OutputProfile const* profile;
+
 	vector<function<void(void)>> data_filler;
 
 	VTKAppender(
@@ -187,14 +271,18 @@ struct VTKAppender
 		particleinfo const* _info,
 		GlobalData const* _gdata,
 		size_t _node_offset,
-		size_t _numParts)
+		size_t _numParts,
+		uint const* _selection = NULL,
+		OutputProfile const* _profile = NULL)
 	:
 		out(_out),
 		info(_info),
 		gdata(_gdata),
 		node_offset(_node_offset),
 		numParts(_numParts),
-		data_offset(0)
+		data_offset(0),
+		selection(_selection),
+		profile(_profile)
 	{}
 
 private:
@@ -264,6 +352,16 @@ private:
 		out.write(reinterpret_cast<const char *>(var), sizeof(T)*nels);
 	}
 
+	/// Local index of the i-th particle to write
+	inline size_t
+	local(size_t i) const
+	{ return selection ? selection[i] : i; }
+
+	/// Should the array with the given name be skipped?
+	inline bool
+	skip(const char *name) const
+	{ return profile && !profile->writes_field(name); }
+
 public:
 	/// Write appended data for VTK, without any transformation
 	/*! The array is assumed to be local to the node, and node_offset will not
@@ -273,13 +371,20 @@ public:
 	inline void
 	append_local_data(T const* data, const char *name)
 	{
+		if (skip(name)) return;
+
 		array_header(data, name);
 
 		// Push back a lambda that does the actual data storage
 		data_filler.push_back([this, data]() {
 			uint numbytes = sizeof(T)*numParts;
 			write_var(numbytes);
-			write_array(data, numParts);
+			if (selection) {
+				for (size_t i = 0; i < numParts; ++i)
+					write_array(data + selection[i], 1);
+			} else {
+				write_array(data, numParts);
+			}
 		});
 	}
 
@@ -299,6 +404,8 @@ public:
 	inline void
 	append_local_data(T const* data, const char *name, DataTransformFull<T, Ret> func)
 	{
+		if (skip(name)) return;
+
 		Ret *dummy(nullptr);
 		array_header(dummy, name);
 
@@ -306,7 +413,8 @@ public:
 			uint numbytes = sizeof(Ret)*numParts;
 			write_var(numbytes);
 			for (size_t i = 0; i < numParts; ++i) {
-				Ret value = func(data[i], info[i + node_offset], gdata);
+				const size_t li = local(i);
+				Ret value = func(data[li], info[li + node_offset], gdata);
 				write_var(value);
 			}
 		});
@@ -320,6 +428,8 @@ public:
 	inline void
 	append_local_data(T const* data, const char *name, DataTransformInfo<T, Ret> func)
 	{
+		if (skip(name)) return;
+
 		Ret *dummy(nullptr);
 		array_header(dummy, name);
 
@@ -327,7 +437,8 @@ public:
 			uint numbytes = sizeof(Ret)*numParts;
 			write_var(numbytes);
 			for (size_t i = 0; i < numParts; ++i) {
-				Ret value = func(data[i], info[i + node_offset]);
+				const size_t li = local(i);
+				Ret value = func(data[li], info[li + node_offset]);
 				write_var(value);
 			}
 		});
@@ -340,6 +451,8 @@ public:
 	inline void
 	append_local_data(T const* data, const char *name, DataTransform<T, Ret> func)
 	{
+		if (skip(name)) return;
+
 		Ret *dummy(nullptr);
 		array_header(dummy, name);
 
@@ -347,17 +460,42 @@ public:
 			uint numbytes = sizeof(Ret)*numParts;
 			write_var(numbytes);
 			for (size_t i = 0; i < numParts; ++i) {
-				Ret value = func(data[i]);
+				Ret value = func(data[local(i)]);
 				write_var(value);
 			}
 		});
 	}
 
-	/// Write appended data for VTK, mapping the index to some arbitrary value
+	/// Write appended data for VTK, mapping the (local) particle index to some arbitrary value
 	template<typename IndexTransform,
 		typename Ret = typename result_of<IndexTransform(size_t)>::type>
 	inline void
 	append_local_data(const char *name, IndexTransform func)
+	{
+		if (skip(name)) return;
+
+		Ret *dummy = nullptr;
+		array_header(dummy, name);
+
+		data_filler.push_back( [this, func]() {
+			uint numbytes = sizeof(Ret)*numParts;
+			write_var(numbytes);
+			for (size_t i = 0; i < numParts; ++i) {
+				Ret value = func(local(i));
+				write_var(value);
+			}
+		});
+	}
+
+	/// Write appended data for VTK, mapping the output index to some arbitrary value
+	/*! Contrary to the other methods, the index is the one in the output,
+	 * regardless of the particle selection, and the array is always written.
+	 * This is used for the topology information.
+	 */
+	template<typename IndexTransform,
+		typename Ret = typename result_of<IndexTransform(size_t)>::type>
+	inline void
+	append_sequence_data(const char *name, IndexTransform func)
 	{
 		Ret *dummy = nullptr;
 		array_header(dummy, name);
@@ -380,6 +518,10 @@ public:
 	enable_if_t<vector_traits<T>::components == 4>
 	append_local_data(T const* data, const char *name_xyz, const char *name_w)
 	{
+		if (name_xyz && skip(name_xyz)) name_xyz = nullptr;
+		if (name_w && skip(name_w)) name_w = nullptr;
+		if (!name_xyz && !name_w) return;
+
 		array_header(data, name_xyz, name_w);
 
 		data_filler.push_back( [this, data, name_xyz, name_w]() {
@@ -387,13 +529,13 @@ public:
 				uint numbytes = 3*sizeof(T)*numParts;
 				write_var(numbytes);
 				for (size_t i = 0; i < numParts; ++i)
-					write_var(data[i], 3);
+					write_var(data[local(i)], 3);
 			}
 			if (name_w) {
 				uint numbytes = sizeof(T)*numParts;
 				write_var(numbytes);
 				for (size_t i = 0; i < numParts; ++i)
-					write_var(data[i].w);
+					write_var(data[local(i)].w);
 			}
 		});
 	}
@@ -431,10 +573,6 @@ float get_density(float4 const& pvel, particleinfo const& pinfo, GlobalData cons
 float get_last_component(float4 const& pvel )
 { return pvel.w; }
 
-// Return the last component of a double4, demoted to a float
-float demote_w(double4 const& data)
-{ return data.w; }
-
 uchar get_part_type(particleinfo const& pinfo)
 { return PART_TYPE(pinfo); }
 
@@ -480,7 +618,14 @@ const char ParticleTypeSym[PT_NONE]
 void
 VTKWriter::write(uint numParts, BufferList const& buffers, uint node_offset, double t, const bool testpoints)
 {
-	const double4 *pos = buffers.getData<BUFFER_POS_GLOBAL>();
+	for (VTKWriter *pw : m_profile_writers)
+		if (pw->m_writing)
+			pw->write(numParts, buffers, node_offset, t, testpoints);
+
+	if (!m_writing)
+		return;
+
+	const GlobalPosAccessor pos(gdata, buffers);
 	const hashKey *particleHash = buffers.getData<BUFFER_HASH>();
 	const float4 *vel = buffers.getData<BUFFER_VEL>();
 	const float4 *vol = buffers.getData<BUFFER_VOLUME>();
@@ -503,7 +648,8 @@ VTKWriter::write(uint numParts, BufferList const& buffers, uint node_offset, dou
 	const float *intEnergy = buffers.getData<BUFFER_INTERNAL_ENERGY>();
 	const float4 *forces = buffers.getData<BUFFER_FORCES>();
 
-	const neibdata *neibslist = buffers.getData<BUFFER_NEIBSLIST>();
+	// the neighbors list debugging output is only produced with the full output
+	const neibdata *neibslist = m_profile ? NULL : buffers.getData<BUFFER_NEIBSLIST>();
 
 	// TODO debugging
 	const uint *nextIDs = buffers.getData<BUFFER_NEXTID>();
@@ -513,6 +659,10 @@ VTKWriter::write(uint numParts, BufferList const& buffers, uint node_offset, dou
 	if (neibslist) {
 		const uint *cellStart = buffers.getData<BUFFER_CELLSTART>();
 
+		// the particle storage may have grown since the last write
+		m_neiblist_stride = gdata->allocatedParticles;
+		m_neiblist_end = m_neiblist_stride*m_neiblist_size;
+
 		// initialize cell_to_offset array
 		if (cell_to_offset[0].x == 0) {
 			for(char z=-1; z<=1; z++) {
@@ -606,14 +756,18 @@ VTKWriter::write(uint numParts, BufferList const& buffers, uint node_offset, dou
 		neibs.close();
 	}
 
-	string filename;
+	// select the particles to write, if the profile asks for it,
+	// so that the data volume is reduced before encoding
+	vector<uint> selection;
+	const bool filtered = m_profile && m_profile->is_filtered();
+	if (filtered)
+		select_particles(selection, numParts, buffers, node_offset);
+	const uint numWritten = filtered ? selection.size() : numParts;
 
 	ofstream fid;
-	if (gdata->run_mode == REPACK)
-		filename = open_data_file(fid, "REPACK", current_filenum());
-	else
-		filename = open_data_file(fid, "PART", current_filenum());
-	VTKAppender appender(fid, info, gdata, node_offset, numParts);
+	string filename = open_data_file(fid, particle_file_base().c_str(), current_filenum());
+	VTKAppender appender(fid, info, gdata, node_offset, numWritten,
+		filtered ? selection.data() : NULL, m_profile.get());
 
 	// Header
 	//====================================================================================
@@ -621,13 +775,15 @@ VTKWriter::write(uint numParts, BufferList const& buffers, uint node_offset, dou
 	fid << "<VTKFile type='PolyData'  version='0.1'  byte_order='" <<
 		endianness[*(char*)&endian_int & 1] << "'>" << endl;
 	fid << " <PolyData>" << endl;
-	fid << "  <Piece NumberOfPoints='" << numParts << "' NumberOfVerts='" << numParts << "'>" << endl;
+	fid << "  <Piece NumberOfPoints='" << numWritten << "' NumberOfVerts='" << numWritten << "'>" << endl;
 
 	size_t offset = 0;
 
 	// position
 	fid << "   <Points>" << endl;
-	appender.append_data(pos, "Position", nullptr);
+	appender.append_local_data("Position", [pos, node_offset](size_t i) {
+		return as_double3(pos[i + node_offset]);
+	});
 	fid << "   </Points>" << endl;
 
 	fid << "   <PointData Scalars='" << (neibslist ? "Neibs" : "Pressure") << "' Vectors='Velocity'>" << endl;
@@ -664,7 +820,9 @@ VTKWriter::write(uint numParts, BufferList const& buffers, uint node_offset, dou
 	}
 
 	// mass
-	appender.append_data(pos, "Mass", demote_w);
+	appender.append_local_data("Mass", [pos, node_offset](size_t i) {
+		return float(pos[i + node_offset].w);
+	});
 
 	// gamma and its gradient
 	if (gradGamma) {
@@ -807,9 +965,9 @@ VTKWriter::write(uint numParts, BufferList const& buffers, uint node_offset, dou
 	fid << "   <Verts>" << endl;
 
 	// connectivity
-	appender.append_local_data("connectivity", [](size_t i)->uint { return i; });
+	appender.append_sequence_data("connectivity", [](size_t i)->uint { return i; });
 	// offsets
-	appender.append_local_data("offsets", [](size_t i)->uint { return i+1; });
+	appender.append_sequence_data("offsets", [](size_t i)->uint { return i+1; });
 
 	fid << "   </Verts>" << endl;
 	fid << "  </Piece>" << endl;
@@ -833,6 +991,10 @@ VTKWriter::write(uint numParts, BufferList const& buffers, uint node_offset, dou
 void
 VTKWriter::write_WaveGage(double t, GageList const& gage)
 {
+	// wave gages are written with the full output only
+	if (!m_writing)
+		return;
+
 	ofstream fp;
 	string filename = open_data_file(fp, "WaveGage", current_filenum(), ".vtu");
 
@@ -28,6 +28,9 @@
 #ifndef _VTKWRITER_H
 #define	_VTKWRITER_H
 
+#include <memory>
+#include <vector>
+
 #include "Writer.h"
 
 class VTKWriter : public Writer
@@ -46,10 +49,17 @@ class VTKWriter : public Writer
 	// index of the last written block
 	int m_blockidx;
 
+	// output profile of this writer (NULL for the full output)
+	std::unique_ptr<OutputProfile> m_profile;
+	// writers for the additional output profiles
+	std::vector<VTKWriter*> m_profile_writers;
+	// is this writer writing in the current writing session?
+	bool m_writing;
+
 	// neighbors list structural information, used when neighbors list debugging is enabled
-	const uint m_neiblist_stride; ///< stride between two neighbors of the same particle
+	uint m_neiblist_stride; ///< stride between two neighbors of the same particle (grows with the particle storage)
 	const uint m_neiblist_size; ///< maximum number of neighbors for one particle
-	const uint m_neiblist_end; ///< end of the whole neighbors list
+	uint m_neiblist_end; ///< end of the whole neighbors list
 	const uint m_neib_bound_pos; ///< local neighbors list index of the first boundary neighbor
 
 	// Save planes to a VTU file
@@ -65,12 +75,24 @@ class VTKWriter : public Writer
 	// position so that the next entry is properly inserted
 	void mark_timefile();
 
+	// base name of the particle files
+	std::string particle_file_base() const;
+
+	// select the (local) indices of the particles to be written according to the profile
+	void select_particles(std::vector<uint> &selection, uint numParts,
+		BufferList const& buffers, uint node_offset) const;
+
 public:
-	VTKWriter(const GlobalData *_gdata);
+	VTKWriter(const GlobalData *_gdata, const OutputProfile *profile = NULL);
 	~VTKWriter();
 
+	// add an output profile, written with its own frequency to its own time series
+	void add_profile(OutputProfile const& profile, double freq);
+
+	bool need_write(double t) const;
 	void start_writing(double t, WriteFlags const& write_flags);
 	void mark_written(double t);
+	void fake_mark_written(double t, WriteFlags const& write_flags);
 
 	virtual void write(uint numParts, BufferList const& buffers, uint node_offset, double t, const bool testpoints);
 	virtual void write_WaveGage(double t, GageList const& gage);
@@ -0,0 +1,66 @@
+/*  Copyright (c) 2019 INGV, EDF, UniCT, JHU
+
+    Istituto Nazionale di Geofisica e Vulcanologia, Sezione di Catania, Italy
+    Électricité de France, Paris, France
+    Università di Catania, Catania, Italy
+    Johns Hopkins University, Baltimore (MD), USA
+
+    This file is part of GPUSPH. Project founders:
+        Alexis Hérault, Giuseppe Bilotta, Robert A. Dalrymple,
+        Eugenio Rustico, Ciro Del Negro
+    For a full list of authors and project partners, consult the logs
+    and the project website <https://www.gpusph.org>
+
+    GPUSPH is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GPUSPH is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GPUSPH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*! \file
+ * Host-side evaluation of the SPH kernels, for the writers that interpolate
+ * particle data (e.g. ProbeWriter, SurfaceWriter)
+ */
+
+#ifndef H_KERNEL_SHAPE_H
+#define H_KERNEL_SHAPE_H
+
+#include <cmath>
+#include <stdexcept>
+
+#include "particledefine.h"
+
+//! Kernel shape (without normalization) at normalized distance R = r/h
+/*! The normalization cancels out in Shepard-normalized interpolants;
+ * users that need it can compute it numerically from the particle spacing.
+ */
+inline double
+kernel_shape(KernelType kernel, double R, double kernelradius)
+{
+	switch (kernel) {
+	case CUBICSPLINE:
+		return R < 1 ? 1 - 1.5*R*R + 0.75*R*R*R : 0.25*(2 - R)*(2 - R)*(2 - R);
+	case QUADRATIC:
+		return 0.25*R*R - R + 1;
+	case WENDLAND:
+		{
+			const double q = 1 - 0.5*R;
+			return q*q*q*q*(1 + 2*R);
+		}
+	case GAUSSIAN:
+		return exp(-R*R) - exp(-kernelradius*kernelradius);
+	default:
+		throw std::invalid_argument("unsupported kernel for host-side interpolation");
+	}
+}
+
+#endif